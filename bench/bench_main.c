@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdbool.h>
+
+#ifdef _WIN32
+    #include <direct.h>
+    #include <io.h>
+#else
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "dicom_header_parser.h"
+#include "dicom_stats.h"
+#include "dicom_synth.h"
+
+#define DEFAULT_FILES_PER_CONFIG 32
+#define DEFAULT_ITERATIONS 5
+#define DEFAULT_CORPUS_DIR "dcmloupe_bench_corpus"
+#define MAX_PATH_LENGTH 1024
+
+#ifdef _WIN32
+    #define NULL_DEVICE "NUL"
+#else
+    #define NULL_DEVICE "/dev/null"
+#endif
+
+// Shapes seen in our archives: plain CT/MR headers, vendor-heavy ones, SR-like nesting, big text values
+static const synth_config default_configs[] = {
+    {"small", 100, 0, 0.0, SYNTH_EXPLICIT_VR_LITTLE_ENDIAN, 16},
+    {"typical", 400, 2, 0.1, SYNTH_EXPLICIT_VR_LITTLE_ENDIAN, 32},
+    {"implicit", 400, 2, 0.1, SYNTH_IMPLICIT_VR_LITTLE_ENDIAN, 32},
+    {"big_endian", 400, 2, 0.1, SYNTH_EXPLICIT_VR_BIG_ENDIAN, 32},
+    {"private_heavy", 400, 0, 0.5, SYNTH_EXPLICIT_VR_LITTLE_ENDIAN, 32},
+    {"deep", 200, 8, 0.0, SYNTH_EXPLICIT_VR_LITTLE_ENDIAN, 32},
+    {"large_values", 200, 1, 0.1, SYNTH_EXPLICIT_VR_LITTLE_ENDIAN, 4096},
+};
+
+static void print_usage(const char* program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  Runs parse_dicom_header over a generated corpus and prints one result line per configuration\n");
+    fprintf(stderr, "  Options:\n");
+    fprintf(stderr, "\t--dir <path>         Corpus directory (default: %s)\n", DEFAULT_CORPUS_DIR);
+    fprintf(stderr, "\t--files <n>          Files per configuration (default: %d)\n", DEFAULT_FILES_PER_CONFIG);
+    fprintf(stderr, "\t--iterations <n>     Timed passes over each corpus (default: %d)\n", DEFAULT_ITERATIONS);
+    fprintf(stderr, "\t--generate           Only write the corpus, do not benchmark\n");
+    fprintf(stderr, "\t--elements <n>       Custom configuration: top-level element count\n");
+    fprintf(stderr, "\t--depth <n>          Custom configuration: sequence nesting depth\n");
+    fprintf(stderr, "\t--private <ratio>    Custom configuration: share of private elements (0..1)\n");
+    fprintf(stderr, "\t--ts <syntax>        Custom configuration: explicit-le, implicit-le or explicit-be\n");
+    fprintf(stderr, "\t--value-size <n>     Custom configuration: bytes per long value\n");
+}
+
+static int make_directory(const char* path) {
+#ifdef _WIN32
+    _mkdir(path);
+#else
+    mkdir(path, 0755);
+#endif
+
+    // mkdir fails for an existing directory too, so check that files can be written instead
+    char probe_path[MAX_PATH_LENGTH];
+    snprintf(probe_path, sizeof(probe_path), "%s/.probe", path);
+    FILE* probe = fopen(probe_path, "wb");
+    if (probe == NULL) { return -1; }
+    fclose(probe);
+    remove(probe_path);
+    return 0;
+}
+
+static void corpus_path(char* path, const size_t size, const char* dir, const synth_config* config, const int index) {
+    snprintf(path, size, "%s/%s_%03d.dcm", dir, config->name, index);
+}
+
+// Results keep going to the real stdout while the parser's output is thrown away
+static FILE* redirect_stdout(void) {
+    fflush(stdout);
+#ifdef _WIN32
+    const int fd = _dup(_fileno(stdout));
+    FILE* results = fd >= 0 ? _fdopen(fd, "w") : NULL;
+#else
+    const int fd = dup(fileno(stdout));
+    FILE* results = fd >= 0 ? fdopen(fd, "w") : NULL;
+#endif
+    if (results == NULL) { return NULL; }
+    if (freopen(NULL_DEVICE, "w", stdout) == NULL) {
+        fclose(results);
+        return NULL;
+    }
+    return results;
+}
+
+static bool parse_count(const char* text, const long min, const long max, long* value) {
+    char* endptr;
+    *value = strtol(text, &endptr, 10);
+    return endptr != text && *endptr == '\0' && *value >= min && *value <= max;
+}
+
+static int run_config(FILE* results, const char* dir, const synth_config* config, const int files, const int iterations,
+                      dicom_arena* arena) {
+    char path[MAX_PATH_LENGTH];
+    uint64_t corpus_bytes = 0;
+
+    for (int i = 0; i < files; i++) {
+        corpus_path(path, sizeof(path), dir, config, i);
+        const long size = synth_write_file(path, config, (uint32_t)(i + 1));
+        if (size < 0) {
+            fprintf(stderr, "Error: Cannot write '%s'\n", path);
+            return -1;
+        }
+        corpus_bytes += (uint64_t)size;
+    }
+
+    if (results == NULL) { return 0; }
+
+    const parse_options options = {
+        .max_elements = INT_MAX,
+        .max_sq_depth = 100,
+        .collapse_sequences = false,
+        .show_full_values = false,
+        .show_all_values = false,
+        .filter = NULL,
+    };
+
+    // One untimed pass to warm the page cache and the arena
+    for (int i = 0; i < files; i++) {
+        corpus_path(path, sizeof(path), dir, config, i);
+        parse_dicom_header(path, &options, arena);
+    }
+
+    const double start = dicom_stats_now();
+    for (int iteration = 0; iteration < iterations; iteration++) {
+        for (int i = 0; i < files; i++) {
+            corpus_path(path, sizeof(path), dir, config, i);
+            if (parse_dicom_header(path, &options, arena) != 0) {
+                fprintf(stderr, "Error: Parsing '%s' failed\n", path);
+                return -1;
+            }
+        }
+    }
+    fflush(stdout);
+    const double seconds = dicom_stats_now() - start;
+
+    const double parsed_files = (double)files * iterations;
+    const double parsed_bytes = (double)corpus_bytes * iterations;
+    fprintf(results, "[bench] config=%s ts=%s elements=%d depth=%d private_ratio=%.2f value_size=%u files=%.0f "
+            "bytes=%.0f seconds=%.6f files_per_s=%.1f mb_per_s=%.2f\n",
+            config->name, synth_transfer_syntax_name(config->transfer_syntax), config->element_count, config->depth,
+            config->private_ratio, config->value_size, parsed_files, parsed_bytes, seconds,
+            seconds > 0 ? parsed_files / seconds : 0.0, seconds > 0 ? parsed_bytes / seconds / 1e6 : 0.0);
+    fflush(results);
+    return 0;
+}
+
+int main(const int argc, char* argv[]) {
+    const char* dir = DEFAULT_CORPUS_DIR;
+    long files = DEFAULT_FILES_PER_CONFIG;
+    long iterations = DEFAULT_ITERATIONS;
+    bool generate_only = false;
+    bool custom = false;
+    synth_config custom_config = {"custom", 400, 0, 0.0, SYNTH_EXPLICIT_VR_LITTLE_ENDIAN, 32};
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--generate") == 0) {
+            generate_only = true;
+            continue;
+        }
+        if (argv[i][0] != '-' || i + 1 >= argc) {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        const char* option = argv[i];
+        const char* arg = argv[++i];
+        long value = 0;
+        bool valid = true;
+
+        if (strcmp(option, "--dir") == 0) { dir = arg; }
+        else if (strcmp(option, "--files") == 0) { valid = parse_count(arg, 1, 100000, &files); }
+        else if (strcmp(option, "--iterations") == 0) { valid = parse_count(arg, 1, 100000, &iterations); }
+        else if (strcmp(option, "--elements") == 0) {
+            valid = parse_count(arg, 1, 100000, &value);
+            custom_config.element_count = (int)value;
+        }
+        else if (strcmp(option, "--depth") == 0) {
+            valid = parse_count(arg, 0, 60, &value);
+            custom_config.depth = (int)value;
+        }
+        else if (strcmp(option, "--value-size") == 0) {
+            valid = parse_count(arg, 0, 64 * 1024 * 1024, &value);
+            custom_config.value_size = (uint32_t)value;
+        }
+        else if (strcmp(option, "--private") == 0) {
+            char* endptr;
+            custom_config.private_ratio = strtod(arg, &endptr);
+            valid = endptr != arg && *endptr == '\0' && custom_config.private_ratio >= 0.0 &&
+                custom_config.private_ratio <= 1.0;
+        }
+        else if (strcmp(option, "--ts") == 0) {
+            valid = synth_transfer_syntax_parse(arg, &custom_config.transfer_syntax) == 0;
+        }
+        else {
+            print_usage(argv[0]);
+            return 1;
+        }
+
+        if (!valid) {
+            fprintf(stderr, "Error: Invalid value '%s' for %s\n", arg, option);
+            return 1;
+        }
+        if (strcmp(option, "--dir") != 0 && strcmp(option, "--files") != 0 && strcmp(option, "--iterations") != 0) {
+            custom = true;
+        }
+    }
+
+    if (make_directory(dir) != 0) {
+        fprintf(stderr, "Error: Cannot use corpus directory '%s'\n", dir);
+        return 1;
+    }
+
+    FILE* results = NULL;
+    if (!generate_only) {
+        results = redirect_stdout();
+        if (results == NULL) {
+            fprintf(stderr, "Error: Cannot redirect stdout to %s\n", NULL_DEVICE);
+            return 1;
+        }
+    }
+
+    dicom_arena arena;
+    dicom_arena_init(&arena);
+
+    const synth_config* configs = custom ? &custom_config : default_configs;
+    const size_t config_count = custom ? 1 : sizeof(default_configs) / sizeof(default_configs[0]);
+    int result = 0;
+
+    for (size_t i = 0; i < config_count && result == 0; i++) {
+        result = run_config(results, dir, &configs[i], (int)files, (int)iterations, &arena);
+    }
+
+    dicom_arena_free(&arena);
+    if (results != NULL) { fclose(results); }
+    return result == 0 ? 0 : 1;
+}
@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "dicom_synth.h"
+#include "dicom_dict.h"
+
+#define SYNTH_PREAMBLE_SIZE 128
+#define SYNTH_ITEMS_PER_SEQUENCE 2
+#define SYNTH_PRIVATE_PER_GROUP 256
+#define SYNTH_PRIVATE_CREATOR "DCMLOUPE BENCH"
+#define TAG_CONTENT_SEQUENCE 0x0040A730
+#define TAG_PIXEL_DATA 0x7FE00010
+
+static const uint16_t private_groups[] = {0x0009, 0x0019, 0x0029, 0x0043, 0x0045, 0x0051, 0x0053, 0x0055};
+static const char* const private_vrs[] = {"LO", "UN", "OB", "DS", "US", "SH"};
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    bool is_explicit_vr;
+    bool is_little_endian;
+    bool failed;
+} synth_buffer;
+
+typedef struct {
+    uint32_t tag;
+    char vr[3];
+} synth_entry;
+
+const char* synth_transfer_syntax_name(const synth_transfer_syntax ts) {
+    switch (ts) {
+    case SYNTH_IMPLICIT_VR_LITTLE_ENDIAN: return "implicit-le";
+    case SYNTH_EXPLICIT_VR_BIG_ENDIAN: return "explicit-be";
+    default: return "explicit-le";
+    }
+}
+
+int synth_transfer_syntax_parse(const char* name, synth_transfer_syntax* ts) {
+    if (strcmp(name, "explicit-le") == 0) { *ts = SYNTH_EXPLICIT_VR_LITTLE_ENDIAN; }
+    else if (strcmp(name, "implicit-le") == 0) { *ts = SYNTH_IMPLICIT_VR_LITTLE_ENDIAN; }
+    else if (strcmp(name, "explicit-be") == 0) { *ts = SYNTH_EXPLICIT_VR_BIG_ENDIAN; }
+    else { return -1; }
+    return 0;
+}
+
+static const char* transfer_syntax_uid(const synth_transfer_syntax ts) {
+    switch (ts) {
+    case SYNTH_IMPLICIT_VR_LITTLE_ENDIAN: return "1.2.840.10008.1.2";
+    case SYNTH_EXPLICIT_VR_BIG_ENDIAN: return "1.2.840.10008.1.2.2";
+    default: return "1.2.840.10008.1.2.1";
+    }
+}
+
+static uint32_t next_random(uint32_t* state) {
+    // xorshift32, plenty for filler values
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void put_bytes(synth_buffer* buf, const void* bytes, const size_t length) {
+    if (buf->failed) { return; }
+
+    if (buf->size + length > buf->capacity) {
+        size_t capacity = buf->capacity > 0 ? buf->capacity * 2 : 64 * 1024;
+        while (capacity < buf->size + length) { capacity *= 2; }
+
+        uint8_t* data = (uint8_t*)realloc(buf->data, capacity);
+        if (data == NULL) {
+            buf->failed = true;
+            return;
+        }
+        buf->data = data;
+        buf->capacity = capacity;
+    }
+
+    memcpy(buf->data + buf->size, bytes, length);
+    buf->size += length;
+}
+
+static void put_u16(synth_buffer* buf, const uint16_t value) {
+    const uint8_t le[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+    const uint8_t be[2] = {(uint8_t)(value >> 8), (uint8_t)value};
+    put_bytes(buf, buf->is_little_endian ? le : be, 2);
+}
+
+static void put_u32(synth_buffer* buf, const uint32_t value) {
+    const uint8_t le[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    const uint8_t be[4] = {(uint8_t)(value >> 24), (uint8_t)(value >> 16), (uint8_t)(value >> 8), (uint8_t)value};
+    put_bytes(buf, buf->is_little_endian ? le : be, 4);
+}
+
+static bool is_long_vr(const char* vr) {
+    static const char* const long_vrs[] = {"OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV"};
+    for (size_t i = 0; i < sizeof(long_vrs) / sizeof(long_vrs[0]); i++) {
+        if (strcmp(vr, long_vrs[i]) == 0) { return true; }
+    }
+    return false;
+}
+
+static void put_header(synth_buffer* buf, const uint32_t tag, const char* vr, const uint32_t length) {
+    put_u16(buf, (uint16_t)(tag >> 16));
+    put_u16(buf, (uint16_t)tag);
+
+    if (!buf->is_explicit_vr) {
+        put_u32(buf, length);
+        return;
+    }
+
+    put_bytes(buf, vr, 2);
+    if (is_long_vr(vr)) {
+        put_u16(buf, 0);
+        put_u32(buf, length);
+    }
+    else { put_u16(buf, (uint16_t)length); }
+}
+
+static void put_item_tag(synth_buffer* buf, const uint16_t element, const uint32_t length) {
+    put_u16(buf, 0xFFFE);
+    put_u16(buf, element);
+    put_u32(buf, length);
+}
+
+static uint32_t max_string_length(const char* vr) {
+    static const struct { const char* vr; uint32_t length; } limits[] = {
+        {"AE", 16}, {"AS", 4}, {"CS", 16}, {"DA", 8}, {"DS", 16}, {"DT", 26}, {"IS", 12},
+        {"LO", 64}, {"PN", 64}, {"SH", 16}, {"TM", 14}, {"UI", 64}
+    };
+    for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+        if (strcmp(vr, limits[i].vr) == 0) { return limits[i].length; }
+    }
+    return UINT32_MAX;
+}
+
+static bool is_string_vr(const char* vr) {
+    return max_string_length(vr) != UINT32_MAX || strcmp(vr, "LT") == 0 || strcmp(vr, "ST") == 0 ||
+        strcmp(vr, "UC") == 0 || strcmp(vr, "UR") == 0 || strcmp(vr, "UT") == 0;
+}
+
+static uint32_t numeric_width(const char* vr) {
+    if (strcmp(vr, "US") == 0 || strcmp(vr, "SS") == 0) { return 2; }
+    if (strcmp(vr, "UL") == 0 || strcmp(vr, "SL") == 0 || strcmp(vr, "FL") == 0 || strcmp(vr, "AT") == 0) { return 4; }
+    if (strcmp(vr, "FD") == 0 || strcmp(vr, "SV") == 0 || strcmp(vr, "UV") == 0) { return 8; }
+    return 0;
+}
+
+// Text that looks like the VR: dates are dates, numbers are numbers, so value rendering is exercised too
+static uint32_t fill_string(const char* vr, char* text, const uint32_t size, uint32_t* rng) {
+    const char* pattern;
+    if (strcmp(vr, "DA") == 0) { pattern = "20240131"; }
+    else if (strcmp(vr, "TM") == 0) { pattern = "121530.250000"; }
+    else if (strcmp(vr, "DT") == 0) { pattern = "20240131121530.25"; }
+    else if (strcmp(vr, "AS") == 0) { pattern = "042Y"; }
+    else if (strcmp(vr, "DS") == 0) { pattern = "-12.5\\0.125\\3e2"; }
+    else if (strcmp(vr, "IS") == 0) { pattern = "1024\\-7\\42"; }
+    else if (strcmp(vr, "UI") == 0) { pattern = "1.2.826.0.1.3680043.10.543."; }
+    else if (strcmp(vr, "PN") == 0) { pattern = "Doe^John^Q^Dr^"; }
+    else if (strcmp(vr, "CS") == 0) { pattern = "ORIGINAL\\PRIMARY"; }
+    else { pattern = NULL; }
+
+    uint32_t length = 0;
+    if (pattern != NULL) {
+        const size_t pattern_length = strlen(pattern);
+        while (length < size) {
+            text[length] = pattern[length % pattern_length];
+            length++;
+        }
+        // Numeric strings must not end in a separator or a dangling sign
+        while (length > 0 && (text[length - 1] == '\\' || text[length - 1] == '-' || text[length - 1] == '.' ||
+                              text[length - 1] == 'e')) {
+            length--;
+        }
+    }
+    else {
+        static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ abcdefghijklmnopqrstuvwxyz 0123456789";
+        while (length < size) { text[length++] = alphabet[next_random(rng) % (sizeof(alphabet) - 1)]; }
+    }
+    return length;
+}
+
+static void put_value(synth_buffer* buf, const uint32_t tag, const char* vr, const uint32_t value_size,
+                      uint32_t* rng) {
+    const uint32_t width = numeric_width(vr);
+
+    if (is_string_vr(vr)) {
+        const uint32_t limit = max_string_length(vr);
+        const uint32_t size = value_size < limit ? value_size : limit;
+        char* text = (char*)malloc((size_t)size + 2);  // Room for the even-length pad
+        if (text == NULL) {
+            buf->failed = true;
+            return;
+        }
+
+        uint32_t length = fill_string(vr, text, size > 0 ? size : 1, rng);
+        if (length % 2 != 0) { text[length++] = strcmp(vr, "UI") == 0 ? '\0' : ' '; }
+
+        put_header(buf, tag, vr, length);
+        put_bytes(buf, text, length);
+        free(text);
+    }
+    else if (width > 0) {
+        const uint32_t count = value_size / width > 0 ? value_size / width : 1;
+        put_header(buf, tag, vr, count * width);
+
+        for (uint32_t i = 0; i < count; i++) {
+            const uint32_t r = next_random(rng);
+            if (width == 2) { put_u16(buf, (uint16_t)(r % 4096)); }
+            else if (strcmp(vr, "AT") == 0) {
+                put_u16(buf, 0x0010);
+                put_u16(buf, (uint16_t)(0x0010 + r % 64));
+            }
+            else if (strcmp(vr, "FL") == 0) {
+                const float f = (float)(r % 100000) / 64.0f;
+                uint32_t bits;
+                memcpy(&bits, &f, sizeof(bits));
+                put_u32(buf, bits);
+            }
+            else if (width == 4) { put_u32(buf, r); }
+            else if (strcmp(vr, "FD") == 0) {
+                const double d = (double)r / 1024.0;
+                uint64_t bits;
+                memcpy(&bits, &d, sizeof(bits));
+                put_u32(buf, buf->is_little_endian ? (uint32_t)bits : (uint32_t)(bits >> 32));
+                put_u32(buf, buf->is_little_endian ? (uint32_t)(bits >> 32) : (uint32_t)bits);
+            }
+            else {
+                put_u32(buf, buf->is_little_endian ? r : 0);
+                put_u32(buf, buf->is_little_endian ? 0 : r);
+            }
+        }
+    }
+    else {
+        // OB, OW, UN and friends: raw bytes, even length
+        const uint32_t length = (value_size + 7) & ~7u;
+        put_header(buf, tag, vr, length);
+        for (uint32_t i = 0; i < length; i += 4) {
+            const uint32_t r = next_random(rng);
+            put_bytes(buf, &r, 4);
+        }
+    }
+}
+
+static void put_content_sequence(synth_buffer* buf, const int level, const int depth, const uint32_t value_size,
+                                 uint32_t* rng) {
+    put_header(buf, TAG_CONTENT_SEQUENCE, "SQ", 0xFFFFFFFF);
+
+    for (int item = 0; item < SYNTH_ITEMS_PER_SEQUENCE; item++) {
+        put_item_tag(buf, 0xE000, 0xFFFFFFFF);
+        put_value(buf, 0x0040A010, "CS", 8, rng);
+        put_value(buf, 0x0040A040, "CS", 4, rng);
+        put_value(buf, 0x0040A160, "UT", value_size, rng);
+        if (level < depth) { put_content_sequence(buf, level + 1, depth, value_size, rng); }
+        put_item_tag(buf, 0xE00D, 0);
+    }
+
+    put_item_tag(buf, 0xE0DD, 0);
+}
+
+static int compare_entries(const void* a, const void* b) {
+    const uint32_t ta = ((const synth_entry*)a)->tag;
+    const uint32_t tb = ((const synth_entry*)b)->tag;
+    return ta < tb ? -1 : ta > tb;
+}
+
+static bool is_usable_public(const dicom_element* entry) {
+    const uint16_t group = (uint16_t)(entry->tag >> 16);
+    if (strlen(entry->vr) != 2 || strcmp(entry->vr, "SQ") == 0) { return false; }
+    // 64-bit VRs are not known to the streaming parser yet, it would stop at the first one
+    if (strcmp(entry->vr, "OV") == 0 || strcmp(entry->vr, "SV") == 0 || strcmp(entry->vr, "UV") == 0) { return false; }
+    if (group <= 0x0002 || group == 0x7FE0 || group == 0xFFFE) { return false; }
+    if ((entry->tag & 0xFFFF) == 0) { return false; }
+    return entry->tag != 0x00080005 && entry->tag != TAG_CONTENT_SEQUENCE;  // Keep the decoder on ASCII
+}
+
+// Sorted list of top-level elements: a spread of dictionary tags plus private blocks
+static synth_entry* build_entries(const synth_config* config, int* count) {
+    const int total = config->element_count > 0 ? config->element_count : 1;
+    int private_count = (int)(total * config->private_ratio + 0.5);
+    const int max_private = (int)(sizeof(private_groups) / sizeof(private_groups[0])) * SYNTH_PRIVATE_PER_GROUP;
+    if (private_count > max_private) { private_count = max_private; }
+    if (private_count > total) { private_count = total; }
+    int public_count = total - private_count;
+
+    int usable = 0;
+    for (int i = 0; i < DICOM_DICT_SIZE; i++) { if (is_usable_public(&dicom_dictionary[i])) { usable++; } }
+    if (public_count > usable) { public_count = usable; }
+
+    const int groups_used = (private_count + SYNTH_PRIVATE_PER_GROUP - 1) / SYNTH_PRIVATE_PER_GROUP;
+    synth_entry* entries = (synth_entry*)malloc(sizeof(synth_entry) * (size_t)(public_count + private_count +
+                                                                                 groups_used + 2));
+    if (entries == NULL) { return NULL; }
+
+    int n = 0;
+    if (public_count > 0) {
+        const double stride = (double)usable / public_count;
+        int seen = 0;
+        int taken = 0;
+        for (int i = 0; i < DICOM_DICT_SIZE && taken < public_count; i++) {
+            if (!is_usable_public(&dicom_dictionary[i])) { continue; }
+            if (seen++ < (int)(taken * stride)) { continue; }
+            entries[n].tag = dicom_dictionary[i].tag;
+            memcpy(entries[n].vr, dicom_dictionary[i].vr, 3);
+            n++;
+            taken++;
+        }
+    }
+
+    for (int i = 0; i < private_count; i++) {
+        const uint16_t group = private_groups[i / SYNTH_PRIVATE_PER_GROUP];
+        const uint16_t element = (uint16_t)(0x1000 + i % SYNTH_PRIVATE_PER_GROUP);
+        if (i % SYNTH_PRIVATE_PER_GROUP == 0) {
+            entries[n].tag = ((uint32_t)group << 16) | 0x0010;
+            memcpy(entries[n].vr, "LO", 3);
+            n++;
+        }
+        entries[n].tag = ((uint32_t)group << 16) | element;
+        memcpy(entries[n].vr, private_vrs[i % (sizeof(private_vrs) / sizeof(private_vrs[0]))], 3);
+        n++;
+    }
+
+    if (config->depth > 0) {
+        entries[n].tag = TAG_CONTENT_SEQUENCE;
+        memcpy(entries[n].vr, "SQ", 3);
+        n++;
+    }
+
+    qsort(entries, (size_t)n, sizeof(synth_entry), compare_entries);
+    *count = n;
+    return entries;
+}
+
+static void put_file_meta(synth_buffer* buf, const synth_config* config, const uint32_t seed) {
+    synth_buffer meta = {.is_explicit_vr = true, .is_little_endian = true};
+    char instance_uid[64];
+
+    snprintf(instance_uid, sizeof(instance_uid), "1.2.826.0.1.3680043.10.543.%u", seed);
+
+    const uint8_t version[2] = {0x00, 0x01};
+    put_header(&meta, 0x00020001, "OB", 2);
+    put_bytes(&meta, version, 2);
+
+    const char* const values[][2] = {
+        {"UI", "1.2.840.10008.5.1.4.1.1.2"},
+        {"UI", instance_uid},
+        {"UI", transfer_syntax_uid(config->transfer_syntax)},
+        {"UI", "1.2.826.0.1.3680043.10.543"},
+        {"SH", "DCMLOUPE_BENCH"},
+    };
+    const uint32_t tags[] = {0x00020002, 0x00020003, 0x00020010, 0x00020012, 0x00020013};
+
+    for (size_t i = 0; i < sizeof(tags) / sizeof(tags[0]); i++) {
+        const uint32_t length = (uint32_t)strlen(values[i][1]);
+        const bool pad = length % 2 != 0;
+        put_header(&meta, tags[i], values[i][0], length + (pad ? 1 : 0));
+        put_bytes(&meta, values[i][1], length);
+        if (pad) { put_bytes(&meta, strcmp(values[i][0], "UI") == 0 ? "\0" : " ", 1); }
+    }
+
+    const bool explicit_vr = buf->is_explicit_vr;
+    const bool little_endian = buf->is_little_endian;
+    buf->is_explicit_vr = true;
+    buf->is_little_endian = true;
+    put_header(buf, 0x00020000, "UL", 4);
+    put_u32(buf, (uint32_t)meta.size);
+    put_bytes(buf, meta.data, meta.size);
+    buf->is_explicit_vr = explicit_vr;
+    buf->is_little_endian = little_endian;
+
+    if (meta.failed) { buf->failed = true; }
+    free(meta.data);
+}
+
+long synth_write_file(const char* path, const synth_config* config, const uint32_t seed) {
+    synth_buffer buf = {
+        .is_explicit_vr = config->transfer_syntax != SYNTH_IMPLICIT_VR_LITTLE_ENDIAN,
+        .is_little_endian = config->transfer_syntax != SYNTH_EXPLICIT_VR_BIG_ENDIAN,
+    };
+    uint32_t rng = seed != 0 ? seed : 0x9E3779B9u;
+
+    const uint8_t preamble[SYNTH_PREAMBLE_SIZE] = {0};
+    put_bytes(&buf, preamble, sizeof(preamble));
+    put_bytes(&buf, "DICM", 4);
+    put_file_meta(&buf, config, seed);
+
+    int count = 0;
+    synth_entry* entries = build_entries(config, &count);
+    if (entries == NULL) {
+        free(buf.data);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const uint16_t group = (uint16_t)(entries[i].tag >> 16);
+        const uint16_t element = (uint16_t)entries[i].tag;
+
+        if (entries[i].tag == TAG_CONTENT_SEQUENCE) {
+            put_content_sequence(&buf, 1, config->depth, config->value_size, &rng);
+        }
+        else if ((group & 1) != 0 && element == 0x0010) {
+            const uint32_t length = (uint32_t)strlen(SYNTH_PRIVATE_CREATOR);
+            put_header(&buf, entries[i].tag, "LO", length);
+            put_bytes(&buf, SYNTH_PRIVATE_CREATOR, length);
+        }
+        else { put_value(&buf, entries[i].tag, entries[i].vr, config->value_size, &rng); }
+    }
+    free(entries);
+
+    // Small pixel data so the parser's stop condition is part of the run
+    put_value(&buf, TAG_PIXEL_DATA, "OW", 256, &rng);
+
+    if (buf.failed) {
+        free(buf.data);
+        return -1;
+    }
+
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        free(buf.data);
+        return -1;
+    }
+
+    const bool ok = fwrite(buf.data, 1, buf.size, fp) == buf.size;
+    const bool closed = fclose(fp) == 0;
+    free(buf.data);
+    return ok && closed ? (long)buf.size : -1;
+}
@@ -0,0 +1,33 @@
+#ifndef DICOM_SYNTH_H
+#define DICOM_SYNTH_H
+
+#include <stdint.h>
+
+typedef enum {
+    SYNTH_EXPLICIT_VR_LITTLE_ENDIAN,
+    SYNTH_IMPLICIT_VR_LITTLE_ENDIAN,
+    SYNTH_EXPLICIT_VR_BIG_ENDIAN,
+} synth_transfer_syntax;
+
+/*
+ * Shape of a generated file. Public elements are taken from the dictionary so every VR is covered,
+ * private ones are spread over a few odd groups with their creator elements. depth > 0 adds a
+ * ContentSequence nested that many levels deep. value_size is the length of long text, binary and
+ * numeric array values; short string VRs are capped at their maximum length.
+ */
+typedef struct {
+    const char* name;
+    int element_count;
+    int depth;
+    double private_ratio;
+    synth_transfer_syntax transfer_syntax;
+    uint32_t value_size;
+} synth_config;
+
+const char* synth_transfer_syntax_name(synth_transfer_syntax ts);
+int synth_transfer_syntax_parse(const char* name, synth_transfer_syntax* ts);
+
+// Same config and seed give a byte-identical file. Returns the file size or -1 on error
+long synth_write_file(const char* path, const synth_config* config, uint32_t seed);
+
+#endif // DICOM_SYNTH_H
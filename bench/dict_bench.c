@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __linux__
+    #include <unistd.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <linux/perf_event.h>
+#endif
+
+#include "dicom_dict.h"
+#include "dicom_stats.h"
+
+#define TAG_COUNT (1 << 16)
+#define WARMUP_COUNT 4096
+#define MIN_SECONDS 0.2
+
+typedef enum {
+    DIST_PUBLIC,   // Tags from the dictionary with a few private ones, like a plain CT or MR header
+    DIST_PRIVATE,  // Vendor-heavy headers: mostly odd groups, creators and their blocks
+    DIST_MASK,     // Repeating groups (overlays, curves) that only the mask table knows
+    DIST_RANDOM,   // Uniform 32-bit tags, nearly all misses
+    DIST_COUNT
+} distribution;
+
+static const char* const distribution_names[] = {"public", "private", "mask", "random"};
+
+typedef struct {
+    const char* name;
+    bool (*lookup)(uint32_t tag);
+} lookup_function;
+
+static bool lookup_dict(const uint32_t tag) { return dicom_dict_lookup(tag) != NULL; }
+static bool lookup_mask(const uint32_t tag) { return dicom_mask_lookup(tag) != NULL; }
+static bool lookup_name(const uint32_t tag) { return dicom_get_name(tag) != NULL; }
+static bool lookup_vr(const uint32_t tag) { return dicom_get_vr(tag) != NULL; }
+static bool lookup_keyword(const uint32_t tag) { return dicom_get_keyword(tag) != NULL; }
+
+static const lookup_function functions[] = {
+    {"dicom_dict_lookup", lookup_dict},
+    {"dicom_mask_lookup", lookup_mask},
+    {"dicom_get_name", lookup_name},
+    {"dicom_get_vr", lookup_vr},
+    {"dicom_get_keyword", lookup_keyword},
+};
+
+static uint32_t next_random(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static uint32_t private_tag(uint32_t* rng) {
+    static const uint16_t groups[] = {0x0009, 0x0011, 0x0019, 0x0021, 0x0029, 0x0043, 0x0051, 0x2001};
+    const uint16_t group = groups[next_random(rng) % (sizeof(groups) / sizeof(groups[0]))];
+    const uint32_t r = next_random(rng);
+    const uint16_t element = r % 8 == 0 ? (uint16_t)(0x0010 + r % 4) : (uint16_t)(0x1000 + (r >> 8) % 0x300);
+    return ((uint32_t)group << 16) | element;
+}
+
+static uint32_t mask_tag(uint32_t* rng) {
+    const dicom_mask_element* entry = &dicom_mask_dictionary[next_random(rng) % DICOM_MASK_DICT_SIZE];
+    char hex[9];
+
+    // Fill every 'x' of the mask with a hex digit; overlay and curve groups are even
+    for (int i = 0; i < 8; i++) {
+        hex[i] = entry->tag[i] == 'x' ? "0123456789ABCDEF"[next_random(rng) % 16] : entry->tag[i];
+    }
+    if (entry->tag[3] == 'x') { hex[3] = "02468ACE"[next_random(rng) % 8]; }
+    hex[8] = '\0';
+    return (uint32_t)strtoul(hex, NULL, 16);
+}
+
+static void fill_tags(uint32_t* tags, const distribution dist, uint32_t seed) {
+    uint32_t rng = seed;
+    for (int i = 0; i < TAG_COUNT; i++) {
+        const uint32_t pick = next_random(&rng) % 100;
+        switch (dist) {
+        case DIST_PUBLIC:
+            tags[i] = pick < 90 ? dicom_dictionary[next_random(&rng) % DICOM_DICT_SIZE].tag : private_tag(&rng);
+            break;
+        case DIST_PRIVATE:
+            tags[i] = pick < 70 ? private_tag(&rng) : dicom_dictionary[next_random(&rng) % DICOM_DICT_SIZE].tag;
+            break;
+        case DIST_MASK:
+            tags[i] = mask_tag(&rng);
+            break;
+        default:
+            tags[i] = next_random(&rng);
+            break;
+        }
+    }
+}
+
+#ifdef __linux__
+static int open_cache_miss_counter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;
+    double seconds;
+    long long cache_misses;  // -1 when no counter is available
+} run_result;
+
+static run_result run(const lookup_function* function, const uint32_t* tags, const int counter_fd) {
+    run_result result = {0, 0, 0.0, -1};
+    uint64_t hits = 0;
+
+    // Untimed pass so the first table touches do not count
+    for (int i = 0; i < WARMUP_COUNT; i++) { (void)function->lookup(tags[i]); }
+
+#ifdef __linux__
+    if (counter_fd >= 0) {
+        ioctl(counter_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else
+    (void)counter_fd;
+#endif
+
+    const double start = dicom_stats_now();
+    double elapsed;
+    do {
+        for (int i = 0; i < TAG_COUNT; i++) { hits += function->lookup(tags[i]); }
+        result.lookups += TAG_COUNT;
+        elapsed = dicom_stats_now() - start;
+    } while (elapsed < MIN_SECONDS);
+
+#ifdef __linux__
+    if (counter_fd >= 0) {
+        ioctl(counter_fd, PERF_EVENT_IOC_DISABLE, 0);
+        long long count;
+        if (read(counter_fd, &count, sizeof(count)) == (ssize_t)sizeof(count)) { result.cache_misses = count; }
+    }
+#endif
+
+    result.hits = hits;
+    result.seconds = elapsed;
+    return result;
+}
+
+// Optional argument: run only the named function
+int main(const int argc, char* argv[]) {
+    const char* only_function = argc > 1 ? argv[1] : NULL;
+    uint32_t* tags = (uint32_t*)malloc(sizeof(uint32_t) * TAG_COUNT);
+    if (tags == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1;
+    }
+
+    int counter_fd = -1;
+#ifdef __linux__
+    counter_fd = open_cache_miss_counter();
+#endif
+    if (counter_fd < 0) { fprintf(stderr, "Note: No cache-miss counter (perf_event_open unavailable)\n"); }
+
+    for (int d = 0; d < DIST_COUNT; d++) {
+        fill_tags(tags, (distribution)d, 0x2545F491u + (uint32_t)d);
+
+        for (size_t f = 0; f < sizeof(functions) / sizeof(functions[0]); f++) {
+            if (only_function != NULL && strcmp(only_function, functions[f].name) != 0) { continue; }
+
+            const run_result r = run(&functions[f], tags, counter_fd);
+            printf("[dict] function=%s distribution=%s lookups=%llu hit_rate=%.3f ns_per_lookup=%.2f",
+                   functions[f].name, distribution_names[d], (unsigned long long)r.lookups,
+                   (double)r.hits / (double)r.lookups, r.seconds * 1e9 / (double)r.lookups);
+            if (r.cache_misses >= 0) {
+                printf(" cache_misses=%lld cache_misses_per_lookup=%.4f\n", r.cache_misses,
+                       (double)r.cache_misses / (double)r.lookups);
+            }
+            else { printf(" cache_misses=n/a\n"); }
+        }
+    }
+
+#ifdef __linux__
+    if (counter_fd >= 0) { close(counter_fd); }
+#endif
+    free(tags);
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef DICOM_ARCHIVE_H
+#define DICOM_ARCHIVE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Member iteration over .zip and .tar bundles, so their instances can be parsed without
+ * extracting them. The archive is mapped: stored zip members and plain tar members are handed out
+ * as pointers into the mapping. Deflated zip members and gzip-compressed tars are inflated into
+ * memory, which needs zlib at build time (DCMLOUPE_HAVE_ZLIB).
+ */
+typedef enum {
+    DICOM_ARCHIVE_NONE,
+    DICOM_ARCHIVE_ZIP,
+    DICOM_ARCHIVE_TAR,
+    DICOM_ARCHIVE_TAR_GZ,
+    DICOM_ARCHIVE_TAR_ZSTD,
+} dicom_archive_kind;
+
+// Called per regular file member; data is only valid during the call. Non-zero stops the iteration.
+typedef int (*dicom_member_fn)(const char* name, const uint8_t* data, size_t size, void* user);
+
+dicom_archive_kind dicom_archive_detect(const char* filename);
+int dicom_archive_foreach(const char* filename, dicom_member_fn fn, void* user);
+
+#endif // DICOM_ARCHIVE_H
@@ -0,0 +1,38 @@
+#ifndef DICOM_ARENA_H
+#define DICOM_ARENA_H
+
+#include <stddef.h>
+
+#define DICOM_ARENA_BLOCK_SIZE (64 * 1024)
+
+/*
+ * Bump allocator for per-file parse state (value buffers, decoded strings, tree nodes).
+ * Nothing is freed individually: roll back with dicom_arena_restore() or drop everything with
+ * dicom_arena_reset() between files. Blocks are kept across resets, so a warmed-up arena does not
+ * touch malloc at all. An arena is not thread-safe; give every worker its own.
+ */
+typedef struct dicom_arena_block {
+    struct dicom_arena_block* next;
+    size_t capacity;
+    size_t used;
+} dicom_arena_block;
+
+typedef struct {
+    dicom_arena_block* first;
+    dicom_arena_block* current;
+} dicom_arena;
+
+typedef struct {
+    dicom_arena_block* block;
+    size_t used;
+} dicom_arena_mark;
+
+void dicom_arena_init(dicom_arena* arena);
+void* dicom_arena_alloc(dicom_arena* arena, size_t size);
+char* dicom_arena_strndup(dicom_arena* arena, const char* str, size_t length);
+dicom_arena_mark dicom_arena_save(const dicom_arena* arena);
+void dicom_arena_restore(dicom_arena* arena, dicom_arena_mark mark);
+void dicom_arena_reset(dicom_arena* arena);
+void dicom_arena_free(dicom_arena* arena);
+
+#endif // DICOM_ARENA_H
@@ -0,0 +1,23 @@
+#ifndef DICOM_BATCH_H
+#define DICOM_BATCH_H
+
+#include <stdbool.h>
+
+#include "dicom_stats.h"
+
+/*
+ * Batch mode: every file under the given files and directories is loaded by a pool of worker
+ * threads through the mapped dataset tree, stopping at the last tag the selected reports need.
+ * Results are merged into sharded hash tables and printed once all files are done.
+ */
+typedef struct {
+    int threads;            // Worker threads, 0 for one per CPU
+    bool find_duplicates;   // Group files by SOP Instance UID
+    bool hash_pixels;       // Also group files by pixel data digest (reads up to the pixel data)
+    bool build_hierarchy;   // Study/series report: counts, bytes, modality, Instance Number gaps
+    bool collect_stats;     // Sum the per-file counters into the stats passed to run_batch()
+} batch_options;
+
+int run_batch(const char* const* paths, int path_count, const batch_options* options, dicom_stats* stats);
+
+#endif // DICOM_BATCH_H
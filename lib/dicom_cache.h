@@ -0,0 +1,52 @@
+#ifndef DICOM_CACHE_H
+#define DICOM_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "dicom_arena.h"
+#include "dicom_dataset.h"
+#include "dicom_io.h"
+
+/*
+ * On-disk cache of dataset trees, so that dumping the same file again needs no parse at all. An
+ * entry is the tree flattened in document order: one fixed-size record per element (tag, VR,
+ * length, child count, size of its subtree) followed by at most value_cap value bytes. Entries
+ * are named by a hash of the file identity (device, inode, size, modification time), which is
+ * stored in the entry too and compared on load; a changed file simply misses.
+ */
+#define DICOM_CACHE_VALUE_PRESENT 0x01        // Value bytes were readable (not past the end of the file)
+#define DICOM_CACHE_LITTLE_ENDIAN 0x02        // Value is little endian
+
+typedef struct {
+    uint32_t tag;
+    uint32_t length;              // As encoded, can be DICOM_UNDEFINED_LENGTH
+    uint32_t child_count;
+    uint32_t descendants;         // Records of the subtree, they follow this one
+    uint32_t value_length;        // Stored bytes, min(length, value_cap)
+    uint16_t vr;
+    uint8_t flags;
+    const uint8_t* value;         // Into the mapped entry, NULL without DICOM_CACHE_VALUE_PRESENT
+} dicom_cache_record;
+
+typedef struct {
+    dicom_cache_record* records;
+    uint32_t count;
+    uint32_t top_level;           // Records at depth 0
+    bool is_truncated;
+    dicom_file_map map;
+} dicom_cache_entry;
+
+// $DCMLOUPE_CACHE_DIR, else the platform's per-user cache directory; -1 if none can be determined
+int dicom_cache_default_dir(char* dir, size_t size);
+
+// -1 on a miss, a stale entry or a different value_cap. Records live in the arena.
+int dicom_cache_load(const char* cache_dir, const char* filename, uint32_t value_cap, dicom_arena* arena,
+                     dicom_cache_entry* entry);
+void dicom_cache_close(dicom_cache_entry* entry);
+
+// Written to a temporary file and renamed, so concurrent readers never see a partial entry
+int dicom_cache_store(const char* cache_dir, const char* filename, const dicom_dataset* ds, uint32_t value_cap);
+
+#endif // DICOM_CACHE_H
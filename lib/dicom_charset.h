@@ -0,0 +1,40 @@
+#ifndef DICOM_CHARSET_H
+#define DICOM_CHARSET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "dicom_arena.h"
+
+typedef enum {
+    DICOM_CHARSET_DEFAULT,   // ISO_IR 6, stray high bytes are read as ISO 8859-1
+    DICOM_CHARSET_LATIN1,    // ISO_IR 100, decoded without iconv
+    DICOM_CHARSET_UTF8,      // ISO_IR 192, passed through once checked, invalid bytes become '?'
+    DICOM_CHARSET_ICONV,     // Everything else (GB18030, ISO 2022 IR 87, ISO_IR 144, ...)
+    DICOM_CHARSET_KATAKANA,  // ISO 2022 IR 13: 8-bit JIS X 0201 katakana decoded here, the 7-bit rest by iconv
+} dicom_charset_kind;
+
+/*
+ * Specific Character Set (0008,0005) of a dataset and the converter to UTF-8 for it. Pure ASCII values
+ * are detected with a SIMD scan and returned as they are, so only values that really contain
+ * non-ASCII bytes are transcoded. The iconv handle is opened once per character set and reused for
+ * every element.
+ */
+typedef struct {
+    dicom_charset_kind kind;
+    char name[64];            // Defined term as found in the dataset
+    const char* iconv_name;
+    void* iconv_handle;
+} dicom_charset;
+
+void dicom_charset_init(dicom_charset* charset);
+void dicom_charset_set(dicom_charset* charset, const uint8_t* value, size_t length);
+const uint8_t* dicom_charset_to_utf8(dicom_charset* charset, const uint8_t* data, size_t length, dicom_arena* arena,
+                                     size_t* out_length);
+void dicom_charset_close(dicom_charset* charset);
+
+// Bytes taken by the first max_chars characters of UTF-8 text, never ending inside a multi-byte sequence
+size_t dicom_utf8_prefix(const uint8_t* text, size_t length, size_t max_chars);
+
+#endif // DICOM_CHARSET_H
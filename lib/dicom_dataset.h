@@ -0,0 +1,94 @@
+#ifndef DICOM_DATASET_H
+#define DICOM_DATASET_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "dicom_arena.h"
+#include "dicom_io.h"
+#include "dicom_path.h"
+
+#define DICOM_VR(a, b) ((uint16_t)(((uint16_t)(uint8_t)(a) << 8) | (uint16_t)(uint8_t)(b)))
+#define DICOM_UNDEFINED_LENGTH 0xFFFFFFFF
+#define DICOM_DATASET_MAX_DEPTH 64
+
+#define DICOM_TAG_ITEM 0xFFFEE000
+#define DICOM_TAG_ITEM_DELIMITATION 0xFFFEE00D
+#define DICOM_TAG_SEQUENCE_DELIMITATION 0xFFFEE0DD
+#define DICOM_TAG_LAST 0xFFFFFFFF
+
+#define DICOM_NODE_UNSORTED 0x01  // Children are not in ascending tag order, lookups fall back to a linear scan
+
+/*
+ * One element of the dataset tree. Values are never copied: offset/length point into the buffer
+ * the dataset was built from and are only decoded on access. Sequences have their items as
+ * children, items have their elements as children; encapsulated pixel data has its fragments.
+ */
+typedef struct dicom_node {
+    uint64_t offset;              // Offset of the value in the dataset buffer
+    uint64_t end;                 // Offset just past the element, including any delimitation item
+    struct dicom_node* children;
+    uint32_t tag;
+    uint32_t length;              // Value length as encoded, can be DICOM_UNDEFINED_LENGTH
+    uint32_t child_count;
+    uint16_t vr;                  // DICOM_VR() code, 0 for items
+    uint8_t header_size;          // Bytes from the start of the element to its value
+    uint8_t flags;
+} dicom_node;
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    bool is_explicit_vr;          // Encoding of the dataset after the file meta group
+    bool is_little_endian;
+    bool is_truncated;            // Traversal stopped early at a malformed or incomplete element
+    bool is_partial;              // Traversal stopped at the requested stop tag, later elements are missing
+    char transfer_syntax_uid[65];
+    dicom_node root;              // Top-level elements, file meta group included
+    dicom_file_map map;
+    dicom_arena* item_arenas;     // Nodes built by worker threads (dicom_dataset_load_parallel)
+    size_t item_arena_count;
+} dicom_dataset;
+
+int dicom_dataset_load(const char* filename, dicom_arena* arena, dicom_dataset* ds);
+int dicom_dataset_parse(const uint8_t* data, size_t size, dicom_arena* arena, dicom_dataset* ds);
+
+// Same, but the top level ends at the last element with a tag <= stop_tag, so nothing past it is touched
+int dicom_dataset_load_until(const char* filename, uint32_t stop_tag, dicom_arena* arena, dicom_dataset* ds);
+int dicom_dataset_parse_until(const uint8_t* data, size_t size, uint32_t stop_tag, dicom_arena* arena,
+                              dicom_dataset* ds);
+
+// Items of the Per-Frame Functional Groups Sequence are built on up to `threads` threads; same tree
+int dicom_dataset_load_parallel(const char* filename, int threads, dicom_arena* arena, dicom_dataset* ds);
+
+// A bare dataset as sent over the network: no preamble or meta group, encoded in the given transfer syntax
+int dicom_dataset_parse_raw(const uint8_t* data, size_t size, const char* transfer_syntax_uid, uint32_t stop_tag,
+                            dicom_arena* arena, dicom_dataset* ds);
+void dicom_dataset_close(dicom_dataset* ds);
+
+typedef struct {
+    dicom_node element;           // Element matched by the step; children are never built
+    dicom_node item;              // Item it was entered through, for every step but the last
+} dicom_path_span;
+
+/*
+ * Finds the element at the end of a tag path without building a tree: elements before each step
+ * and items before the wanted one are stepped over by their lengths, so the cost follows the
+ * path, not the element count. `end` of a span is 0 where the length is undefined. spans has one
+ * entry per step; those not reached are zeroed. A sequence as the result gets its item count.
+ * Returns 0 when found, 1 when the path does not exist, -1 when the file cannot be read; ds holds
+ * the mapping (close it) unless -1 is returned.
+ */
+int dicom_dataset_seek(const char* filename, const dicom_tag_path* path, dicom_dataset* ds, dicom_path_span* spans);
+int dicom_dataset_seek_buffer(const uint8_t* data, size_t size, const dicom_tag_path* path, dicom_dataset* ds,
+                              dicom_path_span* spans);
+
+const dicom_node* dicom_dataset_find(const dicom_node* parent, uint32_t tag);
+const uint8_t* dicom_node_value(const dicom_dataset* ds, const dicom_node* node);
+bool dicom_node_is_little_endian(const dicom_dataset* ds, const dicom_node* node);
+size_t dicom_node_string(const dicom_dataset* ds, const dicom_node* node, char* buffer, size_t buffer_size);
+bool dicom_node_uint(const dicom_dataset* ds, const dicom_node* node, uint32_t* value);
+void dicom_vr_string(uint16_t vr, char out[3]);
+
+#endif // DICOM_DATASET_H
@@ -0,0 +1,14 @@
+#ifndef DICOM_DIR_H
+#define DICOM_DIR_H
+
+#include "dicom_arena.h"
+
+/*
+ * DICOMDIR media directories (PS3.10, PS3.3 F.3). The Directory Record Sequence is loaded once as a
+ * dataset tree; the patient/study/series/image hierarchy is then rebuilt from the record offsets
+ * (0004,1200 first root record, 0004,1400 next sibling, 0004,1420 first child) and every
+ * ReferencedFileID is resolved to a path next to the DICOMDIR. Referenced files are not opened.
+ */
+int dump_dicomdir(const char* filename, dicom_arena* arena);
+
+#endif // DICOM_DIR_H
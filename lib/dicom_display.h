@@ -4,11 +4,17 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "dicom_arena.h"
+#include "dicom_charset.h"
+
 typedef struct {
     bool is_little_endian;
     bool overwrite_max_disp_len;
+    bool show_all_values;  // Decode every value of multi-valued numeric elements instead of the first
     int terminal_width;
     int val_col_start;
+    dicom_charset* charset;  // Specific Character Set of the dataset, NULL to print ASCII only
+    dicom_arena* arena;      // Scratch space for converted text
 } display_context;
 
 void display_value(const char* vr, const uint8_t* data, uint32_t length, int depth, const display_context* ctx);
@@ -0,0 +1,33 @@
+#ifndef DICOM_HASH_H
+#define DICOM_HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "dicom_dataset.h"
+
+/*
+ * XXH64 (xxHash, 64-bit variant), written out here so there is no dependency to vendor. Four
+ * independent 64-bit lanes per 32-byte stripe keep the multipliers busy, which is enough to hash
+ * mapped pixel data at roughly memory bandwidth. Digests match the reference implementation.
+ */
+typedef struct {
+    uint64_t lanes[4];
+    uint64_t total;
+    uint64_t seed;
+    uint8_t buffer[32];
+    size_t buffered;
+} dicom_xxh64;
+
+void dicom_xxh64_init(dicom_xxh64* state, uint64_t seed);
+void dicom_xxh64_update(dicom_xxh64* state, const void* data, size_t length);
+uint64_t dicom_xxh64_digest(const dicom_xxh64* state);
+
+/*
+ * Digest of the top-level Pixel Data value (7FE0,0010, or Float/Double Float Pixel Data). For
+ * encapsulated pixel data the fragments are hashed in order, without the Basic Offset Table and
+ * item headers. Returns -1 when there is no pixel data.
+ */
+int dicom_pixel_data_hash(const dicom_dataset* ds, uint64_t* digest, uint64_t* bytes);
+
+#endif // DICOM_HASH_H
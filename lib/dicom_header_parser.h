@@ -4,22 +4,48 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "dicom_arena.h"
+#include "dicom_path.h"
+
 #define DEFAULT_MAX_ELEMENTS 250
 #define DEFAULT_MAX_SQ_DEPTH 5
 #define MAX_FILTER_TAGS 100
 
+// Results besides 0 (done) and -1 (error) that the dump functions return, and dcmloupe exits with
+#define DICOM_RESULT_DAMAGED 2     // --recover had to skip corrupt bytes
+#define DICOM_RESULT_NOT_FOUND 3   // --path names an element the file does not have
+
+// -f: the top-level tags it names (for flat lookups and JSON), and all of its paths compiled
 typedef struct {
     uint32_t* tags;
     int count;
+    const dicom_filter* paths;  // NULL for no filter
 } tag_filter;
 
-int parse_dicom_header(
-    const char* filename,
-    int max_elements,
-    bool collapse_sequences,
-    int max_sq_depth,
-    bool show_full_values,
-    const tag_filter* filter
-    );
+typedef struct {
+    int max_elements;
+    int max_sq_depth;
+    bool collapse_sequences;
+    bool show_full_values;
+    bool show_all_values;      // Decode every value of multi-valued numeric elements
+    bool hash_pixels;          // Follow the header with an XXH64 digest of the pixel data
+    const tag_filter* filter;
+    const char* cache_dir;     // Render through the record cache kept in this directory, NULL for none
+    int threads;               // Tree builds split per-frame functional group items across this many threads
+    bool recover;              // After an invalid VR, resynchronize on the next plausible element and report the gap
+} parse_options;
+
+// Streaming dump; the only renderer that honours options->recover
+int parse_dicom_header(const char* filename, const parse_options* options, dicom_arena* arena);
+int dump_dicom_dataset(const char* filename, const parse_options* options, dicom_arena* arena);
+int dump_dicom_cached(const char* filename, const parse_options* options, dicom_arena* arena);
+int dump_dicom_buffer(const char* name, const uint8_t* data, size_t size, const parse_options* options,
+                      dicom_arena* arena);
+// Every Part 10 member of a .zip, .tar or .tar.gz, parsed from memory (see dicom_archive.h)
+int dump_dicom_archive(const char* filename, const parse_options* options, dicom_arena* arena);
+// The element at the end of a tag path, reached by length jumps (see dicom_dataset_seek)
+int dump_dicom_path(const char* filename, const char* path_text, const dicom_tag_path* path,
+                    const parse_options* options, dicom_arena* arena);
+int dump_dicom_json(const char* filename, const parse_options* options, dicom_arena* arena);
 
 #endif //DCMLOUPE_DICOM_HEADER_PARSER_H
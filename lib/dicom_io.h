@@ -0,0 +1,55 @@
+#ifndef DICOM_IO_H
+#define DICOM_IO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+/*
+ * Read-only view of a whole file. Uses mmap where available so that only the pages that are
+ * actually touched get read; falls back to reading the file into memory on Windows.
+ */
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    bool is_mapped;
+} dicom_file_map;
+
+int dicom_file_map_open(const char* filename, dicom_file_map* map);
+void dicom_file_map_close(dicom_file_map* map);
+void dicom_file_map_advise_sequential(const dicom_file_map* map);
+
+#define DICOM_COPIER_BUFFER_SIZE (64 * 1024)
+
+/*
+ * Writes a new file out of byte ranges of a source file plus new bytes in between. Ranges are
+ * moved by the kernel where possible (copy_file_range, then sendfile on Linux) and through a
+ * pread/write loop elsewhere, so unchanged data is never decoded. New bytes are buffered and
+ * flushed before the next range. Every call returns 0 or -1; after an error the rest are no-ops
+ * and dicom_copier_close() reports it.
+ */
+typedef struct {
+#ifdef _WIN32
+    FILE* in;
+    FILE* out;
+#else
+    int in_fd;
+    int out_fd;
+#endif
+    uint64_t written;
+    bool failed;
+    size_t pending;
+    uint8_t buffer[DICOM_COPIER_BUFFER_SIZE];
+} dicom_file_copier;
+
+int dicom_copier_open(dicom_file_copier* copier, const char* source, const char* destination);
+int dicom_copier_copy(dicom_file_copier* copier, uint64_t offset, uint64_t length);
+int dicom_copier_write(dicom_file_copier* copier, const void* data, size_t length);
+int dicom_copier_close(dicom_file_copier* copier);
+
+// Overwrites `length` bytes at `offset` of an existing file; nothing else is read or written
+int dicom_file_write_at(const char* filename, uint64_t offset, const void* data, size_t length);
+bool dicom_same_file(const char* a, const char* b);
+
+#endif // DICOM_IO_H
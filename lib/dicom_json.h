@@ -0,0 +1,21 @@
+#ifndef DICOM_JSON_H
+#define DICOM_JSON_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "dicom_arena.h"
+#include "dicom_dataset.h"
+
+/*
+ * Writes a dataset tree as a single line of DICOM JSON (PS3.18 Annex F). Numeric VRs, including
+ * the DS/IS strings, are emitted as JSON numbers; binary VRs as InlineBinary, except pixel data.
+ * With tags != NULL only those top-level elements are written. The file meta group is left out.
+ * Text is converted to UTF-8 according to the dataset's Specific Character Set.
+ */
+void dicom_json_write(FILE* out, const dicom_dataset* ds, const uint32_t* tags, int tag_count, dicom_arena* arena);
+
+// A NUL-terminated string as a quoted JSON string; bytes >= 0x80 are copied as they are (UTF-8 paths, AE titles)
+void dicom_json_write_string(FILE* out, const char* str);
+
+#endif // DICOM_JSON_H
@@ -0,0 +1,21 @@
+#ifndef DICOM_NUMERIC_H
+#define DICOM_NUMERIC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Parsers for the numeric string VRs. Values are backslash separated and may carry leading/trailing
+ * spaces. Each function fills up to max_values entries and returns the number of values in the
+ * string (which can be larger than max_values), or -1 if a value is malformed. Empty values are
+ * reported through `present` when it is not NULL.
+ */
+int dicom_parse_ds(const char* str, size_t length, double* values, bool* present, size_t max_values);
+int dicom_parse_is(const char* str, size_t length, int64_t* values, bool* present, size_t max_values);
+
+bool dicom_parse_double(const char* str, size_t length, double* value);
+bool dicom_parse_int64(const char* str, size_t length, int64_t* value);
+size_t dicom_format_double(double value, char* buffer, size_t buffer_size);
+
+#endif // DICOM_NUMERIC_H
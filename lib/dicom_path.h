@@ -0,0 +1,84 @@
+#ifndef DICOM_PATH_H
+#define DICOM_PATH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DICOM_PATH_MAX_STEPS 16
+#define DICOM_PATH_ANY_ITEM 0xFFFFFFFF
+
+/*
+ * A path to an element inside nested sequences, written as elements separated by '.':
+ *
+ *     5200,9230[12].0028,9110.0028,0030
+ *     (0040,0275)[*].(0040,0009)
+ *     ScheduledProcedureStepSequence[*].ScheduledProcedureStepID
+ *
+ * Each element is GGGG,EEEE, (GGGG,EEEE), GGGGEEEE or a dictionary keyword. Every element but the
+ * last is a sequence and may pick an item with [n], counted from 0, or all of them with [*];
+ * without an index the first item is used.
+ */
+typedef struct {
+    uint32_t tag;
+    uint32_t item;      // Item of this sequence the next step looks in, DICOM_PATH_ANY_ITEM for [*]
+} dicom_path_step;
+
+typedef struct {
+    dicom_path_step steps[DICOM_PATH_MAX_STEPS];
+    int count;
+} dicom_tag_path;
+
+int dicom_tag_path_parse(const char* text, dicom_tag_path* path);
+bool dicom_tag_path_has_wildcard(const dicom_tag_path* path);
+
+/*
+ * A set of tag paths compiled into a deterministic automaton. A renderer keeps one state per
+ * nesting level, starting at DICOM_FILTER_ROOT. For each element the state says whether to show it
+ * with everything inside it, to skip it by its length, or to descend into its items, which get a
+ * state of their own (or DICOM_FILTER_NONE: skip the item). Inside a shown element the state is
+ * DICOM_FILTER_ALL.
+ */
+#define DICOM_FILTER_ROOT 0
+#define DICOM_FILTER_ALL (-1)
+#define DICOM_FILTER_NONE (-2)
+
+typedef enum {
+    DICOM_FILTER_SKIP,
+    DICOM_FILTER_SHOW,
+    DICOM_FILTER_DESCEND,
+} dicom_filter_action;
+
+typedef struct {
+    uint32_t item;              // DICOM_PATH_ANY_ITEM: every item without an edge of its own
+    int next;
+} dicom_filter_edge;
+
+typedef struct {
+    uint32_t tag;
+    dicom_filter_action action;
+    int first_edge;             // DESCEND: states for the items, edges [first_edge, first_edge + edge_count)
+    int edge_count;
+} dicom_filter_rule;
+
+typedef struct {
+    int first_rule;             // Sorted by tag
+    int rule_count;
+} dicom_filter_state;
+
+typedef struct {
+    dicom_filter_state* states;
+    dicom_filter_rule* rules;
+    dicom_filter_edge* edges;
+    int state_count;
+    int rule_count;
+    int edge_count;
+    bool is_nested;             // Some path has more than one step
+} dicom_filter;
+
+int dicom_filter_compile(const dicom_tag_path* paths, int count, dicom_filter* filter);
+void dicom_filter_free(dicom_filter* filter);
+
+dicom_filter_action dicom_filter_match(const dicom_filter* filter, int state, uint32_t tag);
+int dicom_filter_item(const dicom_filter* filter, int state, uint32_t tag, uint32_t item);
+
+#endif // DICOM_PATH_H
@@ -0,0 +1,29 @@
+#ifndef DICOM_REWRITE_H
+#define DICOM_REWRITE_H
+
+#include <stdint.h>
+
+/*
+ * Tools that write a new Part 10 file from an existing one. Byte ranges that do not change are
+ * copied from the source as they are (see dicom_file_copier), nothing is re-encoded.
+ */
+
+// Preamble, meta group and every top-level element before the pixel data
+int strip_pixel_data(const char* filename, const char* output);
+
+// PS3.15 basic profile, extended or overridden by an optional profile file (see dicom_rewrite.c)
+int deidentify_file(const char* filename, const char* output, const char* profile_path);
+
+typedef struct {
+    uint32_t tag;
+    const char* value;
+} dicom_value_edit;
+
+/*
+ * Patches top-level text values of the file itself. Only the value bytes are overwritten, so each new
+ * value has to fit the old value length; the rest is padded as the VR requires. All edits are checked
+ * before the first byte is written.
+ */
+int set_values_in_place(const char* filename, const dicom_value_edit* edits, int count);
+
+#endif // DICOM_REWRITE_H
@@ -0,0 +1,29 @@
+#ifndef DICOM_SCP_H
+#define DICOM_SCP_H
+
+#include <stdint.h>
+
+/*
+ * Minimal Storage SCP (PS3.7, PS3.8) for triage at the moment of receipt: association negotiation,
+ * C-ECHO and C-STORE over TCP. Received datasets are parsed from memory as the P-DATA fragments
+ * arrive and logged as one JSON object per line on stdout; nothing is written to disk. Buffering
+ * stops once the header before the pixel data is complete, the remaining fragments are only
+ * counted. Every abstract syntax is accepted.
+ *
+ * The log lines carry patient data, so by default the SCP listens on the loopback interface only
+ * and accepts any called AE title. Binding to another address exposes it to every host that can
+ * reach the port; set ae_title so that at least the called AE title has to match. Command sets are
+ * capped at 64 KiB and the buffered header at 64 MiB; an association over either is aborted.
+ */
+typedef struct {
+    int port;
+    const char* bind_address; // IPv4 address to listen on, NULL for 127.0.0.1
+    const char* ae_title;     // Called AE title associations must use, NULL to accept any
+    int threads;              // Associations served at once, 0 for one per CPU
+    const uint32_t* tags;     // Only these top-level elements in each line, NULL for all
+    int tag_count;
+} scp_options;
+
+int run_scp(const scp_options* options);
+
+#endif // DICOM_SCP_H
@@ -0,0 +1,22 @@
+#ifndef DICOM_SERVER_H
+#define DICOM_SERVER_H
+
+/*
+ * Query daemon on a Unix domain socket. The dictionary, worker threads and their warm arenas stay
+ * resident, so a lookup costs one parse instead of a process start.
+ *
+ * Each message, in both directions, is a 4-byte big-endian length followed by that many bytes.
+ * Request: a file path, optionally followed by '\n' and a tag list ("00100010;00080020").
+ * Response: one DICOM JSON object ({"path":..,"dataset":{..}} or {"path":..,"error":".."}).
+ * A connection may carry any number of requests; a zero-length request closes it, and so does the
+ * server after 5 seconds without a request, so clients should be ready to reconnect. Paths are
+ * opened with the daemon's permissions and relative to its working directory, so the socket is
+ * created with mode 0600: only the daemon's user can connect.
+ */
+typedef struct {
+    int threads;    // Connections served at once, 0 for one per CPU
+} server_options;
+
+int run_server(const char* socket_path, const server_options* options);
+
+#endif // DICOM_SERVER_H
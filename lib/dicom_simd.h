@@ -0,0 +1,42 @@
+#ifndef DICOM_SIMD_H
+#define DICOM_SIMD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * Array kernels for decoding multi-valued binary elements (US/SS/OW: 16 bit, UL/SL/FL/AT/OL/OF: 32 bit,
+ * FD/OD: 64 bit). Each call converts `count` values stored in the given byte order into native values.
+ * When the byte order matches the host this is a plain copy, otherwise the swap runs through
+ * AVX2/SSSE3 (x86) or NEON (ARM64) with a scalar fallback, picked once at runtime.
+ */
+void dicom_decode_16(const uint8_t* src, size_t count, bool little_endian, uint16_t* dst);
+void dicom_decode_32(const uint8_t* src, size_t count, bool little_endian, uint32_t* dst);
+void dicom_decode_64(const uint8_t* src, size_t count, bool little_endian, uint64_t* dst);
+
+/*
+ * Text classification for string VRs. dicom_printable_run() returns the length of the leading run of
+ * printable ASCII bytes (32-126), so callers can write whole runs at once. dicom_text_scan() classifies
+ * a span in one pass.
+ */
+typedef struct {
+    size_t nul_offset;   // Index of the first NUL byte, or the span length
+    size_t text_bytes;   // Printable ASCII plus TAB, LF and CR
+    size_t high_bytes;   // Bytes >= 0x80, zero for a pure ASCII span
+} dicom_text_scan_result;
+
+bool dicom_is_ascii(const uint8_t* data, size_t length);
+size_t dicom_printable_run(const uint8_t* data, size_t length);
+void dicom_text_scan(const uint8_t* data, size_t length, dicom_text_scan_result* result);
+
+/*
+ * Resynchronization after a corrupt element (--recover). Returns the index of the first byte pair
+ * data[i], data[i + 1] that could be the VR of an explicit VR header (two letters A-Z) or the group
+ * of an item tag (FE FF or FF FE), or `length` when there is none. Callers check each candidate.
+ */
+size_t dicom_find_header_candidate(const uint8_t* data, size_t length);
+
+const char* dicom_simd_isa(void);
+
+#endif // DICOM_SIMD_H
@@ -0,0 +1,53 @@
+#ifndef DICOM_STATS_H
+#define DICOM_STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#if defined(_MSC_VER)
+    #define DICOM_THREAD_LOCAL __declspec(thread)
+#else
+    #define DICOM_THREAD_LOCAL _Thread_local
+#endif
+
+typedef enum {
+    DICOM_PHASE_OPEN,     // fopen/mmap and the preamble check
+    DICOM_PHASE_META,     // File meta information (group 0002)
+    DICOM_PHASE_DATASET,  // Everything after the meta group
+    DICOM_PHASE_RENDER,   // Formatting and printing
+    DICOM_PHASE_COUNT
+} dicom_phase;
+
+/*
+ * Counters for one file (or a sum of files) collected while --stats is on. Counting goes to the
+ * stats installed with dicom_stats_begin() on the calling thread; with none installed every hook is
+ * a single NULL check. Read and seek counts are stdio calls for the streaming parser and one read
+ * of the whole file for the mapped one.
+ */
+typedef struct {
+    uint64_t bytes_read;
+    uint64_t read_calls;
+    uint64_t seek_calls;
+    uint64_t dict_lookups;
+    uint64_t dict_misses;
+    uint64_t elements;
+    uint64_t cache_hits;    // Files rendered from the record cache without being parsed
+    uint64_t files;
+    double phase_seconds[DICOM_PHASE_COUNT];
+    dicom_phase phase;
+    double phase_start;
+} dicom_stats;
+
+extern DICOM_THREAD_LOCAL dicom_stats* dicom_stats_current;
+
+#define DICOM_STATS_ADD(field, n) \
+    do { if (dicom_stats_current != NULL) { dicom_stats_current->field += (n); } } while (0)
+
+double dicom_stats_now(void);
+void dicom_stats_begin(dicom_stats* stats);
+void dicom_stats_end(void);
+dicom_phase dicom_stats_phase(dicom_phase phase);  // Returns the phase that was running
+void dicom_stats_add(dicom_stats* total, const dicom_stats* stats);
+void dicom_stats_print(FILE* out, const char* label, const dicom_stats* stats);
+
+#endif // DICOM_STATS_H
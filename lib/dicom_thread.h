@@ -0,0 +1,50 @@
+#ifndef DICOM_THREAD_H
+#define DICOM_THREAD_H
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <pthread.h>
+#endif
+
+/*
+ * The few threading primitives batch and watch mode need: start/join, a plain mutex and a condition
+ * variable, one-time initialization, on Win32 threads or pthreads. Nothing here is recursive or timed.
+ */
+#ifdef _WIN32
+typedef HANDLE dicom_thread;
+typedef SRWLOCK dicom_mutex;
+typedef CONDITION_VARIABLE dicom_cond;
+typedef INIT_ONCE dicom_once;
+#define DICOM_ONCE_INIT INIT_ONCE_STATIC_INIT
+#else
+typedef pthread_t dicom_thread;
+typedef pthread_mutex_t dicom_mutex;
+typedef pthread_cond_t dicom_cond;
+typedef pthread_once_t dicom_once;
+#define DICOM_ONCE_INIT PTHREAD_ONCE_INIT
+#endif
+
+typedef void (*dicom_thread_fn)(void* arg);
+
+int dicom_thread_start(dicom_thread* thread, dicom_thread_fn fn, void* arg);
+void dicom_thread_join(dicom_thread thread);
+
+void dicom_mutex_init(dicom_mutex* mutex);
+void dicom_mutex_lock(dicom_mutex* mutex);
+void dicom_mutex_unlock(dicom_mutex* mutex);
+void dicom_mutex_destroy(dicom_mutex* mutex);
+
+// Waits release the mutex while blocked; callers re-check their condition, wakeups may be spurious
+void dicom_cond_init(dicom_cond* cond);
+void dicom_cond_wait(dicom_cond* cond, dicom_mutex* mutex);
+void dicom_cond_signal(dicom_cond* cond);
+void dicom_cond_broadcast(dicom_cond* cond);
+void dicom_cond_destroy(dicom_cond* cond);
+
+// Runs fn exactly once per dicom_once (initialized with DICOM_ONCE_INIT); other callers wait for it to finish
+void dicom_once_run(dicom_once* once, void (*fn)(void));
+
+int dicom_cpu_count(void);
+
+#endif // DICOM_THREAD_H
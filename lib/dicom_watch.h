@@ -0,0 +1,19 @@
+#ifndef DICOM_WATCH_H
+#define DICOM_WATCH_H
+
+#include <stdint.h>
+
+/*
+ * Watch mode: files that are closed after writing in, or renamed into, a spool directory are
+ * parsed by a pool of worker threads as they land and reported as one JSON object per line
+ * (NDJSON) on stdout. Runs until SIGINT or SIGTERM. Needs inotify, so Linux only.
+ */
+typedef struct {
+    int threads;              // Worker threads, 0 for one per CPU
+    const uint32_t* tags;     // Only these top-level elements in each line, NULL for all
+    int tag_count;
+} watch_options;
+
+int run_watch(const char* dir, const watch_options* options);
+
+#endif // DICOM_WATCH_H
@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef DCMLOUPE_HAVE_ZLIB
+    #include <zlib.h>
+#endif
+
+#include "dicom_archive.h"
+#include "dicom_io.h"
+
+#define TAR_BLOCK 512
+#define MAX_MEMBER_NAME 4096
+#define ZIP_EOCD_SIZE 22
+#define ZIP_MAX_COMMENT 0xFFFF
+#define ZIP_LOCAL_HEADER_SIZE 30
+#define ZIP_CENTRAL_HEADER_SIZE 46
+
+static uint16_t le16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t le32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t le64(const uint8_t* p) {
+    return (uint64_t)le32(p) | ((uint64_t)le32(p + 4) << 32);
+}
+
+static bool ends_with(const char* str, const char* suffix) {
+    const size_t length = strlen(str);
+    const size_t suffix_length = strlen(suffix);
+    if (suffix_length > length) { return false; }
+
+    for (size_t i = 0; i < suffix_length; i++) {
+        if (tolower((unsigned char)str[length - suffix_length + i]) != suffix[i]) { return false; }
+    }
+    return true;
+}
+
+dicom_archive_kind dicom_archive_detect(const char* filename) {
+    if (ends_with(filename, ".zip")) { return DICOM_ARCHIVE_ZIP; }
+    if (ends_with(filename, ".tar")) { return DICOM_ARCHIVE_TAR; }
+    if (ends_with(filename, ".tar.gz") || ends_with(filename, ".tgz")) { return DICOM_ARCHIVE_TAR_GZ; }
+    if (ends_with(filename, ".tar.zst") || ends_with(filename, ".tzst")) { return DICOM_ARCHIVE_TAR_ZSTD; }
+    return DICOM_ARCHIVE_NONE;
+}
+
+/*
+ * Zip: the central directory at the end lists every member with its local header offset; members
+ * are read from there, never by scanning local headers (which may lack sizes when streamed).
+ */
+typedef struct {
+    uint64_t entries;
+    uint64_t directory_offset;
+    uint64_t directory_size;
+} zip_directory;
+
+// Whether [offset, offset + length) lies inside `size` bytes; offsets from the archive can be anything up to 2^64-1
+static bool fits(const uint64_t offset, const uint64_t length, const uint64_t size) {
+    return offset <= size && length <= size - offset;
+}
+
+static int find_zip_directory(const uint8_t* data, const size_t size, zip_directory* dir) {
+    if (size < ZIP_EOCD_SIZE) { return -1; }
+
+    // The end of central directory record is followed only by the archive comment
+    size_t eocd = size - ZIP_EOCD_SIZE;
+    const size_t lowest = size > ZIP_EOCD_SIZE + ZIP_MAX_COMMENT ? size - ZIP_EOCD_SIZE - ZIP_MAX_COMMENT : 0;
+    while (le32(data + eocd) != 0x06054B50) {
+        if (eocd == lowest) { return -1; }
+        eocd--;
+    }
+
+    dir->entries = le16(data + eocd + 10);
+    dir->directory_size = le32(data + eocd + 12);
+    dir->directory_offset = le32(data + eocd + 16);
+
+    // Zip64: the locator right before the record points at the 64-bit end of central directory
+    if (eocd >= 20 && le32(data + eocd - 20) == 0x07064B50) {
+        const uint64_t zip64 = le64(data + eocd - 20 + 8);
+        if (fits(zip64, 56, size) && le32(data + zip64) == 0x06064B50) {
+            dir->entries = le64(data + zip64 + 32);
+            dir->directory_size = le64(data + zip64 + 40);
+            dir->directory_offset = le64(data + zip64 + 48);
+        }
+    }
+
+    return fits(dir->directory_offset, dir->directory_size, size) ? 0 : -1;
+}
+
+// Sizes and offset saturated at 0xFFFFFFFF are in the Zip64 extra field, in this order
+static void read_zip64_extra(const uint8_t* extra, const size_t length, uint64_t* uncompressed, uint64_t* compressed,
+                             uint64_t* offset) {
+    size_t pos = 0;
+    while (pos + 4 <= length) {
+        const uint16_t id = le16(extra + pos);
+        const uint16_t field_length = le16(extra + pos + 2);
+        const uint8_t* field = extra + pos + 4;
+        if (pos + 4 + field_length > length) { return; }
+
+        if (id == 0x0001) {
+            size_t f = 0;
+            if (*uncompressed == 0xFFFFFFFF && f + 8 <= field_length) { *uncompressed = le64(field + f); f += 8; }
+            if (*compressed == 0xFFFFFFFF && f + 8 <= field_length) { *compressed = le64(field + f); f += 8; }
+            if (*offset == 0xFFFFFFFF && f + 8 <= field_length) { *offset = le64(field + f); }
+            return;
+        }
+        pos += 4 + (size_t)field_length;
+    }
+}
+
+#ifdef DCMLOUPE_HAVE_ZLIB
+static uint8_t* inflate_member(const uint8_t* data, const uint64_t compressed, const uint64_t uncompressed) {
+    if (uncompressed > SIZE_MAX - 1 || compressed > UINT32_MAX || uncompressed > UINT32_MAX) { return NULL; }
+
+    uint8_t* out = (uint8_t*)malloc((size_t)uncompressed + 1);
+    if (out == NULL) { return NULL; }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {  // Raw deflate, zip has no zlib header
+        free(out);
+        return NULL;
+    }
+    stream.next_in = (Bytef*)data;
+    stream.avail_in = (uInt)compressed;
+    stream.next_out = out;
+    stream.avail_out = (uInt)uncompressed;
+
+    const int status = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    if (status != Z_STREAM_END || stream.total_out != uncompressed) {
+        free(out);
+        return NULL;
+    }
+    return out;
+}
+#endif
+
+static int foreach_zip_member(const char* filename, const uint8_t* data, const size_t size, const dicom_member_fn fn,
+                              void* user) {
+    zip_directory dir;
+    if (find_zip_directory(data, size, &dir) != 0) {
+        fprintf(stderr, "Error: '%s' is not a zip archive (no central directory)\n", filename);
+        return -1;
+    }
+
+    char name[MAX_MEMBER_NAME];
+    uint64_t pos = dir.directory_offset;
+    const uint64_t end = dir.directory_offset + dir.directory_size;
+
+    for (uint64_t i = 0; i < dir.entries; i++) {
+        if (!fits(pos, ZIP_CENTRAL_HEADER_SIZE, end) || le32(data + pos) != 0x02014B50) {
+            fprintf(stderr, "Error: Corrupt zip central directory in '%s'\n", filename);
+            return -1;
+        }
+
+        const uint8_t* entry = data + pos;
+        const uint16_t flags = le16(entry + 8);
+        const uint16_t method = le16(entry + 10);
+        uint64_t compressed = le32(entry + 20);
+        uint64_t uncompressed = le32(entry + 24);
+        const uint16_t name_length = le16(entry + 28);
+        const uint16_t extra_length = le16(entry + 30);
+        const uint16_t comment_length = le16(entry + 32);
+        uint64_t local = le32(entry + 42);
+        if (!fits(pos, ZIP_CENTRAL_HEADER_SIZE + (uint64_t)name_length + extra_length + comment_length, end)) {
+            fprintf(stderr, "Error: Corrupt zip central directory in '%s'\n", filename);
+            return -1;
+        }
+
+        const uint8_t* raw_name = entry + ZIP_CENTRAL_HEADER_SIZE;
+        snprintf(name, sizeof(name), "%.*s", (int)name_length, (const char*)raw_name);
+        read_zip64_extra(entry + ZIP_CENTRAL_HEADER_SIZE + name_length, extra_length, &uncompressed, &compressed, &local);
+        pos += ZIP_CENTRAL_HEADER_SIZE + (uint64_t)name_length + extra_length + comment_length;
+
+        if (name_length == 0 || raw_name[name_length - 1] == '/') { continue; }  // Directory entry
+
+        if (!fits(local, ZIP_LOCAL_HEADER_SIZE, size) || le32(data + local) != 0x04034B50) {
+            fprintf(stderr, "Warning: Skipping '%s': bad local header\n", name);
+            continue;
+        }
+        const uint64_t start = local + ZIP_LOCAL_HEADER_SIZE + le16(data + local + 26) + le16(data + local + 28);
+        if (!fits(start, compressed, size)) {
+            fprintf(stderr, "Warning: Skipping '%s': member extends past the end of the archive\n", name);
+            continue;
+        }
+        if (flags & 0x0001) {
+            fprintf(stderr, "Warning: Skipping '%s': encrypted\n", name);
+            continue;
+        }
+
+        int result = 0;
+        if (method == 0) { result = fn(name, data + start, (size_t)compressed, user); }  // Stored: zero-copy
+#ifdef DCMLOUPE_HAVE_ZLIB
+        else if (method == 8) {
+            uint8_t* member = inflate_member(data + start, compressed, uncompressed);
+            if (member == NULL) {
+                fprintf(stderr, "Warning: Skipping '%s': cannot inflate\n", name);
+                continue;
+            }
+            result = fn(name, member, (size_t)uncompressed, user);
+            free(member);
+        }
+#endif
+        else {
+            fprintf(stderr, "Warning: Skipping '%s': compression method %u is not supported\n", name, method);
+            continue;
+        }
+        if (result != 0) { return result; }
+    }
+    return 0;
+}
+
+/*
+ * Tar is a sequence of 512-byte headers, each followed by the member padded to 512 bytes. Reads
+ * come straight from the mapping for plain tars and through a reused buffer for gzip.
+ */
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    size_t pos;
+#ifdef DCMLOUPE_HAVE_ZLIB
+    gzFile gz;
+#endif
+    uint8_t* buffer;
+    size_t capacity;
+} tar_reader;
+
+static const uint8_t* tar_read(tar_reader* reader, const uint64_t length) {
+#ifdef DCMLOUPE_HAVE_ZLIB
+    if (reader->gz != NULL) {
+        if (length > SIZE_MAX / 2) { return NULL; }
+        if (length > reader->capacity) {
+            uint8_t* grown = (uint8_t*)realloc(reader->buffer, (size_t)length);
+            if (grown == NULL) { return NULL; }
+            reader->buffer = grown;
+            reader->capacity = (size_t)length;
+        }
+
+        uint64_t done = 0;
+        while (done < length) {
+            const unsigned chunk = length - done < 0x40000000 ? (unsigned)(length - done) : 0x40000000u;
+            const int n = gzread(reader->gz, reader->buffer + done, chunk);
+            if (n <= 0) { return NULL; }
+            done += (uint64_t)n;
+        }
+        return reader->buffer;
+    }
+#endif
+    if (length > reader->size - reader->pos) { return NULL; }
+    const uint8_t* p = reader->data + reader->pos;
+    reader->pos += (size_t)length;
+    return p;
+}
+
+// Octal, or base-256 with the high bit set for sizes that do not fit 11 octal digits
+static uint64_t tar_number(const uint8_t* field, const size_t length) {
+    uint64_t value = 0;
+    if (field[0] & 0x80) {
+        for (size_t i = 1; i < length; i++) { value = (value << 8) | field[i]; }
+        return value;
+    }
+    for (size_t i = 0; i < length && field[i] >= '0' && field[i] <= '7'; i++) { value = value * 8 + (uint64_t)(field[i] - '0'); }
+    return value;
+}
+
+static bool tar_checksum_ok(const uint8_t* header) {
+    uint64_t sum = 0;
+    for (int i = 0; i < TAR_BLOCK; i++) { sum += i >= 148 && i < 156 ? (uint8_t)' ' : header[i]; }
+    size_t start = 148;
+    while (start < 156 && header[start] == ' ') { start++; }
+    return tar_number(header + start, 156 - start) == sum;
+}
+
+// "<length> path=<name>\n" records of a pax extended header
+static void pax_path(const uint8_t* data, const size_t size, char* name, const size_t name_size) {
+    size_t pos = 0;
+    while (pos < size) {
+        size_t record_length = 0;
+        size_t p = pos;
+        while (p < size && data[p] >= '0' && data[p] <= '9') { record_length = record_length * 10 + (size_t)(data[p++] - '0'); }
+        if (record_length == 0 || record_length > size - pos) { return; }
+
+        const char* record = (const char*)data + p + 1;
+        const size_t record_end = pos + record_length - 1;  // Without the newline
+        if (p + 6 <= record_end && strncmp(record, "path=", 5) == 0) {
+            snprintf(name, name_size, "%.*s", (int)(record_end - (p + 6)), record + 5);
+        }
+        pos += record_length;
+    }
+}
+
+static int foreach_tar_member(const char* filename, tar_reader* reader, const dicom_member_fn fn, void* user) {
+    char name[MAX_MEMBER_NAME];
+    char long_name[MAX_MEMBER_NAME] = "";
+
+    for (;;) {
+        const uint8_t* header = tar_read(reader, TAR_BLOCK);
+        if (header == NULL) {
+            fprintf(stderr, "Warning: '%s' ends without an end-of-archive marker\n", filename);
+            return 0;
+        }
+
+        bool zero = true;
+        for (int i = 0; i < TAR_BLOCK && zero; i++) { zero = header[i] == 0; }
+        if (zero) { return 0; }
+
+        if (!tar_checksum_ok(header)) {
+            fprintf(stderr, "Error: Bad tar header checksum in '%s'\n", filename);
+            return -1;
+        }
+
+        // Copy what is needed before the next read reuses the buffer
+        const uint64_t size = tar_number(header + 124, 12);
+        const char type = (char)header[156];
+        if (long_name[0] != '\0') { snprintf(name, sizeof(name), "%s", long_name); }
+        else if (memcmp(header + 257, "ustar", 5) == 0 && header[345] != '\0') {
+            snprintf(name, sizeof(name), "%.155s/%.100s", (const char*)header + 345, (const char*)header);
+        }
+        else { snprintf(name, sizeof(name), "%.100s", (const char*)header); }
+
+        const uint8_t* data = tar_read(reader, size);
+        const uint64_t padding = (TAR_BLOCK - size % TAR_BLOCK) % TAR_BLOCK;
+        if (data == NULL) {
+            fprintf(stderr, "Warning: '%s' is truncated in member '%s'\n", filename, name);
+            return 0;
+        }
+
+        int result = 0;
+        if (type == 'L') {  // GNU long name for the next member
+            snprintf(long_name, sizeof(long_name), "%.*s", (int)(size < sizeof(long_name) ? size : sizeof(long_name) - 1), (const char*)data);
+            if (tar_read(reader, padding) == NULL && padding > 0) { return 0; }
+            continue;
+        }
+        if (type == 'x') {
+            pax_path(data, (size_t)size, long_name, sizeof(long_name));
+            if (tar_read(reader, padding) == NULL && padding > 0) { return 0; }
+            continue;
+        }
+        if (type == '0' || type == '\0' || type == '7') { result = fn(name, data, (size_t)size, user); }
+
+        long_name[0] = '\0';
+        if (result != 0) { return result; }
+        if (padding > 0 && tar_read(reader, padding) == NULL) { return 0; }
+    }
+}
+
+int dicom_archive_foreach(const char* filename, const dicom_member_fn fn, void* user) {
+    const dicom_archive_kind kind = dicom_archive_detect(filename);
+
+    if (kind == DICOM_ARCHIVE_TAR_ZSTD) {
+        fprintf(stderr, "Error: '%s': zstd-compressed tar is not supported, decompress it with zstd -d first\n", filename);
+        return -1;
+    }
+
+    if (kind == DICOM_ARCHIVE_TAR_GZ) {
+#ifdef DCMLOUPE_HAVE_ZLIB
+        tar_reader reader = {0};
+        reader.gz = gzopen(filename, "rb");
+        if (reader.gz == NULL) {
+            fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
+            return -1;
+        }
+        gzbuffer(reader.gz, 256 * 1024);
+        const int result = foreach_tar_member(filename, &reader, fn, user);
+        gzclose(reader.gz);
+        free(reader.buffer);
+        return result;
+#else
+        fprintf(stderr, "Error: '%s': this build has no zlib, gzip-compressed tar is not supported\n", filename);
+        return -1;
+#endif
+    }
+
+    dicom_file_map map;
+    if (dicom_file_map_open(filename, &map) != 0) {
+        fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
+        return -1;
+    }
+
+    int result;
+    if (kind == DICOM_ARCHIVE_ZIP) { result = foreach_zip_member(filename, map.data, map.size, fn, user); }
+    else {
+        tar_reader reader = {0};
+        reader.data = map.data;
+        reader.size = map.size;
+        result = foreach_tar_member(filename, &reader, fn, user);
+    }
+
+    dicom_file_map_close(&map);
+    return result;
+}
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "dicom_arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_HEADER_SIZE ((sizeof(dicom_arena_block) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+static uint8_t* block_data(dicom_arena_block* block) { return (uint8_t*)block + ARENA_HEADER_SIZE; }
+
+static dicom_arena_block* new_block(const size_t min_capacity) {
+    const size_t capacity = min_capacity > DICOM_ARENA_BLOCK_SIZE ? min_capacity : DICOM_ARENA_BLOCK_SIZE;
+    dicom_arena_block* block = (dicom_arena_block*)malloc(ARENA_HEADER_SIZE + capacity);
+    if (block == NULL) { return NULL; }
+
+    block->next = NULL;
+    block->capacity = capacity;
+    block->used = 0;
+    return block;
+}
+
+void dicom_arena_init(dicom_arena* arena) {
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+void* dicom_arena_alloc(dicom_arena* arena, size_t size) {
+    if (size == 0) { size = 1; }
+    if (size > SIZE_MAX - ARENA_HEADER_SIZE - ARENA_ALIGN) { return NULL; }
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    dicom_arena_block* block = arena->current;
+    if (block != NULL && block->capacity - block->used >= size) {
+        void* ptr = block_data(block) + block->used;
+        block->used += size;
+        return ptr;
+    }
+
+    // Blocks after the current one are free (left over from a reset/restore), reuse the first that fits
+    dicom_arena_block* prev = block;
+    dicom_arena_block* next = block != NULL ? block->next : arena->first;
+    while (next != NULL && next->capacity < size) {
+        prev = next;
+        next = next->next;
+    }
+
+    if (next == NULL) {
+        next = new_block(size);
+        if (next == NULL) { return NULL; }
+
+        if (prev == NULL) { arena->first = next; }
+        else { prev->next = next; }
+    }
+
+    next->used = size;
+    arena->current = next;
+    return block_data(next);
+}
+
+char* dicom_arena_strndup(dicom_arena* arena, const char* str, const size_t length) {
+    char* copy = (char*)dicom_arena_alloc(arena, length + 1);
+    if (copy == NULL) { return NULL; }
+
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+dicom_arena_mark dicom_arena_save(const dicom_arena* arena) {
+    return (dicom_arena_mark){
+        .block = arena->current,
+        .used = arena->current != NULL ? arena->current->used : 0,
+    };
+}
+
+void dicom_arena_restore(dicom_arena* arena, const dicom_arena_mark mark) {
+    if (mark.block == NULL) {
+        dicom_arena_reset(arena);
+        return;
+    }
+
+    arena->current = mark.block;
+    mark.block->used = mark.used;
+}
+
+void dicom_arena_reset(dicom_arena* arena) {
+    arena->current = arena->first;
+    if (arena->first != NULL) { arena->first->used = 0; }
+}
+
+void dicom_arena_free(dicom_arena* arena) {
+    dicom_arena_block* block = arena->first;
+    while (block != NULL) {
+        dicom_arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->first = NULL;
+    arena->current = NULL;
+}
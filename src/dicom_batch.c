@@ -0,0 +1,618 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <dirent.h>
+    #include <sys/stat.h>
+#endif
+
+#include "dicom_batch.h"
+#include "dicom_arena.h"
+#include "dicom_dataset.h"
+#include "dicom_hash.h"
+#include "dicom_numeric.h"
+#include "dicom_thread.h"
+
+#define BATCH_SHARDS 64         // Power of two; the top bits of a key hash pick the shard
+#define BATCH_CHUNK 8           // Files a worker takes per trip to the queue
+#define BATCH_NO_FILE UINT32_MAX
+#define BATCH_MAX_GAP_RANGES 20
+#define TAG_SOP_INSTANCE_UID 0x00080018
+#define TAG_MODALITY 0x00080060
+#define TAG_STUDY_INSTANCE_UID 0x0020000D
+#define TAG_SERIES_INSTANCE_UID 0x0020000E
+#define TAG_INSTANCE_NUMBER 0x00200013
+
+typedef struct {
+    char** paths;
+    size_t count;
+    size_t capacity;
+} file_list;
+
+/*
+ * Concurrent multiset of string keys. Each shard is an open-addressing table behind its own mutex,
+ * with the keys in its own arena. Files that share a key are chained through `next`, which is
+ * indexed by file and only written for the file being inserted.
+ */
+typedef struct {
+    uint64_t hash;
+    const char* key;
+    uint32_t first_file;
+    uint32_t file_count;
+} key_entry;
+
+typedef struct {
+    dicom_mutex mutex;
+    key_entry* entries;
+    size_t capacity;
+    size_t count;
+    dicom_arena keys;
+} key_shard;
+
+typedef struct {
+    key_shard shards[BATCH_SHARDS];
+    uint32_t* next;
+} key_set;
+
+// What the hierarchy report needs of each file; written only by the worker that parsed it
+typedef struct {
+    uint64_t size;
+    int64_t instance_number;
+    bool has_instance_number;
+    char modality[17];
+} file_record;
+
+typedef struct {
+    const batch_options* options;
+    const file_list* files;
+    uint32_t stop_tag;
+    key_set uids;
+    key_set pixels;
+    key_set series;
+    file_record* records;
+
+    dicom_mutex mutex;      // Guards everything below
+    size_t next_file;
+    size_t parsed;
+    size_t not_dicom;
+    size_t unsorted;        // Files without a Study or Series Instance UID
+    dicom_stats* stats;
+} batch_job;
+
+static int add_file(file_list* list, const char* path) {
+    if (list->count == list->capacity) {
+        const size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        char** grown = (char**)realloc(list->paths, capacity * sizeof(char*));
+        if (grown == NULL) { return -1; }
+        list->paths = grown;
+        list->capacity = capacity;
+    }
+
+    const size_t length = strlen(path);
+    char* copy = (char*)malloc(length + 1);
+    if (copy == NULL) { return -1; }
+    memcpy(copy, path, length + 1);
+    list->paths[list->count++] = copy;
+    return 0;
+}
+
+static void free_files(file_list* list) {
+    for (size_t i = 0; i < list->count; i++) { free(list->paths[i]); }
+    free(list->paths);
+}
+
+#ifdef _WIN32
+static int collect_files(file_list* list, const char* path) {
+    const DWORD attributes = GetFileAttributesA(path);
+    if (attributes == INVALID_FILE_ATTRIBUTES) {
+        fprintf(stderr, "Warning: Cannot access '%s'\n", path);
+        return 0;
+    }
+    if ((attributes & FILE_ATTRIBUTE_DIRECTORY) == 0) { return add_file(list, path); }
+
+    char pattern[MAX_PATH];
+    snprintf(pattern, sizeof(pattern), "%s\\*", path);
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(pattern, &entry);
+    if (find == INVALID_HANDLE_VALUE) { return 0; }
+
+    int result = 0;
+    do {
+        if (strcmp(entry.cFileName, ".") == 0 || strcmp(entry.cFileName, "..") == 0) { continue; }
+        if (entry.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) { continue; }  // No junction loops
+
+        char child[MAX_PATH];
+        snprintf(child, sizeof(child), "%s\\%s", path, entry.cFileName);
+        result = collect_files(list, child);
+    } while (result == 0 && FindNextFileA(find, &entry));
+
+    FindClose(find);
+    return result;
+}
+#else
+static int collect_files(file_list* list, const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Warning: Cannot access '%s'\n", path);
+        return 0;
+    }
+    if (S_ISREG(st.st_mode)) { return add_file(list, path); }
+    if (!S_ISDIR(st.st_mode)) { return 0; }
+
+    DIR* dir = opendir(path);
+    if (dir == NULL) {
+        fprintf(stderr, "Warning: Cannot open directory '%s'\n", path);
+        return 0;
+    }
+
+    int result = 0;
+    const struct dirent* entry;
+    while (result == 0 && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) { continue; }
+
+        const size_t length = strlen(path) + strlen(entry->d_name) + 2;
+        char* child = (char*)malloc(length);
+        if (child == NULL) {
+            result = -1;
+            break;
+        }
+        snprintf(child, length, "%s/%s", path, entry->d_name);
+
+        // Symlinked directories are skipped so that a link back up cannot loop
+        struct stat link;
+        if (lstat(child, &link) == 0 && S_ISLNK(link.st_mode) && stat(child, &st) == 0 && S_ISDIR(st.st_mode)) {
+            free(child);
+            continue;
+        }
+        result = collect_files(list, child);
+        free(child);
+    }
+
+    closedir(dir);
+    return result;
+}
+#endif
+
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static int key_set_init(key_set* set, const size_t file_count) {
+    set->next = (uint32_t*)malloc((file_count + 1) * sizeof(uint32_t));
+    if (set->next == NULL) { return -1; }
+
+    for (int i = 0; i < BATCH_SHARDS; i++) {
+        key_shard* shard = &set->shards[i];
+        dicom_mutex_init(&shard->mutex);
+        dicom_arena_init(&shard->keys);
+        shard->entries = NULL;
+        shard->capacity = 0;
+        shard->count = 0;
+    }
+    return 0;
+}
+
+// Also safe on a zeroed set whose key_set_init failed or never ran
+static void key_set_free(key_set* set) {
+    if (set->next == NULL) { return; }
+    for (int i = 0; i < BATCH_SHARDS; i++) {
+        key_shard* shard = &set->shards[i];
+        dicom_mutex_destroy(&shard->mutex);
+        dicom_arena_free(&shard->keys);
+        free(shard->entries);
+    }
+    free(set->next);
+}
+
+static key_entry* find_slot(key_entry* entries, const size_t capacity, const uint64_t hash, const char* key) {
+    size_t i = (size_t)hash & (capacity - 1);
+    while (entries[i].key != NULL && (entries[i].hash != hash || strcmp(entries[i].key, key) != 0)) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &entries[i];
+}
+
+static int grow_shard(key_shard* shard) {
+    const size_t capacity = shard->capacity ? shard->capacity * 2 : 64;
+    key_entry* entries = (key_entry*)calloc(capacity, sizeof(key_entry));
+    if (entries == NULL) { return -1; }
+
+    for (size_t i = 0; i < shard->capacity; i++) {
+        const key_entry* old = &shard->entries[i];
+        if (old->key != NULL) { *find_slot(entries, capacity, old->hash, old->key) = *old; }
+    }
+    free(shard->entries);
+    shard->entries = entries;
+    shard->capacity = capacity;
+    return 0;
+}
+
+static int key_set_add(key_set* set, const char* key, const uint32_t file) {
+    const size_t length = strlen(key);
+    dicom_xxh64 state;
+    dicom_xxh64_init(&state, 0);
+    dicom_xxh64_update(&state, key, length);
+    const uint64_t hash = dicom_xxh64_digest(&state);
+    key_shard* shard = &set->shards[hash >> 58];
+    int result = 0;
+
+    dicom_mutex_lock(&shard->mutex);
+    if ((shard->count + 1) * 4 > shard->capacity * 3) { result = grow_shard(shard); }
+
+    if (result == 0) {
+        key_entry* entry = find_slot(shard->entries, shard->capacity, hash, key);
+        if (entry->key == NULL) {
+            entry->key = dicom_arena_strndup(&shard->keys, key, length);
+            if (entry->key == NULL) { result = -1; }
+            else {
+                entry->hash = hash;
+                entry->first_file = BATCH_NO_FILE;
+                entry->file_count = 0;
+                shard->count++;
+            }
+        }
+        if (result == 0) {
+            set->next[file] = entry->first_file;
+            entry->first_file = file;
+            entry->file_count++;
+        }
+    }
+    dicom_mutex_unlock(&shard->mutex);
+    return result;
+}
+
+static int compare_files(const void* a, const void* b) {
+    const uint32_t fa = *(const uint32_t*)a;
+    const uint32_t fb = *(const uint32_t*)b;
+    return fa < fb ? -1 : fa > fb;
+}
+
+typedef struct {
+    const key_entry* entry;
+    uint32_t* files;  // Sorted, so members print in path order
+} key_group;
+
+typedef struct {
+    key_group* groups;
+    size_t count;
+    uint32_t* members;  // Backing store of every group's files
+} group_list;
+
+static int compare_groups_by_file(const void* a, const void* b) {
+    return compare_files(((const key_group*)a)->files, ((const key_group*)b)->files);
+}
+
+static int compare_groups_by_key(const void* a, const void* b) {
+    return strcmp(((const key_group*)a)->entry->key, ((const key_group*)b)->entry->key);
+}
+
+// Keys with at least min_files files, each with its files resolved from the chain
+static int collect_groups(const key_set* set, const size_t file_count, const uint32_t min_files,
+                          int (*compare)(const void*, const void*), group_list* list) {
+    list->count = 0;
+    list->groups = NULL;
+    list->members = NULL;
+    for (int s = 0; s < BATCH_SHARDS; s++) {
+        for (size_t i = 0; i < set->shards[s].capacity; i++) {
+            if (set->shards[s].entries[i].key != NULL && set->shards[s].entries[i].file_count >= min_files) {
+                list->count++;
+            }
+        }
+    }
+    if (list->count == 0) { return 0; }
+
+    list->groups = (key_group*)malloc(list->count * sizeof(key_group));
+    list->members = (uint32_t*)malloc(file_count * sizeof(uint32_t));
+    if (list->groups == NULL || list->members == NULL) {
+        fprintf(stderr, "Error: Out of memory while building the report\n");
+        free(list->groups);
+        free(list->members);
+        list->count = 0;
+        return -1;
+    }
+
+    size_t g = 0;
+    size_t used = 0;
+    for (int s = 0; s < BATCH_SHARDS; s++) {
+        for (size_t i = 0; i < set->shards[s].capacity; i++) {
+            const key_entry* entry = &set->shards[s].entries[i];
+            if (entry->key == NULL || entry->file_count < min_files) { continue; }
+
+            list->groups[g].entry = entry;
+            list->groups[g].files = list->members + used;
+            for (uint32_t f = entry->first_file; f != BATCH_NO_FILE; f = set->next[f]) { list->members[used++] = f; }
+            qsort(list->groups[g].files, entry->file_count, sizeof(uint32_t), compare_files);
+            g++;
+        }
+    }
+    qsort(list->groups, list->count, sizeof(key_group), compare);
+    return 0;
+}
+
+static void free_groups(group_list* list) {
+    free(list->groups);
+    free(list->members);
+}
+
+// Prints every key shared by more than one file; returns the number of such keys
+static size_t report_duplicates(const key_set* set, const file_list* files, const char* label,
+                                size_t* duplicate_files) {
+    group_list list;
+    if (collect_groups(set, files->count, 2, compare_groups_by_file, &list) != 0) { return 0; }
+
+    for (size_t i = 0; i < list.count; i++) {
+        const key_group* group = &list.groups[i];
+        printf("Duplicate %s %s (%u files)\n", label, group->entry->key, group->entry->file_count);
+        for (uint32_t f = 0; f < group->entry->file_count; f++) { printf("    %s\n", files->paths[group->files[f]]); }
+        *duplicate_files += group->entry->file_count;
+    }
+
+    free_groups(&list);
+    return list.count;
+}
+
+static int compare_numbers(const void* a, const void* b) {
+    const int64_t na = *(const int64_t*)a;
+    const int64_t nb = *(const int64_t*)b;
+    return na < nb ? -1 : na > nb;
+}
+
+// Instance numbers missing between the lowest and highest one, as ranges ("5,7-9")
+static void print_gaps(const int64_t* numbers, const size_t count) {
+    int printed = 0;
+    for (size_t i = 1; i < count; i++) {
+        if (numbers[i] <= numbers[i - 1] + 1) { continue; }
+        if (printed == BATCH_MAX_GAP_RANGES) {
+            printf(",...");
+            return;
+        }
+
+        const int64_t first = numbers[i - 1] + 1;
+        const int64_t last = numbers[i] - 1;
+        printf("%s%lld", printed++ > 0 ? "," : "", (long long)first);
+        if (last > first) { printf("-%lld", (long long)last); }
+    }
+    if (printed == 0) { printf("none"); }
+}
+
+static void print_series(const key_group* group, const file_record* records, int64_t* numbers) {
+    const char* series_uid = strchr(group->entry->key, '/') + 1;
+    const char* modality = "";
+    bool mixed_modality = false;
+    uint64_t bytes = 0;
+    size_t number_count = 0;
+    size_t repeated = 0;
+
+    for (uint32_t i = 0; i < group->entry->file_count; i++) {
+        const file_record* record = &records[group->files[i]];
+        bytes += record->size;
+        if (record->has_instance_number) { numbers[number_count++] = record->instance_number; }
+        if (record->modality[0] == '\0') { continue; }
+        if (modality[0] == '\0') { modality = record->modality; }
+        else if (strcmp(modality, record->modality) != 0) { mixed_modality = true; }
+    }
+    qsort(numbers, number_count, sizeof(int64_t), compare_numbers);
+    for (size_t i = 1; i < number_count; i++) { repeated += numbers[i] == numbers[i - 1]; }
+
+    printf("    Series %s modality=%s instances=%u bytes=%llu", series_uid,
+           mixed_modality ? "mixed" : modality[0] != '\0' ? modality : "-", group->entry->file_count,
+           (unsigned long long)bytes);
+    if (number_count > 0) {
+        printf(" numbers=%lld-%lld missing=", (long long)numbers[0], (long long)numbers[number_count - 1]);
+        print_gaps(numbers, number_count);
+    }
+    if (number_count < group->entry->file_count) { printf(" unnumbered=%zu", group->entry->file_count - number_count); }
+    if (repeated > 0) { printf(" repeated_numbers=%zu", repeated); }
+    printf("\n");
+}
+
+// Series keys are "<study>/<series>", so sorting by key lines up each study's series
+static void report_hierarchy(const key_set* set, const file_list* files, const file_record* records,
+                             size_t* study_count, size_t* series_count) {
+    group_list list;
+    int64_t* numbers = (int64_t*)malloc((files->count + 1) * sizeof(int64_t));
+    if (numbers == NULL || collect_groups(set, files->count, 1, compare_groups_by_key, &list) != 0) {
+        free(numbers);
+        return;
+    }
+
+    for (size_t i = 0; i < list.count;) {
+        const char* key = list.groups[i].entry->key;
+        const size_t study_length = (size_t)(strchr(key, '/') - key);
+        size_t end = i;
+        uint64_t instances = 0;
+        uint64_t bytes = 0;
+
+        for (; end < list.count && strncmp(list.groups[end].entry->key, key, study_length + 1) == 0; end++) {
+            instances += list.groups[end].entry->file_count;
+            for (uint32_t f = 0; f < list.groups[end].entry->file_count; f++) { bytes += records[list.groups[end].files[f]].size; }
+        }
+
+        printf("Study %.*s series=%zu instances=%llu bytes=%llu\n", (int)study_length, key, end - i,
+               (unsigned long long)instances, (unsigned long long)bytes);
+        for (; i < end; i++) { print_series(&list.groups[i], records, numbers); }
+        (*study_count)++;
+    }
+
+    *series_count = list.count;
+    free_groups(&list);
+    free(numbers);
+}
+
+static size_t node_text(const dicom_dataset* ds, const uint32_t tag, char* buffer, const size_t size) {
+    const dicom_node* node = dicom_dataset_find(&ds->root, tag);
+    if (node != NULL) { return dicom_node_string(ds, node, buffer, size); }
+    buffer[0] = '\0';
+    return 0;
+}
+
+static void index_series(batch_job* job, const dicom_dataset* ds, const uint32_t file, size_t* unsorted) {
+    file_record* record = &job->records[file];
+    char number[17];
+    char study[65];
+    char series[65];
+    char key[sizeof(study) + sizeof(series)];
+
+    record->size = ds->size;
+    node_text(ds, TAG_MODALITY, record->modality, sizeof(record->modality));
+    const size_t number_length = node_text(ds, TAG_INSTANCE_NUMBER, number, sizeof(number));
+    record->has_instance_number = number_length > 0 && dicom_parse_int64(number, number_length, &record->instance_number);
+
+    if (node_text(ds, TAG_STUDY_INSTANCE_UID, study, sizeof(study)) == 0 ||
+        node_text(ds, TAG_SERIES_INSTANCE_UID, series, sizeof(series)) == 0) {
+        (*unsorted)++;
+        return;
+    }
+
+    snprintf(key, sizeof(key), "%s/%s", study, series);
+    if (key_set_add(&job->series, key, file) != 0) {
+        fprintf(stderr, "Error: Out of memory while indexing '%s'\n", job->files->paths[file]);
+    }
+}
+
+static void process_file(batch_job* job, const uint32_t file, dicom_arena* arena, size_t* parsed, size_t* not_dicom,
+                         size_t* unsorted) {
+    dicom_arena_reset(arena);
+
+    dicom_dataset ds;
+    if (dicom_dataset_load_until(job->files->paths[file], job->stop_tag, arena, &ds) != 0) {
+        (*not_dicom)++;
+        return;
+    }
+    (*parsed)++;
+
+    char uid[65];
+    const dicom_node* node = dicom_dataset_find(&ds.root, TAG_SOP_INSTANCE_UID);
+    if (job->options->find_duplicates && node != NULL && dicom_node_string(&ds, node, uid, sizeof(uid)) > 0 &&
+        key_set_add(&job->uids, uid, file) != 0) {
+        fprintf(stderr, "Error: Out of memory while indexing '%s'\n", job->files->paths[file]);
+    }
+
+    if (job->options->build_hierarchy) { index_series(job, &ds, file, unsorted); }
+
+    uint64_t digest, bytes;
+    if (job->options->hash_pixels && dicom_pixel_data_hash(&ds, &digest, &bytes) == 0) {
+        char key[48];
+        snprintf(key, sizeof(key), "xxh64:%016llx/%llu", (unsigned long long)digest, (unsigned long long)bytes);
+        if (key_set_add(&job->pixels, key, file) != 0) {
+            fprintf(stderr, "Error: Out of memory while indexing '%s'\n", job->files->paths[file]);
+        }
+    }
+
+    dicom_dataset_close(&ds);
+}
+
+static void batch_worker(void* arg) {
+    batch_job* job = (batch_job*)arg;
+    dicom_arena arena;
+    dicom_arena_init(&arena);
+    dicom_stats thread_stats = {0};
+    size_t parsed = 0;
+    size_t not_dicom = 0;
+    size_t unsorted = 0;
+
+    for (;;) {
+        dicom_mutex_lock(&job->mutex);
+        const size_t first = job->next_file;
+        job->next_file = first + BATCH_CHUNK < job->files->count ? first + BATCH_CHUNK : job->files->count;
+        const size_t last = job->next_file;
+        dicom_mutex_unlock(&job->mutex);
+        if (first == last) { break; }
+
+        for (size_t i = first; i < last; i++) {
+            dicom_stats stats;
+            if (job->options->collect_stats) { dicom_stats_begin(&stats); }
+            process_file(job, (uint32_t)i, &arena, &parsed, &not_dicom, &unsorted);
+            if (job->options->collect_stats) {
+                dicom_stats_end();
+                dicom_stats_add(&thread_stats, &stats);
+            }
+        }
+    }
+
+    dicom_mutex_lock(&job->mutex);
+    job->parsed += parsed;
+    job->not_dicom += not_dicom;
+    job->unsorted += unsorted;
+    if (job->options->collect_stats) { dicom_stats_add(job->stats, &thread_stats); }
+    dicom_mutex_unlock(&job->mutex);
+    dicom_arena_free(&arena);
+}
+
+static void free_job(batch_job* job) {
+    key_set_free(&job->uids);
+    key_set_free(&job->pixels);
+    key_set_free(&job->series);
+    free(job->records);
+    dicom_mutex_destroy(&job->mutex);
+}
+
+int run_batch(const char* const* paths, const int path_count, const batch_options* options, dicom_stats* stats) {
+    const double start = dicom_stats_now();
+    file_list files = {NULL, 0, 0};
+    for (int i = 0; i < path_count; i++) {
+        if (collect_files(&files, paths[i]) != 0) {
+            fprintf(stderr, "Error: Out of memory while listing files\n");
+            free_files(&files);
+            return -1;
+        }
+    }
+    if (files.count >= BATCH_NO_FILE) {
+        fprintf(stderr, "Error: Too many files (%zu)\n", files.count);
+        free_files(&files);
+        return -1;
+    }
+    qsort(files.paths, files.count, sizeof(char*), compare_paths);
+
+    batch_job job;
+    memset(&job, 0, sizeof(job));
+    job.options = options;
+    job.files = &files;
+    job.stats = stats;
+    job.stop_tag = options->hash_pixels ? DICOM_TAG_LAST
+        : options->build_hierarchy ? TAG_INSTANCE_NUMBER : TAG_SOP_INSTANCE_UID;
+    job.records = (file_record*)calloc(files.count + 1, sizeof(file_record));
+    dicom_mutex_init(&job.mutex);
+    if (job.records == NULL || key_set_init(&job.uids, files.count) != 0 || key_set_init(&job.pixels, files.count) != 0 ||
+        key_set_init(&job.series, files.count) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        free_job(&job);
+        free_files(&files);
+        return -1;
+    }
+
+    int thread_count = options->threads > 0 ? options->threads : dicom_cpu_count();
+    if ((size_t)thread_count > files.count / BATCH_CHUNK + 1) { thread_count = (int)(files.count / BATCH_CHUNK + 1); }
+
+    dicom_thread* threads = (dicom_thread*)malloc((size_t)thread_count * sizeof(dicom_thread));
+    int started = 0;
+    while (threads != NULL && started < thread_count && dicom_thread_start(&threads[started], batch_worker, &job) == 0) {
+        started++;
+    }
+    if (started == 0) { batch_worker(&job); }  // No threads available: do the work here
+    for (int i = 0; i < started; i++) { dicom_thread_join(threads[i]); }
+    free(threads);
+
+    size_t duplicate_uids = 0, uid_files = 0, duplicate_pixels = 0, pixel_files = 0, studies = 0, series = 0;
+    if (options->build_hierarchy) { report_hierarchy(&job.series, &files, job.records, &studies, &series); }
+    if (options->find_duplicates) {
+        duplicate_uids = report_duplicates(&job.uids, &files, "SOP Instance UID", &uid_files);
+    }
+    if (options->hash_pixels) { duplicate_pixels = report_duplicates(&job.pixels, &files, "pixel data", &pixel_files); }
+
+    printf("[batch] files=%zu parsed=%zu not_dicom=%zu threads=%d", files.count, job.parsed, job.not_dicom,
+           started > 0 ? started : 1);
+    if (options->find_duplicates) { printf(" duplicate_uids=%zu duplicate_uid_files=%zu", duplicate_uids, uid_files); }
+    if (options->hash_pixels) { printf(" duplicate_pixels=%zu duplicate_pixel_files=%zu", duplicate_pixels, pixel_files); }
+    if (options->build_hierarchy) { printf(" studies=%zu series=%zu unsorted=%zu", studies, series, job.unsorted); }
+    printf(" seconds=%.3f\n", dicom_stats_now() - start);
+
+    free_job(&job);
+    free_files(&files);
+    return 0;
+}
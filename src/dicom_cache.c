@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+    #include <direct.h>
+    #include <process.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "dicom_cache.h"
+#include "dicom_hash.h"
+
+#define CACHE_MAGIC "DLC1"
+#define CACHE_HEADER_SIZE 72
+#define CACHE_IDENTITY_SIZE 48
+#define CACHE_RECORD_SIZE 24
+#define CACHE_FLAG_TRUNCATED 0x01
+#define MAX_CACHE_PATH 4096
+
+static void put_u16(uint8_t* p, const uint16_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* p, const uint32_t value) {
+    for (int i = 0; i < 4; i++) { p[i] = (uint8_t)(value >> (8 * i)); }
+}
+
+static void put_u64(uint8_t* p, const uint64_t value) {
+    for (int i = 0; i < 8; i++) { p[i] = (uint8_t)(value >> (8 * i)); }
+}
+
+static uint16_t get_u16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t get_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Device, inode, size, modification time (with nanoseconds where available) and change time
+static int file_identity(const char* filename, uint8_t identity[CACHE_IDENTITY_SIZE]) {
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(filename, &st) != 0) { return -1; }
+    const uint64_t mtime_ns = 0;
+#else
+    struct stat st;
+    if (stat(filename, &st) != 0 || !S_ISREG(st.st_mode)) { return -1; }
+    #if defined(__APPLE__)
+    const uint64_t mtime_ns = (uint64_t)st.st_mtimespec.tv_nsec;
+    #elif defined(__linux__)
+    const uint64_t mtime_ns = (uint64_t)st.st_mtim.tv_nsec;
+    #else
+    const uint64_t mtime_ns = 0;
+    #endif
+#endif
+    put_u64(identity, (uint64_t)st.st_dev);
+    put_u64(identity + 8, (uint64_t)st.st_ino);
+    put_u64(identity + 16, (uint64_t)st.st_size);
+    put_u64(identity + 24, (uint64_t)st.st_mtime);
+    put_u64(identity + 32, mtime_ns);
+    put_u64(identity + 40, (uint64_t)st.st_ctime);
+    return 0;
+}
+
+static int entry_path(const char* cache_dir, const char* filename, const uint8_t identity[CACHE_IDENTITY_SIZE],
+                      char* path, const size_t size) {
+    dicom_xxh64 hash;
+    dicom_xxh64_init(&hash, 0);
+    dicom_xxh64_update(&hash, identity, CACHE_IDENTITY_SIZE);
+
+    // No inode numbers (Windows): fall back to the path for telling files apart
+    if (get_u32(identity + 8) == 0 && get_u32(identity + 12) == 0) { dicom_xxh64_update(&hash, filename, strlen(filename)); }
+
+    const int length = snprintf(path, size, "%s/%016llx.dlc", cache_dir, (unsigned long long)dicom_xxh64_digest(&hash));
+    return length > 0 && (size_t)length < size ? 0 : -1;
+}
+
+int dicom_cache_default_dir(char* dir, const size_t size) {
+    const char* explicit_dir = getenv("DCMLOUPE_CACHE_DIR");
+    int length;
+    if (explicit_dir != NULL && explicit_dir[0] != '\0') { length = snprintf(dir, size, "%s", explicit_dir); }
+    else {
+#if defined(_WIN32)
+        const char* base = getenv("LOCALAPPDATA");
+        if (base == NULL) { return -1; }
+        length = snprintf(dir, size, "%s/dcmloupe", base);
+#elif defined(__APPLE__)
+        const char* home = getenv("HOME");
+        if (home == NULL) { return -1; }
+        length = snprintf(dir, size, "%s/Library/Caches/dcmloupe", home);
+#else
+        const char* xdg = getenv("XDG_CACHE_HOME");
+        const char* home = getenv("HOME");
+        if (xdg != NULL && xdg[0] != '\0') { length = snprintf(dir, size, "%s/dcmloupe", xdg); }
+        else if (home != NULL) { length = snprintf(dir, size, "%s/.cache/dcmloupe", home); }
+        else { return -1; }
+#endif
+    }
+    return length > 0 && (size_t)length < size ? 0 : -1;
+}
+
+int dicom_cache_load(const char* cache_dir, const char* filename, const uint32_t value_cap, dicom_arena* arena,
+                     dicom_cache_entry* entry) {
+    memset(entry, 0, sizeof(*entry));
+
+    uint8_t identity[CACHE_IDENTITY_SIZE];
+    char path[MAX_CACHE_PATH];
+    if (file_identity(filename, identity) != 0 || entry_path(cache_dir, filename, identity, path, sizeof(path)) != 0) {
+        return -1;
+    }
+
+    if (dicom_file_map_open(path, &entry->map) != 0) { return -1; }
+
+    const uint8_t* data = entry->map.data;
+    const size_t size = entry->map.size;
+    bool valid = size >= CACHE_HEADER_SIZE && memcmp(data, CACHE_MAGIC, 4) == 0 && get_u32(data + 4) == value_cap &&
+        memcmp(data + 8, identity, CACHE_IDENTITY_SIZE) == 0;
+    if (valid) {
+        entry->count = get_u32(data + 56);
+        entry->top_level = get_u32(data + 60);
+        entry->is_truncated = (get_u32(data + 64) & CACHE_FLAG_TRUNCATED) != 0;
+        valid = entry->count <= (size - CACHE_HEADER_SIZE) / CACHE_RECORD_SIZE;
+    }
+    if (valid) {
+        entry->records = (dicom_cache_record*)dicom_arena_alloc(arena, (size_t)entry->count * sizeof(dicom_cache_record) + 1);
+        valid = entry->records != NULL;
+    }
+
+    // A damaged or foreign entry is a miss; the next store replaces it
+    size_t pos = CACHE_HEADER_SIZE;
+    for (uint32_t i = 0; valid && i < entry->count; i++) {
+        dicom_cache_record* record = &entry->records[i];
+        if (pos + CACHE_RECORD_SIZE > size) {
+            valid = false;
+            break;
+        }
+        const uint8_t* p = data + pos;
+        record->tag = get_u32(p);
+        record->length = get_u32(p + 4);
+        record->child_count = get_u32(p + 8);
+        record->descendants = get_u32(p + 12);
+        record->value_length = get_u32(p + 16);
+        record->vr = get_u16(p + 20);
+        record->flags = p[22];
+        pos += CACHE_RECORD_SIZE;
+
+        valid = record->value_length <= value_cap && record->value_length <= size - pos &&
+            record->descendants <= entry->count - i - 1;
+        record->value = record->flags & DICOM_CACHE_VALUE_PRESENT ? data + pos : NULL;
+        pos += record->value_length;
+    }
+
+    if (!valid) {
+        dicom_cache_close(entry);
+        return -1;
+    }
+    return 0;
+}
+
+void dicom_cache_close(dicom_cache_entry* entry) {
+    if (entry->map.data != NULL) { dicom_file_map_close(&entry->map); }
+    entry->records = NULL;
+    entry->count = 0;
+}
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+} entry_writer;
+
+static uint8_t* writer_reserve(entry_writer* w, const size_t length) {
+    if (w->failed) { return NULL; }
+    if (w->size + length > w->capacity) {
+        size_t capacity = w->capacity > 0 ? w->capacity : 16384;
+        while (capacity < w->size + length) { capacity *= 2; }
+        uint8_t* grown = (uint8_t*)realloc(w->data, capacity);
+        if (grown == NULL) {
+            w->failed = true;
+            return NULL;
+        }
+        w->data = grown;
+        w->capacity = capacity;
+    }
+    uint8_t* p = w->data + w->size;
+    w->size += length;
+    return p;
+}
+
+// Returns the number of records written for the node and its subtree
+static uint32_t write_records(entry_writer* w, const dicom_dataset* ds, const dicom_node* node, const uint32_t value_cap) {
+    const size_t record_pos = w->size;
+    if (writer_reserve(w, CACHE_RECORD_SIZE) == NULL) { return 0; }
+
+    const bool has_value = node->vr != DICOM_VR('S', 'Q') && node->length != DICOM_UNDEFINED_LENGTH &&
+        node->tag != DICOM_TAG_ITEM;
+    const uint8_t* value = has_value ? dicom_node_value(ds, node) : NULL;
+    const uint32_t value_length = value != NULL ? (node->length < value_cap ? node->length : value_cap) : 0;
+    if (value_length > 0) {
+        uint8_t* p = writer_reserve(w, value_length);
+        if (p == NULL) { return 0; }
+        memcpy(p, value, value_length);
+    }
+
+    uint32_t descendants = 0;
+    for (uint32_t i = 0; i < node->child_count; i++) { descendants += write_records(w, ds, &node->children[i], value_cap); }
+    if (w->failed) { return 0; }
+
+    uint8_t* record = w->data + record_pos;
+    put_u32(record, node->tag);
+    put_u32(record + 4, node->length);
+    put_u32(record + 8, node->child_count);
+    put_u32(record + 12, descendants);
+    put_u32(record + 16, value_length);
+    put_u16(record + 20, node->vr);
+    record[22] = (uint8_t)((value != NULL ? DICOM_CACHE_VALUE_PRESENT : 0) |
+                           (dicom_node_is_little_endian(ds, node) ? DICOM_CACHE_LITTLE_ENDIAN : 0));
+    record[23] = 0;
+    return descendants + 1;
+}
+
+// mkdir -p; existing directories are fine
+static int make_directories(const char* dir) {
+    char path[MAX_CACHE_PATH];
+    const size_t length = strlen(dir);
+    if (length >= sizeof(path)) { return -1; }
+    memcpy(path, dir, length + 1);
+
+    for (size_t i = 1; i <= length; i++) {
+        if (path[i] != '/' && path[i] != '\\' && path[i] != '\0') { continue; }
+        const char saved = path[i];
+        path[i] = '\0';
+#ifdef _WIN32
+        const int result = _mkdir(path);
+#else
+        const int result = mkdir(path, 0700);
+#endif
+        if (result != 0 && errno != EEXIST && saved == '\0') { return -1; }
+        path[i] = saved;
+    }
+    return 0;
+}
+
+int dicom_cache_store(const char* cache_dir, const char* filename, const dicom_dataset* ds, const uint32_t value_cap) {
+    uint8_t identity[CACHE_IDENTITY_SIZE];
+    char path[MAX_CACHE_PATH];
+    char temp_path[MAX_CACHE_PATH + 32];
+    if (file_identity(filename, identity) != 0 || entry_path(cache_dir, filename, identity, path, sizeof(path)) != 0) {
+        return -1;
+    }
+
+    entry_writer w = {NULL, 0, 0, false};
+    uint8_t* header = writer_reserve(&w, CACHE_HEADER_SIZE);
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < ds->root.child_count && header != NULL; i++) {
+        count += write_records(&w, ds, &ds->root.children[i], value_cap);
+    }
+    if (w.failed || header == NULL) {
+        free(w.data);
+        return -1;
+    }
+
+    header = w.data;
+    memcpy(header, CACHE_MAGIC, 4);
+    put_u32(header + 4, value_cap);
+    memcpy(header + 8, identity, CACHE_IDENTITY_SIZE);
+    put_u32(header + 56, count);
+    put_u32(header + 60, ds->root.child_count);
+    put_u32(header + 64, ds->is_truncated ? CACHE_FLAG_TRUNCATED : 0);
+    put_u32(header + 68, 0);
+
+#ifdef _WIN32
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp.%d", path, _getpid());
+#else
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp.%ld", path, (long)getpid());
+#endif
+
+    FILE* out = make_directories(cache_dir) == 0 ? fopen(temp_path, "wb") : NULL;
+    bool written = out != NULL && fwrite(w.data, 1, w.size, out) == w.size;
+    if (out != NULL && fclose(out) != 0) { written = false; }
+    free(w.data);
+
+#ifdef _WIN32
+    if (written) { remove(path); }  // rename() does not replace on Windows
+#endif
+    if (!written || rename(temp_path, path) != 0) {
+        if (out != NULL) { remove(temp_path); }
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#ifdef DCMLOUPE_HAVE_ICONV
+    #include <errno.h>
+    #include <iconv.h>
+#endif
+
+#include "dicom_charset.h"
+#include "dicom_simd.h"
+
+typedef struct {
+    const char* term;
+    dicom_charset_kind kind;
+    const char* iconv_name;
+} charset_term;
+
+// Defined terms of PS3.3 C.12.1.1.2, with and without code extensions
+static const charset_term charset_terms[] = {
+    {"ISO_IR 6", DICOM_CHARSET_DEFAULT, NULL},
+    {"ISO 2022 IR 6", DICOM_CHARSET_DEFAULT, NULL},
+    {"ISO_IR 100", DICOM_CHARSET_LATIN1, NULL},
+    {"ISO 2022 IR 100", DICOM_CHARSET_LATIN1, NULL},
+    {"ISO_IR 192", DICOM_CHARSET_UTF8, NULL},
+    {"ISO_IR 101", DICOM_CHARSET_ICONV, "ISO-8859-2"},
+    {"ISO 2022 IR 101", DICOM_CHARSET_ICONV, "ISO-8859-2"},
+    {"ISO_IR 109", DICOM_CHARSET_ICONV, "ISO-8859-3"},
+    {"ISO 2022 IR 109", DICOM_CHARSET_ICONV, "ISO-8859-3"},
+    {"ISO_IR 110", DICOM_CHARSET_ICONV, "ISO-8859-4"},
+    {"ISO 2022 IR 110", DICOM_CHARSET_ICONV, "ISO-8859-4"},
+    {"ISO_IR 144", DICOM_CHARSET_ICONV, "ISO-8859-5"},
+    {"ISO 2022 IR 144", DICOM_CHARSET_ICONV, "ISO-8859-5"},
+    {"ISO_IR 127", DICOM_CHARSET_ICONV, "ISO-8859-6"},
+    {"ISO 2022 IR 127", DICOM_CHARSET_ICONV, "ISO-8859-6"},
+    {"ISO_IR 126", DICOM_CHARSET_ICONV, "ISO-8859-7"},
+    {"ISO 2022 IR 126", DICOM_CHARSET_ICONV, "ISO-8859-7"},
+    {"ISO_IR 138", DICOM_CHARSET_ICONV, "ISO-8859-8"},
+    {"ISO 2022 IR 138", DICOM_CHARSET_ICONV, "ISO-8859-8"},
+    {"ISO_IR 148", DICOM_CHARSET_ICONV, "ISO-8859-9"},
+    {"ISO 2022 IR 148", DICOM_CHARSET_ICONV, "ISO-8859-9"},
+    {"ISO_IR 203", DICOM_CHARSET_ICONV, "ISO-8859-15"},
+    {"ISO 2022 IR 203", DICOM_CHARSET_ICONV, "ISO-8859-15"},
+    {"ISO_IR 166", DICOM_CHARSET_ICONV, "TIS-620"},
+    {"ISO 2022 IR 166", DICOM_CHARSET_ICONV, "TIS-620"},
+    {"ISO_IR 13", DICOM_CHARSET_ICONV, "SHIFT_JIS"},
+    {"ISO 2022 IR 13", DICOM_CHARSET_KATAKANA, "ISO-2022-JP-2"},
+    {"ISO 2022 IR 87", DICOM_CHARSET_ICONV, "ISO-2022-JP"},
+    {"ISO 2022 IR 159", DICOM_CHARSET_ICONV, "ISO-2022-JP-2"},
+    {"ISO 2022 IR 149", DICOM_CHARSET_ICONV, "ISO-2022-KR"},
+    {"ISO 2022 IR 58", DICOM_CHARSET_ICONV, "ISO-2022-CN"},
+    {"GB18030", DICOM_CHARSET_ICONV, "GB18030"},
+    {"GBK", DICOM_CHARSET_ICONV, "GBK"},
+};
+
+void dicom_charset_init(dicom_charset* charset) {
+    charset->kind = DICOM_CHARSET_DEFAULT;
+    charset->name[0] = '\0';
+    charset->iconv_name = NULL;
+    charset->iconv_handle = NULL;
+}
+
+static const charset_term* find_term(const char* term) {
+    for (size_t i = 0; i < sizeof(charset_terms) / sizeof(charset_terms[0]); i++) {
+        if (strcmp(charset_terms[i].term, term) == 0) { return &charset_terms[i]; }
+    }
+    return NULL;
+}
+
+void dicom_charset_set(dicom_charset* charset, const uint8_t* value, const size_t length) {
+    dicom_charset_close(charset);
+    dicom_charset_init(charset);
+
+    // Multi-valued terms ("\ISO 2022 IR 87", "ISO 2022 IR 6\ISO 2022 IR 149"): the first term that is
+    // not plain ASCII decides the converter
+    size_t start = 0;
+    for (size_t i = 0; i <= length; i++) {
+        if (i < length && value[i] != '\\') { continue; }
+
+        size_t term_start = start;
+        size_t term_end = i;
+        while (term_start < term_end && value[term_start] == ' ') { term_start++; }
+        while (term_end > term_start && (value[term_end - 1] == ' ' || value[term_end - 1] == '\0')) { term_end--; }
+        start = i + 1;
+
+        char term[sizeof(charset->name)];
+        const size_t term_length = term_end - term_start;
+        if (term_length == 0 || term_length >= sizeof(term)) { continue; }
+        memcpy(term, value + term_start, term_length);
+        term[term_length] = '\0';
+
+        const charset_term* entry = find_term(term);
+        if (entry == NULL) {
+            fprintf(stderr, "Warning: Unknown Specific Character Set '%s', treating as ISO_IR 6\n", term);
+            continue;
+        }
+        if (entry->kind == DICOM_CHARSET_DEFAULT) { continue; }
+
+        memcpy(charset->name, term, term_length + 1);
+        charset->kind = entry->kind;
+        charset->iconv_name = entry->iconv_name;
+        break;
+    }
+}
+
+// Length of the well-formed UTF-8 sequence at text (RFC 3629: no overlongs, surrogates or code points past U+10FFFF)
+static size_t utf8_sequence_length(const uint8_t* text, const size_t length) {
+    const uint8_t lead = text[0];
+    if (lead < 0x80) { return 1; }
+
+    size_t count;
+    uint8_t low = 0x80, high = 0xBF;  // Range of the second byte
+    if (lead >= 0xC2 && lead <= 0xDF) { count = 2; }
+    else if (lead >= 0xE0 && lead <= 0xEF) {
+        count = 3;
+        if (lead == 0xE0) { low = 0xA0; }
+        else if (lead == 0xED) { high = 0x9F; }
+    }
+    else if (lead >= 0xF0 && lead <= 0xF4) {
+        count = 4;
+        if (lead == 0xF0) { low = 0x90; }
+        else if (lead == 0xF4) { high = 0x8F; }
+    }
+    else { return 0; }
+
+    if (length < count || text[1] < low || text[1] > high) { return 0; }
+    for (size_t i = 2; i < count; i++) { if ((text[i] & 0xC0) != 0x80) { return 0; } }
+    return count;
+}
+
+size_t dicom_utf8_prefix(const uint8_t* text, const size_t length, const size_t max_chars) {
+    size_t pos = 0;
+    for (size_t chars = 0; pos < length && chars < max_chars; chars++) {
+        const size_t step = utf8_sequence_length(text + pos, length - pos);
+        pos += step > 0 ? step : 1;  // A stray byte counts as one character
+    }
+    return pos;
+}
+
+// NULL when the text is valid UTF-8 already, otherwise a copy in out with every invalid byte replaced by '?'
+static const uint8_t* checked_utf8(const uint8_t* data, const size_t length, uint8_t* out, size_t* out_length) {
+    size_t pos = 0;
+    size_t step;
+    while (pos < length && (step = utf8_sequence_length(data + pos, length - pos)) > 0) { pos += step; }
+    if (pos == length) { return NULL; }
+
+    memcpy(out, data, pos);
+    size_t written = pos;
+    while (pos < length) {
+        step = utf8_sequence_length(data + pos, length - pos);
+        if (step == 0) {
+            out[written++] = '?';
+            pos++;
+            continue;
+        }
+        memcpy(out + written, data + pos, step);
+        written += step;
+        pos += step;
+    }
+    *out_length = written;
+    return out;
+}
+
+static size_t latin1_to_utf8(const uint8_t* data, const size_t length, uint8_t* out) {
+    size_t written = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (data[i] < 0x80) { out[written++] = data[i]; }
+        else {
+            out[written++] = (uint8_t)(0xC0 | (data[i] >> 6));
+            out[written++] = (uint8_t)(0x80 | (data[i] & 0x3F));
+        }
+    }
+    return written;
+}
+
+#ifdef DCMLOUPE_HAVE_ICONV
+// The converter of the character set, opened on first use; NULL (and plain ISO_IR 6 from then on) without one
+static void* open_converter(dicom_charset* charset) {
+    if (charset->iconv_handle == NULL) {
+        const iconv_t cd = iconv_open("UTF-8", charset->iconv_name);
+        if (cd == (iconv_t)-1) {
+            fprintf(stderr, "Warning: No converter for Specific Character Set '%s'\n", charset->name);
+            charset->kind = DICOM_CHARSET_DEFAULT;
+            return NULL;
+        }
+        charset->iconv_handle = (void*)cd;
+    }
+    return charset->iconv_handle;
+}
+
+// Converts one run, keeping the shift state for the next run of the same value
+static size_t iconv_run(void* handle, const uint8_t* data, const size_t length, uint8_t* out, const size_t out_size) {
+    const iconv_t cd = (iconv_t)handle;
+    char* in_ptr = (char*)data;
+    size_t in_left = length;
+    char* out_ptr = (char*)out;
+    size_t out_left = out_size;
+
+    while (in_left > 0) {
+        if (iconv(cd, &in_ptr, &in_left, &out_ptr, &out_left) != (size_t)-1) { break; }
+        if (errno != EILSEQ || out_left == 0) { break; }  // EINVAL: value ends mid-character
+
+        *out_ptr++ = '?';
+        out_left--;
+        in_ptr++;
+        in_left--;
+    }
+    return out_size - out_left;
+}
+
+static size_t iconv_to_utf8(void* handle, const uint8_t* data, const size_t length, uint8_t* out,
+                            const size_t out_size) {
+    const iconv_t cd = (iconv_t)handle;
+    iconv(cd, NULL, NULL, NULL, NULL);  // Every value starts in the initial shift state
+
+    size_t written = iconv_run(handle, data, length, out, out_size);
+    char* out_ptr = (char*)out + written;
+    size_t out_left = out_size - written;
+    iconv(cd, NULL, NULL, &out_ptr, &out_left);
+    return out_size - out_left;
+}
+#endif
+
+static bool is_katakana(const uint8_t byte) { return byte >= 0xA1 && byte <= 0xDF; }
+
+// ESC ) I designates JIS X 0201 katakana to G1; iconv's ISO-2022-JP family has no G1, so it is dropped here
+static bool is_katakana_designation(const uint8_t* data, const size_t length) {
+    return length >= 3 && data[0] == 0x1B && data[1] == ')' && data[2] == 'I';
+}
+
+/*
+ * ISO 2022 IR 13 puts half-width katakana in G1, as single bytes 0xA1-0xDF, and JIS X 0201 romaji or
+ * (with ISO 2022 IR 87/159) kanji in G0. The 8-bit bytes map straight to U+FF61-U+FF9F; the 7-bit runs
+ * between them, escape sequences included, go through iconv with the shift state kept across runs.
+ */
+static size_t katakana_to_utf8(dicom_charset* charset, const uint8_t* data, const size_t length, uint8_t* out,
+                               const size_t out_size) {
+#ifdef DCMLOUPE_HAVE_ICONV
+    void* handle = open_converter(charset);
+    if (handle != NULL) { iconv((iconv_t)handle, NULL, NULL, NULL, NULL); }
+#else
+    (void)charset;
+    (void)out_size;
+#endif
+
+    size_t written = 0;
+    size_t pos = 0;
+    while (pos < length) {
+        if (is_katakana(data[pos])) {
+            const uint32_t code_point = 0xFF61 + (data[pos++] - 0xA1);
+            out[written++] = (uint8_t)(0xE0 | (code_point >> 12));
+            out[written++] = (uint8_t)(0x80 | ((code_point >> 6) & 0x3F));
+            out[written++] = (uint8_t)(0x80 | (code_point & 0x3F));
+            continue;
+        }
+        if (is_katakana_designation(data + pos, length - pos)) {
+            pos += 3;
+            continue;
+        }
+
+        size_t end = pos + 1;
+        while (end < length && !is_katakana(data[end]) && !is_katakana_designation(data + end, length - end)) {
+            end++;
+        }
+#ifdef DCMLOUPE_HAVE_ICONV
+        if (handle != NULL) {
+            written += iconv_run(handle, data + pos, end - pos, out + written, out_size - written);
+            pos = end;
+            continue;
+        }
+#endif
+        for (; pos < end; pos++) { out[written++] = data[pos] < 0x80 && data[pos] != 0x1B ? data[pos] : '?'; }
+    }
+    return written;
+}
+
+const uint8_t* dicom_charset_to_utf8(dicom_charset* charset, const uint8_t* data, const size_t length,
+                                     dicom_arena* arena, size_t* out_length) {
+    *out_length = length;
+    if (length == 0) { return data; }
+
+    // ISO 2022 text is 7-bit, only an escape sequence tells it apart from ASCII
+    const bool uses_iso_2022 = charset->kind == DICOM_CHARSET_ICONV || charset->kind == DICOM_CHARSET_KATAKANA;
+    if (dicom_is_ascii(data, length) && (!uses_iso_2022 || memchr(data, 0x1B, length) == NULL)) { return data; }
+
+    // Four bytes per input byte covers every supported character set
+    uint8_t* out = (uint8_t*)dicom_arena_alloc(arena, length * 4 + 4);
+    if (out == NULL) { return data; }
+
+    if (charset->kind == DICOM_CHARSET_UTF8) {
+        const uint8_t* checked = checked_utf8(data, length, out, out_length);
+        return checked != NULL ? checked : data;
+    }
+    if (charset->kind == DICOM_CHARSET_KATAKANA) {
+        *out_length = katakana_to_utf8(charset, data, length, out, length * 4 + 4);
+        return out;
+    }
+
+#ifdef DCMLOUPE_HAVE_ICONV
+    if (charset->kind == DICOM_CHARSET_ICONV) {
+        void* handle = open_converter(charset);
+        if (handle != NULL) {
+            *out_length = iconv_to_utf8(handle, data, length, out, length * 4 + 4);
+            return out;
+        }
+    }
+#else
+    if (charset->kind == DICOM_CHARSET_ICONV) {
+        // Without iconv the best we can do is keep the ASCII part
+        for (size_t i = 0; i < length; i++) { out[i] = data[i] < 0x80 ? data[i] : '?'; }
+        return out;
+    }
+#endif
+
+    *out_length = latin1_to_utf8(data, length, out);
+    return out;
+}
+
+void dicom_charset_close(dicom_charset* charset) {
+#ifdef DCMLOUPE_HAVE_ICONV
+    if (charset->iconv_handle != NULL) { iconv_close((iconv_t)charset->iconv_handle); }
+#endif
+    charset->iconv_handle = NULL;
+}
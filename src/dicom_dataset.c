@@ -0,0 +1,920 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "dicom_dataset.h"
+#include "dicom_dict.h"
+#include "dicom_path.h"
+#include "dicom_stats.h"
+#include "dicom_thread.h"
+
+#define DICOM_PREAMBLE_SIZE 128
+#define DICOM_PREFIX_SIZE 4
+#define DICOM_PREFIX "DICM"
+#define TS_IMPLICIT_VR_LITTLE_ENDIAN "1.2.840.10008.1.2"
+#define TS_EXPLICIT_VR_BIG_ENDIAN "1.2.840.10008.1.2.2"
+#define PARALLEL_SEQUENCE_TAG 0x52009230  // Per-Frame Functional Groups Sequence
+#define PARALLEL_MIN_ITEMS 64             // Below this, starting threads costs more than it saves
+
+typedef struct {
+    const uint8_t* data;
+    size_t size;
+    bool is_explicit_vr;
+    bool is_little_endian;
+} encoding;
+
+typedef struct {
+    dicom_arena* arena;
+    dicom_node* stack;  // Nodes of the containers still being built, copied into the arena once complete
+    size_t stack_len;
+    size_t stack_cap;
+    uint32_t stop_tag;  // Top-level elements after this tag are left unread
+    bool has_meta;      // Part 10 file: the top level starts with the explicit VR LE meta group
+    int threads;        // Items of the per-frame functional groups are built by this many threads
+    bool truncated;
+    bool stopped;
+} build_state;
+
+static int build_elements(build_state* st, const encoding* enc, size_t* pos, size_t end, int depth,
+                          dicom_node* parent, dicom_dataset* ds);
+
+static void apply_transfer_syntax(dicom_dataset* ds) {
+    ds->is_explicit_vr = strcmp(ds->transfer_syntax_uid, TS_IMPLICIT_VR_LITTLE_ENDIAN) != 0;
+    ds->is_little_endian = strcmp(ds->transfer_syntax_uid, TS_EXPLICIT_VR_BIG_ENDIAN) != 0;
+}
+
+static void set_transfer_syntax(dicom_dataset* ds, const uint8_t* value, const uint32_t length) {
+    if (length >= sizeof(ds->transfer_syntax_uid)) { return; }
+
+    memcpy(ds->transfer_syntax_uid, value, length);
+    ds->transfer_syntax_uid[length] = '\0';
+    for (size_t i = length; i > 0 && (ds->transfer_syntax_uid[i - 1] == ' ' ||
+                                       ds->transfer_syntax_uid[i - 1] == '\0'); i--) {
+        ds->transfer_syntax_uid[i - 1] = '\0';
+    }
+
+    apply_transfer_syntax(ds);
+}
+
+static uint16_t get_u16(const encoding* enc, const size_t pos) {
+    const uint8_t* p = enc->data + pos;
+    return enc->is_little_endian ? (uint16_t)(p[0] | (p[1] << 8)) : (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get_u32(const encoding* enc, const size_t pos) {
+    const uint8_t* p = enc->data + pos;
+    if (enc->is_little_endian) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+static bool is_long_vr(const uint16_t vr) {
+    switch (vr) {
+    case DICOM_VR('O', 'B'): case DICOM_VR('O', 'D'): case DICOM_VR('O', 'F'): case DICOM_VR('O', 'L'):
+    case DICOM_VR('O', 'V'): case DICOM_VR('O', 'W'): case DICOM_VR('S', 'Q'): case DICOM_VR('S', 'V'):
+    case DICOM_VR('U', 'C'): case DICOM_VR('U', 'N'): case DICOM_VR('U', 'R'): case DICOM_VR('U', 'T'):
+    case DICOM_VR('U', 'V'):
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_known_vr(const uint16_t vr) {
+    switch (vr) {
+    case DICOM_VR('A', 'E'): case DICOM_VR('A', 'S'): case DICOM_VR('A', 'T'): case DICOM_VR('C', 'S'):
+    case DICOM_VR('D', 'A'): case DICOM_VR('D', 'S'): case DICOM_VR('D', 'T'): case DICOM_VR('F', 'D'):
+    case DICOM_VR('F', 'L'): case DICOM_VR('I', 'S'): case DICOM_VR('L', 'O'): case DICOM_VR('L', 'T'):
+    case DICOM_VR('P', 'N'): case DICOM_VR('S', 'H'): case DICOM_VR('S', 'L'): case DICOM_VR('S', 'S'):
+    case DICOM_VR('S', 'T'): case DICOM_VR('T', 'M'): case DICOM_VR('U', 'I'): case DICOM_VR('U', 'L'):
+    case DICOM_VR('U', 'S'):
+        return true;
+    default:
+        return is_long_vr(vr);
+    }
+}
+
+static uint16_t dict_vr_code(const uint32_t tag) {
+    const char* vr = dicom_get_vr(tag);
+    if (vr == NULL || strlen(vr) < 2 || strcmp(vr, "NONE") == 0) { return DICOM_VR('U', 'N'); }
+    return DICOM_VR(vr[0], vr[1]);  // "US or SS" and friends: take the first candidate, as the parser does
+}
+
+static dicom_node* push_node(build_state* st) {
+    if (st->stack_len == st->stack_cap) {
+        const size_t new_cap = st->stack_cap ? st->stack_cap * 2 : 256;
+        dicom_node* grown = (dicom_node*)realloc(st->stack, new_cap * sizeof(dicom_node));
+        if (grown == NULL) { return NULL; }
+        st->stack = grown;
+        st->stack_cap = new_cap;
+    }
+
+    dicom_node* node = &st->stack[st->stack_len++];
+    memset(node, 0, sizeof(*node));
+    return node;
+}
+
+// Moves the nodes pushed since `first` into an arena array owned by parent
+static int finish_container(build_state* st, const size_t first, dicom_node* parent) {
+    const size_t count = st->stack_len - first;
+    parent->child_count = (uint32_t)count;
+    parent->children = NULL;
+    if (count == 0) { return 0; }
+
+    dicom_node* children = (dicom_node*)dicom_arena_alloc(st->arena, count * sizeof(dicom_node));
+    if (children == NULL) { return -1; }
+
+    memcpy(children, &st->stack[first], count * sizeof(dicom_node));
+    st->stack_len = first;
+
+    for (size_t i = 1; i < count; i++) {
+        if (children[i].tag < children[i - 1].tag) {
+            parent->flags |= DICOM_NODE_UNSORTED;
+            break;
+        }
+    }
+
+    parent->children = children;
+    return 0;
+}
+
+// End offset of a sequence's value; SIZE_MAX when its defined length runs past the buffer
+static size_t sequence_end(const encoding* enc, const dicom_node* seq) {
+    if (seq->length == DICOM_UNDEFINED_LENGTH) { return enc->size; }
+    return seq->length <= enc->size - (size_t)seq->offset ? (size_t)seq->offset + seq->length : SIZE_MAX;
+}
+
+// Items of a sequence, or fragments of encapsulated pixel data when raw_items is set
+static int build_items(build_state* st, const encoding* enc, size_t* pos, dicom_node* seq, const int depth,
+                       const bool raw_items, dicom_dataset* ds) {
+    const bool undefined = seq->length == DICOM_UNDEFINED_LENGTH;
+    const size_t seq_end = sequence_end(enc, seq);
+    const size_t first = st->stack_len;
+
+    if (seq_end > enc->size) { st->truncated = true; }
+
+    while (*pos + 8 <= seq_end && *pos + 8 <= enc->size) {
+        const uint16_t group = get_u16(enc, *pos);
+        const uint16_t element = get_u16(enc, *pos + 2);
+        const uint32_t length = get_u32(enc, *pos + 4);
+
+        if (group != 0xFFFE) {
+            st->truncated = true;
+            break;
+        }
+
+        if (element == 0xE0DD) {
+            *pos += 8;
+            break;
+        }
+
+        if (element != 0xE000) {
+            st->truncated = true;
+            break;
+        }
+
+        *pos += 8;
+
+        // Pushing may move the stack, so the item is filled in through its index
+        const size_t item_index = st->stack_len;
+        if (push_node(st) == NULL) { return -1; }
+        st->stack[item_index].tag = DICOM_TAG_ITEM;
+        st->stack[item_index].length = length;
+        st->stack[item_index].offset = *pos;
+        st->stack[item_index].header_size = 8;
+
+        dicom_node item = st->stack[item_index];
+        if (raw_items) {
+            if (length == DICOM_UNDEFINED_LENGTH || length > enc->size - *pos) {
+                st->truncated = true;
+                break;
+            }
+            *pos += length;
+        }
+        else if (length == DICOM_UNDEFINED_LENGTH) {
+            if (build_elements(st, enc, pos, enc->size, depth + 1, &item, ds) != 0) { return -1; }
+        }
+        else {
+            const bool item_fits = length <= enc->size - *pos;
+            const size_t item_end = item_fits ? *pos + length : enc->size;
+            if (!item_fits) { st->truncated = true; }
+            if (build_elements(st, enc, pos, item_end, depth + 1, &item, ds) != 0) { return -1; }
+            if (item_fits) { *pos = item_end; }
+        }
+
+        item.end = *pos;
+        st->stack[item_index] = item;
+
+        if (st->truncated) { break; }
+    }
+
+    if (!undefined && !st->truncated) { *pos = seq_end; }
+    if (finish_container(st, first, seq) != 0) { return -1; }
+    seq->end = *pos;
+    return 0;
+}
+
+/*
+ * Structural skip: finds where elements and items end by following lengths only. Defined-length
+ * values, sequences and items are stepped over in one addition; only undefined lengths are walked.
+ * Nothing is allocated and no dictionary lookup is needed. Returns -1 on anything malformed.
+ */
+static int skip_items(const encoding* enc, size_t* pos, size_t end, int depth);
+
+static int skip_elements(const encoding* enc, size_t* pos, const size_t end, const int depth) {
+    if (depth > DICOM_DATASET_MAX_DEPTH) { return -1; }
+
+    while (*pos + 8 <= end) {
+        const uint16_t group = get_u16(enc, *pos);
+        const uint16_t element = get_u16(enc, *pos + 2);
+        if (group == 0xFFFE) {
+            if (element != 0xE00D) { return -1; }
+            *pos += 8;
+            return 0;  // End of an undefined-length item
+        }
+
+        uint16_t vr = 0;
+        uint32_t length;
+        if (enc->is_explicit_vr) {
+            vr = DICOM_VR(enc->data[*pos + 4], enc->data[*pos + 5]);
+            if (!is_known_vr(vr)) { return -1; }
+            if (is_long_vr(vr)) {
+                if (*pos + 12 > end) { return -1; }
+                length = get_u32(enc, *pos + 8);
+                *pos += 12;
+            }
+            else {
+                length = get_u16(enc, *pos + 6);
+                *pos += 8;
+            }
+        }
+        else {
+            length = get_u32(enc, *pos + 4);
+            *pos += 8;
+        }
+
+        if (length == DICOM_UNDEFINED_LENGTH) {
+            // A sequence or encapsulated pixel data; undefined-length UN holds implicit VR LE
+            const encoding un = {enc->data, enc->size, false, true};
+            if (skip_items(vr == DICOM_VR('U', 'N') ? &un : enc, pos, enc->size, depth + 1) != 0) { return -1; }
+        }
+        else if (length > end - *pos) { return -1; }
+        else { *pos += length; }
+    }
+    return *pos == end ? 0 : -1;
+}
+
+// Items of one sequence up to end (enc->size for undefined length); stops after the sequence delimiter
+static int skip_items(const encoding* enc, size_t* pos, const size_t end, const int depth) {
+    if (depth > DICOM_DATASET_MAX_DEPTH) { return -1; }
+
+    while (*pos + 8 <= end) {
+        const uint16_t group = get_u16(enc, *pos);
+        const uint16_t element = get_u16(enc, *pos + 2);
+        const uint32_t length = get_u32(enc, *pos + 4);
+        if (group != 0xFFFE) { return -1; }
+
+        *pos += 8;
+        if (element == 0xE0DD) { return 0; }
+        if (element != 0xE000) { return -1; }
+
+        if (length == DICOM_UNDEFINED_LENGTH) {
+            if (skip_elements(enc, pos, enc->size, depth + 1) != 0) { return -1; }
+        }
+        else if (length > end - *pos) { return -1; }
+        else { *pos += length; }
+    }
+    return *pos == end && end != enc->size ? 0 : -1;
+}
+
+typedef struct {
+    const encoding* enc;
+    dicom_dataset scratch;      // Private copy, build_elements() may record a transfer syntax in it
+    dicom_arena* arena;
+    dicom_node items;           // Stand-in sequence spanning this chunk's items
+    int depth;
+    int result;
+    bool truncated;
+    uint64_t elements;          // Counted on a worker thread, added to the caller's stats after the join
+} item_chunk;
+
+static void build_chunk_items(item_chunk* chunk) {
+    build_state st = {.arena = chunk->arena, .stop_tag = DICOM_TAG_LAST};
+    size_t pos = (size_t)chunk->items.offset;
+    chunk->result = build_items(&st, chunk->enc, &pos, &chunk->items, chunk->depth, false, &chunk->scratch);
+    chunk->truncated = st.truncated;
+    free(st.stack);
+}
+
+static void build_item_chunk_worker(void* arg) {
+    item_chunk* chunk = (item_chunk*)arg;
+    dicom_stats stats;
+    dicom_stats_begin(&stats);
+    build_chunk_items(chunk);
+    dicom_stats_end();
+    chunk->elements = stats.elements;
+}
+
+/*
+ * Large multi-frame objects spend nearly all of their parse in one top-level sequence with an item
+ * per frame. Its item boundaries are found with the structural skip, then contiguous runs of items
+ * are built on separate threads, each into an arena owned by the dataset, and the item nodes are
+ * joined in order. Anything unexpected falls back to the serial build_items().
+ */
+static int build_items_parallel(build_state* st, const encoding* enc, size_t* pos, dicom_node* seq, const int depth,
+                                dicom_dataset* ds) {
+    const size_t start = *pos;
+    const bool undefined = seq->length == DICOM_UNDEFINED_LENGTH;
+    const size_t seq_end = sequence_end(enc, seq);
+
+    size_t* starts = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t scan = start;
+    bool valid = seq_end <= enc->size;
+    while (valid && scan + 8 <= seq_end) {
+        if (get_u16(enc, scan) != 0xFFFE) { valid = false; break; }
+        const uint16_t element = get_u16(enc, scan + 2);
+        const uint32_t length = get_u32(enc, scan + 4);
+        if (element == 0xE0DD) { break; }
+        if (element != 0xE000) { valid = false; break; }
+
+        if (count == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : 1024;
+            size_t* grown = (size_t*)realloc(starts, capacity * sizeof(size_t));
+            if (grown == NULL) { valid = false; break; }
+            starts = grown;
+        }
+        starts[count++] = scan;
+
+        scan += 8;
+        if (length == DICOM_UNDEFINED_LENGTH) { valid = skip_elements(enc, &scan, enc->size, depth + 2) == 0; }
+        else if (length > seq_end - scan) { valid = false; }
+        else { scan += length; }
+    }
+    const size_t items_end = scan;
+    const bool delimited = undefined && valid && items_end + 8 <= enc->size && get_u16(enc, items_end) == 0xFFFE &&
+        get_u16(enc, items_end + 2) == 0xE0DD;
+    if (undefined && !delimited) { valid = false; }
+
+    // Chunks of at least half the threshold, so every thread gets a worthwhile run of items
+    int chunk_count = (int)(count / (PARALLEL_MIN_ITEMS / 2) < (size_t)st->threads ? count / (PARALLEL_MIN_ITEMS / 2) :
+                            (size_t)st->threads);
+    item_chunk* chunks = NULL;
+    dicom_arena* arenas = NULL;
+    dicom_thread* threads = NULL;
+    if (valid && count >= PARALLEL_MIN_ITEMS) {
+        chunks = (item_chunk*)calloc((size_t)chunk_count, sizeof(item_chunk));
+        arenas = (dicom_arena*)malloc((size_t)chunk_count * sizeof(dicom_arena));
+        threads = (dicom_thread*)malloc((size_t)chunk_count * sizeof(dicom_thread));
+    }
+    if (chunks == NULL || arenas == NULL || threads == NULL) {
+        free(starts);
+        free(chunks);
+        free(arenas);
+        free(threads);
+        return build_items(st, enc, pos, seq, depth, false, ds);
+    }
+
+    for (int i = 0; i < chunk_count; i++) {
+        const size_t first = count * (size_t)i / (size_t)chunk_count;
+        const size_t last = count * (size_t)(i + 1) / (size_t)chunk_count;
+        const size_t chunk_end = last < count ? starts[last] : items_end;
+        dicom_arena_init(&arenas[i]);
+        chunks[i].enc = enc;
+        chunks[i].scratch = *ds;
+        chunks[i].arena = &arenas[i];
+        chunks[i].depth = depth;
+        chunks[i].items.offset = starts[first];
+        chunks[i].items.length = (uint32_t)(chunk_end - starts[first]);
+    }
+
+    // The calling thread builds the first chunk itself
+    int started = 1;
+    while (started < chunk_count &&
+           dicom_thread_start(&threads[started], build_item_chunk_worker, &chunks[started]) == 0) {
+        started++;
+    }
+    for (int i = started; i < chunk_count; i++) { build_chunk_items(&chunks[i]); }
+    build_chunk_items(&chunks[0]);
+    for (int i = 1; i < started; i++) { dicom_thread_join(threads[i]); }
+    free(threads);
+
+    uint32_t built = 0;
+    bool complete = true;
+    for (int i = 0; i < chunk_count; i++) {
+        complete = complete && chunks[i].result == 0 && !chunks[i].truncated;
+        built += chunks[i].items.child_count;
+        DICOM_STATS_ADD(elements, chunks[i].elements);
+    }
+
+    dicom_node* items = NULL;
+    if (complete && built == count) { items = (dicom_node*)dicom_arena_alloc(st->arena, count * sizeof(dicom_node)); }
+    if (items == NULL) {
+        for (int i = 0; i < chunk_count; i++) { dicom_arena_free(&arenas[i]); }
+        free(arenas);
+        free(chunks);
+        free(starts);
+        *pos = start;
+        return build_items(st, enc, pos, seq, depth, false, ds);
+    }
+
+    size_t next = 0;
+    for (int i = 0; i < chunk_count; i++) {
+        memcpy(items + next, chunks[i].items.children, chunks[i].items.child_count * sizeof(dicom_node));
+        next += chunks[i].items.child_count;
+    }
+    seq->children = items;
+    seq->child_count = (uint32_t)count;
+    *pos = delimited ? items_end + 8 : seq_end;
+    seq->end = *pos;
+
+    // The item trees live in the chunk arenas until the dataset is closed
+    const size_t owned_count = ds->item_arena_count + (size_t)chunk_count;
+    dicom_arena* owned = (dicom_arena*)realloc(ds->item_arenas, owned_count * sizeof(dicom_arena));
+    if (owned == NULL) {
+        for (int i = 0; i < chunk_count; i++) { dicom_arena_free(&arenas[i]); }
+        free(arenas);
+        free(chunks);
+        free(starts);
+        return -1;
+    }
+    memcpy(owned + ds->item_arena_count, arenas, (size_t)chunk_count * sizeof(dicom_arena));
+    ds->item_arenas = owned;
+    ds->item_arena_count = owned_count;
+
+    free(arenas);
+    free(chunks);
+    free(starts);
+    return 0;
+}
+
+static int build_elements(build_state* st, const encoding* enc, size_t* pos, const size_t end, const int depth,
+                          dicom_node* parent, dicom_dataset* ds) {
+    const size_t first = st->stack_len;
+    const encoding meta = {enc->data, enc->size, true, true};  // File meta information is always explicit VR LE
+    encoding current = *enc;
+    bool in_file_meta = depth == 0 && st->has_meta;
+
+    if (depth > DICOM_DATASET_MAX_DEPTH) {
+        st->truncated = true;
+        return finish_container(st, first, parent);
+    }
+
+    while (*pos + 8 <= end) {
+        const uint16_t peek_group = get_u16(in_file_meta ? &meta : &current, *pos);
+
+        if (in_file_meta && peek_group != 0x0002) {
+            dicom_stats_phase(DICOM_PHASE_DATASET);
+            in_file_meta = false;
+            current.is_explicit_vr = ds->is_explicit_vr;
+            current.is_little_endian = ds->is_little_endian;
+        }
+
+        const encoding* e = in_file_meta ? &meta : &current;
+        const uint16_t group = get_u16(e, *pos);
+        const uint16_t element = get_u16(e, *pos + 2);
+        const uint32_t tag = ((uint32_t)group << 16) | element;
+
+        if (depth == 0 && tag > st->stop_tag && group != 0xFFFE) {
+            st->stopped = true;
+            break;
+        }
+
+        if (group == 0xFFFE) {
+            if (depth > 0 && element == 0xE00D) { *pos += 8; }
+            else if (depth == 0 || element != 0xE0DD) { st->truncated = true; }
+            break;  // Sequence delimiter without item delimiter: let build_items pick it up
+        }
+
+        uint16_t vr;
+        uint32_t length;
+        uint8_t header_size;
+
+        if (e->is_explicit_vr) {
+            vr = DICOM_VR(e->data[*pos + 4], e->data[*pos + 5]);
+            if (!is_known_vr(vr)) {
+                st->truncated = true;
+                break;
+            }
+
+            if (is_long_vr(vr)) {
+                if (*pos + 12 > end) {
+                    st->truncated = true;
+                    break;
+                }
+                length = get_u32(e, *pos + 8);
+                header_size = 12;
+            }
+            else {
+                length = get_u16(e, *pos + 6);
+                header_size = 8;
+            }
+        }
+        else {
+            length = get_u32(e, *pos + 4);
+            vr = dict_vr_code(tag);
+            header_size = 8;
+        }
+
+        const size_t node_index = st->stack_len;
+        if (push_node(st) == NULL) { return -1; }
+        DICOM_STATS_ADD(elements, 1);
+
+        dicom_node node = {0};
+        node.tag = tag;
+        node.vr = vr;
+        node.length = length;
+        node.header_size = header_size;
+        node.offset = *pos + header_size;
+        *pos += header_size;
+
+        if (depth == 0 && tag == PARALLEL_SEQUENCE_TAG && vr == DICOM_VR('S', 'Q') && st->threads > 1) {
+            if (build_items_parallel(st, e, pos, &node, depth, ds) != 0) { return -1; }
+        }
+        else if (vr == DICOM_VR('S', 'Q') || (length == DICOM_UNDEFINED_LENGTH && vr == DICOM_VR('U', 'N'))) {
+            // Undefined length UN is a sequence encoded as implicit VR little endian (PS3.5 6.2.2)
+            const encoding un = {e->data, e->size, false, true};
+            const encoding* items_enc = vr == DICOM_VR('S', 'Q') ? e : &un;
+            if (build_items(st, items_enc, pos, &node, depth, false, ds) != 0) { return -1; }
+        }
+        else if (length == DICOM_UNDEFINED_LENGTH) {
+            if (build_items(st, e, pos, &node, depth, true, ds) != 0) { return -1; }
+        }
+        else if (length > end - *pos) {
+            st->truncated = true;
+            st->stack_len = node_index;
+            break;
+        }
+        else {
+            *pos += length;
+            node.end = *pos;
+        }
+
+        st->stack[node_index] = node;
+
+        // Transfer syntax decides how everything after the meta group is encoded
+        if (tag == 0x00020010) { set_transfer_syntax(ds, e->data + node.offset, length); }
+
+        if (st->truncated) { break; }
+    }
+
+    if (*pos < end && *pos + 8 > end && depth == 0 && !st->stopped) { st->truncated = true; }
+    return finish_container(st, first, parent);
+}
+
+int dicom_dataset_parse(const uint8_t* data, const size_t size, dicom_arena* arena, dicom_dataset* ds) {
+    return dicom_dataset_parse_until(data, size, DICOM_TAG_LAST, arena, ds);
+}
+
+static int build_top_level(build_state* st, const uint8_t* data, const size_t size, const size_t start,
+                           dicom_dataset* ds) {
+    const encoding enc = {data, size, ds->is_explicit_vr, ds->is_little_endian};
+    size_t pos = start;
+
+    const int result = build_elements(st, &enc, &pos, size, 0, &ds->root, ds);
+    free(st->stack);
+
+    ds->root.offset = start;
+    ds->root.end = pos;
+    ds->root.length = (uint32_t)(pos - ds->root.offset);
+    ds->is_truncated = st->truncated;
+    ds->is_partial = st->stopped;
+    return result;
+}
+
+static int parse_part10(const uint8_t* data, const size_t size, const uint32_t stop_tag, const int threads,
+                        dicom_arena* arena, dicom_dataset* ds) {
+    memset(ds, 0, sizeof(*ds));
+    ds->data = data;
+    ds->size = size;
+    ds->is_explicit_vr = true;
+    ds->is_little_endian = true;
+    ds->root.tag = 0;
+
+    if (size < DICOM_PREAMBLE_SIZE + DICOM_PREFIX_SIZE ||
+        memcmp(data + DICOM_PREAMBLE_SIZE, DICOM_PREFIX, DICOM_PREFIX_SIZE) != 0) {
+        return -1;
+    }
+
+    dicom_stats_phase(DICOM_PHASE_META);
+    build_state st = {.arena = arena, .stop_tag = stop_tag, .has_meta = true, .threads = threads};
+    return build_top_level(&st, data, size, DICOM_PREAMBLE_SIZE + DICOM_PREFIX_SIZE, ds);
+}
+
+int dicom_dataset_parse_until(const uint8_t* data, const size_t size, const uint32_t stop_tag, dicom_arena* arena,
+                              dicom_dataset* ds) {
+    return parse_part10(data, size, stop_tag, 1, arena, ds);
+}
+
+int dicom_dataset_parse_raw(const uint8_t* data, const size_t size, const char* transfer_syntax_uid,
+                            const uint32_t stop_tag, dicom_arena* arena, dicom_dataset* ds) {
+    memset(ds, 0, sizeof(*ds));
+    ds->data = data;
+    ds->size = size;
+    snprintf(ds->transfer_syntax_uid, sizeof(ds->transfer_syntax_uid), "%s", transfer_syntax_uid);
+    apply_transfer_syntax(ds);
+
+    dicom_stats_phase(DICOM_PHASE_DATASET);
+    build_state st = {.arena = arena, .stop_tag = stop_tag, .has_meta = false};
+    return build_top_level(&st, data, size, 0, ds);
+}
+
+int dicom_dataset_load(const char* filename, dicom_arena* arena, dicom_dataset* ds) {
+    return dicom_dataset_load_until(filename, DICOM_TAG_LAST, arena, ds);
+}
+
+static int load_part10(const char* filename, const uint32_t stop_tag, const int threads, dicom_arena* arena,
+                      dicom_dataset* ds) {
+    dicom_file_map map;
+    if (dicom_file_map_open(filename, &map) != 0) {
+        memset(ds, 0, sizeof(*ds));
+        return -1;
+    }
+
+    const int result = parse_part10(map.data, map.size, stop_tag, threads, arena, ds);
+    ds->map = map;
+    if (result != 0) { dicom_dataset_close(ds); }
+    return result;
+}
+
+int dicom_dataset_load_until(const char* filename, const uint32_t stop_tag, dicom_arena* arena, dicom_dataset* ds) {
+    return load_part10(filename, stop_tag, 1, arena, ds);
+}
+
+int dicom_dataset_load_parallel(const char* filename, const int threads, dicom_arena* arena, dicom_dataset* ds) {
+    return load_part10(filename, DICOM_TAG_LAST, threads, arena, ds);
+}
+
+/*
+ * Path seeks read element headers only. Each step looks for its tag among the elements of one
+ * level and steps over everything before it by its length; undefined lengths are walked with the
+ * structural skip. Levels are searched to their end rather than to the first larger tag, since files
+ * with elements out of order do turn up (see DICOM_NODE_UNSORTED).
+ * Returns 0 with the element in `found`, 1 when the level has no such element, -1 when malformed.
+ */
+static int seek_element(const encoding* enc, size_t* pos, const size_t end, const uint32_t tag, dicom_node* found) {
+    while (*pos + 8 <= end) {
+        const uint16_t group = get_u16(enc, *pos);
+        const uint32_t current = ((uint32_t)group << 16) | get_u16(enc, *pos + 2);
+        if (group == 0xFFFE) { return current == DICOM_TAG_ITEM_DELIMITATION ? 1 : -1; }
+
+        uint16_t vr = 0;
+        uint32_t length;
+        uint8_t header_size = 8;
+        if (enc->is_explicit_vr) {
+            vr = DICOM_VR(enc->data[*pos + 4], enc->data[*pos + 5]);
+            if (!is_known_vr(vr)) { return -1; }
+            if (is_long_vr(vr)) {
+                if (*pos + 12 > end) { return -1; }
+                length = get_u32(enc, *pos + 8);
+                header_size = 12;
+            }
+            else { length = get_u16(enc, *pos + 6); }
+        }
+        else {
+            length = get_u32(enc, *pos + 4);
+            if (current == tag) { vr = dict_vr_code(tag); }
+        }
+
+        if (current == tag) {
+            memset(found, 0, sizeof(*found));
+            found->tag = tag;
+            found->vr = vr;
+            found->length = length;
+            found->header_size = header_size;
+            found->offset = *pos + header_size;
+            if (length != DICOM_UNDEFINED_LENGTH) { found->end = found->offset + length; }
+            return 0;
+        }
+
+        *pos += header_size;
+        if (length == DICOM_UNDEFINED_LENGTH) {
+            const encoding un = {enc->data, enc->size, false, true};
+            if (skip_items(vr == DICOM_VR('U', 'N') ? &un : enc, pos, enc->size, 1) != 0) { return -1; }
+        }
+        else if (length > end - *pos) { return -1; }
+        else { *pos += length; }
+    }
+    return 1;
+}
+
+/*
+ * Item `index` of a sequence, reached by jumping over the items before it. `passed` counts the items
+ * stepped over, so an index past the end counts them all. Returns 0, 1 (no such item) or -1.
+ */
+static int seek_item(const encoding* enc, const dicom_node* seq, const uint32_t index, dicom_node* item,
+                     uint32_t* passed) {
+    const bool undefined = seq->length == DICOM_UNDEFINED_LENGTH;
+    const size_t seq_end = sequence_end(enc, seq);
+    size_t pos = (size_t)seq->offset;
+    *passed = 0;
+    if (seq_end > enc->size) { return -1; }
+
+    while (pos + 8 <= seq_end) {
+        const uint16_t group = get_u16(enc, pos);
+        const uint16_t element = get_u16(enc, pos + 2);
+        const uint32_t length = get_u32(enc, pos + 4);
+        if (group != 0xFFFE || (element != 0xE000 && element != 0xE0DD)) { return -1; }
+        if (element == 0xE0DD) { return 1; }
+
+        pos += 8;
+        if (length != DICOM_UNDEFINED_LENGTH && length > seq_end - pos) { return -1; }
+        if (*passed == index) {
+            memset(item, 0, sizeof(*item));
+            item->tag = DICOM_TAG_ITEM;
+            item->length = length;
+            item->header_size = 8;
+            item->offset = pos;
+            if (length != DICOM_UNDEFINED_LENGTH) { item->end = pos + length; }
+            return 0;
+        }
+
+        if (length == DICOM_UNDEFINED_LENGTH) {
+            if (skip_elements(enc, &pos, enc->size, 1) != 0) { return -1; }
+        }
+        else { pos += length; }
+        (*passed)++;
+    }
+    return undefined ? -1 : 1;
+}
+
+static int seek_path(const encoding* enc, size_t pos, size_t end, const dicom_tag_path* path,
+                     dicom_path_span* spans) {
+    const encoding un = {enc->data, enc->size, false, true};
+    encoding level = *enc;
+
+    for (int i = 0; i < path->count; i++) {
+        dicom_node* element = &spans[i].element;
+        const int found = seek_element(&level, &pos, end, path->steps[i].tag, element);
+        if (found != 0) { return found; }
+
+        // Undefined length UN is a sequence encoded as implicit VR little endian (PS3.5 6.2.2)
+        const bool is_sequence = element->vr == DICOM_VR('S', 'Q') ||
+            (element->length == DICOM_UNDEFINED_LENGTH && element->vr == DICOM_VR('U', 'N'));
+        const encoding* items_enc = element->vr == DICOM_VR('S', 'Q') ? &level : &un;
+        uint32_t passed;
+
+        if (i == path->count - 1) {
+            // Counting the items of the result still only reads item headers
+            if (is_sequence) {
+                seek_item(items_enc, element, UINT32_MAX, NULL, &passed);
+                element->child_count = passed;
+            }
+            return 0;
+        }
+
+        if (!is_sequence) { return 1; }
+        const int entered = seek_item(items_enc, element, path->steps[i].item, &spans[i].item, &passed);
+        if (entered != 0) { return entered; }
+
+        level = *items_enc;
+        pos = (size_t)spans[i].item.offset;
+        end = spans[i].item.length == DICOM_UNDEFINED_LENGTH ? enc->size : (size_t)spans[i].item.end;
+    }
+    return 1;
+}
+
+int dicom_dataset_seek_buffer(const uint8_t* data, const size_t size, const dicom_tag_path* path, dicom_dataset* ds,
+                              dicom_path_span* spans) {
+    memset(ds, 0, sizeof(*ds));
+    memset(spans, 0, (size_t)path->count * sizeof(dicom_path_span));
+    ds->data = data;
+    ds->size = size;
+    ds->is_explicit_vr = true;
+    ds->is_little_endian = true;
+
+    if (size < DICOM_PREAMBLE_SIZE + DICOM_PREFIX_SIZE ||
+        memcmp(data + DICOM_PREAMBLE_SIZE, DICOM_PREFIX, DICOM_PREFIX_SIZE) != 0) {
+        return -1;
+    }
+
+    // The meta group is short and always explicit VR LE; it gives the encoding of the rest
+    const encoding meta = {data, size, true, true};
+    const size_t meta_start = DICOM_PREAMBLE_SIZE + DICOM_PREFIX_SIZE;
+    size_t pos = meta_start;
+    while (pos + 8 <= size && get_u16(&meta, pos) == 0x0002) {
+        const uint16_t vr = DICOM_VR(data[pos + 4], data[pos + 5]);
+        if (!is_known_vr(vr) || (is_long_vr(vr) && pos + 12 > size)) { return -1; }
+        const uint8_t header_size = is_long_vr(vr) ? 12 : 8;
+        const uint32_t length = is_long_vr(vr) ? get_u32(&meta, pos + 8) : get_u16(&meta, pos + 6);
+        if (length > size - pos - header_size) { return -1; }
+
+        if (get_u16(&meta, pos + 2) == 0x0010) { set_transfer_syntax(ds, data + pos + header_size, length); }
+        pos += header_size + length;
+    }
+
+    if (path->count > 0 && (path->steps[0].tag >> 16) == 0x0002) {
+        return seek_path(&meta, meta_start, pos, path, spans);
+    }
+
+    const encoding enc = {data, size, ds->is_explicit_vr, ds->is_little_endian};
+    return seek_path(&enc, pos, size, path, spans);
+}
+
+int dicom_dataset_seek(const char* filename, const dicom_tag_path* path, dicom_dataset* ds, dicom_path_span* spans) {
+    dicom_file_map map;
+    if (dicom_file_map_open(filename, &map) != 0) {
+        memset(ds, 0, sizeof(*ds));
+        return -1;
+    }
+
+    const int result = dicom_dataset_seek_buffer(map.data, map.size, path, ds, spans);
+    ds->map = map;
+    if (result < 0) { dicom_dataset_close(ds); }
+    return result;
+}
+
+void dicom_dataset_close(dicom_dataset* ds) {
+    if (ds->map.data != NULL) { dicom_file_map_close(&ds->map); }
+    for (size_t i = 0; i < ds->item_arena_count; i++) { dicom_arena_free(&ds->item_arenas[i]); }
+    free(ds->item_arenas);
+    ds->item_arenas = NULL;
+    ds->item_arena_count = 0;
+    ds->data = NULL;
+    ds->size = 0;
+    ds->root.children = NULL;
+    ds->root.child_count = 0;
+}
+
+const dicom_node* dicom_dataset_find(const dicom_node* parent, const uint32_t tag) {
+    if (parent == NULL || parent->children == NULL) { return NULL; }
+
+    if (parent->flags & DICOM_NODE_UNSORTED) {
+        for (uint32_t i = 0; i < parent->child_count; i++) {
+            if (parent->children[i].tag == tag) { return &parent->children[i]; }
+        }
+        return NULL;
+    }
+
+    uint32_t left = 0;
+    uint32_t right = parent->child_count;
+    while (left < right) {
+        const uint32_t mid = left + (right - left) / 2;
+        const uint32_t mid_tag = parent->children[mid].tag;
+
+        if (mid_tag == tag) { return &parent->children[mid]; }
+        if (mid_tag < tag) { left = mid + 1; }
+        else { right = mid; }
+    }
+
+    return NULL;
+}
+
+const uint8_t* dicom_node_value(const dicom_dataset* ds, const dicom_node* node) {
+    if (node->length == DICOM_UNDEFINED_LENGTH || node->offset + node->length > ds->size) { return NULL; }
+    return ds->data + node->offset;
+}
+
+bool dicom_node_is_little_endian(const dicom_dataset* ds, const dicom_node* node) {
+    return (node->tag >> 16) == 0x0002 || ds->is_little_endian;
+}
+
+size_t dicom_node_string(const dicom_dataset* ds, const dicom_node* node, char* buffer, const size_t buffer_size) {
+    if (buffer_size == 0) { return 0; }
+
+    const uint8_t* value = dicom_node_value(ds, node);
+    size_t length = value != NULL ? node->length : 0;
+    if (length > buffer_size - 1) { length = buffer_size - 1; }
+
+    if (length > 0) { memcpy(buffer, value, length); }
+    while (length > 0 && (buffer[length - 1] == ' ' || buffer[length - 1] == '\0')) { length--; }
+    buffer[length] = '\0';
+    return length;
+}
+
+bool dicom_node_uint(const dicom_dataset* ds, const dicom_node* node, uint32_t* value) {
+    const uint8_t* data = dicom_node_value(ds, node);
+    if (data == NULL) { return false; }
+
+    const encoding enc = {data, node->length, true, dicom_node_is_little_endian(ds, node)};
+    switch (node->vr) {
+    case DICOM_VR('U', 'S'):
+    case DICOM_VR('S', 'S'):
+        if (node->length < 2) { return false; }
+        *value = get_u16(&enc, 0);
+        return true;
+    case DICOM_VR('U', 'L'):
+    case DICOM_VR('S', 'L'):
+        if (node->length < 4) { return false; }
+        *value = get_u32(&enc, 0);
+        return true;
+    default:
+        return false;
+    }
+}
+
+void dicom_vr_string(const uint16_t vr, char out[3]) {
+    if (vr == 0) {
+        out[0] = '-';
+        out[1] = '-';
+    }
+    else {
+        out[0] = (char)(vr >> 8);
+        out[1] = (char)(vr & 0xFF);
+    }
+    out[2] = '\0';
+}
@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "dicom_dict.h"
+#include "dicom_stats.h"
 
 const dicom_element dicom_dictionary[DICOM_DICT_SIZE] = {
     {0x00000000, "UL", "1", "Command Group Length", "CommandGroupLength", 0},
@@ -6515,31 +6516,37 @@ const dicom_mask_element* dicom_mask_lookup(const uint32_t tag) {
 }
 
 const char* dicom_get_name(const uint32_t tag) {
+    DICOM_STATS_ADD(dict_lookups, 1);
     const dicom_element* entry = dicom_dict_lookup(tag);
     if (entry != NULL) { return entry->name; }
 
     const dicom_mask_element* mask_entry = dicom_mask_lookup(tag);
     if (mask_entry != NULL) { return mask_entry->name; }
 
+    DICOM_STATS_ADD(dict_misses, 1);
     return NULL;
 }
 
 const char* dicom_get_vr(const uint32_t tag) {
+    DICOM_STATS_ADD(dict_lookups, 1);
     const dicom_element* entry = dicom_dict_lookup(tag);
     if (entry != NULL) { return entry->vr; }
 
     const dicom_mask_element* mask_entry = dicom_mask_lookup(tag);
     if (mask_entry != NULL) { return mask_entry->vr; }
 
+    DICOM_STATS_ADD(dict_misses, 1);
     return NULL;
 }
 
 const char* dicom_get_keyword(const uint32_t tag) {
+    DICOM_STATS_ADD(dict_lookups, 1);
     const dicom_element* entry = dicom_dict_lookup(tag);
     if (entry != NULL) { return entry->keyword; }
 
     const dicom_mask_element* mask_entry = dicom_mask_lookup(tag);
     if (mask_entry != NULL) { return mask_entry->keyword; }
 
+    DICOM_STATS_ADD(dict_misses, 1);
     return NULL;
 }
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "dicom_dir.h"
+#include "dicom_dataset.h"
+
+#define TAG_ROOT_RECORD_OFFSET 0x00041200
+#define TAG_DIRECTORY_RECORD_SEQUENCE 0x00041220
+#define TAG_NEXT_RECORD_OFFSET 0x00041400
+#define TAG_RECORD_IN_USE 0x00041410
+#define TAG_LOWER_LEVEL_OFFSET 0x00041420
+#define TAG_RECORD_TYPE 0x00041430
+#define TAG_REFERENCED_FILE_ID 0x00041500
+#define TAG_REFERENCED_SOP_INSTANCE_UID 0x00041511
+
+#define MAX_RECORD_DEPTH 16
+#define MAX_PATH_LENGTH 1024
+
+typedef struct {
+    uint32_t tag;
+    const char* label;
+} record_field;
+
+typedef struct {
+    const char* type;
+    record_field fields[4];
+} record_layout;
+
+// Attributes worth a column per record type, anything else only shows its type and file
+static const record_layout layouts[] = {
+    {"PATIENT", {{0x00100020, "id"}, {0x00100010, "name"}, {0, NULL}}},
+    {"STUDY", {{0x0020000D, "uid"}, {0x00080020, "date"}, {0x00080050, "accession"}, {0x00081030, "description"}}},
+    {"SERIES", {{0x0020000E, "uid"}, {0x00080060, "modality"}, {0x00200011, "number"}, {0, NULL}}},
+    {"IMAGE", {{0x00200013, "number"}, {TAG_REFERENCED_SOP_INSTANCE_UID, "sop"}, {0, NULL}}},
+};
+
+typedef struct {
+    const dicom_dataset* ds;
+    const dicom_node* records;  // The Directory Record Sequence
+    uint8_t* visited;           // Per record, so that offsets pointing backwards cannot loop
+    char base[MAX_PATH_LENGTH]; // Directory of the DICOMDIR, with a trailing separator
+    uint32_t counts[sizeof(layouts) / sizeof(layouts[0]) + 1];
+    uint32_t inactive;
+    uint32_t bad_offsets;
+} dir_walk;
+
+// Items are in file order, so the record an offset points at is found by binary search
+static int32_t record_at(const dir_walk* walk, const uint32_t offset) {
+    uint32_t left = 0;
+    uint32_t right = walk->records->child_count;
+    while (left < right) {
+        const uint32_t mid = left + (right - left) / 2;
+        const dicom_node* item = &walk->records->children[mid];
+        const uint64_t start = item->offset - item->header_size;
+
+        if (start == offset) { return (int32_t)mid; }
+        if (start < offset) { left = mid + 1; }
+        else { right = mid; }
+    }
+    return -1;
+}
+
+static uint32_t record_uint(const dir_walk* walk, const dicom_node* item, const uint32_t tag) {
+    uint32_t value = 0;
+    const dicom_node* node = dicom_dataset_find(item, tag);
+    if (node != NULL) { dicom_node_uint(walk->ds, node, &value); }
+    return value;
+}
+
+static size_t record_string(const dir_walk* walk, const dicom_node* item, const uint32_t tag, char* buffer,
+                            const size_t size) {
+    const dicom_node* node = dicom_dataset_find(item, tag);
+    if (node != NULL) { return dicom_node_string(walk->ds, node, buffer, size); }
+    buffer[0] = '\0';
+    return 0;
+}
+
+// ReferencedFileID is a CS with one value per path component ("DIR1\SUB\FILE0001")
+static bool resolve_file_id(const dir_walk* walk, const dicom_node* item, char* path, const size_t size) {
+    char file_id[MAX_PATH_LENGTH];
+    if (record_string(walk, item, TAG_REFERENCED_FILE_ID, file_id, sizeof(file_id)) == 0) { return false; }
+
+    for (char* p = file_id; *p != '\0'; p++) {
+#ifdef _WIN32
+        if (*p == '/') { *p = '\\'; }
+#else
+        if (*p == '\\') { *p = '/'; }
+#endif
+    }
+    snprintf(path, size, "%s%s", walk->base, file_id);
+    return true;
+}
+
+static void print_record(dir_walk* walk, const dicom_node* item, const int depth) {
+    char type[17];
+    char value[256];
+    char path[MAX_PATH_LENGTH * 2];
+    record_string(walk, item, TAG_RECORD_TYPE, type, sizeof(type));
+
+    size_t layout = 0;
+    while (layout < sizeof(layouts) / sizeof(layouts[0]) && strcmp(layouts[layout].type, type) != 0) { layout++; }
+    walk->counts[layout]++;
+
+    printf("%*s%s", depth * 4, "", type[0] != '\0' ? type : "(no type)");
+    if (layout < sizeof(layouts) / sizeof(layouts[0])) {
+        for (int i = 0; i < 4 && layouts[layout].fields[i].label != NULL; i++) {
+            if (record_string(walk, item, layouts[layout].fields[i].tag, value, sizeof(value)) > 0) {
+                printf(" %s=\"%s\"", layouts[layout].fields[i].label, value);
+            }
+        }
+    }
+    if (resolve_file_id(walk, item, path, sizeof(path))) { printf(" file=%s", path); }
+
+    // Retired, but inactive records (0x0000) are still written by some media creators
+    if (dicom_dataset_find(item, TAG_RECORD_IN_USE) != NULL && record_uint(walk, item, TAG_RECORD_IN_USE) == 0) {
+        printf(" (inactive)");
+        walk->inactive++;
+    }
+    printf("\n");
+}
+
+static void walk_records(dir_walk* walk, uint32_t offset, const int depth) {
+    while (offset != 0) {
+        const int32_t index = record_at(walk, offset);
+        if (index < 0 || walk->visited[index] || depth > MAX_RECORD_DEPTH) {
+            walk->bad_offsets++;
+            return;
+        }
+        walk->visited[index] = 1;
+
+        const dicom_node* item = &walk->records->children[index];
+        print_record(walk, item, depth);
+        walk_records(walk, record_uint(walk, item, TAG_LOWER_LEVEL_OFFSET), depth + 1);
+        offset = record_uint(walk, item, TAG_NEXT_RECORD_OFFSET);
+    }
+}
+
+static void set_base(dir_walk* walk, const char* filename) {
+    const char* slash = strrchr(filename, '/');
+#ifdef _WIN32
+    const char* backslash = strrchr(filename, '\\');
+    if (backslash != NULL && (slash == NULL || backslash > slash)) { slash = backslash; }
+#endif
+    const size_t length = slash != NULL ? (size_t)(slash - filename) + 1 : 0;
+    snprintf(walk->base, sizeof(walk->base), "%.*s", (int)length, filename);
+}
+
+int dump_dicomdir(const char* filename, dicom_arena* arena) {
+    dicom_arena_reset(arena);
+
+    dicom_dataset ds;
+    if (dicom_dataset_load(filename, arena, &ds) != 0) {
+        fprintf(stderr, "Error: Cannot read file '%s': Invalid DICOM file\n", filename);
+        return -1;
+    }
+
+    dir_walk walk;
+    memset(&walk, 0, sizeof(walk));
+    walk.ds = &ds;
+    walk.records = dicom_dataset_find(&ds.root, TAG_DIRECTORY_RECORD_SEQUENCE);
+    if (walk.records == NULL) {
+        fprintf(stderr, "Error: '%s' is not a DICOMDIR (no Directory Record Sequence)\n", filename);
+        dicom_dataset_close(&ds);
+        return -1;
+    }
+    if (ds.is_truncated) { fprintf(stderr, "Warning: DICOMDIR is truncated or malformed, records may be missing\n"); }
+
+    walk.visited = (uint8_t*)dicom_arena_alloc(arena, walk.records->child_count + 1);
+    if (walk.visited == NULL) {
+        dicom_dataset_close(&ds);
+        return -1;
+    }
+    memset(walk.visited, 0, walk.records->child_count + 1);
+    set_base(&walk, filename);
+
+    walk_records(&walk, record_uint(&walk, &ds.root, TAG_ROOT_RECORD_OFFSET), 0);
+
+    uint32_t unreachable = 0;
+    for (uint32_t i = 0; i < walk.records->child_count; i++) { unreachable += walk.visited[i] == 0; }
+
+    printf("\n[DICOMDIR: %u records, %u patients, %u studies, %u series, %u images, %u other",
+           walk.records->child_count, walk.counts[0], walk.counts[1], walk.counts[2], walk.counts[3], walk.counts[4]);
+    if (walk.inactive > 0) { printf(", %u inactive", walk.inactive); }
+    if (unreachable > 0) { printf(", %u unreachable", unreachable); }
+    if (walk.bad_offsets > 0) { printf(", %u bad offsets", walk.bad_offsets); }
+    printf("]\n");
+
+    dicom_dataset_close(&ds);
+    return 0;
+}
@@ -4,6 +4,103 @@
 #include <stdio.h>
 #include <limits.h>
 #include "dicom_display.h"
+#include "dicom_simd.h"
+
+#define DECODE_CHUNK 256
+
+// Bytes per value of the VRs -m decodes; the O* VRs are the word arrays (LUT data and the like)
+static uint32_t numeric_value_width(const char* vr) {
+    if (strcmp(vr, "US") == 0 || strcmp(vr, "SS") == 0 || strcmp(vr, "OW") == 0) { return 2; }
+    if (strcmp(vr, "UL") == 0 || strcmp(vr, "SL") == 0 || strcmp(vr, "FL") == 0 || strcmp(vr, "AT") == 0 ||
+        strcmp(vr, "OL") == 0 || strcmp(vr, "OF") == 0) {
+        return 4;
+    }
+    if (strcmp(vr, "FD") == 0 || strcmp(vr, "OD") == 0) { return 8; }
+    return 0;
+}
+
+// Writes printable ASCII up to the first NUL in contiguous runs, dropping any other byte except UTF-8 when asked
+static void write_printable(const uint8_t* data, const uint32_t length, const bool keep_utf8) {
+    uint32_t pos = 0;
+    while (pos < length) {
+        const uint32_t run = (uint32_t)dicom_printable_run(data + pos, length - pos);
+        fwrite(data + pos, 1, run, stdout);
+        pos += run;
+
+        if (pos >= length || data[pos] == 0) { break; }
+        if (keep_utf8 && data[pos] >= 0x80) { putchar(data[pos]); }
+        pos++;
+    }
+}
+
+static bool uses_specific_charset(const char* vr) {
+    return strcmp(vr, "LO") == 0 || strcmp(vr, "LT") == 0 || strcmp(vr, "PN") == 0 || strcmp(vr, "SH") == 0 ||
+        strcmp(vr, "ST") == 0 || strcmp(vr, "UC") == 0 || strcmp(vr, "UT") == 0;
+}
+
+/*
+ * Text VRs are converted to UTF-8 per Specific Character Set before they are cut to max_chars characters,
+ * so a multi-byte character is never split; pure ASCII values are written as they are. Returns whether
+ * the value was cut.
+ */
+static bool write_text(const char* vr, const uint8_t* data, const uint32_t length, const uint32_t max_chars,
+                       const display_context* ctx) {
+    if (ctx->charset == NULL || ctx->arena == NULL || !uses_specific_charset(vr)) {
+        write_printable(data, length < max_chars ? length : max_chars, false);
+        return length > max_chars;
+    }
+
+    const dicom_arena_mark mark = dicom_arena_save(ctx->arena);
+    size_t utf8_length;
+    const uint8_t* utf8 = dicom_charset_to_utf8(ctx->charset, data, length, ctx->arena, &utf8_length);
+    const size_t shown = dicom_utf8_prefix(utf8, utf8_length, max_chars);
+    write_printable(utf8, (uint32_t)shown, true);
+    dicom_arena_restore(ctx->arena, mark);
+    return shown < utf8_length;
+}
+
+// Decodes the whole array in chunks through the SIMD kernels and prints it backslash separated
+static void display_all_values(const char* vr, const uint8_t* data, const uint32_t length, const display_context* ctx) {
+    const uint32_t width = numeric_value_width(vr);
+    const bool is_at = strcmp(vr, "AT") == 0;
+    const uint32_t count = length / width;
+
+    union {
+        uint16_t u16[DECODE_CHUNK * 2];
+        uint32_t u32[DECODE_CHUNK];
+        uint64_t u64[DECODE_CHUNK];
+    } buf;
+
+    for (uint32_t start = 0; start < count; start += DECODE_CHUNK) {
+        const uint32_t n = count - start < DECODE_CHUNK ? count - start : DECODE_CHUNK;
+        const uint8_t* src = data + (size_t)start * width;
+
+        // AT is a pair of 16-bit values (group, element), each swapped on its own
+        if (width == 2 || is_at) { dicom_decode_16(src, (size_t)n * (width / 2), ctx->is_little_endian, buf.u16); }
+        else if (width == 4) { dicom_decode_32(src, n, ctx->is_little_endian, buf.u32); }
+        else { dicom_decode_64(src, n, ctx->is_little_endian, buf.u64); }
+
+        for (uint32_t i = 0; i < n; i++) {
+            if (start + i > 0) { putchar('\\'); }
+
+            if (is_at) { printf("(%04X,%04X)", buf.u16[i * 2], buf.u16[i * 2 + 1]); }
+            else if (strcmp(vr, "US") == 0 || strcmp(vr, "OW") == 0) { printf("%u", buf.u16[i]); }
+            else if (strcmp(vr, "SS") == 0) { printf("%d", (int16_t)buf.u16[i]); }
+            else if (strcmp(vr, "UL") == 0 || strcmp(vr, "OL") == 0) { printf("%u", buf.u32[i]); }
+            else if (strcmp(vr, "SL") == 0) { printf("%d", (int32_t)buf.u32[i]); }
+            else if (strcmp(vr, "FL") == 0 || strcmp(vr, "OF") == 0) {
+                float val;
+                memcpy(&val, &buf.u32[i], sizeof(float));
+                printf("%g", val);
+            }
+            else {
+                double val;
+                memcpy(&val, &buf.u64[i], sizeof(double));
+                printf("%g", val);
+            }
+        }
+    }
+}
 
 void display_value(const char* vr, const uint8_t* data, const uint32_t length, const int depth, const display_context* ctx) {
     if (data == NULL || length == 0 || length == 0xFFFFFFFF) {
@@ -22,16 +119,13 @@ void display_value(const char* vr, const uint8_t* data, const uint32_t length, c
         strcmp(vr, "PN") == 0 || strcmp(vr, "SH") == 0 || strcmp(vr, "ST") == 0 ||
         strcmp(vr, "TM") == 0 || strcmp(vr, "UC") == 0 || strcmp(vr, "UI") == 0 ||
         strcmp(vr, "UR") == 0 || strcmp(vr, "UT") == 0) {
-        const uint32_t display_len = length < max_val_width ? length : max_val_width;
-
         printf("\"");
-        for (uint32_t i = 0; i < display_len; i++) {
-            if (data[i] >= 32 && data[i] < 127) { putchar(data[i]); }
-            else if (data[i] == 0) { break; }
-        }
-        if (length > max_val_width) { printf("..."); }
+        if (write_text(vr, data, length, max_val_width, ctx)) { printf("..."); }
         printf("\"");
     }
+    else if (ctx->show_all_values && numeric_value_width(vr) > 0 && length >= 2 * numeric_value_width(vr)) {
+        display_all_values(vr, data, length, ctx);
+    }
     else if (strcmp(vr, "US") == 0) {
         if (length >= 2) {
             uint16_t val;
@@ -133,20 +227,14 @@ void display_value(const char* vr, const uint8_t* data, const uint32_t length, c
     else if (strcmp(vr, "SQ") == 0) { printf("(sequence)"); }
     else if (strcmp(vr, "UN") == 0 && length > 0 && length < 256) {
         // tries to interpret unknown tags (typically private ones) as a string to see if we can show something
-        uint32_t printable_count = 0;
-        for (uint32_t i = 0; i < length && i < 100; i++) {
-            if ((data[i] >= 32 && data[i] < 127) || data[i] == '\n' || data[i] == '\r' || data[i] == '\t') {
-                printable_count++;
-            }
-        }
+        dicom_text_scan_result scan;
+        dicom_text_scan(data, length < 100 ? length : 100, &scan);
+        const uint32_t printable_count = (uint32_t)scan.text_bytes;
         if (printable_count > (length * 5 / 10)) {
             const uint32_t display_len = length < max_val_width ? length : max_val_width;
 
             printf("\"");
-            for (uint32_t i = 0; i < display_len; i++) {
-                if (data[i] >= 32 && data[i] < 127) { putchar(data[i]); }
-                else if (data[i] == 0) { break; }
-            }
+            write_printable(data, display_len, false);
             if (length > max_val_width) { printf("..."); }
             printf("\" [interpreted]");
         } else {
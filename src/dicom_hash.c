@@ -0,0 +1,152 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "dicom_hash.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static uint64_t rotl64(const uint64_t x, const int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Byte-wise little endian reads; compilers turn these into single loads on x86 and ARM
+static uint64_t read_u64(const uint8_t* p) {
+    return (uint64_t)p[0] | ((uint64_t)p[1] << 8) | ((uint64_t)p[2] << 16) | ((uint64_t)p[3] << 24) |
+           ((uint64_t)p[4] << 32) | ((uint64_t)p[5] << 40) | ((uint64_t)p[6] << 48) | ((uint64_t)p[7] << 56);
+}
+
+static uint32_t read_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t xxh64_round(uint64_t acc, const uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, const uint64_t lane) {
+    acc ^= xxh64_round(0, lane);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+static void process_stripes(uint64_t lanes[4], const uint8_t* p, const size_t stripes) {
+    uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+    for (size_t i = 0; i < stripes; i++, p += 32) {
+        v1 = xxh64_round(v1, read_u64(p));
+        v2 = xxh64_round(v2, read_u64(p + 8));
+        v3 = xxh64_round(v3, read_u64(p + 16));
+        v4 = xxh64_round(v4, read_u64(p + 24));
+    }
+    lanes[0] = v1;
+    lanes[1] = v2;
+    lanes[2] = v3;
+    lanes[3] = v4;
+}
+
+void dicom_xxh64_init(dicom_xxh64* state, const uint64_t seed) {
+    state->lanes[0] = seed + PRIME64_1 + PRIME64_2;
+    state->lanes[1] = seed + PRIME64_2;
+    state->lanes[2] = seed;
+    state->lanes[3] = seed - PRIME64_1;
+    state->total = 0;
+    state->seed = seed;
+    state->buffered = 0;
+}
+
+void dicom_xxh64_update(dicom_xxh64* state, const void* data, size_t length) {
+    const uint8_t* p = (const uint8_t*)data;
+    state->total += length;
+
+    if (state->buffered > 0) {
+        const size_t take = length < 32 - state->buffered ? length : 32 - state->buffered;
+        memcpy(state->buffer + state->buffered, p, take);
+        state->buffered += take;
+        p += take;
+        length -= take;
+        if (state->buffered < 32) { return; }
+        process_stripes(state->lanes, state->buffer, 1);
+        state->buffered = 0;
+    }
+
+    process_stripes(state->lanes, p, length / 32);
+    p += length & ~(size_t)31;
+    length &= 31;
+
+    memcpy(state->buffer, p, length);
+    state->buffered = length;
+}
+
+uint64_t dicom_xxh64_digest(const dicom_xxh64* state) {
+    uint64_t h;
+    if (state->total >= 32) {
+        const uint64_t* v = state->lanes;
+        h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+        for (int i = 0; i < 4; i++) { h = xxh64_merge(h, v[i]); }
+    }
+    else { h = state->seed + PRIME64_5; }
+    h += state->total;
+
+    const uint8_t* p = state->buffer;
+    size_t remaining = state->buffered;
+    for (; remaining >= 8; remaining -= 8, p += 8) {
+        h ^= xxh64_round(0, read_u64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (remaining >= 4) {
+        h ^= (uint64_t)read_u32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+        remaining -= 4;
+    }
+    for (; remaining > 0; remaining--, p++) {
+        h ^= *p * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static const dicom_node* find_pixel_data(const dicom_dataset* ds) {
+    static const uint32_t tags[] = {0x7FE00010, 0x7FE00008, 0x7FE00009};
+    for (size_t i = 0; i < sizeof(tags) / sizeof(tags[0]); i++) {
+        const dicom_node* node = dicom_dataset_find(&ds->root, tags[i]);
+        if (node != NULL) { return node; }
+    }
+    return NULL;
+}
+
+int dicom_pixel_data_hash(const dicom_dataset* ds, uint64_t* digest, uint64_t* bytes) {
+    const dicom_node* node = find_pixel_data(ds);
+    if (node == NULL) { return -1; }
+
+    dicom_xxh64 state;
+    dicom_xxh64_init(&state, 0);
+    dicom_file_map_advise_sequential(&ds->map);
+
+    if (node->length != DICOM_UNDEFINED_LENGTH) {
+        dicom_xxh64_update(&state, ds->data + node->offset, node->length);
+    }
+    else {
+        // Fragment 0 is the Basic Offset Table, which says where frames start, not what they hold
+        for (uint32_t i = 1; i < node->child_count; i++) {
+            const dicom_node* fragment = &node->children[i];
+            if (fragment->length != DICOM_UNDEFINED_LENGTH) {
+                dicom_xxh64_update(&state, ds->data + fragment->offset, fragment->length);
+            }
+        }
+    }
+
+    *digest = dicom_xxh64_digest(&state);
+    *bytes = state.total;
+    return 0;
+}
@@ -12,6 +12,15 @@
 #include "dicom_header_parser.h"
 #include "dicom_dict.h"
 #include "dicom_display.h"
+#include "dicom_arena.h"
+#include "dicom_archive.h"
+#include "dicom_cache.h"
+#include "dicom_charset.h"
+#include "dicom_dataset.h"
+#include "dicom_hash.h"
+#include "dicom_json.h"
+#include "dicom_simd.h"
+#include "dicom_stats.h"
 
 #define DICOM_PREAMBLE_SIZE 128
 #define DICOM_PREFIX_SIZE 4
@@ -19,6 +28,11 @@
 #define TS_IMPLICIT_VR_LITTLE_ENDIAN "1.2.840.10008.1.2"
 #define TS_EXPLICIT_VR_LITTLE_ENDIAN "1.2.840.10008.1.2.1"
 #define TS_EXPLICIT_VR_BIG_ENDIAN "1.2.840.10008.1.2.2"
+#define DEFAULT_VALUE_READ_LENGTH 4096
+#define MAX_DISPLAY_VALUE_LENGTH (1024 * 1024)
+#define MAX_DAMAGE_RANGES 16
+#define RESYNC_WINDOW 4096
+#define RESYNC_OVERLAP 12  // Longest element header, so one that spans two windows is seen whole in the second
 
 static int global_terminal_width = 0;
 static int global_val_col_start = 108; // start of VALUE column
@@ -39,6 +53,14 @@ typedef enum {
     TRANSFER_EXPLICIT_VR_BIG_ENDIAN,
 } transfer_syntax_type;
 
+// --recover: byte ranges skipped to get past corrupt elements
+typedef struct {
+    long start[MAX_DAMAGE_RANGES];
+    long end[MAX_DAMAGE_RANGES];
+    int count;                  // Every range; only the first MAX_DAMAGE_RANGES are kept
+    long bytes;
+} damage_log;
+
 typedef struct {
     transfer_syntax_type ts_type;
     bool is_explicit_vr;
@@ -46,48 +68,94 @@ typedef struct {
     bool collapse_sequences;
     int max_sq_depth;
     bool overwrite_max_disp_len;
+    bool show_all_values;
+    uint32_t max_value_read;  // Bytes of a value read for display
+    dicom_arena* arena;  // Scratch memory for value buffers, reset per file
+    dicom_charset* charset;  // Specific Character Set of the dataset, text is printed as UTF-8
+    damage_log* damage;  // Resynchronize after an invalid VR and log the lost bytes, NULL to stop there
 } parser_state;
 
 static int parse_data_elements(FILE* fp, const parser_state* state, int depth, int max_elements, int* element_count,
-                               const tag_filter* filter);
+                               const tag_filter* filter, int scope, long end_pos);
+
+// fread/fseek with the --stats counters
+static size_t counted_fread(void* buffer, const size_t size, const size_t count, FILE* fp) {
+    const size_t read = fread(buffer, size, count, fp);
+    DICOM_STATS_ADD(read_calls, 1);
+    DICOM_STATS_ADD(bytes_read, read * size);
+    return read;
+}
+
+static int counted_fseek(FILE* fp, const long offset, const int origin) {
+    DICOM_STATS_ADD(seek_calls, 1);
+    return fseek(fp, offset, origin);
+}
 
 static display_context create_display_context(const parser_state* state) {
     return (display_context){
         .is_little_endian = state->is_little_endian,
         .overwrite_max_disp_len = state->overwrite_max_disp_len,
+        .show_all_values = state->show_all_values,
         .terminal_width = global_terminal_width,
         .val_col_start = global_val_col_start,
+        .charset = state->charset,
+        .arena = state->arena,
     };
 }
 
-static bool should_disp_tag(uint32_t tag, const tag_filter* filter) {
-    if (filter == NULL || filter->count == 0) { return true; }
-    for (int i = 0; i < filter->count; i++) { if (filter->tags[i] == tag) return true; }
-    return false;
+// display_value() accounted as rendering time for --stats
+static void render_value(const char* vr, const uint8_t* data, const uint32_t length, const int depth,
+                         const parser_state* state) {
+    const dicom_phase phase = dicom_stats_phase(DICOM_PHASE_RENDER);
+    const display_context ctx = create_display_context(state);
+    display_value(vr, data, length, depth, &ctx);
+    dicom_stats_phase(phase);
+}
+
+// Picks up (0008,0005) before the element is displayed or skipped, the file position is left unchanged
+static void read_specific_character_set(FILE* fp, const uint32_t length, const parser_state* state) {
+    uint8_t value[128];
+    if (length == 0 || length > sizeof(value)) { return; }
+
+    const long start_pos = ftell(fp);
+    const size_t bytes_read = counted_fread(value, 1, length, fp);
+    dicom_charset_set(state->charset, value, bytes_read);
+    counted_fseek(fp, start_pos, SEEK_SET);
+}
+
+// What -f does with an element in filter state `scope` (see dicom_filter); everything is shown without one
+static dicom_filter_action filter_action(const tag_filter* filter, const int scope, const uint32_t tag) {
+    if (filter == NULL || filter->paths == NULL) { return DICOM_FILTER_SHOW; }
+    return dicom_filter_match(filter->paths, scope, tag);
+}
+
+static int filter_item_scope(const tag_filter* filter, const int scope, const uint32_t tag, const uint32_t item) {
+    if (filter == NULL || filter->paths == NULL) { return DICOM_FILTER_ALL; }
+    return dicom_filter_item(filter->paths, scope, tag, item);
 }
 
 static uint16_t read_uint16_le(FILE* fp) {
     uint8_t buf[2];
-    if (fread(buf, 1, 2, fp) != 2) { return 0; }
+    if (counted_fread(buf, 1, 2, fp) != 2) { return 0; }
     return (uint16_t)buf[0] | ((uint16_t)buf[1] << 8);
 }
 
 static uint16_t read_uint16_be(FILE* fp) {
     uint8_t buf[2];
-    if (fread(buf, 1, 2, fp) != 2) { return 0; }
+    if (counted_fread(buf, 1, 2, fp) != 2) { return 0; }
     return ((uint16_t)buf[0] << 8) | (uint16_t)buf[1];
 }
 
 static uint32_t read_uint32_le(FILE* fp) {
     uint8_t buf[4];
-    if (fread(buf, 1, 4, fp) != 4) { return 0; }
+    if (counted_fread(buf, 1, 4, fp) != 4) { return 0; }
     return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) |
         ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
 }
 
 static uint32_t read_uint32_be(FILE* fp) {
     uint8_t buf[4];
-    if (fread(buf, 1, 4, fp) != 4) { return 0; }
+    if (counted_fread(buf, 1, 4, fp) != 4) { return 0; }
     return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
         ((uint32_t)buf[2] << 8) | (uint32_t)buf[3];
 }
@@ -131,11 +199,59 @@ static int is_valid_vr(const char* vr) {
 
 static void print_indent(const int depth) { for (int i = 0; i < depth * 2; i++) { printf("  "); } }
 
-static int count_sequence_items(FILE* fp, const parser_state* state, long* end_pos) {
+// end_pos is where a defined-length sequence or item stops, -1 for undefined length (read up to the delimiter)
+static bool within(FILE* fp, const long end_pos) { return end_pos < 0 || ftell(fp) < end_pos; }
+
+static int count_sequence_items(FILE* fp, const parser_state* state, long limit, long* end_pos);
+
+// Elements of an undefined-length item, up to and including its delimiter
+static void skip_item_elements(FILE* fp, const parser_state* state) {
+    while (!feof(fp)) {
+        const uint16_t g = read_uint16(fp, state);
+        const uint16_t e = read_uint16(fp, state);
+        if (feof(fp)) break;
+
+        if (g == 0xFFFE && e == 0xE00D) {
+            read_uint32(fp, state);
+            break;
+        }
+
+        uint32_t tag_len;
+        char vr[3] = {0};
+
+        if (state->is_explicit_vr) {
+            if (counted_fread(vr, 1, 2, fp) != 2) break;
+            if (is_explicit_vr_long(vr)) {
+                counted_fseek(fp, 2, SEEK_CUR);
+                tag_len = read_uint32(fp, state);
+            }
+            else { tag_len = read_uint16(fp, state); }
+        }
+        else {
+            tag_len = read_uint32(fp, state);
+            const uint32_t tag = ((uint32_t)g << 16) | e;
+            const char* dict_vr = dicom_get_vr(tag);
+            if (dict_vr != NULL) { strncpy(vr, dict_vr, 2); }
+            else { strcpy(vr, "UN"); }
+        }
+
+        if (strcmp(vr, "SQ") == 0) {
+            if (tag_len == 0xFFFFFFFF) {
+                long nested_end;
+                count_sequence_items(fp, state, -1, &nested_end);
+            }
+            else if (tag_len > 0) { counted_fseek(fp, tag_len, SEEK_CUR); }
+        }
+        else if (tag_len > 0 && tag_len != 0xFFFFFFFF) { counted_fseek(fp, tag_len, SEEK_CUR); }
+    }
+}
+
+// Items up to the sequence delimiter, or up to limit for a defined-length sequence (-1 for none)
+static int count_sequence_items(FILE* fp, const parser_state* state, const long limit, long* end_pos) {
     int item_count = 0;
     *end_pos = ftell(fp);
 
-    while (!feof(fp)) {
+    while (!feof(fp) && within(fp, limit)) {
         const long current_pos = ftell(fp);
         const uint16_t group = read_uint16(fp, state);
         const uint16_t element = read_uint16(fp, state);
@@ -151,53 +267,14 @@ static int count_sequence_items(FILE* fp, const parser_state* state, long* end_p
             else if (element == 0xE000) {
                 item_count++;
 
-                if (length == 0xFFFFFFFF) {
-                    while (!feof(fp)) {
-                        const uint16_t g = read_uint16(fp, state);
-                        const uint16_t e = read_uint16(fp, state);
-                        if (feof(fp)) break;
-
-                        if (g == 0xFFFE && e == 0xE00D) {
-                            read_uint32(fp, state);
-                            break;
-                        }
-
-                        uint32_t tag_len;
-                        char vr[3] = {0};
-
-                        if (state->is_explicit_vr) {
-                            if (fread(vr, 1, 2, fp) != 2) break;
-                            if (is_explicit_vr_long(vr)) {
-                                fseek(fp, 2, SEEK_CUR);
-                                tag_len = read_uint32(fp, state);
-                            }
-                            else { tag_len = read_uint16(fp, state); }
-                        }
-                        else {
-                            tag_len = read_uint32(fp, state);
-                            const uint32_t tag = ((uint32_t)g << 16) | e;
-                            const char* dict_vr = dicom_get_vr(tag);
-                            if (dict_vr != NULL) { strncpy(vr, dict_vr, 2); }
-                            else { strcpy(vr, "UN"); }
-                        }
-
-                        if (strcmp(vr, "SQ") == 0) {
-                            if (tag_len == 0xFFFFFFFF) {
-                                long nested_end;
-                                count_sequence_items(fp, state, &nested_end);
-                            }
-                            else if (tag_len > 0) { fseek(fp, tag_len, SEEK_CUR); }
-                        }
-                        else if (tag_len > 0 && tag_len != 0xFFFFFFFF) { fseek(fp, tag_len, SEEK_CUR); }
-                    }
-                }
-                else if (length > 0) { fseek(fp, length, SEEK_CUR); }
+                if (length == 0xFFFFFFFF) { skip_item_elements(fp, state); }
+                else if (length > 0) { counted_fseek(fp, length, SEEK_CUR); }
                 *end_pos = ftell(fp);
                 continue;
             }
         }
         else {
-            fseek(fp, current_pos, SEEK_SET);
+            counted_fseek(fp, current_pos, SEEK_SET);
             break;
         }
     }
@@ -205,12 +282,162 @@ static int count_sequence_items(FILE* fp, const parser_state* state, long* end_p
     return item_count;
 }
 
+// A value the filter does not want; sequences of undefined length are walked to their delimiter
+static void skip_value(FILE* fp, const parser_state* state, const uint32_t length) {
+    if (length == 0xFFFFFFFF) {
+        long end_pos;
+        count_sequence_items(fp, state, -1, &end_pos);
+    }
+    else { counted_fseek(fp, length, SEEK_CUR); }
+}
+
+static uint16_t buffer_uint16(const uint8_t* p, const parser_state* state) {
+    return state->is_little_endian ? (uint16_t)(p[0] | (p[1] << 8)) : (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t buffer_uint32(const uint8_t* p, const parser_state* state) {
+    if (state->is_little_endian) {
+        return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+    }
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/*
+ * Whether the `avail` bytes at h, file offset pos, decode as an explicit VR element header whose value
+ * ends by `limit`: a known VR, zero reserved bytes in the long form, no group that cannot occur in a
+ * dataset. Item tags only count inside sequences (depth > 0). *next is where the following header
+ * would be, -1 after an undefined length.
+ */
+static bool plausible_header(const uint8_t* h, const size_t avail, const long pos, const long limit,
+                             const int depth, const parser_state* state, uint32_t* tag, long* next) {
+    if (avail < 8) { return false; }
+
+    const uint16_t group = buffer_uint16(h, state);
+    const uint16_t element = buffer_uint16(h + 2, state);
+    *tag = ((uint32_t)group << 16) | element;
+
+    if (group == 0xFFFE) {
+        const uint32_t length = buffer_uint32(h + 4, state);
+        if (depth == 0) { return false; }
+        if (element == 0xE00D || element == 0xE0DD) {
+            *next = pos + 8;
+            return length == 0;
+        }
+        if (element != 0xE000) { return false; }
+        *next = length == 0xFFFFFFFF ? -1 : pos + 8 + (long)length;
+        return *next <= limit;
+    }
+    if (group == 0x0000 || group == 0xFFFF || (group & 1 && group <= 0x0007)) { return false; }
+
+    char vr[3] = {(char)h[4], (char)h[5], '\0'};
+    if (!is_valid_vr(vr)) { return false; }
+
+    long header = 8;
+    uint32_t length = buffer_uint16(h + 6, state);
+    if (is_explicit_vr_long(vr)) {
+        if (avail < 12 || h[6] != 0 || h[7] != 0) { return false; }
+        header = 12;
+        length = buffer_uint32(h + 8, state);
+    }
+
+    if (length == 0xFFFFFFFF) {
+        *next = -1;
+        return strcmp(vr, "SQ") == 0 || strcmp(vr, "UN") == 0 || strcmp(vr, "OB") == 0 || strcmp(vr, "OW") == 0;
+    }
+    *next = pos + header + (long)length;
+    return *next <= limit;
+}
+
+/*
+ * A plausible header is taken when its VR is the one the dictionary gives its tag, or when its value
+ * runs exactly to the limit or into a second plausible header. Short stretches of text look like VRs
+ * often enough that one check alone is not enough.
+ */
+static bool confirm_header(FILE* fp, const uint8_t* h, const size_t avail, const long pos, const long limit,
+                           const int depth, const parser_state* state) {
+    uint32_t tag;
+    long next;
+    if (!plausible_header(h, avail, pos, limit, depth, state, &tag, &next)) { return false; }
+
+    const char vr[3] = {(char)h[4], (char)h[5], '\0'};
+    const char* dict_vr = dicom_get_vr(tag);
+    if ((tag >> 16) == 0xFFFE || (dict_vr != NULL && strstr(dict_vr, vr) != NULL)) { return true; }
+    if (next < 0) { return false; }
+    if (next == limit) { return true; }
+
+    uint8_t following[RESYNC_OVERLAP];
+    counted_fseek(fp, next, SEEK_SET);
+    const size_t got = counted_fread(following, 1, sizeof(following), fp);
+    uint32_t following_tag;
+    long following_next;
+    return plausible_header(following, got, next, limit, depth, state, &following_tag, &following_next);
+}
+
+static void record_damage(damage_log* damage, const long start, const long end) {
+    if (damage->count < MAX_DAMAGE_RANGES) {
+        damage->start[damage->count] = start;
+        damage->end[damage->count] = end;
+    }
+    damage->count++;
+    damage->bytes += end - start;
+}
+
+/*
+ * After an invalid header at header_pos, scans forward window by window for the next element that
+ * checks out (dicom_find_header_candidate() proposes, confirm_header() decides) and leaves fp on it.
+ * Without one fp ends up at end_pos, the end of the enclosing defined-length item, or at the end of
+ * the file. The bytes passed over go to the damage log. Returns whether parsing can go on at this level.
+ */
+static bool resynchronize(FILE* fp, const parser_state* state, const long header_pos, const long end_pos,
+                          const int depth) {
+    long limit = end_pos;
+    if (limit < 0) {
+        counted_fseek(fp, 0, SEEK_END);
+        limit = ftell(fp);
+    }
+
+    uint8_t window[RESYNC_WINDOW];
+    long base = header_pos + 1;
+    long found = -1;
+
+    while (found < 0 && base < limit) {
+        const size_t want = limit - base < RESYNC_WINDOW ? (size_t)(limit - base) : RESYNC_WINDOW;
+        counted_fseek(fp, base, SEEK_SET);
+        const size_t got = counted_fread(window, 1, want, fp);
+
+        for (size_t i = dicom_find_header_candidate(window, got); i + 1 < got && found < 0;
+             i += 1 + dicom_find_header_candidate(window + i + 1, got - i - 1)) {
+            // A letter pair is a VR, four bytes after its tag; FE FF is the group of an item tag itself
+            const bool is_item = window[i] >= 0xFE;
+            if (!is_item && i < 4) { continue; }  // Its tag is before header_pos or was seen in the last window
+
+            const size_t start = is_item ? i : i - 4;
+            if (confirm_header(fp, window + start, got - start, base + (long)start, limit, depth, state)) {
+                found = base + (long)start;
+            }
+        }
+
+        if (got < want || base + (long)got >= limit) { break; }
+        base += (long)got - RESYNC_OVERLAP;
+    }
+
+    const long resume = found >= 0 ? found : limit;
+    record_damage(state->damage, header_pos, resume);
+    counted_fseek(fp, resume, SEEK_SET);
+
+    print_indent(depth);
+    printf("[DAMAGED: bytes %ld-%ld skipped]\n", header_pos, resume);
+    return found >= 0;
+}
+
+// Items of a sequence; with a path filter, `scope` and seq_tag decide which items are entered
 
 static int parse_sequence(FILE* fp, const parser_state* state, const int depth, const int max_elements,
-                          int* element_count, const tag_filter* filter) {
+                          int* element_count, const tag_filter* filter, const int scope, const uint32_t seq_tag,
+                          const long end_pos) {
     if (depth > state->max_sq_depth) {
         long sq_end;
-        const int item_count = count_sequence_items(fp, state, &sq_end);
+        const int item_count = count_sequence_items(fp, state, end_pos, &sq_end);
 
         print_indent(depth - 1);
         if (item_count == 0) { printf("[EMPTY SEQUENCE ABOVE MAX DEPTH]"); }
@@ -221,7 +448,8 @@ static int parse_sequence(FILE* fp, const parser_state* state, const int depth,
         return -1;
     }
 
-    while (!feof(fp) && *element_count < max_elements) {
+    uint32_t item_index = 0;
+    while (!feof(fp) && *element_count < max_elements && within(fp, end_pos)) {
         const uint16_t group = read_uint16(fp, state);
         const uint16_t element = read_uint16(fp, state);
 
@@ -238,6 +466,14 @@ static int parse_sequence(FILE* fp, const parser_state* state, const int depth,
                 return 0;
             }
             else if (element == 0xE000) {
+                const int item_scope = filter_item_scope(filter, scope, seq_tag, item_index++);
+                if (item_scope == DICOM_FILTER_NONE) {
+                    // No filter path goes through this item
+                    if (length == 0xFFFFFFFF) { skip_item_elements(fp, state); }
+                    else { counted_fseek(fp, length, SEEK_CUR); }
+                    continue;
+                }
+
                 print_indent(depth);
                 if (length == 0xFFFFFFFF) {
                     printf("(FFFE,E000)  %-3s %-8s %-40s %-45s %s\n",
@@ -255,17 +491,18 @@ static int parse_sequence(FILE* fp, const parser_state* state, const int depth,
 
                 // parse the inside of the sequence
                 if (length == 0xFFFFFFFF) {
-                    parse_data_elements(fp, state, depth + 1, max_elements, element_count, filter);
+                    parse_data_elements(fp, state, depth + 1, max_elements, element_count, filter, item_scope, -1);
                 }
                 else if (length > 0) {
                     const long start_pos = ftell(fp);
-                    parse_data_elements(fp, state, depth + 1, max_elements, element_count, filter);
+                    parse_data_elements(fp, state, depth + 1, max_elements, element_count, filter, item_scope,
+                                        start_pos + (long)length);
                     const long end_pos = ftell(fp);
                     const long bytes_read = end_pos - start_pos;
 
                     if (bytes_read < length) {
                         // Double check position
-                        fseek(fp, start_pos + length, SEEK_SET);
+                        counted_fseek(fp, start_pos + length, SEEK_SET);
                     }
                 }
 
@@ -280,7 +517,7 @@ static int parse_sequence(FILE* fp, const parser_state* state, const int depth,
             }
         }
 
-        fseek(fp, -4, SEEK_CUR); // If regular data element (should not happen in a SQ)
+        counted_fseek(fp, -4, SEEK_CUR); // If regular data element (should not happen in a SQ)
         return 0;
     }
 
@@ -288,8 +525,15 @@ static int parse_sequence(FILE* fp, const parser_state* state, const int depth,
 }
 
 static int parse_data_elements(FILE* fp, const parser_state* state, const int depth, const int max_elements,
-                               int* element_count, const tag_filter* filter) {
-    while (!feof(fp) && *element_count < max_elements) {
+                               int* element_count, const tag_filter* filter, const int scope, const long end_pos) {
+    // An item may redefine the Specific Character Set for the elements inside it
+    parser_state item_state = *state;
+    dicom_charset item_charset;
+    dicom_charset_init(&item_charset);
+    state = &item_state;
+    int result = 0;
+
+    while (!feof(fp) && *element_count < max_elements && within(fp, end_pos)) {
         const uint16_t group = read_uint16(fp, state);
         const uint16_t element = read_uint16(fp, state);
 
@@ -298,8 +542,8 @@ static int parse_data_elements(FILE* fp, const parser_state* state, const int de
         const uint32_t tag = ((uint32_t)group << 16) | element;
 
         if (depth > 0 && group == 0xFFFE) {
-            fseek(fp, -4, SEEK_CUR); // Put the tag back and let parse_sequence handle it
-            return 0;
+            counted_fseek(fp, -4, SEEK_CUR); // Put the tag back and let parse_sequence handle it
+            break;
         }
 
         if (group == 0x7FE0 && element == 0x0010) {
@@ -309,23 +553,25 @@ static int parse_data_elements(FILE* fp, const parser_state* state, const int de
                    group, element, "OW/OB", "PixelData", "Pixel Data",
                    "(stopping: pixel data encountered)");
             (*element_count)++;
-            return 1;
+            result = 1;
+            break;
         }
 
         char vr[3] = {0};
         uint32_t length;
 
         if (state->is_explicit_vr) {
-            if (fread(vr, 1, 2, fp) != 2) { break; }
+            if (counted_fread(vr, 1, 2, fp) != 2) { break; }
 
             if (!is_valid_vr(vr)) {
                 fprintf(stderr, "Warning: Invalid VR '%c%c' at tag (%04X,%04X), skipping\n",
                         vr[0], vr[1], group, element);
+                if (state->damage != NULL && resynchronize(fp, state, ftell(fp) - 6, end_pos, depth)) { continue; }
                 break;
             }
 
             if (is_explicit_vr_long(vr)) {
-                fseek(fp, 2, SEEK_CUR);
+                counted_fseek(fp, 2, SEEK_CUR);
                 length = read_uint32(fp, state);
             }
             else { length = read_uint16(fp, state); }
@@ -337,9 +583,16 @@ static int parse_data_elements(FILE* fp, const parser_state* state, const int de
             else { strcpy(vr, "UN"); }
         }
 
-        const bool should_display = should_disp_tag(tag, filter);
+        if (tag == 0x00080005) {
+            item_state.charset = &item_charset;
+            read_specific_character_set(fp, length, &item_state);
+        }
+
+        const dicom_filter_action action = filter_action(filter, scope, tag);
+        const bool should_display =
+            action == DICOM_FILTER_SHOW || (action == DICOM_FILTER_DESCEND && strcmp(vr, "SQ") == 0);
         if (!should_display && tag != 0x00020010) {
-            fseek(fp, length, SEEK_CUR);
+            skip_value(fp, state, length);
             continue;
         }
 
@@ -347,6 +600,7 @@ static int parse_data_elements(FILE* fp, const parser_state* state, const int de
         const char* dict_vr = dicom_get_vr(tag);
         const char* keyword = dicom_get_keyword(tag);
         const char* actual_vr = state->is_explicit_vr ? vr : (dict_vr ? dict_vr : "UN");
+        const int inner_scope = action == DICOM_FILTER_DESCEND ? scope : DICOM_FILTER_ALL;
 
         char disp_keyword_buff[100];
         const char* display_keyword;
@@ -367,9 +621,10 @@ static int parse_data_elements(FILE* fp, const parser_state* state, const int de
                    name ? name : "[N/A]"
             );
 
-            if (state->collapse_sequences) {
+            if (state->collapse_sequences && action == DICOM_FILTER_SHOW) {
                 long seq_end;
-                const int item_count = count_sequence_items(fp, state, &seq_end);
+                const long limit = length == 0xFFFFFFFF ? -1 : ftell(fp) + (long)length;
+                const int item_count = count_sequence_items(fp, state, limit, &seq_end);
 
                 if (item_count == 0) { printf("[EMPTY SEQUENCE]\n"); }
                 else { printf("[SEQUENCE with %d ITEM%s]\n", item_count, item_count == 1 ? "" : "S"); }
@@ -381,7 +636,7 @@ static int parse_data_elements(FILE* fp, const parser_state* state, const int de
             if (length == 0xFFFFFFFF) {
                 printf("(sequence - undefined length)\n");
                 (*element_count)++;
-                parse_sequence(fp, state, depth + 1, max_elements, element_count, filter);
+                parse_sequence(fp, state, depth + 1, max_elements, element_count, filter, inner_scope, tag, -1);
             }
             else if (length == 0) {
                 printf("(empty sequence)\n");
@@ -391,11 +646,12 @@ static int parse_data_elements(FILE* fp, const parser_state* state, const int de
                 printf("(sequence - defined length: %u bytes)\n", length);
                 (*element_count)++;
                 const long start_pos = ftell(fp);
-                parse_sequence(fp, state, depth + 1, max_elements, element_count, filter);
+                parse_sequence(fp, state, depth + 1, max_elements, element_count, filter, inner_scope, tag,
+                               start_pos + (long)length);
                 const long end_pos = ftell(fp);
                 const long bytes_read = end_pos - start_pos;
 
-                if (bytes_read < length) { fseek(fp, start_pos + length, SEEK_SET); }
+                if (bytes_read < length) { counted_fseek(fp, start_pos + length, SEEK_SET); }
             }
 
             if (length != 0) {
@@ -410,6 +666,7 @@ static int parse_data_elements(FILE* fp, const parser_state* state, const int de
             continue;
         }
 
+        const dicom_phase parse_phase = dicom_stats_phase(DICOM_PHASE_RENDER);
         print_indent(depth);
         printf("(%04X,%04X)  %-3s %-8u %-40s %-45s ",
                group, element,
@@ -418,21 +675,22 @@ static int parse_data_elements(FILE* fp, const parser_state* state, const int de
                display_keyword,
                name ? name : "[N/A]"
         );
+        dicom_stats_phase(parse_phase);
 
-        if (length > 0 && length != 0xFFFFFFFF && length < 1024 * 1024) {
-            const uint32_t read_len = length < 4096 ? length : 4096;
-            uint8_t* value_data = (uint8_t*)malloc(read_len);
+        if (length > 0 && length != 0xFFFFFFFF && length < MAX_DISPLAY_VALUE_LENGTH) {
+            const uint32_t read_len = length < state->max_value_read ? length : state->max_value_read;
+            const dicom_arena_mark mark = dicom_arena_save(state->arena);
+            uint8_t* value_data = (uint8_t*)dicom_arena_alloc(state->arena, read_len);
 
             if (value_data != NULL) {
-                const size_t bytes_read = fread(value_data, 1, read_len, fp);
+                const size_t bytes_read = counted_fread(value_data, 1, read_len, fp);
                 if (bytes_read > 0) {
-                    display_context ctx = create_display_context(state);
-                    display_value(actual_vr, value_data, bytes_read, depth, &ctx);
+                    render_value(actual_vr, value_data, bytes_read, depth, state);
                 }
-                free(value_data);
+                dicom_arena_restore(state->arena, mark);
 
                 if (length > read_len) {
-                    if (fseek(fp, length - read_len, SEEK_CUR) != 0) {
+                    if (counted_fseek(fp, length - read_len, SEEK_CUR) != 0) {
                         fprintf(stderr, "\nERROR: Failed to seek in file\n");
                         break;
                     }
@@ -440,14 +698,14 @@ static int parse_data_elements(FILE* fp, const parser_state* state, const int de
             }
             else {
                 printf("(memory alloc failed)");
-                fseek(fp, length, SEEK_CUR);
+                counted_fseek(fp, length, SEEK_CUR);
             }
         }
         else if (length == 0xFFFFFFFF) { printf("(undefined length - non-sequence)"); }
         else if (length == 0) { printf("(empty)"); }
         else {
             printf("(too large to display)");
-            if (fseek(fp, length, SEEK_CUR) != 0) {
+            if (counted_fseek(fp, length, SEEK_CUR) != 0) {
                 fprintf(stderr, "\nERROR: Failed to seek past large element\n");
                 break;
             }
@@ -457,11 +715,34 @@ static int parse_data_elements(FILE* fp, const parser_state* state, const int de
         (*element_count)++;
     }
 
-    return 0;
+    dicom_charset_close(&item_charset);
+    return result;
+}
+
+static void print_pixel_hash(const dicom_dataset* ds) {
+    uint64_t digest, bytes;
+    if (dicom_pixel_data_hash(ds, &digest, &bytes) != 0) {
+        printf("[Pixel Data xxh64: (not present)]\n");
+        return;
+    }
+    printf("[Pixel Data xxh64: %016llx, %llu bytes]\n", (unsigned long long)digest, (unsigned long long)bytes);
 }
 
-int parse_dicom_header(const char* filename, const int max_elements, const bool collapse_sequences,
-                       const int max_sq_depth, const bool show_full_values, const tag_filter* filter) {
+// The streaming parse stops at the pixel data; the mapped tree gets past it without reading the rest
+static void print_file_pixel_hash(const char* filename, dicom_arena* arena) {
+    dicom_dataset ds;
+    if (dicom_dataset_load(filename, arena, &ds) != 0) {
+        fprintf(stderr, "Error: Cannot hash pixel data of '%s'\n", filename);
+        return;
+    }
+    print_pixel_hash(&ds);
+    dicom_dataset_close(&ds);
+}
+
+int parse_dicom_header(const char* filename, const parse_options* options, dicom_arena* arena) {
+    const int max_elements = options->max_elements;
+    const tag_filter* filter = options->filter;
+
     FILE* fp = fopen(filename, "rb");
     if (fp == NULL) {
         fprintf(stderr, "Error: Cannot open file '%s'\n", filename);
@@ -469,14 +750,14 @@ int parse_dicom_header(const char* filename, const int max_elements, const bool
     }
 
     uint8_t preamble[DICOM_PREAMBLE_SIZE];
-    if (fread(preamble, 1, DICOM_PREAMBLE_SIZE, fp) != DICOM_PREAMBLE_SIZE) {
+    if (counted_fread(preamble, 1, DICOM_PREAMBLE_SIZE, fp) != DICOM_PREAMBLE_SIZE) {
         fprintf(stderr, "Error: Cannot read file '%s': Invalid DICOM file (header too short)\n", filename);
         fclose(fp);
         return -1;
     }
 
     char prefix[DICOM_PREFIX_SIZE];
-    if (fread(prefix, 1, DICOM_PREFIX_SIZE, fp) != DICOM_PREFIX_SIZE) {
+    if (counted_fread(prefix, 1, DICOM_PREFIX_SIZE, fp) != DICOM_PREFIX_SIZE) {
         fprintf(stderr, "Error: Invalid DICOM file (missing DICM prefix from header)\n");
         fclose(fp);
         return -1;
@@ -489,15 +770,26 @@ int parse_dicom_header(const char* filename, const int max_elements, const bool
     }
 
     init_terminal_width();
+    dicom_arena_reset(arena);
+    dicom_stats_phase(DICOM_PHASE_META);
+
+    dicom_charset charset;
+    dicom_charset_init(&charset);
+    damage_log damage = {0};
 
     // File meta information is always TRANSFER_EXPLICIT_VR_LITTLE_ENDIAN
     parser_state state = {
         .ts_type = TRANSFER_EXPLICIT_VR_LITTLE_ENDIAN,
         .is_explicit_vr = true,
         .is_little_endian = true,
-        .collapse_sequences = collapse_sequences,
-        .max_sq_depth = max_sq_depth,
-        .overwrite_max_disp_len = show_full_values
+        .collapse_sequences = options->collapse_sequences,
+        .max_sq_depth = options->max_sq_depth,
+        .overwrite_max_disp_len = options->show_full_values,
+        .show_all_values = options->show_all_values,
+        .max_value_read = options->show_all_values ? MAX_DISPLAY_VALUE_LENGTH : DEFAULT_VALUE_READ_LENGTH,
+        .arena = arena,
+        .charset = &charset,
+        .damage = options->recover ? &damage : NULL
     };
 
     printf("DICOM version: %s\n", DICOM_VERSION);
@@ -520,6 +812,7 @@ int parse_dicom_header(const char* filename, const int max_elements, const bool
         if (feof(fp)) { break; }
 
         const uint32_t tag = ((uint32_t)group << 16) | element;
+        dicom_stats_phase(group == 0x0002 ? DICOM_PHASE_META : DICOM_PHASE_DATASET);
 
         if (in_file_meta && group != 0x0002) {
             in_file_meta = 0;
@@ -559,16 +852,17 @@ int parse_dicom_header(const char* filename, const int max_elements, const bool
         uint32_t length;
 
         if (state.is_explicit_vr) {
-            if (fread(vr, 1, 2, fp) != 2) { break; }
+            if (counted_fread(vr, 1, 2, fp) != 2) { break; }
 
             if (!is_valid_vr(vr)) {
                 fprintf(stderr, "Warning: Invalid VR '%c%c' at tag (%04X,%04X), skipping\n",
                         vr[0], vr[1], group, element);
+                if (state.damage != NULL && resynchronize(fp, &state, ftell(fp) - 6, -1, 0)) { continue; }
                 break;
             }
 
             if (is_explicit_vr_long(vr)) {
-                fseek(fp, 2, SEEK_CUR); // Skip 2 reserved bytes
+                counted_fseek(fp, 2, SEEK_CUR); // Skip 2 reserved bytes
                 length = read_uint32(fp, &state);
             }
             else { length = read_uint16(fp, &state); }
@@ -582,11 +876,16 @@ int parse_dicom_header(const char* filename, const int max_elements, const bool
             }
         }
 
-        const bool should_display = should_disp_tag(tag, filter);
+        if (tag == 0x00080005) { read_specific_character_set(fp, length, &state); }
+
+        const dicom_filter_action action = filter_action(filter, DICOM_FILTER_ROOT, tag);
+        const bool should_display =
+            action == DICOM_FILTER_SHOW || (action == DICOM_FILTER_DESCEND && strcmp(vr, "SQ") == 0);
         if (!should_display && tag != 0x00020010) {
-            fseek(fp, length, SEEK_CUR);
+            skip_value(fp, &state, length);
             continue;
         }
+        const int inner_scope = action == DICOM_FILTER_DESCEND ? DICOM_FILTER_ROOT : DICOM_FILTER_ALL;
 
         const char* name = dicom_get_name(tag);
         const char* dict_vr = dicom_get_vr(tag);
@@ -610,9 +909,10 @@ int parse_dicom_header(const char* filename, const int max_elements, const bool
                    name ? name : "[N/A]"
             );
 
-            if (state.collapse_sequences) {
+            if (state.collapse_sequences && action == DICOM_FILTER_SHOW) {
                 long seq_end;
-                const int item_count = count_sequence_items(fp, &state, &seq_end);
+                const long limit = length == 0xFFFFFFFF ? -1 : ftell(fp) + (long)length;
+                const int item_count = count_sequence_items(fp, &state, limit, &seq_end);
 
                 if (item_count == 0) { printf("[EMPTY SEQUENCE]\n"); }
                 else { printf("[SEQUENCE with %d ITEM%s]\n", item_count, item_count == 1 ? "" : "S"); }
@@ -627,12 +927,15 @@ int parse_dicom_header(const char* filename, const int max_elements, const bool
 
             element_count++;
 
-            if (length == 0xFFFFFFFF) { parse_sequence(fp, &state, 1, max_elements, &element_count, filter); }
+            if (length == 0xFFFFFFFF) {
+                parse_sequence(fp, &state, 1, max_elements, &element_count, filter, inner_scope, tag, -1);
+            }
             else if (length > 0) {
                 const long start_pos = ftell(fp);
-                parse_sequence(fp, &state, 1, max_elements, &element_count, filter);
+                parse_sequence(fp, &state, 1, max_elements, &element_count, filter, inner_scope, tag,
+                               start_pos + (long)length);
                 const long end_pos = ftell(fp);
-                if ((end_pos - start_pos) < length) { fseek(fp, start_pos + length, SEEK_SET); }
+                if ((end_pos - start_pos) < length) { counted_fseek(fp, start_pos + length, SEEK_SET); }
             }
 
             if (length != 0) {
@@ -647,6 +950,7 @@ int parse_dicom_header(const char* filename, const int max_elements, const bool
         }
 
         if (should_display) {
+            const dicom_phase parse_phase = dicom_stats_phase(DICOM_PHASE_RENDER);
             printf("(%04X,%04X)  %-3s %-8u %-40s %-45s ",
                    group, element,
                    actual_vr,
@@ -654,11 +958,12 @@ int parse_dicom_header(const char* filename, const int max_elements, const bool
                    display_keyword,
                    name ? name : "[N/A]"
             );
+            dicom_stats_phase(parse_phase);
         }
 
         // Handle trnasfer syntax UID specifically
         if (tag == 0x00020010 && length > 0 && length < sizeof(transfer_syntax_uid)) {
-            if (fread(transfer_syntax_uid, 1, length, fp) == length) {
+            if (counted_fread(transfer_syntax_uid, 1, length, fp) == length) {
                 transfer_syntax_uid[length] = '\0';
                 for (uint32_t i = length - 1; i >= 0 &&
                      (transfer_syntax_uid[i] == ' ' || transfer_syntax_uid[i] == '\0'); i--) {
@@ -666,25 +971,24 @@ int parse_dicom_header(const char* filename, const int max_elements, const bool
                 }
 
                 if (should_display) {
-                    display_context ctx = create_display_context(&state);
-                    display_value(actual_vr, (uint8_t*)transfer_syntax_uid, strlen(transfer_syntax_uid), 0, &ctx);
+                    render_value(actual_vr, (uint8_t*)transfer_syntax_uid, strlen(transfer_syntax_uid), 0, &state);
                 }
             }
         }
-        else if (length > 0 && length != 0xFFFFFFFF && length < 1024 * 1024) {
-            const uint32_t read_len = length < 4096 ? length : 4096;
-            uint8_t* value_data = (uint8_t*)malloc(read_len);
+        else if (length > 0 && length != 0xFFFFFFFF && length < MAX_DISPLAY_VALUE_LENGTH) {
+            const uint32_t read_len = length < state.max_value_read ? length : state.max_value_read;
+            const dicom_arena_mark mark = dicom_arena_save(state.arena);
+            uint8_t* value_data = (uint8_t*)dicom_arena_alloc(state.arena, read_len);
 
             if (value_data != NULL) {
-                const size_t bytes_read = fread(value_data, 1, read_len, fp);
+                const size_t bytes_read = counted_fread(value_data, 1, read_len, fp);
                 if (bytes_read > 0) {
-                    display_context ctx = create_display_context(&state);
-                    display_value(actual_vr, value_data, bytes_read, 0, &ctx);
+                    render_value(actual_vr, value_data, bytes_read, 0, &state);
                 }
-                free(value_data);
+                dicom_arena_restore(state.arena, mark);
 
                 if (length > read_len) {
-                    if (fseek(fp, length - read_len, SEEK_CUR) != 0) {
+                    if (counted_fseek(fp, length - read_len, SEEK_CUR) != 0) {
                         fprintf(stderr, "\nERROR: Failed to seek in file\n");
                         break;
                     }
@@ -692,13 +996,13 @@ int parse_dicom_header(const char* filename, const int max_elements, const bool
             }
             else {
                 printf("(memory alloc failed)");
-                fseek(fp, length, SEEK_CUR);
+                counted_fseek(fp, length, SEEK_CUR);
             }
         }
         else if (length == 0) { printf("(empty)"); }
         else {
             printf("(too large to display)");
-            if (fseek(fp, length, SEEK_CUR) != 0) {
+            if (counted_fseek(fp, length, SEEK_CUR) != 0) {
                 fprintf(stderr, "\nERROR: Failed to seek past large element\n");
                 break;
             }
@@ -709,6 +1013,535 @@ int parse_dicom_header(const char* filename, const int max_elements, const bool
     }
 
     printf("\n[Parsed %d element%s]\n", element_count, element_count == 1 ? "" : "s");
+    if (damage.count > 0) {
+        printf("[Damaged: %ld byte%s in %d range%s:", damage.bytes, damage.bytes == 1 ? "" : "s",
+               damage.count, damage.count == 1 ? "" : "s");
+        for (int i = 0; i < damage.count && i < MAX_DAMAGE_RANGES; i++) {
+            printf(" %ld-%ld", damage.start[i], damage.end[i]);
+        }
+        printf("%s]\n", damage.count > MAX_DAMAGE_RANGES ? " ..." : "");
+    }
+    DICOM_STATS_ADD(elements, (uint64_t)element_count);
+    dicom_charset_close(&charset);
     fclose(fp);
+    if (options->hash_pixels) { print_file_pixel_hash(filename, arena); }
+    return damage.count > 0 ? DICOM_RESULT_DAMAGED : 0;
+}
+
+// One row of the tree renderers, taken from a dataset node or from a cached record
+typedef struct {
+    uint32_t tag;
+    uint16_t vr;
+    uint32_t length;
+    uint32_t child_count;
+    const uint8_t* value;       // NULL when the value could not be read
+    bool is_little_endian;
+} element_row;
+
+static const char* row_keyword(const uint32_t tag, char* buffer, const size_t size) {
+    const char* keyword = dicom_get_keyword(tag);
+    if ((tag & 0x00010000) && keyword) {
+        snprintf(buffer, size, "[PRIVATE TAG] %s", keyword);
+        return buffer;
+    }
+    if (tag & 0x00010000) { return "[PRIVATE TAG]"; }
+    return keyword ? keyword : "[N/A]";
+}
+
+static void print_element_row(const element_row* row, const int depth, const parser_state* state) {
+    const uint16_t group = (uint16_t)(row->tag >> 16);
+    const uint16_t element = (uint16_t)(row->tag & 0xFFFF);
+
+    print_indent(depth);
+
+    if (row->tag == DICOM_TAG_ITEM) {
+        if (row->length == DICOM_UNDEFINED_LENGTH) {
+            printf("(FFFE,E000)  %-3s %-8s %-40s %-45s %s\n", "--", "undef", "--", "Item (UNDEFINED LENGTH)",
+                   "(begin item)");
+        }
+        else {
+            printf("(FFFE,E000)  %-3s %-8u %-40s %-45s %s\n", "--", row->length, "--", "Item (DEFINED LENGTH)",
+                   "(begin item)");
+        }
+        return;
+    }
+
+    char vr[3];
+    dicom_vr_string(row->vr, vr);
+
+    const char* name = dicom_get_name(row->tag);
+    char disp_keyword_buff[100];
+    const char* display_keyword = row_keyword(row->tag, disp_keyword_buff, sizeof(disp_keyword_buff));
+
+    if (row->vr == DICOM_VR('S', 'Q') || row->length == DICOM_UNDEFINED_LENGTH) {
+        printf("(%04X,%04X)  %-3s %-8s %-40s %-45s ", group, element, vr, "--", display_keyword,
+               name ? name : "[N/A]");
+        if (row->child_count == 0) { printf("[EMPTY SEQUENCE]\n"); }
+        else { printf("[SEQUENCE with %u ITEM%s]\n", row->child_count, row->child_count == 1 ? "" : "S"); }
+        return;
+    }
+
+    printf("(%04X,%04X)  %-3s %-8u %-40s %-45s ", group, element, vr, row->length, display_keyword,
+           name ? name : "[N/A]");
+
+    if (row->length == 0) { printf("(empty)"); }
+    else if (row->value == NULL || row->length >= MAX_DISPLAY_VALUE_LENGTH) { printf("(too large to display)"); }
+    else {
+        display_context ctx = create_display_context(state);
+        ctx.is_little_endian = row->is_little_endian;
+        display_value(vr, row->value, row->length < state->max_value_read ? row->length : state->max_value_read, depth,
+                      &ctx);
+    }
+    printf("\n");
+}
+
+static void print_dataset_node(const dicom_dataset* ds, const dicom_node* node, const int depth,
+                               const parser_state* state) {
+    const element_row row = {
+        node->tag, node->vr, node->length, node->child_count, dicom_node_value(ds, node),
+        dicom_node_is_little_endian(ds, node),
+    };
+    print_element_row(&row, depth, state);
+}
+
+// Encapsulated pixel data fragments are listed as items, but have no elements of their own
+static bool has_nested_rows(const uint32_t tag, const uint16_t vr) {
+    return tag == DICOM_TAG_ITEM || vr == DICOM_VR('S', 'Q') || vr == DICOM_VR('U', 'N');
+}
+
+/*
+ * -d for the tree renderers, counted as the streaming dump counts it: the items of a sequence whose row is
+ * at `depth` sit at depth + 1, and are replaced by a note past max_sq_depth.
+ */
+static bool above_max_depth(const parser_state* state, const uint32_t child_count, const int depth) {
+    if (depth + 1 <= state->max_sq_depth) { return false; }
+    print_indent(depth);
+    printf("[%u ITEM%s ABOVE MAX SEQUENCE DEPTH]\n", child_count, child_count == 1 ? "" : "S");
+    return true;
+}
+
+// Whether the rows under a sequence or item are listed; with -c a sequence row stands for its items
+static bool lists_nested_rows(const parser_state* state, const uint32_t tag, const uint16_t vr,
+                              const uint32_t child_count, const int depth) {
+    if (!has_nested_rows(tag, vr) || child_count == 0) { return false; }
+    if (tag == DICOM_TAG_ITEM) { return true; }
+    return !state->collapse_sequences && !above_max_depth(state, child_count, depth);
+}
+
+static void print_dataset_nodes(const dicom_dataset* ds, const dicom_node* parent, const int depth,
+                                const parser_state* state, const int max_elements, int* element_count);
+
+/*
+ * An item may redefine the Specific Character Set for the elements inside it. Given the (0008,0005) value
+ * of an item, or NULL, returns the state for its rows: `scoped` with the item's own charset, or state itself.
+ * charset is initialized either way, the caller closes it.
+ */
+static const parser_state* item_state(const parser_state* state, const uint8_t* charset_value, const uint32_t length,
+                                      parser_state* scoped, dicom_charset* charset) {
+    dicom_charset_init(charset);
+    if (charset_value == NULL) { return state; }
+
+    dicom_charset_set(charset, charset_value, length);
+    *scoped = *state;
+    scoped->charset = charset;
+    return scoped;
+}
+
+static const parser_state* node_state(const dicom_dataset* ds, const dicom_node* node, const parser_state* state,
+                                      parser_state* scoped, dicom_charset* charset) {
+    const dicom_node* charset_node = node->tag == DICOM_TAG_ITEM ? dicom_dataset_find(node, 0x00080005) : NULL;
+    const uint8_t* value = charset_node != NULL ? dicom_node_value(ds, charset_node) : NULL;
+    return item_state(state, value, value != NULL ? charset_node->length : 0, scoped, charset);
+}
+
+// Path filters: only the sequences and items on the way to a match are printed around it
+static void print_filtered_nodes(const dicom_dataset* ds, const dicom_node* parent, const int depth,
+                                 const parser_state* state, const dicom_filter* paths, const int scope,
+                                 const int max_elements, int* element_count) {
+    for (uint32_t i = 0; i < parent->child_count && *element_count < max_elements; i++) {
+        const dicom_node* node = &parent->children[i];
+        const dicom_filter_action action = dicom_filter_match(paths, scope, node->tag);
+        if (action == DICOM_FILTER_SKIP || (action == DICOM_FILTER_DESCEND && !has_nested_rows(node->tag, node->vr))) {
+            continue;
+        }
+
+        print_dataset_node(ds, node, depth, state);
+        (*element_count)++;
+        if (node->child_count == 0) { continue; }
+
+        if (action == DICOM_FILTER_SHOW) {
+            if (lists_nested_rows(state, node->tag, node->vr, node->child_count, depth)) {
+                print_dataset_nodes(ds, node, depth + 1, state, max_elements, element_count);
+            }
+            continue;
+        }
+        if (above_max_depth(state, node->child_count, depth)) { continue; }
+
+        for (uint32_t k = 0; k < node->child_count && *element_count < max_elements; k++) {
+            const int item_scope = dicom_filter_item(paths, scope, node->tag, k);
+            if (item_scope == DICOM_FILTER_NONE) { continue; }
+
+            print_dataset_node(ds, &node->children[k], depth + 1, state);
+            (*element_count)++;
+
+            parser_state scoped;
+            dicom_charset charset;
+            const parser_state* inner = node_state(ds, &node->children[k], state, &scoped, &charset);
+            print_filtered_nodes(ds, &node->children[k], depth + 2, inner, paths, item_scope, max_elements,
+                                 element_count);
+            dicom_charset_close(&charset);
+        }
+    }
+}
+
+static void print_dataset_nodes(const dicom_dataset* ds, const dicom_node* parent, const int depth,
+                                const parser_state* state, const int max_elements, int* element_count) {
+    for (uint32_t i = 0; i < parent->child_count && *element_count < max_elements; i++) {
+        const dicom_node* node = &parent->children[i];
+        print_dataset_node(ds, node, depth, state);
+        (*element_count)++;
+
+        if (lists_nested_rows(state, node->tag, node->vr, node->child_count, depth)) {
+            parser_state scoped;
+            dicom_charset charset;
+            const parser_state* inner = node_state(ds, node, state, &scoped, &charset);
+            print_dataset_nodes(ds, node, depth + 1, inner, max_elements, element_count);
+            dicom_charset_close(&charset);
+        }
+    }
+}
+
+// Values are decoded per row with the byte order of the element, so the state only carries the options
+static parser_state tree_render_state(const parse_options* options, dicom_charset* charset, dicom_arena* arena) {
+    return (parser_state){
+        .ts_type = TRANSFER_EXPLICIT_VR_LITTLE_ENDIAN,
+        .is_explicit_vr = true,
+        .is_little_endian = true,
+        .collapse_sequences = options->collapse_sequences,
+        .max_sq_depth = options->max_sq_depth,
+        .overwrite_max_disp_len = options->show_full_values,
+        .show_all_values = options->show_all_values,
+        .max_value_read = options->show_all_values ? MAX_DISPLAY_VALUE_LENGTH : DEFAULT_VALUE_READ_LENGTH,
+        .arena = arena,
+        .charset = charset
+    };
+}
+
+static void print_tree_header(void) {
+    dicom_stats_phase(DICOM_PHASE_RENDER);
+    printf("DICOM version: %s\n", DICOM_VERSION);
+    printf("%-12s %-3s %-8s %-40s %-45s %s\n",
+           "TAG", "VR", "LENGTH", "KEYWORD", "NAME", "VALUE");
+    printf("%-12s %-3s %-8s %-40s %-45s %s\n",
+           "------------", "---", "--------",
+           "----------------------------------------",
+           "---------------------------------------------",
+           "----------------------------------------");
+}
+
+static void print_dataset(const dicom_dataset* ds, const parse_options* options, dicom_arena* arena) {
+    const int max_elements = options->max_elements;
+    const tag_filter* filter = options->filter;
+
+    init_terminal_width();
+
+    dicom_charset charset;
+    dicom_charset_init(&charset);
+    const dicom_node* charset_node = dicom_dataset_find(&ds->root, 0x00080005);
+    const uint8_t* charset_value = charset_node != NULL ? dicom_node_value(ds, charset_node) : NULL;
+    if (charset_value != NULL) { dicom_charset_set(&charset, charset_value, charset_node->length); }
+
+    const parser_state state = tree_render_state(options, &charset, arena);
+    print_tree_header();
+
+    int element_count = 0;
+
+    if (filter != NULL && filter->paths != NULL) {
+        // Document order and nesting as in the streaming dump
+        print_filtered_nodes(ds, &ds->root, 0, &state, filter->paths, DICOM_FILTER_ROOT, max_elements, &element_count);
+    }
+    else { print_dataset_nodes(ds, &ds->root, 0, &state, max_elements, &element_count); }
+
+    if (ds->is_truncated) { fprintf(stderr, "Warning: Dataset is truncated or malformed, tree is incomplete\n"); }
+
+    printf("\n[Parsed %d element%s, %u top-level]\n", element_count, element_count == 1 ? "" : "s",
+           ds->root.child_count);
+    if (options->hash_pixels) { print_pixel_hash(ds); }
+    dicom_charset_close(&charset);
+}
+
+/*
+ * The same rendering from a cache entry. Records are in document order with the size of their
+ * subtree, so skipping a sequence is one addition and no file is opened at all.
+ */
+static element_row cached_row(const dicom_cache_record* record) {
+    const element_row row = {
+        record->tag, record->vr, record->length, record->child_count, record->value,
+        (record->flags & DICOM_CACHE_LITTLE_ENDIAN) != 0,
+    };
+    return row;
+}
+
+// The record for tag among the children in [first, end)
+static const dicom_cache_record* find_cached(const dicom_cache_entry* entry, const uint32_t first, const uint32_t end,
+                                             const uint32_t tag) {
+    for (uint32_t i = first; i < end; i += 1 + entry->records[i].descendants) {
+        if (entry->records[i].tag == tag) { return &entry->records[i]; }
+    }
+    return NULL;
+}
+
+static void print_cached_records(const dicom_cache_entry* entry, const uint32_t first, const uint32_t end,
+                                 const int depth, const parser_state* state, const int max_elements,
+                                 int* element_count) {
+    for (uint32_t i = first; i < end && *element_count < max_elements; i += 1 + entry->records[i].descendants) {
+        const dicom_cache_record* record = &entry->records[i];
+        const element_row row = cached_row(record);
+        print_element_row(&row, depth, state);
+        (*element_count)++;
+
+        if (lists_nested_rows(state, record->tag, record->vr, record->child_count, depth)) {
+            const uint32_t end = i + 1 + record->descendants;
+            const dicom_cache_record* charset_record =
+                record->tag == DICOM_TAG_ITEM ? find_cached(entry, i + 1, end, 0x00080005) : NULL;
+            parser_state scoped;
+            dicom_charset charset;
+            const parser_state* inner = item_state(state, charset_record != NULL ? charset_record->value : NULL,
+                                                   charset_record != NULL ? charset_record->value_length : 0,
+                                                   &scoped, &charset);
+            print_cached_records(entry, i + 1, end, depth + 1, inner, max_elements, element_count);
+            dicom_charset_close(&charset);
+        }
+    }
+}
+
+static void print_cached(const dicom_cache_entry* entry, const parse_options* options, dicom_arena* arena) {
+    const int max_elements = options->max_elements;
+    const tag_filter* filter = options->filter;
+
+    init_terminal_width();
+
+    dicom_charset charset;
+    dicom_charset_init(&charset);
+    const dicom_cache_record* charset_record = find_cached(entry, 0, entry->count, 0x00080005);
+    if (charset_record != NULL && charset_record->value != NULL) {
+        dicom_charset_set(&charset, charset_record->value, charset_record->value_length);
+    }
+
+    const parser_state state = tree_render_state(options, &charset, arena);
+    print_tree_header();
+
+    int element_count = 0;
+
+    if (filter != NULL && filter->paths != NULL) {
+        // Only flat filters get here (see dump_dicom_cached), matched in document order like the streaming dump
+        for (uint32_t i = 0; i < entry->count && element_count < max_elements; i += 1 + entry->records[i].descendants) {
+            if (dicom_filter_match(filter->paths, DICOM_FILTER_ROOT, entry->records[i].tag) != DICOM_FILTER_SHOW) {
+                continue;
+            }
+            print_cached_records(entry, i, i + 1, 0, &state, max_elements, &element_count);
+        }
+    }
+    else { print_cached_records(entry, 0, entry->count, 0, &state, max_elements, &element_count); }
+
+    if (entry->is_truncated) { fprintf(stderr, "Warning: Dataset is truncated or malformed, tree is incomplete\n"); }
+
+    printf("\n[Parsed %d element%s, %u top-level]\n", element_count, element_count == 1 ? "" : "s", entry->top_level);
+    dicom_charset_close(&charset);
+}
+
+static int load_dataset(const char* filename, const parse_options* options, dicom_arena* arena, dicom_dataset* ds) {
+    if (options->threads > 1) { return dicom_dataset_load_parallel(filename, options->threads, arena, ds); }
+    return dicom_dataset_load(filename, arena, ds);
+}
+
+int dump_dicom_dataset(const char* filename, const parse_options* options, dicom_arena* arena) {
+    dicom_arena_reset(arena);
+
+    dicom_dataset ds;
+    if (load_dataset(filename, options, arena, &ds) != 0) {
+        fprintf(stderr, "Error: Cannot read file '%s': Invalid DICOM file\n", filename);
+        return -1;
+    }
+
+    print_dataset(&ds, options, arena);
+    dicom_dataset_close(&ds);
+    return 0;
+}
+
+int dump_dicom_cached(const char* filename, const parse_options* options, dicom_arena* arena) {
+    // Cached values stop at what the default rendering reads; -m and pixel hashes need the file itself.
+    // Path filters are rare enough that they are answered from the file as well.
+    const bool nested_filter = options->filter != NULL && options->filter->paths != NULL &&
+        options->filter->paths->is_nested;
+    if (options->show_all_values || options->hash_pixels || nested_filter) {
+        return dump_dicom_dataset(filename, options, arena);
+    }
+
+    dicom_arena_reset(arena);
+    dicom_cache_entry entry;
+    if (dicom_cache_load(options->cache_dir, filename, DEFAULT_VALUE_READ_LENGTH, arena, &entry) == 0) {
+        DICOM_STATS_ADD(cache_hits, 1);
+        print_cached(&entry, options, arena);
+        dicom_cache_close(&entry);
+        return 0;
+    }
+
+    dicom_dataset ds;
+    if (load_dataset(filename, options, arena, &ds) != 0) {
+        fprintf(stderr, "Error: Cannot read file '%s': Invalid DICOM file\n", filename);
+        return -1;
+    }
+
+    print_dataset(&ds, options, arena);
+    if (dicom_cache_store(options->cache_dir, filename, &ds, DEFAULT_VALUE_READ_LENGTH) != 0) {
+        fprintf(stderr, "Warning: Cannot write a cache entry for '%s' in '%s'\n", filename, options->cache_dir);
+    }
+    dicom_dataset_close(&ds);
+    return 0;
+}
+
+/*
+ * One element picked by a tag path. The sequences and items on the way are printed as tree rows
+ * above it; none of the elements around them are read.
+ */
+int dump_dicom_path(const char* filename, const char* path_text, const dicom_tag_path* path,
+                    const parse_options* options, dicom_arena* arena) {
+    dicom_arena_reset(arena);
+
+    dicom_dataset ds;
+    dicom_path_span spans[DICOM_PATH_MAX_STEPS];
+    const int result = dicom_dataset_seek(filename, path, &ds, spans);
+    if (result < 0) {
+        fprintf(stderr, "Error: Cannot read file '%s': Invalid DICOM file\n", filename);
+        return -1;
+    }
+
+    init_terminal_width();
+    dicom_charset charset;
+    dicom_charset_init(&charset);
+
+    // Specific Character Set is one more seek per level: top-level, then each item on the way may redefine it
+    for (int level = 0; level < path->count; level++) {
+        dicom_tag_path charset_path = *path;
+        charset_path.steps[level].tag = 0x00080005;
+        charset_path.steps[level].item = 0;
+        charset_path.count = level + 1;
+
+        dicom_dataset charset_ds;
+        dicom_path_span charset_spans[DICOM_PATH_MAX_STEPS];
+        if (dicom_dataset_seek_buffer(ds.data, ds.size, &charset_path, &charset_ds, charset_spans) != 0) { continue; }
+        const dicom_node* charset_node = &charset_spans[level].element;
+        const uint8_t* value = dicom_node_value(&charset_ds, charset_node);
+        if (value != NULL) { dicom_charset_set(&charset, value, charset_node->length); }
+    }
+
+    const parser_state state = tree_render_state(options, &charset, arena);
+    print_tree_header();
+
+    for (int i = 0; i < path->count; i++) {
+        const dicom_path_span* span = &spans[i];
+        const uint32_t tag = path->steps[i].tag;
+        if (span->element.tag != tag) {
+            print_indent(i * 2);
+            printf("(%04X,%04X)  %s\n", tag >> 16, tag & 0xFFFF, "(not present)");
+            break;
+        }
+
+        if (i == path->count - 1) {
+            print_dataset_node(&ds, &span->element, i * 2, &state);
+            break;
+        }
+
+        // Sequences on the way are not counted, the row names the item that was taken instead
+        char disp_keyword_buff[100];
+        const char* name = dicom_get_name(tag);
+        print_indent(i * 2);
+        printf("(%04X,%04X)  %-3s %-8s %-40s %-45s [ITEM %u]\n", tag >> 16, tag & 0xFFFF, "SQ", "--",
+               row_keyword(tag, disp_keyword_buff, sizeof(disp_keyword_buff)), name ? name : "[N/A]",
+               path->steps[i].item);
+        if (span->item.tag != DICOM_TAG_ITEM) {
+            print_indent(i * 2 + 1);
+            printf("[ITEM %u not present]\n", path->steps[i].item);
+            break;
+        }
+        print_dataset_node(&ds, &span->item, i * 2 + 1, &state);
+    }
+
+    if (result == 0) {
+        const dicom_node* found = &spans[path->count - 1].element;
+        printf("\n[%s: value at byte %llu]\n", path_text, (unsigned long long)found->offset);
+    }
+    else { printf("\n[%s: not present]\n", path_text); }
+
+    dicom_charset_close(&charset);
+    dicom_dataset_close(&ds);
+    return result == 0 ? 0 : DICOM_RESULT_NOT_FOUND;
+}
+
+int dump_dicom_buffer(const char* name, const uint8_t* data, const size_t size, const parse_options* options,
+                      dicom_arena* arena) {
+    dicom_arena_reset(arena);
+
+    dicom_dataset ds;
+    if (dicom_dataset_parse(data, size, arena, &ds) != 0) {
+        fprintf(stderr, "Error: Cannot read '%s': Invalid DICOM file\n", name);
+        return -1;
+    }
+
+    print_dataset(&ds, options, arena);
+    return 0;
+}
+
+typedef struct {
+    const char* archive;
+    const parse_options* options;
+    dicom_arena* arena;
+    int members;
+    int parsed;
+    int failed;
+} archive_dump;
+
+static int dump_archive_member(const char* name, const uint8_t* data, const size_t size, void* user) {
+    archive_dump* dump = (archive_dump*)user;
+    dump->members++;
+
+    // Bundles usually carry READMEs, viewers and DICOMDIRs' neighbours; only Part 10 files are shown
+    if (size < 132 || memcmp(data + 128, "DICM", 4) != 0) { return 0; }
+
+    printf("\n=== %s:%s ===\n", dump->archive, name);
+    if (dump_dicom_buffer(name, data, size, dump->options, dump->arena) == 0) { dump->parsed++; }
+    else { dump->failed++; }
+    return 0;
+}
+
+int dump_dicom_archive(const char* filename, const parse_options* options, dicom_arena* arena) {
+    archive_dump dump = {filename, options, arena, 0, 0, 0};
+    const int result = dicom_archive_foreach(filename, dump_archive_member, &dump);
+    if (result != 0 && dump.members == 0) { return result; }
+
+    printf("\n[Archive %s: %d member%s, %d DICOM, %d failed]\n", filename, dump.members, dump.members == 1 ? "" : "s",
+           dump.parsed + dump.failed, dump.failed);
+    return result != 0 || dump.failed > 0 ? -1 : 0;
+}
+
+int dump_dicom_json(const char* filename, const parse_options* options, dicom_arena* arena) {
+    const tag_filter* filter = options->filter;
+    dicom_arena_reset(arena);
+
+    dicom_dataset ds;
+    if (load_dataset(filename, options, arena, &ds) != 0) {
+        fprintf(stderr, "Error: Cannot read file '%s': Invalid DICOM file\n", filename);
+        return -1;
+    }
+
+    if (ds.is_truncated) { fprintf(stderr, "Warning: Dataset in '%s' is truncated or malformed\n", filename); }
+
+    const bool has_filter = filter != NULL && filter->count > 0;
+    dicom_stats_phase(DICOM_PHASE_RENDER);
+    dicom_json_write(stdout, &ds, has_filter ? filter->tags : NULL, has_filter ? filter->count : 0, arena);
+    printf("\n");
+
+    dicom_dataset_close(&ds);
     return 0;
 }
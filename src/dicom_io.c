@@ -0,0 +1,330 @@
+#ifdef __linux__
+    #define _GNU_SOURCE  // copy_file_range, sendfile
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+#ifndef _WIN32
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+    #include <sys/sendfile.h>
+    #include <sys/syscall.h>
+#endif
+
+#include "dicom_io.h"
+#include "dicom_stats.h"
+
+#ifndef _WIN32
+int dicom_file_map_open(const char* filename, dicom_file_map* map) {
+    map->data = NULL;
+    map->size = 0;
+    map->is_mapped = false;
+
+    const int fd = open(filename, O_RDONLY);
+    if (fd < 0) { return -1; }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) { return -1; }
+
+    map->data = (const uint8_t*)data;
+    map->size = (size_t)st.st_size;
+    map->is_mapped = true;
+    DICOM_STATS_ADD(bytes_read, map->size);
+    DICOM_STATS_ADD(read_calls, 1);
+    return 0;
+}
+
+void dicom_file_map_close(dicom_file_map* map) {
+    if (map->is_mapped) { munmap((void*)map->data, map->size); }
+    else { free((void*)map->data); }
+
+    map->data = NULL;
+    map->size = 0;
+    map->is_mapped = false;
+}
+
+void dicom_file_map_advise_sequential(const dicom_file_map* map) {
+    // Larger readahead for whole-value scans such as pixel data hashing
+    if (map->is_mapped) { posix_madvise((void*)map->data, map->size, POSIX_MADV_SEQUENTIAL); }
+}
+#else
+int dicom_file_map_open(const char* filename, dicom_file_map* map) {
+    map->data = NULL;
+    map->size = 0;
+    map->is_mapped = false;
+
+    FILE* fp = fopen(filename, "rb");
+    if (fp == NULL) { return -1; }
+
+    if (_fseeki64(fp, 0, SEEK_END) != 0) {
+        fclose(fp);
+        return -1;
+    }
+    const long long size = _ftelli64(fp);
+    rewind(fp);
+
+    if (size <= 0) {
+        fclose(fp);
+        return size == 0 ? 0 : -1;
+    }
+
+    uint8_t* data = (uint8_t*)malloc((size_t)size);
+    if (data == NULL || fread(data, 1, (size_t)size, fp) != (size_t)size) {
+        free(data);
+        fclose(fp);
+        return -1;
+    }
+
+    fclose(fp);
+    map->data = data;
+    map->size = (size_t)size;
+    DICOM_STATS_ADD(bytes_read, map->size);
+    DICOM_STATS_ADD(read_calls, 1);
+    DICOM_STATS_ADD(seek_calls, 1);
+    return 0;
+}
+
+void dicom_file_map_close(dicom_file_map* map) {
+    free((void*)map->data);
+
+    map->data = NULL;
+    map->size = 0;
+}
+
+void dicom_file_map_advise_sequential(const dicom_file_map* map) {
+    (void)map;  // Already read into memory
+}
+#endif
+
+#ifndef _WIN32
+int dicom_copier_open(dicom_file_copier* copier, const char* source, const char* destination) {
+    copier->written = 0;
+    copier->failed = false;
+    copier->pending = 0;
+
+    copier->in_fd = open(source, O_RDONLY);
+    if (copier->in_fd < 0) { return -1; }
+
+    copier->out_fd = open(destination, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (copier->out_fd < 0) {
+        close(copier->in_fd);
+        return -1;
+    }
+    return 0;
+}
+
+static int write_all(const int fd, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        const ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { return -1; }
+        data += n;
+        length -= (size_t)n;
+    }
+    return 0;
+}
+
+static int copy_with_pread(dicom_file_copier* copier, uint64_t offset, uint64_t length) {
+    uint8_t chunk[DICOM_COPIER_BUFFER_SIZE];
+    while (length > 0) {
+        const size_t want = length < sizeof(chunk) ? (size_t)length : sizeof(chunk);
+        const ssize_t n = pread(copier->in_fd, chunk, want, (off_t)offset);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0 || write_all(copier->out_fd, chunk, (size_t)n) != 0) { return -1; }
+        offset += (uint64_t)n;
+        length -= (uint64_t)n;
+    }
+    return 0;
+}
+
+static int copy_range(dicom_file_copier* copier, uint64_t offset, uint64_t length) {
+#ifdef __linux__
+    // Same-filesystem copies may even be reflinks; sendfile covers kernels and filesystems without it
+    #ifdef SYS_copy_file_range
+    while (length > 0) {
+        loff_t in_offset = (loff_t)offset;
+        const ssize_t n = (ssize_t)syscall(SYS_copy_file_range, copier->in_fd, &in_offset, copier->out_fd, NULL,
+                                           (size_t)length, 0u);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { break; }
+        offset += (uint64_t)n;
+        length -= (uint64_t)n;
+    }
+    #endif
+    while (length > 0) {
+        off_t in_offset = (off_t)offset;
+        const ssize_t n = sendfile(copier->out_fd, copier->in_fd, &in_offset, (size_t)length);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) { break; }
+        offset += (uint64_t)n;
+        length -= (uint64_t)n;
+    }
+#endif
+    return length > 0 ? copy_with_pread(copier, offset, length) : 0;
+}
+
+static int flush_pending(dicom_file_copier* copier) {
+    if (copier->pending == 0) { return 0; }
+
+    const int result = write_all(copier->out_fd, copier->buffer, copier->pending);
+    copier->pending = 0;
+    return result;
+}
+
+int dicom_copier_close(dicom_file_copier* copier) {
+    if (!copier->failed && flush_pending(copier) != 0) { copier->failed = true; }
+    if (close(copier->out_fd) != 0) { copier->failed = true; }
+    close(copier->in_fd);
+    return copier->failed ? -1 : 0;
+}
+
+int dicom_file_write_at(const char* filename, const uint64_t offset, const void* data, size_t length) {
+    const int fd = open(filename, O_WRONLY);
+    if (fd < 0) { return -1; }
+
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t position = offset;
+    int result = 0;
+    while (length > 0) {
+        const ssize_t n = pwrite(fd, p, length, (off_t)position);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n <= 0) {
+            result = -1;
+            break;
+        }
+        p += n;
+        position += (uint64_t)n;
+        length -= (size_t)n;
+    }
+    if (close(fd) != 0) { result = -1; }
+    return result;
+}
+
+bool dicom_same_file(const char* a, const char* b) {
+    struct stat sa, sb;
+    if (stat(a, &sa) != 0 || stat(b, &sb) != 0) { return false; }
+    return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+#else
+int dicom_copier_open(dicom_file_copier* copier, const char* source, const char* destination) {
+    copier->written = 0;
+    copier->failed = false;
+    copier->pending = 0;
+
+    copier->in = fopen(source, "rb");
+    if (copier->in == NULL) { return -1; }
+
+    copier->out = fopen(destination, "wb");
+    if (copier->out == NULL) {
+        fclose(copier->in);
+        return -1;
+    }
+    return 0;
+}
+
+static int copy_range(dicom_file_copier* copier, uint64_t offset, uint64_t length) {
+    uint8_t chunk[DICOM_COPIER_BUFFER_SIZE];
+    if (_fseeki64(copier->in, (long long)offset, SEEK_SET) != 0) { return -1; }
+
+    while (length > 0) {
+        const size_t want = length < sizeof(chunk) ? (size_t)length : sizeof(chunk);
+        const size_t n = fread(chunk, 1, want, copier->in);
+        if (n == 0 || fwrite(chunk, 1, n, copier->out) != n) { return -1; }
+        length -= n;
+    }
+    return 0;
+}
+
+static int flush_pending(dicom_file_copier* copier) {
+    if (copier->pending == 0) { return 0; }
+
+    const bool ok = fwrite(copier->buffer, 1, copier->pending, copier->out) == copier->pending;
+    copier->pending = 0;
+    return ok ? 0 : -1;
+}
+
+int dicom_copier_close(dicom_file_copier* copier) {
+    if (!copier->failed && flush_pending(copier) != 0) { copier->failed = true; }
+    if (fclose(copier->out) != 0) { copier->failed = true; }
+    fclose(copier->in);
+    return copier->failed ? -1 : 0;
+}
+
+int dicom_file_write_at(const char* filename, const uint64_t offset, const void* data, const size_t length) {
+    // No pwrite: "r+b" keeps the file as it is, seek and overwrite
+    FILE* fp = fopen(filename, "r+b");
+    if (fp == NULL) { return -1; }
+
+    bool ok = _fseeki64(fp, (long long)offset, SEEK_SET) == 0 && fwrite(data, 1, length, fp) == length;
+    if (fclose(fp) != 0) { ok = false; }
+    return ok ? 0 : -1;
+}
+
+bool dicom_same_file(const char* a, const char* b) {
+    char full_a[_MAX_PATH], full_b[_MAX_PATH];
+    if (_fullpath(full_a, a, sizeof(full_a)) == NULL || _fullpath(full_b, b, sizeof(full_b)) == NULL) { return false; }
+    return _stricmp(full_a, full_b) == 0;
+}
+#endif
+
+int dicom_copier_copy(dicom_file_copier* copier, const uint64_t offset, const uint64_t length) {
+    if (copier->failed) { return -1; }
+    if (length == 0) { return 0; }
+
+    if (flush_pending(copier) != 0 || copy_range(copier, offset, length) != 0) {
+        copier->failed = true;
+        return -1;
+    }
+    copier->written += length;
+    return 0;
+}
+
+int dicom_copier_write(dicom_file_copier* copier, const void* data, const size_t length) {
+    if (copier->failed) { return -1; }
+
+    if (copier->pending + length > sizeof(copier->buffer) && flush_pending(copier) != 0) {
+        copier->failed = true;
+        return -1;
+    }
+
+    if (length > sizeof(copier->buffer)) {
+#ifdef _WIN32
+        const bool ok = fwrite(data, 1, length, copier->out) == length;
+#else
+        const bool ok = write_all(copier->out_fd, (const uint8_t*)data, length) == 0;
+#endif
+        if (!ok) {
+            copier->failed = true;
+            return -1;
+        }
+    }
+    else {
+        memcpy(copier->buffer + copier->pending, data, length);
+        copier->pending += length;
+    }
+
+    copier->written += length;
+    return 0;
+}
@@ -0,0 +1,380 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "dicom_json.h"
+#include "dicom_charset.h"
+#include "dicom_numeric.h"
+#include "dicom_simd.h"
+
+#define MAX_INLINE_BINARY_LENGTH (1024 * 1024)
+#define NUMERIC_CHUNK 256
+
+typedef struct {
+    FILE* out;
+    const dicom_dataset* ds;
+    dicom_charset* charset;   // Of the dataset, or of the item being written when it has its own
+    dicom_arena* arena;
+} json_writer;
+
+static void write_container(json_writer* w, const dicom_node* container, bool skip_meta, const uint32_t* tags,
+                            int tag_count);
+
+// Bytes >= 0x80 are copied as they are when the text is UTF-8, otherwise escaped as ISO 8859-1 code points
+static void write_escaped(FILE* out, const uint8_t* str, const size_t length, const bool is_utf8) {
+    fputc('"', out);
+    size_t run_start = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        const uint8_t c = str[i];
+        if ((c >= 0x20 && c < 0x7F && c != '"' && c != '\\') || (c >= 0x80 && is_utf8)) { continue; }
+
+        fwrite(str + run_start, 1, i - run_start, out);
+        if (c == '"') { fputs("\\\"", out); }
+        else if (c == '\\') { fputs("\\\\", out); }
+        else if (c == '\n') { fputs("\\n", out); }
+        else if (c == '\r') { fputs("\\r", out); }
+        else if (c == '\t') { fputs("\\t", out); }
+        else { fprintf(out, "\\u%04X", c); }
+        run_start = i + 1;
+    }
+
+    fwrite(str + run_start, 1, length - run_start, out);
+    fputc('"', out);
+}
+
+static void trim_value(const uint8_t** str, size_t* length, const bool trim_leading) {
+    while (trim_leading && *length > 0 && (**str == ' ')) {
+        (*str)++;
+        (*length)--;
+    }
+    while (*length > 0 && ((*str)[*length - 1] == ' ' || (*str)[*length - 1] == '\0')) { (*length)--; }
+}
+
+static bool is_string_vr(const uint16_t vr) {
+    switch (vr) {
+    case DICOM_VR('A', 'E'): case DICOM_VR('A', 'S'): case DICOM_VR('C', 'S'): case DICOM_VR('D', 'A'):
+    case DICOM_VR('D', 'T'): case DICOM_VR('L', 'O'): case DICOM_VR('L', 'T'): case DICOM_VR('P', 'N'):
+    case DICOM_VR('S', 'H'): case DICOM_VR('S', 'T'): case DICOM_VR('T', 'M'): case DICOM_VR('U', 'C'):
+    case DICOM_VR('U', 'I'): case DICOM_VR('U', 'R'): case DICOM_VR('U', 'T'):
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool is_single_valued_text(const uint16_t vr) {
+    return vr == DICOM_VR('L', 'T') || vr == DICOM_VR('S', 'T') || vr == DICOM_VR('U', 'T') ||
+        vr == DICOM_VR('U', 'R');
+}
+
+static bool uses_specific_charset(const uint16_t vr) {
+    return vr == DICOM_VR('S', 'H') || vr == DICOM_VR('L', 'O') || vr == DICOM_VR('S', 'T') ||
+        vr == DICOM_VR('L', 'T') || vr == DICOM_VR('P', 'N') || vr == DICOM_VR('U', 'C') || vr == DICOM_VR('U', 'T');
+}
+
+static void write_person_name(FILE* out, const uint8_t* value, const size_t length, const bool is_utf8) {
+    static const char* const groups[] = {"Alphabetic", "Ideographic", "Phonetic"};
+    size_t start = 0;
+    int group = 0;
+    bool first = true;
+
+    fputc('{', out);
+    for (size_t i = 0; i <= length && group < 3; i++) {
+        if (i < length && value[i] != '=') { continue; }
+
+        const uint8_t* component = value + start;
+        size_t component_length = i - start;
+        trim_value(&component, &component_length, false);
+
+        if (component_length > 0) {
+            fprintf(out, "%s\"%s\":", first ? "" : ",", groups[group]);
+            write_escaped(out, component, component_length, is_utf8);
+            first = false;
+        }
+
+        group++;
+        start = i + 1;
+    }
+    fputc('}', out);
+}
+
+static void write_strings(FILE* out, const uint16_t vr, const uint8_t* value, const size_t length, const bool is_utf8) {
+    if (is_single_valued_text(vr)) {
+        const uint8_t* text = value;
+        size_t text_length = length;
+        trim_value(&text, &text_length, false);
+        write_escaped(out, text, text_length, is_utf8);
+        return;
+    }
+
+    size_t start = 0;
+    for (size_t i = 0; i <= length; i++) {
+        if (i < length && value[i] != '\\') { continue; }
+
+        const uint8_t* token = value + start;
+        size_t token_length = i - start;
+        trim_value(&token, &token_length, true);
+
+        if (start > 0) { fputc(',', out); }
+        if (token_length == 0) { fputs("null", out); }
+        else if (vr == DICOM_VR('P', 'N')) { write_person_name(out, token, token_length, is_utf8); }
+        else { write_escaped(out, token, token_length, is_utf8); }
+
+        start = i + 1;
+    }
+}
+
+static void write_double(FILE* out, const double value) {
+    if (isnan(value) || isinf(value)) {
+        fputs("null", out);
+        return;
+    }
+
+    char buffer[32];
+    const size_t written = dicom_format_double(value, buffer, sizeof(buffer));
+    fwrite(buffer, 1, written, out);
+}
+
+// Index of the backslash closing the NUMERIC_CHUNK-th value from start, or length when fewer remain
+static size_t numeric_chunk_end(const char* str, const size_t length, const size_t start) {
+    size_t values = 0;
+    for (size_t i = start; i < length; i++) {
+        if (str[i] == '\\' && ++values == NUMERIC_CHUNK) { return i; }
+    }
+    return length;
+}
+
+static int parse_numeric_chunk(const bool is_ds, const char* str, const size_t length, double* doubles,
+                               int64_t* integers, bool* present) {
+    return is_ds ? dicom_parse_ds(str, length, doubles, present, NUMERIC_CHUNK)
+                 : dicom_parse_is(str, length, integers, present, NUMERIC_CHUNK);
+}
+
+// Numeric strings as JSON numbers; malformed values fall back to their text
+static void write_numeric_strings(FILE* out, const uint16_t vr, const uint8_t* value, const size_t length) {
+    const char* str = (const char*)value;
+    const bool is_ds = vr == DICOM_VR('D', 'S');
+
+    double doubles[NUMERIC_CHUNK];
+    int64_t integers[NUMERIC_CHUNK];
+    bool present[NUMERIC_CHUNK];
+
+    // Long values are validated before anything is written so one bad number still falls back as a whole
+    if (numeric_chunk_end(str, length, 0) < length) {
+        for (size_t start = 0; start <= length;) {
+            const size_t end = numeric_chunk_end(str, length, start);
+            if (parse_numeric_chunk(is_ds, str + start, end - start, doubles, integers, present) < 0) {
+                write_strings(out, vr, value, length, false);
+                return;
+            }
+            start = end + 1;
+        }
+    }
+
+    size_t index = 0;
+    for (size_t start = 0; start <= length;) {
+        const size_t end = numeric_chunk_end(str, length, start);
+        const int count = parse_numeric_chunk(is_ds, str + start, end - start, doubles, integers, present);
+        if (count < 0 || count > NUMERIC_CHUNK) {
+            write_strings(out, vr, value, length, false);
+            return;
+        }
+
+        for (int i = 0; i < count; i++) {
+            if (index++ > 0) { fputc(',', out); }
+            if (!present[i]) { fputs("null", out); }
+            else if (is_ds) { write_double(out, doubles[i]); }
+            else { fprintf(out, "%" PRId64, integers[i]); }
+        }
+        start = end + 1;
+    }
+}
+
+static void write_binary_numbers(FILE* out, const uint16_t vr, const uint8_t* value, const size_t length,
+                                 const bool little_endian) {
+    const size_t width = (vr == DICOM_VR('U', 'S') || vr == DICOM_VR('S', 'S')) ? 2 :
+                         (vr == DICOM_VR('F', 'D') || vr == DICOM_VR('S', 'V') || vr == DICOM_VR('U', 'V')) ? 8 : 4;
+    const size_t count = length / width;
+
+    union {
+        uint16_t u16[NUMERIC_CHUNK * 2];
+        uint32_t u32[NUMERIC_CHUNK];
+        uint64_t u64[NUMERIC_CHUNK];
+    } buf;
+
+    for (size_t start = 0; start < count; start += NUMERIC_CHUNK) {
+        const size_t n = count - start < NUMERIC_CHUNK ? count - start : NUMERIC_CHUNK;
+        const uint8_t* src = value + start * width;
+
+        if (vr == DICOM_VR('A', 'T') || width == 2) { dicom_decode_16(src, n * (width / 2), little_endian, buf.u16); }
+        else if (width == 4) { dicom_decode_32(src, n, little_endian, buf.u32); }
+        else { dicom_decode_64(src, n, little_endian, buf.u64); }
+
+        for (size_t i = 0; i < n; i++) {
+            if (start + i > 0) { fputc(',', out); }
+
+            switch (vr) {
+            case DICOM_VR('A', 'T'):
+                fprintf(out, "\"%04X%04X\"", buf.u16[i * 2], buf.u16[i * 2 + 1]);
+                break;
+            case DICOM_VR('U', 'S'): fprintf(out, "%u", buf.u16[i]); break;
+            case DICOM_VR('S', 'S'): fprintf(out, "%d", (int16_t)buf.u16[i]); break;
+            case DICOM_VR('U', 'L'): fprintf(out, "%" PRIu32, buf.u32[i]); break;
+            case DICOM_VR('S', 'L'): fprintf(out, "%" PRId32, (int32_t)buf.u32[i]); break;
+            case DICOM_VR('U', 'V'): fprintf(out, "%" PRIu64, buf.u64[i]); break;
+            case DICOM_VR('S', 'V'): fprintf(out, "%" PRId64, (int64_t)buf.u64[i]); break;
+            case DICOM_VR('F', 'L'): {
+                float val;
+                memcpy(&val, &buf.u32[i], sizeof(float));
+                write_double(out, val);
+                break;
+            }
+            default: {
+                double val;
+                memcpy(&val, &buf.u64[i], sizeof(double));
+                write_double(out, val);
+                break;
+            }
+            }
+        }
+    }
+}
+
+static void write_base64(FILE* out, const uint8_t* data, const size_t length) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char chunk[4];
+
+    fputc('"', out);
+    for (size_t i = 0; i < length; i += 3) {
+        const uint32_t b0 = data[i];
+        const uint32_t b1 = i + 1 < length ? data[i + 1] : 0;
+        const uint32_t b2 = i + 2 < length ? data[i + 2] : 0;
+        const uint32_t triple = (b0 << 16) | (b1 << 8) | b2;
+
+        chunk[0] = alphabet[(triple >> 18) & 0x3F];
+        chunk[1] = alphabet[(triple >> 12) & 0x3F];
+        chunk[2] = i + 1 < length ? alphabet[(triple >> 6) & 0x3F] : '=';
+        chunk[3] = i + 2 < length ? alphabet[triple & 0x3F] : '=';
+        fwrite(chunk, 1, 4, out);
+    }
+    fputc('"', out);
+}
+
+// The Specific Character Set of the container when it has one; false leaves charset initialized but unset
+static bool read_charset(const dicom_dataset* ds, const dicom_node* container, dicom_charset* charset) {
+    dicom_charset_init(charset);
+    const dicom_node* charset_node = dicom_dataset_find(container, 0x00080005);
+    const uint8_t* charset_value = charset_node != NULL ? dicom_node_value(ds, charset_node) : NULL;
+    if (charset_value == NULL) { return false; }
+    dicom_charset_set(charset, charset_value, charset_node->length);
+    return true;
+}
+
+static void write_element(json_writer* w, const dicom_node* node) {
+    FILE* out = w->out;
+    const bool is_sequence = node->vr == DICOM_VR('S', 'Q') ||
+        (node->vr == DICOM_VR('U', 'N') && node->length == DICOM_UNDEFINED_LENGTH);
+    char vr[3];
+    dicom_vr_string(is_sequence ? DICOM_VR('S', 'Q') : node->vr, vr);
+
+    fprintf(out, "\"%08X\":{\"vr\":\"%s\"", node->tag, vr);
+
+    if (is_sequence) {
+        fputs(",\"Value\":[", out);
+        for (uint32_t i = 0; i < node->child_count; i++) {
+            if (i > 0) { fputc(',', out); }
+
+            // An item may redefine the Specific Character Set for the elements inside it
+            dicom_charset item_charset;
+            dicom_charset* outer = w->charset;
+            if (read_charset(w->ds, &node->children[i], &item_charset)) { w->charset = &item_charset; }
+            write_container(w, &node->children[i], false, NULL, 0);
+            w->charset = outer;
+            dicom_charset_close(&item_charset);
+        }
+        fputs("]}", out);
+        return;
+    }
+
+    const uint8_t* value = dicom_node_value(w->ds, node);
+    if (value == NULL || node->length == 0 || node->tag == 0x7FE00010) {
+        fputc('}', out);
+        return;
+    }
+
+    size_t length = node->length;
+    switch (node->vr) {
+    case DICOM_VR('D', 'S'):
+    case DICOM_VR('I', 'S'):
+        fputs(",\"Value\":[", out);
+        write_numeric_strings(out, node->vr, value, length);
+        fputc(']', out);
+        break;
+    case DICOM_VR('A', 'T'): case DICOM_VR('F', 'D'): case DICOM_VR('F', 'L'): case DICOM_VR('S', 'L'):
+    case DICOM_VR('S', 'S'): case DICOM_VR('S', 'V'): case DICOM_VR('U', 'L'): case DICOM_VR('U', 'S'):
+    case DICOM_VR('U', 'V'):
+        fputs(",\"Value\":[", out);
+        write_binary_numbers(out, node->vr, value, length, dicom_node_is_little_endian(w->ds, node));
+        fputc(']', out);
+        break;
+    default:
+        if (is_string_vr(node->vr)) {
+            const bool is_utf8 = uses_specific_charset(node->vr);
+            const dicom_arena_mark mark = dicom_arena_save(w->arena);
+            if (is_utf8) { value = dicom_charset_to_utf8(w->charset, value, length, w->arena, &length); }
+
+            fputs(",\"Value\":[", out);
+            write_strings(out, node->vr, value, length, is_utf8);
+            fputc(']', out);
+            dicom_arena_restore(w->arena, mark);
+        }
+        else if (length <= MAX_INLINE_BINARY_LENGTH) {
+            fputs(",\"InlineBinary\":", out);
+            write_base64(out, value, length);
+        }
+        break;
+    }
+
+    fputc('}', out);
+}
+
+static bool tag_requested(const uint32_t tag, const uint32_t* tags, const int tag_count) {
+    if (tags == NULL) { return true; }
+    for (int i = 0; i < tag_count; i++) { if (tags[i] == tag) { return true; } }
+    return false;
+}
+
+static void write_container(json_writer* w, const dicom_node* container, const bool skip_meta, const uint32_t* tags,
+                            const int tag_count) {
+    bool first = true;
+
+    fputc('{', w->out);
+    for (uint32_t i = 0; i < container->child_count; i++) {
+        const dicom_node* node = &container->children[i];
+        if (skip_meta && (node->tag >> 16) == 0x0002) { continue; }
+        if (!tag_requested(node->tag, tags, tag_count)) { continue; }
+
+        if (!first) { fputc(',', w->out); }
+        write_element(w, node);
+        first = false;
+    }
+    fputc('}', w->out);
+}
+
+void dicom_json_write(FILE* out, const dicom_dataset* ds, const uint32_t* tags, const int tag_count,
+                      dicom_arena* arena) {
+    dicom_charset charset;
+    read_charset(ds, &ds->root, &charset);
+    json_writer w = {.out = out, .ds = ds, .charset = &charset, .arena = arena};
+
+    write_container(&w, &ds->root, true, tags, tag_count);
+    dicom_charset_close(&charset);
+}
+
+void dicom_json_write_string(FILE* out, const char* str) {
+    write_escaped(out, (const uint8_t*)str, strlen(str), true);
+}
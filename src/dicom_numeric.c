@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <float.h>
+
+#include "dicom_numeric.h"
+
+#define MAX_EXACT_MANTISSA (UINT64_C(1) << 53)
+#define MAX_MANTISSA_DIGITS 19
+#define MAX_FALLBACK_LENGTH 63
+
+// Doubles that are exact powers of ten: 10^22 is the largest one
+static const double exact_powers_of_ten[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool is_space(const char c) { return c == ' ' || c == '\0'; }
+
+static void trim(const char** str, size_t* length) {
+    while (*length > 0 && is_space(**str)) {
+        (*str)++;
+        (*length)--;
+    }
+    while (*length > 0 && is_space((*str)[*length - 1])) { (*length)--; }
+}
+
+static bool parse_double_fallback(const char* str, const size_t length, double* value) {
+    if (length > MAX_FALLBACK_LENGTH) { return false; }
+
+    char buffer[MAX_FALLBACK_LENGTH + 1];
+    memcpy(buffer, str, length);
+    buffer[length] = '\0';
+
+    char* endptr;
+    *value = strtod(buffer, &endptr);
+    return endptr == buffer + length;
+}
+
+/*
+ * Clinger's fast path: when the decimal significand and the power of ten are both exactly
+ * representable, a single multiplication or division is correctly rounded. DS values are at most
+ * 16 characters, so nearly all of them take this path; the rest go through strtod.
+ */
+bool dicom_parse_double(const char* str, size_t length, double* value) {
+    trim(&str, &length);
+    if (length == 0) { return false; }
+
+    const char* p = str;
+    const char* end = str + length;
+    bool negative = false;
+
+    if (*p == '+' || *p == '-') {
+        negative = *p == '-';
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool any_digit = false;
+    bool inexact = false;
+
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        any_digit = true;
+        if (mantissa == 0 && *p == '0') { continue; }
+        if (digits < MAX_MANTISSA_DIGITS) {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits++;
+        }
+        else {
+            exponent++;
+            inexact = true;
+        }
+    }
+
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            any_digit = true;
+            if (mantissa == 0 && *p == '0') {
+                exponent--;
+                continue;
+            }
+            if (digits < MAX_MANTISSA_DIGITS) {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digits++;
+                exponent--;
+            }
+            else { inexact = true; }
+        }
+    }
+
+    if (!any_digit) { return false; }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool exp_negative = false;
+        if (p < end && (*p == '+' || *p == '-')) {
+            exp_negative = *p == '-';
+            p++;
+        }
+        if (p == end) { return false; }
+
+        int exp_value = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (exp_value < 100000) { exp_value = exp_value * 10 + (*p - '0'); }
+        }
+        exponent += exp_negative ? -exp_value : exp_value;
+    }
+
+    if (p != end) { return false; }
+
+    if (mantissa == 0) {
+        *value = negative ? -0.0 : 0.0;
+        return true;
+    }
+
+#if !defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD == 0
+    if (!inexact && mantissa <= MAX_EXACT_MANTISSA) {
+        double result = (double)mantissa;
+        bool exact = true;
+
+        if (exponent < 0 && exponent >= -22) { result /= exact_powers_of_ten[-exponent]; }
+        else if (exponent >= 0 && exponent <= 22) { result *= exact_powers_of_ten[exponent]; }
+        else if (exponent > 22 && exponent <= 22 + 15) {
+            // Move the surplus into the significand while it stays exact
+            uint64_t scaled = mantissa;
+            for (int i = 22; i < exponent && exact; i++) {
+                scaled *= 10;
+                exact = scaled <= MAX_EXACT_MANTISSA;
+            }
+            result = (double)scaled * exact_powers_of_ten[22];
+        }
+        else { exact = false; }
+
+        if (exact) {
+            *value = negative ? -result : result;
+            return true;
+        }
+    }
+#endif
+
+    return parse_double_fallback(str, length, value);
+}
+
+bool dicom_parse_int64(const char* str, size_t length, int64_t* value) {
+    trim(&str, &length);
+    if (length == 0) { return false; }
+
+    const char* p = str;
+    const char* end = str + length;
+    bool negative = false;
+
+    if (*p == '+' || *p == '-') {
+        negative = *p == '-';
+        p++;
+    }
+    if (p == end) { return false; }
+
+    uint64_t magnitude = 0;
+    const uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+    for (; p < end; p++) {
+        if (*p < '0' || *p > '9') { return false; }
+
+        const uint64_t digit = (uint64_t)(*p - '0');
+        if (magnitude > (limit - digit) / 10) { return false; }
+        magnitude = magnitude * 10 + digit;
+    }
+
+    *value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    return true;
+}
+
+int dicom_parse_ds(const char* str, const size_t length, double* values, bool* present, const size_t max_values) {
+    int count = 0;
+    size_t start = 0;
+
+    for (size_t i = 0; i <= length; i++) {
+        if (i < length && str[i] != '\\') { continue; }
+
+        const char* token = str + start;
+        size_t token_length = i - start;
+        trim(&token, &token_length);
+
+        if ((size_t)count < max_values) {
+            const bool has_value = token_length > 0;
+            if (present != NULL) { present[count] = has_value; }
+            values[count] = 0.0;
+            if (has_value && !dicom_parse_double(token, token_length, &values[count])) { return -1; }
+        }
+
+        count++;
+        start = i + 1;
+    }
+
+    return count;
+}
+
+int dicom_parse_is(const char* str, const size_t length, int64_t* values, bool* present, const size_t max_values) {
+    int count = 0;
+    size_t start = 0;
+
+    for (size_t i = 0; i <= length; i++) {
+        if (i < length && str[i] != '\\') { continue; }
+
+        const char* token = str + start;
+        size_t token_length = i - start;
+        trim(&token, &token_length);
+
+        if ((size_t)count < max_values) {
+            const bool has_value = token_length > 0;
+            if (present != NULL) { present[count] = has_value; }
+            values[count] = 0;
+            if (has_value && !dicom_parse_int64(token, token_length, &values[count])) { return -1; }
+        }
+
+        count++;
+        start = i + 1;
+    }
+
+    return count;
+}
+
+// Shortest %g representation that reads back to the same double
+size_t dicom_format_double(const double value, char* buffer, const size_t buffer_size) {
+    int written = 0;
+    for (int precision = 15; precision <= 17; precision++) {
+        written = snprintf(buffer, buffer_size, "%.*g", precision, value);
+        if (written < 0 || (size_t)written >= buffer_size) { return 0; }
+
+        double parsed;
+        if (dicom_parse_double(buffer, (size_t)written, &parsed) && parsed == value) { break; }
+    }
+
+    return (size_t)written;
+}
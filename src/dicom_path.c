@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "dicom_path.h"
+#include "dicom_dict.h"
+
+// Four hex digits, one half of a tag; advances the cursor past them
+static bool parse_hex16(const char** text, uint32_t* value) {
+    char hex[5];
+    for (int i = 0; i < 4; i++) {
+        if (!isxdigit((unsigned char)(*text)[i])) { return false; }
+        hex[i] = (*text)[i];
+    }
+    hex[4] = '\0';
+    *value = (uint32_t)strtoul(hex, NULL, 16);
+    *text += 4;
+    return true;
+}
+
+static bool parse_tag(const char** text, uint32_t* tag) {
+    const char* p = *text;
+    const bool parenthesized = *p == '(';
+    if (parenthesized) { p++; }
+
+    uint32_t group, element;
+    if (!parse_hex16(&p, &group)) { return false; }
+    if (*p == ',') { p++; }
+    else if (parenthesized) { return false; }
+    if (!parse_hex16(&p, &element)) { return false; }
+    if (parenthesized && *p++ != ')') { return false; }
+
+    *tag = (group << 16) | element;
+    *text = p;
+    return true;
+}
+
+// Keywords are only looked up while options are parsed, a scan of the dictionary is fine
+static bool parse_keyword(const char** text, uint32_t* tag) {
+    const char* p = *text;
+    size_t length = 0;
+    while (isalnum((unsigned char)p[length])) { length++; }
+    if (length == 0) { return false; }
+
+    for (int i = 0; i < DICOM_DICT_SIZE; i++) {
+        const char* keyword = dicom_dictionary[i].keyword;
+        if (keyword != NULL && strncmp(keyword, p, length) == 0 && keyword[length] == '\0') {
+            *tag = dicom_dictionary[i].tag;
+            *text = p + length;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool is_step_end(const char c) { return c == '\0' || c == '.' || c == '['; }
+
+int dicom_tag_path_parse(const char* text, dicom_tag_path* path) {
+    const char* p = text;
+    path->count = 0;
+
+    for (;;) {
+        if (path->count == DICOM_PATH_MAX_STEPS) { return -1; }
+        dicom_path_step* step = &path->steps[path->count++];
+        step->item = 0;
+
+        const char* start = p;
+        if (!parse_tag(&p, &step->tag) || !is_step_end(*p)) {
+            p = start;
+            if (!parse_keyword(&p, &step->tag) || !is_step_end(*p)) { return -1; }
+        }
+
+        if (*p == '[') {
+            if (p[1] == '*' && p[2] == ']') {
+                step->item = DICOM_PATH_ANY_ITEM;
+                p += 3;
+            }
+            else {
+                char* endptr;
+                const unsigned long item = strtoul(p + 1, &endptr, 10);
+                if (!isdigit((unsigned char)p[1]) || *endptr != ']' || item >= DICOM_PATH_ANY_ITEM) { return -1; }
+                step->item = (uint32_t)item;
+                p = endptr + 1;
+            }
+            if (*p != '.') { return -1; }  // An item is only a place to look in, not a result
+        }
+
+        if (*p == '\0') { return 0; }
+        if (*p++ != '.') { return -1; }
+    }
+}
+
+bool dicom_tag_path_has_wildcard(const dicom_tag_path* path) {
+    for (int i = 0; i < path->count; i++) {
+        if (path->steps[i].item == DICOM_PATH_ANY_ITEM) { return true; }
+    }
+    return false;
+}
+
+/*
+ * Compilation: the paths first form a trie whose nodes are the places a path can be after some
+ * of its steps, then subset construction turns it into the automaton. A state is the set of trie
+ * nodes a renderer can be in at once, e.g. inside item 3 of a sequence that one path takes with
+ * [*] and another with [3].
+ */
+typedef struct {
+    int from;
+    int to;                     // Trie node for the item's elements, -1 when the step shows the element
+    uint32_t tag;
+    uint32_t item;
+} trie_edge;
+
+typedef struct {
+    trie_edge* edges;
+    int edge_count;
+    int node_count;
+    uint64_t* sets;             // One bit set of trie nodes per automaton state
+    int words;                  // 64-bit words per set
+} compiler;
+
+static bool grow(void** array, const int count, int* capacity, const size_t item_size) {
+    if (count < *capacity) { return true; }
+    const int new_capacity = *capacity > 0 ? *capacity * 2 : 16;
+    void* grown = realloc(*array, (size_t)new_capacity * item_size);
+    if (grown == NULL) { return false; }
+    *array = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+static int compare_tags(const void* a, const void* b) {
+    const uint32_t x = *(const uint32_t*)a;
+    const uint32_t y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static bool in_set(const compiler* c, const int state, const int node) {
+    return (c->sets[(size_t)state * c->words + node / 64] >> (node % 64)) & 1;
+}
+
+// Index of the state for `set`, added when new; -1 when out of memory
+static int find_state(compiler* c, dicom_filter* filter, int* state_capacity, const uint64_t* set) {
+    for (int i = 0; i < filter->state_count; i++) {
+        if (memcmp(&c->sets[(size_t)i * c->words], set, (size_t)c->words * sizeof(uint64_t)) == 0) { return i; }
+    }
+
+    const int old_capacity = *state_capacity;
+    if (!grow((void**)&filter->states, filter->state_count, state_capacity, sizeof(dicom_filter_state))) { return -1; }
+    if (*state_capacity != old_capacity) {
+        uint64_t* sets = (uint64_t*)realloc(c->sets, (size_t)*state_capacity * c->words * sizeof(uint64_t));
+        if (sets == NULL) { return -1; }
+        c->sets = sets;
+    }
+    memcpy(&c->sets[(size_t)filter->state_count * c->words], set, (size_t)c->words * sizeof(uint64_t));
+    return filter->state_count++;
+}
+
+// Trie node reached from `from` over (tag, item), created when missing
+static int trie_child(compiler* c, int* capacity, const int from, const uint32_t tag, const uint32_t item) {
+    for (int i = 0; i < c->edge_count; i++) {
+        const trie_edge* e = &c->edges[i];
+        if (e->from == from && e->tag == tag && e->item == item && e->to >= 0) { return e->to; }
+    }
+    if (!grow((void**)&c->edges, c->edge_count, capacity, sizeof(trie_edge))) { return -1; }
+    c->edges[c->edge_count++] = (trie_edge){from, c->node_count, tag, item};
+    return c->node_count++;
+}
+
+static int build_trie(compiler* c, const dicom_tag_path* paths, const int count) {
+    int capacity = 0;
+    c->node_count = 1;
+    for (int p = 0; p < count; p++) {
+        int node = 0;
+        for (int i = 0; i < paths[p].count - 1 && node >= 0; i++) {
+            node = trie_child(c, &capacity, node, paths[p].steps[i].tag, paths[p].steps[i].item);
+        }
+        if (node < 0 || !grow((void**)&c->edges, c->edge_count, &capacity, sizeof(trie_edge))) { return -1; }
+        c->edges[c->edge_count++] = (trie_edge){node, -1, paths[p].steps[paths[p].count - 1].tag, 0};
+    }
+    return 0;
+}
+
+// Rules of one state: a rule per tag that any of its trie nodes has an edge for
+static int compile_state(compiler* c, dicom_filter* filter, const int state, int* state_capacity,
+                         int* rule_capacity, int* edge_capacity, uint32_t* tags, uint64_t* set) {
+    int tag_count = 0;
+    for (int i = 0; i < c->edge_count; i++) {
+        if (in_set(c, state, c->edges[i].from)) { tags[tag_count++] = c->edges[i].tag; }
+    }
+    qsort(tags, (size_t)tag_count, sizeof(uint32_t), compare_tags);
+
+    filter->states[state].first_rule = filter->rule_count;
+    for (int t = 0; t < tag_count; t++) {
+        if (t > 0 && tags[t] == tags[t - 1]) { continue; }
+        if (!grow((void**)&filter->rules, filter->rule_count, rule_capacity, sizeof(dicom_filter_rule))) { return -1; }
+
+        dicom_filter_rule rule = {tags[t], DICOM_FILTER_DESCEND, filter->edge_count, 0};
+        for (int i = 0; i < c->edge_count; i++) {
+            const trie_edge* e = &c->edges[i];
+            if (e->tag == tags[t] && e->to < 0 && in_set(c, state, e->from)) { rule.action = DICOM_FILTER_SHOW; }
+        }
+
+        // One edge per item index a path names, then one for all other items when some path has [*]
+        for (int i = 0; i <= c->edge_count && rule.action == DICOM_FILTER_DESCEND; i++) {
+            const uint32_t item = i < c->edge_count ? c->edges[i].item : DICOM_PATH_ANY_ITEM;
+            if (i < c->edge_count) {
+                const trie_edge* e = &c->edges[i];
+                if (e->tag != tags[t] || e->to < 0 || item == DICOM_PATH_ANY_ITEM || !in_set(c, state, e->from)) {
+                    continue;
+                }
+            }
+
+            bool seen = false;
+            for (int k = rule.first_edge; k < rule.first_edge + rule.edge_count; k++) {
+                seen = seen || filter->edges[k].item == item;
+            }
+            if (seen) { continue; }
+
+            memset(set, 0, (size_t)c->words * sizeof(uint64_t));
+            bool empty = true;
+            for (int k = 0; k < c->edge_count; k++) {
+                const trie_edge* e = &c->edges[k];
+                if (e->tag == tags[t] && e->to >= 0 && (e->item == item || e->item == DICOM_PATH_ANY_ITEM) &&
+                    in_set(c, state, e->from)) {
+                    set[e->to / 64] |= (uint64_t)1 << (e->to % 64);
+                    empty = false;
+                }
+            }
+            if (empty) { continue; }
+
+            const int next = find_state(c, filter, state_capacity, set);
+            if (next < 0 || !grow((void**)&filter->edges, filter->edge_count, edge_capacity, sizeof(dicom_filter_edge))) {
+                return -1;
+            }
+            filter->edges[filter->edge_count++] = (dicom_filter_edge){item, next};
+            rule.edge_count++;
+        }
+
+        filter->rules[filter->rule_count++] = rule;
+    }
+    filter->states[state].rule_count = filter->rule_count - filter->states[state].first_rule;
+    return 0;
+}
+
+int dicom_filter_compile(const dicom_tag_path* paths, const int count, dicom_filter* filter) {
+    memset(filter, 0, sizeof(*filter));
+    compiler c = {0};
+    int result = build_trie(&c, paths, count);
+
+    c.words = (c.node_count + 63) / 64;
+    uint32_t* tags = (uint32_t*)malloc(((size_t)c.edge_count + 1) * sizeof(uint32_t));
+    uint64_t* set = (uint64_t*)calloc((size_t)c.words, sizeof(uint64_t));
+    if (tags == NULL || set == NULL) { result = -1; }
+
+    int state_capacity = 0;
+    int rule_capacity = 0;
+    int edge_capacity = 0;
+    if (result == 0) {
+        set[0] = 1;  // The root state is trie node 0 alone
+        result = find_state(&c, filter, &state_capacity, set) == DICOM_FILTER_ROOT ? 0 : -1;
+    }
+
+    // States are appended while earlier ones are compiled; the loop picks them up in turn
+    for (int state = 0; result == 0 && state < filter->state_count; state++) {
+        result = compile_state(&c, filter, state, &state_capacity, &rule_capacity, &edge_capacity, tags, set);
+    }
+
+    for (int p = 0; p < count; p++) { filter->is_nested = filter->is_nested || paths[p].count > 1; }
+
+    free(tags);
+    free(set);
+    free(c.sets);
+    free(c.edges);
+    if (result != 0) { dicom_filter_free(filter); }
+    return result;
+}
+
+void dicom_filter_free(dicom_filter* filter) {
+    free(filter->states);
+    free(filter->rules);
+    free(filter->edges);
+    memset(filter, 0, sizeof(*filter));
+}
+
+static const dicom_filter_rule* find_rule(const dicom_filter* filter, const int state, const uint32_t tag) {
+    if (state < 0 || state >= filter->state_count) { return NULL; }
+
+    const dicom_filter_rule* rules = &filter->rules[filter->states[state].first_rule];
+    int left = 0;
+    int right = filter->states[state].rule_count;
+    while (left < right) {
+        const int mid = left + (right - left) / 2;
+        if (rules[mid].tag == tag) { return &rules[mid]; }
+        if (rules[mid].tag < tag) { left = mid + 1; }
+        else { right = mid; }
+    }
+    return NULL;
+}
+
+dicom_filter_action dicom_filter_match(const dicom_filter* filter, const int state, const uint32_t tag) {
+    if (state == DICOM_FILTER_ALL) { return DICOM_FILTER_SHOW; }
+    const dicom_filter_rule* rule = find_rule(filter, state, tag);
+    return rule != NULL ? rule->action : DICOM_FILTER_SKIP;
+}
+
+int dicom_filter_item(const dicom_filter* filter, const int state, const uint32_t tag, const uint32_t item) {
+    if (state == DICOM_FILTER_ALL) { return DICOM_FILTER_ALL; }
+    const dicom_filter_rule* rule = find_rule(filter, state, tag);
+    if (rule == NULL || rule->action != DICOM_FILTER_DESCEND) { return DICOM_FILTER_NONE; }
+
+    int next = DICOM_FILTER_NONE;
+    for (int i = rule->first_edge; i < rule->first_edge + rule->edge_count; i++) {
+        if (filter->edges[i].item == item) { return filter->edges[i].next; }
+        if (filter->edges[i].item == DICOM_PATH_ANY_ITEM) { next = filter->edges[i].next; }
+    }
+    return next;
+}
@@ -0,0 +1,894 @@
+#ifdef _WIN32
+    #define _CRT_RAND_S  // rand_s
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "dicom_rewrite.h"
+#include "dicom_arena.h"
+#include "dicom_dataset.h"
+#include "dicom_dict.h"
+#include "dicom_io.h"
+
+static bool is_pixel_data(const uint32_t tag) {
+    // Float and Double Float Pixel Data (7FE0,0008/0009) count as well
+    return tag == 0x7FE00008 || tag == 0x7FE00009 || tag == 0x7FE00010;
+}
+
+static int check_output(const char* filename, const char* output) {
+    if (output == NULL) {
+        fprintf(stderr, "Error: No output file given (-o <file>)\n");
+        return -1;
+    }
+    if (dicom_same_file(filename, output)) {
+        fprintf(stderr, "Error: Output file '%s' is the input file\n", output);
+        return -1;
+    }
+    return 0;
+}
+
+int strip_pixel_data(const char* filename, const char* output) {
+    if (check_output(filename, output) != 0) { return -1; }
+
+    dicom_arena arena;
+    dicom_arena_init(&arena);
+
+    dicom_dataset ds;
+    if (dicom_dataset_load(filename, &arena, &ds) != 0) {
+        fprintf(stderr, "Error: Cannot read file '%s': Invalid DICOM file\n", filename);
+        dicom_arena_free(&arena);
+        return -1;
+    }
+
+    if (ds.is_truncated) {
+        fprintf(stderr, "Warning: Dataset in '%s' is truncated or malformed, copying the readable part\n", filename);
+    }
+
+    dicom_file_copier copier;
+    if (dicom_copier_open(&copier, filename, output) != 0) {
+        fprintf(stderr, "Error: Cannot create output file '%s'\n", output);
+        dicom_dataset_close(&ds);
+        dicom_arena_free(&arena);
+        return -1;
+    }
+
+    // Only the pixel data elements are left out; what follows them (trailing padding, signatures) is kept
+    int result = 0;
+    uint64_t from = 0;
+    for (uint32_t i = 0; i < ds.root.child_count && result == 0; i++) {
+        const dicom_node* node = &ds.root.children[i];
+        if (!is_pixel_data(node->tag)) { continue; }
+
+        const uint64_t start = node->offset - node->header_size;
+        if (start > from) { result = dicom_copier_copy(&copier, from, start - from); }
+        from = node->end;
+    }
+    if (result == 0 && from < ds.root.end) { result = dicom_copier_copy(&copier, from, ds.root.end - from); }
+
+    dicom_dataset_close(&ds);
+    dicom_arena_free(&arena);
+
+    if (dicom_copier_close(&copier) != 0 || result != 0) {
+        fprintf(stderr, "Error: Writing '%s' failed\n", output);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * De-identification. Every element gets one action, looked up by tag in a sorted rule table (the
+ * PS3.15 Annex E basic profile by default, optionally extended from a profile file):
+ *   K keep, X remove, Z replace with a zero-length value, D replace with a dummy value,
+ *   U replace each UID with a salted hash ("2.25." form), R replace with a fixed value.
+ * Private groups are removed unless the profile keeps them, and the dataset group lengths, which
+ * are retired, are dropped. The rules apply inside sequences as well.
+ *
+ * The output is written in one pass over the dataset tree. Elements that keep all their bytes are
+ * merged into one source range and copied by dicom_file_copier; only changed elements, defined
+ * lengths of the sequences and items around them and the meta group length are encoded anew.
+ * Undefined lengths and delimiters are copied as they were.
+ */
+
+#define DEID_MAX_RULES 1024
+#define DEID_SALT_BYTES 16
+#define DEID_METHOD "dcmloupe basic profile"
+#define DEID_UID_ROOT "2.25."
+
+typedef enum {
+    DEID_KEEP,
+    DEID_REMOVE,
+    DEID_EMPTY,
+    DEID_DUMMY,
+    DEID_UID,
+    DEID_REPLACE,
+} deid_action;
+
+typedef struct {
+    uint32_t tag;
+    deid_action action;
+    const char* value;  // Only for DEID_REPLACE
+} deid_rule;
+
+// Subset of PS3.15 Table E.1-1 that covers what we see in our archives, sorted by tag
+static const deid_rule basic_profile[] = {
+    {0x00020003, DEID_UID, NULL},      // Media Storage SOP Instance UID
+    {0x00080014, DEID_UID, NULL},      // Instance Creator UID
+    {0x00080018, DEID_UID, NULL},      // SOP Instance UID
+    {0x00080020, DEID_EMPTY, NULL},    // Study Date
+    {0x00080021, DEID_REMOVE, NULL},   // Series Date
+    {0x00080022, DEID_REMOVE, NULL},   // Acquisition Date
+    {0x00080023, DEID_EMPTY, NULL},    // Content Date
+    {0x00080024, DEID_REMOVE, NULL},   // Overlay Date
+    {0x00080025, DEID_REMOVE, NULL},   // Curve Date
+    {0x0008002A, DEID_REMOVE, NULL},   // Acquisition DateTime
+    {0x00080030, DEID_EMPTY, NULL},    // Study Time
+    {0x00080031, DEID_REMOVE, NULL},   // Series Time
+    {0x00080032, DEID_REMOVE, NULL},   // Acquisition Time
+    {0x00080033, DEID_EMPTY, NULL},    // Content Time
+    {0x00080050, DEID_EMPTY, NULL},    // Accession Number
+    {0x00080080, DEID_REMOVE, NULL},   // Institution Name
+    {0x00080081, DEID_REMOVE, NULL},   // Institution Address
+    {0x00080082, DEID_REMOVE, NULL},   // Institution Code Sequence
+    {0x00080090, DEID_EMPTY, NULL},    // Referring Physician's Name
+    {0x00080092, DEID_REMOVE, NULL},   // Referring Physician's Address
+    {0x00080094, DEID_REMOVE, NULL},   // Referring Physician's Telephone Numbers
+    {0x00081010, DEID_REMOVE, NULL},   // Station Name
+    {0x00081030, DEID_REMOVE, NULL},   // Study Description
+    {0x0008103E, DEID_REMOVE, NULL},   // Series Description
+    {0x00081040, DEID_REMOVE, NULL},   // Institutional Department Name
+    {0x00081048, DEID_REMOVE, NULL},   // Physician(s) of Record
+    {0x00081050, DEID_REMOVE, NULL},   // Performing Physician's Name
+    {0x00081060, DEID_REMOVE, NULL},   // Name of Physician(s) Reading Study
+    {0x00081070, DEID_REMOVE, NULL},   // Operators' Name
+    {0x00081080, DEID_REMOVE, NULL},   // Admitting Diagnoses Description
+    {0x00081084, DEID_REMOVE, NULL},   // Admitting Diagnoses Code Sequence
+    {0x00081155, DEID_UID, NULL},      // Referenced SOP Instance UID
+    {0x00082111, DEID_REMOVE, NULL},   // Derivation Description
+    {0x00100010, DEID_EMPTY, NULL},    // Patient's Name
+    {0x00100020, DEID_EMPTY, NULL},    // Patient ID
+    {0x00100021, DEID_REMOVE, NULL},   // Issuer of Patient ID
+    {0x00100030, DEID_EMPTY, NULL},    // Patient's Birth Date
+    {0x00100032, DEID_REMOVE, NULL},   // Patient's Birth Time
+    {0x00100040, DEID_EMPTY, NULL},    // Patient's Sex
+    {0x00100050, DEID_REMOVE, NULL},   // Patient's Insurance Plan Code Sequence
+    {0x00101000, DEID_REMOVE, NULL},   // Other Patient IDs
+    {0x00101001, DEID_REMOVE, NULL},   // Other Patient Names
+    {0x00101002, DEID_REMOVE, NULL},   // Other Patient IDs Sequence
+    {0x00101005, DEID_REMOVE, NULL},   // Patient's Birth Name
+    {0x00101010, DEID_REMOVE, NULL},   // Patient's Age
+    {0x00101020, DEID_REMOVE, NULL},   // Patient's Size
+    {0x00101030, DEID_REMOVE, NULL},   // Patient's Weight
+    {0x00101040, DEID_REMOVE, NULL},   // Patient's Address
+    {0x00101050, DEID_REMOVE, NULL},   // Insurance Plan Identification
+    {0x00101060, DEID_REMOVE, NULL},   // Patient's Mother's Birth Name
+    {0x00101080, DEID_REMOVE, NULL},   // Military Rank
+    {0x00101081, DEID_REMOVE, NULL},   // Branch of Service
+    {0x00101090, DEID_REMOVE, NULL},   // Medical Record Locator
+    {0x00102000, DEID_REMOVE, NULL},   // Medical Alerts
+    {0x00102110, DEID_REMOVE, NULL},   // Allergies
+    {0x00102150, DEID_REMOVE, NULL},   // Country of Residence
+    {0x00102152, DEID_REMOVE, NULL},   // Region of Residence
+    {0x00102154, DEID_REMOVE, NULL},   // Patient's Telephone Numbers
+    {0x00102160, DEID_REMOVE, NULL},   // Ethnic Group
+    {0x00102180, DEID_REMOVE, NULL},   // Occupation
+    {0x001021A0, DEID_REMOVE, NULL},   // Smoking Status
+    {0x001021B0, DEID_REMOVE, NULL},   // Additional Patient History
+    {0x001021C0, DEID_REMOVE, NULL},   // Pregnancy Status
+    {0x001021D0, DEID_REMOVE, NULL},   // Last Menstrual Date
+    {0x001021F0, DEID_REMOVE, NULL},   // Patient's Religious Preference
+    {0x00104000, DEID_REMOVE, NULL},   // Patient Comments
+    {0x00120062, DEID_REPLACE, "YES"}, // Patient Identity Removed
+    {0x00120063, DEID_REPLACE, DEID_METHOD},  // De-identification Method
+    {0x00181000, DEID_REMOVE, NULL},   // Device Serial Number
+    {0x00181030, DEID_REMOVE, NULL},   // Protocol Name
+    {0x0020000D, DEID_UID, NULL},      // Study Instance UID
+    {0x0020000E, DEID_UID, NULL},      // Series Instance UID
+    {0x00200010, DEID_EMPTY, NULL},    // Study ID
+    {0x00200052, DEID_UID, NULL},      // Frame of Reference UID
+    {0x00200200, DEID_UID, NULL},      // Synchronization Frame of Reference UID
+    {0x00204000, DEID_REMOVE, NULL},   // Image Comments
+    {0x00321032, DEID_REMOVE, NULL},   // Requesting Physician
+    {0x00321060, DEID_REMOVE, NULL},   // Requested Procedure Description
+    {0x00380010, DEID_REMOVE, NULL},   // Admission ID
+    {0x00380300, DEID_REMOVE, NULL},   // Current Patient Location
+    {0x00380400, DEID_REMOVE, NULL},   // Patient's Institution Residence
+    {0x00380500, DEID_REMOVE, NULL},   // Patient State
+    {0x00400241, DEID_REMOVE, NULL},   // Performed Station AE Title
+    {0x00400242, DEID_REMOVE, NULL},   // Performed Station Name
+    {0x00400243, DEID_REMOVE, NULL},   // Performed Location
+    {0x00400244, DEID_REMOVE, NULL},   // Performed Procedure Step Start Date
+    {0x00400245, DEID_REMOVE, NULL},   // Performed Procedure Step Start Time
+    {0x00400250, DEID_REMOVE, NULL},   // Performed Procedure Step End Date
+    {0x00400251, DEID_REMOVE, NULL},   // Performed Procedure Step End Time
+    {0x00400253, DEID_REMOVE, NULL},   // Performed Procedure Step ID
+    {0x00400254, DEID_REMOVE, NULL},   // Performed Procedure Step Description
+    {0x00400275, DEID_REMOVE, NULL},   // Request Attributes Sequence
+    {0x00401001, DEID_REMOVE, NULL},   // Requested Procedure ID
+    {0x00402016, DEID_EMPTY, NULL},    // Placer Order Number / Imaging Service Request
+    {0x00402017, DEID_EMPTY, NULL},    // Filler Order Number / Imaging Service Request
+    {0x0040A124, DEID_UID, NULL},      // UID
+    {0x0040A730, DEID_REMOVE, NULL},   // Content Sequence
+    {0x00880140, DEID_UID, NULL},      // Storage Media File-set UID
+    {0x30060024, DEID_UID, NULL},      // Referenced Frame of Reference UID
+    {0x300600C2, DEID_UID, NULL},      // Related Frame of Reference UID
+};
+
+typedef struct {
+    deid_rule* rules;  // Sorted by tag
+    size_t count;
+    bool keep_private;
+    const char* salt;
+} deid_profile;
+
+typedef struct {
+    bool is_explicit_vr;
+    bool is_little_endian;
+} deid_encoding;
+
+typedef struct deid_plan {
+    uint64_t size;                    // Bytes the element takes in the output, 0 when removed
+    bool changed;                     // False when its source bytes can be copied unchanged
+    deid_action action;
+    const uint8_t* value;             // Replacement value, when the action makes one
+    uint32_t value_length;
+    const struct deid_plan* children; // Plans of a kept container's children
+} deid_plan;
+
+typedef struct {
+    const dicom_dataset* ds;
+    const deid_profile* profile;
+    dicom_arena* arena;
+    dicom_file_copier* copier;
+    uint64_t copy_start;  // Source range waiting to be copied, merged with adjacent unchanged elements
+    uint64_t copy_end;
+    bool failed;          // Out of memory while planning
+    uint32_t too_long;    // Tag of a new value that does not fit its 16-bit length field, 0 for none
+} deid_writer;
+
+static int compare_rules(const void* a, const void* b) {
+    const uint32_t ta = ((const deid_rule*)a)->tag;
+    const uint32_t tb = ((const deid_rule*)b)->tag;
+    return ta < tb ? -1 : ta > tb;
+}
+
+static const deid_rule* find_rule(const deid_profile* profile, const uint32_t tag) {
+    size_t lo = 0;
+    size_t hi = profile->count;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (profile->rules[mid].tag == tag) { return &profile->rules[mid]; }
+        if (profile->rules[mid].tag < tag) { lo = mid + 1; }
+        else { hi = mid; }
+    }
+    return NULL;
+}
+
+static deid_action action_for(const deid_profile* profile, const uint32_t tag, const char** value) {
+    *value = NULL;
+    if (tag == DICOM_TAG_ITEM) { return DEID_KEEP; }
+
+    const deid_rule* rule = find_rule(profile, tag);
+    if (rule != NULL) {
+        *value = rule->value;
+        return rule->action;
+    }
+
+    const uint16_t group = (uint16_t)(tag >> 16);
+    if ((group & 1) != 0 && !profile->keep_private) { return DEID_REMOVE; }
+    if ((tag & 0xFFFF) == 0 && group != 0x0002) { return DEID_REMOVE; }  // Retired group lengths
+    return DEID_KEEP;
+}
+
+static bool parse_action(const char* text, deid_action* action) {
+    static const char codes[] = "KXZDUR";
+    if (text[0] == '\0' || text[1] != '\0' || strchr(codes, text[0]) == NULL) { return false; }
+    *action = (deid_action)(strchr(codes, text[0]) - codes);
+    return true;
+}
+
+// Accepts GGGGEEEE, 0xGGGGEEEE and (GGGG,EEEE)
+static bool parse_rule_tag(const char* text, uint32_t* tag) {
+    char hex[9];
+    size_t n = 0;
+    if (text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) { text += 2; }
+    for (; *text != '\0'; text++) {
+        if (*text == '(' || *text == ')' || *text == ',') { continue; }
+        if (!isxdigit((unsigned char)*text) || n == 8) { return false; }
+        hex[n++] = *text;
+    }
+    hex[n] = '\0';
+    if (n != 8) { return false; }
+    *tag = (uint32_t)strtoul(hex, NULL, 16);
+    return true;
+}
+
+static int add_rule(deid_profile* profile, const deid_rule* rule) {
+    for (size_t i = 0; i < profile->count; i++) {
+        if (profile->rules[i].tag == rule->tag) {
+            profile->rules[i] = *rule;
+            return 0;
+        }
+    }
+    if (profile->count == DEID_MAX_RULES) { return -1; }
+    profile->rules[profile->count++] = *rule;
+    return 0;
+}
+
+// `bytes` random bytes from the OS, written as hex
+static int random_salt(char* out, const size_t bytes) {
+    uint8_t random[DEID_SALT_BYTES];
+    if (bytes > sizeof(random)) { return -1; }
+#ifdef _WIN32
+    for (size_t i = 0; i < bytes; i++) {
+        unsigned int value;
+        if (rand_s(&value) != 0) { return -1; }
+        random[i] = (uint8_t)value;
+    }
+#else
+    FILE* fp = fopen("/dev/urandom", "rb");
+    if (fp == NULL) { return -1; }
+    const size_t got = fread(random, 1, bytes, fp);
+    fclose(fp);
+    if (got != bytes) { return -1; }
+#endif
+    for (size_t i = 0; i < bytes; i++) { snprintf(out + 2 * i, 3, "%02x", random[i]); }
+    return 0;
+}
+
+/*
+ * Profile file, one directive per line, '#' starts a comment:
+ *   salt <text>             Secret mixed into the UID hashes (same salt, same UIDs); without one each
+ *                           run draws a random salt, so UIDs only match within that run
+ *   private keep|remove     What to do with private groups (default: remove)
+ *   <tag> <action> [value]  Rule for one tag, overrides the basic profile; value is for R only
+ */
+static int load_profile(const char* path, dicom_arena* arena, deid_profile* profile) {
+    profile->rules = (deid_rule*)dicom_arena_alloc(arena, DEID_MAX_RULES * sizeof(deid_rule));
+    if (profile->rules == NULL) { return -1; }
+    profile->count = sizeof(basic_profile) / sizeof(basic_profile[0]);
+    memcpy(profile->rules, basic_profile, sizeof(basic_profile));
+    profile->keep_private = false;
+    profile->salt = NULL;
+
+    if (path != NULL) {
+        FILE* fp = fopen(path, "r");
+        if (fp == NULL) {
+            fprintf(stderr, "Error: Cannot open profile '%s'\n", path);
+            return -1;
+        }
+
+        char line[512];
+        int line_number = 0;
+        int result = 0;
+        while (result == 0 && fgets(line, sizeof(line), fp) != NULL) {
+            line_number++;
+            char* comment = strchr(line, '#');
+            if (comment != NULL) { *comment = '\0'; }
+
+            char key[64], arg[64];
+            char rest[256] = "";
+            const int fields = sscanf(line, "%63s %63s %255[^\r\n]", key, arg, rest);
+            if (fields <= 0) { continue; }
+
+            deid_rule rule = {0};
+            if (fields >= 2 && strcmp(key, "salt") == 0) {
+                // The salt may contain spaces: take everything after the keyword
+                const char* start = strstr(line, arg);
+                size_t length = strcspn(start, "\r\n");
+                while (length > 0 && isspace((unsigned char)start[length - 1])) { length--; }
+                profile->salt = dicom_arena_strndup(arena, start, length);
+            }
+            else if (fields == 2 && strcmp(key, "private") == 0 &&
+                     (strcmp(arg, "keep") == 0 || strcmp(arg, "remove") == 0)) {
+                profile->keep_private = strcmp(arg, "keep") == 0;
+            }
+            else if (fields >= 2 && parse_rule_tag(key, &rule.tag) && parse_action(arg, &rule.action) &&
+                     (rule.action == DEID_REPLACE) == (fields == 3)) {
+                if (fields == 3) { rule.value = dicom_arena_strndup(arena, rest, strlen(rest)); }
+                if (add_rule(profile, &rule) != 0) {
+                    fprintf(stderr, "Error: Too many rules in profile '%s'\n", path);
+                    result = -1;
+                }
+            }
+            else {
+                fprintf(stderr, "Error: Invalid profile line %d in '%s'\n", line_number, path);
+                result = -1;
+            }
+        }
+        fclose(fp);
+        if (result != 0) { return -1; }
+    }
+
+    if (profile->salt == NULL) {
+        // A fixed default would make the remapped UIDs the same everywhere and open to a dictionary attack
+        char* salt = (char*)dicom_arena_alloc(arena, DEID_SALT_BYTES * 2 + 1);
+        if (salt == NULL || random_salt(salt, DEID_SALT_BYTES) != 0) {
+            fprintf(stderr, "Error: Cannot draw a random salt, set one with 'salt <secret>' in a --deid-profile\n");
+            return -1;
+        }
+        profile->salt = salt;
+    }
+
+    qsort(profile->rules, profile->count, sizeof(deid_rule), compare_rules);
+    return 0;
+}
+
+static void put_u16(uint8_t* p, const uint16_t value, const bool little_endian) {
+    p[little_endian ? 0 : 1] = (uint8_t)value;
+    p[little_endian ? 1 : 0] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(uint8_t* p, const uint32_t value, const bool little_endian) {
+    for (int i = 0; i < 4; i++) { p[little_endian ? i : 3 - i] = (uint8_t)(value >> (8 * i)); }
+}
+
+static bool is_sequence(const dicom_node* node) {
+    return node->vr == DICOM_VR('S', 'Q') || (node->vr == DICOM_VR('U', 'N') && node->length == DICOM_UNDEFINED_LENGTH);
+}
+
+static bool is_container(const dicom_node* node) {
+    return node->tag == DICOM_TAG_ITEM || is_sequence(node);
+}
+
+static bool is_text_vr(const uint16_t vr) {
+    switch (vr) {
+    case DICOM_VR('A', 'E'): case DICOM_VR('A', 'S'): case DICOM_VR('C', 'S'): case DICOM_VR('D', 'A'):
+    case DICOM_VR('D', 'S'): case DICOM_VR('D', 'T'): case DICOM_VR('I', 'S'): case DICOM_VR('L', 'O'):
+    case DICOM_VR('L', 'T'): case DICOM_VR('P', 'N'): case DICOM_VR('S', 'H'): case DICOM_VR('S', 'T'):
+    case DICOM_VR('T', 'M'): case DICOM_VR('U', 'C'): case DICOM_VR('U', 'I'): case DICOM_VR('U', 'R'):
+    case DICOM_VR('U', 'T'):
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool has_long_header(const uint16_t vr) {
+    return vr == DICOM_VR('U', 'C') || vr == DICOM_VR('U', 'R') || vr == DICOM_VR('U', 'T');
+}
+
+// Valid for the VR and short enough for every length field
+static const char* dummy_text(const uint16_t vr) {
+    switch (vr) {
+    case DICOM_VR('A', 'S'): return "000Y";
+    case DICOM_VR('D', 'A'): return "19000101";
+    case DICOM_VR('D', 'T'): return "19000101000000";
+    case DICOM_VR('T', 'M'): return "000000";
+    case DICOM_VR('D', 'S'): case DICOM_VR('I', 'S'): return "0";
+    default: return "ANONYMOUS";
+    }
+}
+
+static uint64_t fnv1a(uint64_t hash, const void* data, const size_t length) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+/*
+ * Same salt and UID in, same UID out, so references between files of a study stay intact. Two
+ * 64-bit hashes make a 38 or 39 digit integer below 2^128, which fits the 2.25 root (PS3.5 B.2).
+ */
+static size_t remap_uid(const char* salt, const char* uid, const size_t length, char* out, const size_t out_size) {
+    const uint64_t h1 = fnv1a(fnv1a(0xCBF29CE484222325ULL, salt, strlen(salt)), uid, length);
+    const uint64_t h2 = fnv1a(fnv1a(h1 ^ 0x9E3779B97F4A7C15ULL, salt, strlen(salt)), uid, length);
+    const int written = snprintf(out, out_size, DEID_UID_ROOT "%llu%019llu", (unsigned long long)(h1 | 1ULL << 63),
+                                 (unsigned long long)(h2 % 10000000000000000000ULL));
+    return written > 0 ? (size_t)written : 0;
+}
+
+// New value of a replaced element, padded to even length; NULL only when out of memory
+static const uint8_t* make_value(deid_writer* w, const dicom_node* node, const deid_action action,
+                                 const char* rule_value, uint32_t* length) {
+    const uint8_t* source = dicom_node_value(w->ds, node);
+    const uint32_t source_length = source != NULL && node->length != DICOM_UNDEFINED_LENGTH ? node->length : 0;
+    uint8_t* value;
+    size_t n = 0;
+
+    if (action == DEID_UID) {
+        // Each value of a multi-valued UI gets its own UID, an empty value stays empty
+        value = (uint8_t*)dicom_arena_alloc(w->arena, ((size_t)source_length / 2 + 1) * 64 + 2);
+        if (value == NULL) { return NULL; }
+        size_t start = 0;
+        for (size_t i = 0; i <= source_length; i++) {
+            if (i < source_length && source[i] != '\\') { continue; }
+            size_t end = i;
+            while (end > start && (source[end - 1] == '\0' || source[end - 1] == ' ')) { end--; }
+            if (start > 0) { value[n++] = '\\'; }
+            if (end > start) { n += remap_uid(w->profile->salt, (const char*)source + start, end - start, (char*)value + n, 65); }
+            start = i + 1;
+        }
+    }
+    else if (action == DEID_DUMMY && !is_text_vr(node->vr)) {
+        // Binary values keep their size and become zeros
+        value = (uint8_t*)dicom_arena_alloc(w->arena, (size_t)source_length + 1);
+        if (value == NULL) { return NULL; }
+        memset(value, 0, source_length);
+        n = source_length;
+    }
+    else {
+        const char* text = action == DEID_REPLACE && rule_value != NULL ? rule_value : dummy_text(node->vr);
+        n = strlen(text);
+        value = (uint8_t*)dicom_arena_alloc(w->arena, n + 2);
+        if (value == NULL) { return NULL; }
+        memcpy(value, text, n);
+    }
+
+    if (n % 2 != 0) { value[n++] = node->vr == DICOM_VR('U', 'I') ? '\0' : ' '; }
+    *length = (uint32_t)n;
+    return value;
+}
+
+static deid_encoding child_encoding(const deid_writer* w, const dicom_node* parent, const deid_encoding enc,
+                                    const dicom_node* child) {
+    if (parent == &w->ds->root) {
+        // File meta information is always explicit VR little endian
+        const deid_encoding meta = {true, true};
+        const deid_encoding dataset = {w->ds->is_explicit_vr, w->ds->is_little_endian};
+        return (child->tag >> 16) == 0x0002 ? meta : dataset;
+    }
+    if (parent->vr == DICOM_VR('U', 'N')) {
+        const deid_encoding un = {false, true};
+        return un;
+    }
+    return enc;
+}
+
+static uint64_t source_size(const dicom_node* node) {
+    return node->end - (node->offset - node->header_size);
+}
+
+// Bytes after the last child: delimitation items, or the whole value of an empty container
+static uint64_t tail_start(const dicom_node* node) {
+    return node->child_count > 0 ? node->children[node->child_count - 1].end : node->offset;
+}
+
+static int plan_children(deid_writer* w, const dicom_node* parent, deid_encoding enc, deid_plan** plans);
+
+static deid_plan plan_node(deid_writer* w, const dicom_node* node, const deid_encoding enc) {
+    const char* rule_value;
+    const deid_action action = action_for(w->profile, node->tag, &rule_value);
+    deid_plan plan = {source_size(node), false, action, NULL, 0, NULL};
+
+    switch (action) {
+    case DEID_REMOVE:
+        plan.size = 0;
+        plan.changed = true;
+        break;
+    case DEID_EMPTY:
+        plan.size = node->header_size;
+        plan.changed = true;
+        break;
+    case DEID_DUMMY:
+    case DEID_UID:
+    case DEID_REPLACE:
+        if (is_container(node)) {
+            // Sequences have no value to replace, they are emptied instead
+            plan.size = node->header_size;
+        }
+        else {
+            plan.value = make_value(w, node, action, rule_value, &plan.value_length);
+            if (plan.value == NULL) { w->failed = true; }
+            // Remapped UIDs are longer than most originals; a multi-valued UI can outgrow a 16-bit length
+            if (enc.is_explicit_vr && node->header_size == 8 && plan.value_length > 0xFFFF) {
+                w->too_long = node->tag;
+                w->failed = true;
+            }
+            plan.size = node->header_size + (uint64_t)plan.value_length;
+        }
+        plan.changed = true;
+        break;
+    default:
+        if (is_container(node)) {
+            deid_plan* plans;
+            if (plan_children(w, node, enc, &plans) != 0) {
+                w->failed = true;
+                break;
+            }
+            uint64_t size = node->header_size + (node->end - tail_start(node));
+            for (uint32_t i = 0; i < node->child_count; i++) {
+                size += plans[i].size;
+                plan.changed = plan.changed || plans[i].changed;
+            }
+            plan.size = size;
+            plan.children = plans;
+        }
+        break;
+    }
+    return plan;
+}
+
+static bool is_group_length(const dicom_node* node) {
+    return (node->tag & 0xFFFF) == 0 && node->length == 4;
+}
+
+// Output size of the siblings after `index` in the same group
+static uint32_t group_length(const dicom_node* parent, const deid_plan* plans, const uint32_t index) {
+    uint64_t length = 0;
+    for (uint32_t i = index + 1; i < parent->child_count && parent->children[i].tag >> 16 == parent->children[index].tag >> 16; i++) {
+        length += plans[i].size;
+    }
+    return (uint32_t)length;
+}
+
+static int plan_children(deid_writer* w, const dicom_node* parent, const deid_encoding enc, deid_plan** plans) {
+    *plans = (deid_plan*)dicom_arena_alloc(w->arena, (parent->child_count + 1) * sizeof(deid_plan));
+    if (*plans == NULL) { return -1; }
+
+    for (uint32_t i = 0; i < parent->child_count; i++) {
+        const dicom_node* child = &parent->children[i];
+        (*plans)[i] = plan_node(w, child, child_encoding(w, parent, enc, child));
+    }
+
+    // Group lengths that survive are recomputed (in practice only the meta group has one)
+    for (uint32_t i = 0; i < parent->child_count; i++) {
+        const dicom_node* child = &parent->children[i];
+        if ((*plans)[i].size == 0 || (*plans)[i].changed || !is_group_length(child)) { continue; }
+
+        uint32_t old_length = 0;
+        dicom_node_uint(w->ds, child, &old_length);
+        (*plans)[i].changed = group_length(parent, *plans, i) != old_length;
+    }
+    return 0;
+}
+
+static void flush_copy(deid_writer* w) {
+    if (w->copy_end > w->copy_start) { dicom_copier_copy(w->copier, w->copy_start, w->copy_end - w->copy_start); }
+    w->copy_start = w->copy_end = 0;
+}
+
+static void copy_range(deid_writer* w, const uint64_t start, const uint64_t end) {
+    if (end <= start) { return; }
+    if (w->copy_end != start) {
+        flush_copy(w);
+        w->copy_start = start;
+    }
+    w->copy_end = end;
+}
+
+static void write_bytes(deid_writer* w, const void* data, const size_t length) {
+    flush_copy(w);
+    dicom_copier_write(w->copier, data, length);
+}
+
+// The element's own header with a new value length
+static void write_header(deid_writer* w, const dicom_node* node, const deid_encoding enc, const uint32_t length) {
+    uint8_t header[12];
+    memcpy(header, w->ds->data + node->offset - node->header_size, node->header_size);
+
+    if (node->header_size == 12) { put_u32(header + 8, length, enc.is_little_endian); }
+    else if (node->tag == DICOM_TAG_ITEM || !enc.is_explicit_vr) { put_u32(header + 4, length, enc.is_little_endian); }
+    else { put_u16(header + 6, (uint16_t)length, enc.is_little_endian); }
+    write_bytes(w, header, node->header_size);
+}
+
+static int emit_children(deid_writer* w, const dicom_node* parent, deid_encoding enc, const deid_plan* plans);
+
+static int emit_node(deid_writer* w, const dicom_node* node, const deid_encoding enc, const deid_plan* plan,
+                     const dicom_node* parent, const deid_plan* sibling_plans, const uint32_t index) {
+    if (plan->size == 0) { return 0; }
+    if (!plan->changed) {
+        copy_range(w, node->offset - node->header_size, node->end);
+        return 0;
+    }
+
+    const deid_action action = plan->action;
+
+    if (action == DEID_KEEP && is_container(node)) {
+        const bool undefined = node->length == DICOM_UNDEFINED_LENGTH;
+        if (undefined) { copy_range(w, node->offset - node->header_size, node->offset); }
+        else { write_header(w, node, enc, (uint32_t)(plan->size - node->header_size)); }
+        if (emit_children(w, node, enc, plan->children) != 0) { return -1; }
+        copy_range(w, tail_start(node), node->end);
+    }
+    else if (action == DEID_KEEP) {
+        // Only group lengths change while kept
+        uint8_t value[4];
+        put_u32(value, group_length(parent, sibling_plans, index), enc.is_little_endian);
+        write_header(w, node, enc, 4);
+        write_bytes(w, value, sizeof(value));
+    }
+    else if (action == DEID_EMPTY || is_container(node)) { write_header(w, node, enc, 0); }
+    else {
+        write_header(w, node, enc, plan->value_length);
+        write_bytes(w, plan->value, plan->value_length);
+    }
+    return 0;
+}
+
+// R rules add their element to the top level when it is missing (text VRs only)
+static void emit_added_element(deid_writer* w, const deid_rule* rule) {
+    const char* vr_name = dicom_get_vr(rule->tag);
+    if (vr_name == NULL || strlen(vr_name) != 2) { return; }
+    const uint16_t vr = DICOM_VR(vr_name[0], vr_name[1]);
+    if (!is_text_vr(vr)) { return; }
+
+    const bool le = w->ds->is_little_endian;
+    uint8_t header[12];
+    size_t header_size = 8;
+    size_t length = strlen(rule->value);
+    const size_t padded = length + length % 2;
+
+    put_u16(header, (uint16_t)(rule->tag >> 16), le);
+    put_u16(header + 2, (uint16_t)rule->tag, le);
+    if (!w->ds->is_explicit_vr) { put_u32(header + 4, (uint32_t)padded, le); }
+    else if (has_long_header(vr)) {
+        header[4] = vr_name[0];
+        header[5] = vr_name[1];
+        header[6] = header[7] = 0;
+        put_u32(header + 8, (uint32_t)padded, le);
+        header_size = 12;
+    }
+    else {
+        if (padded > 0xFFFF) { return; }
+        header[4] = vr_name[0];
+        header[5] = vr_name[1];
+        put_u16(header + 6, (uint16_t)padded, le);
+    }
+
+    write_bytes(w, header, header_size);
+    write_bytes(w, rule->value, length);
+    if (padded != length) { write_bytes(w, vr == DICOM_VR('U', 'I') ? "\0" : " ", 1); }
+}
+
+static void emit_added_before(deid_writer* w, size_t* next_rule, const uint32_t tag) {
+    const deid_profile* profile = w->profile;
+    for (; *next_rule < profile->count && profile->rules[*next_rule].tag < tag; (*next_rule)++) {
+        const deid_rule* rule = &profile->rules[*next_rule];
+        if (rule->action != DEID_REPLACE || rule->tag >> 16 <= 0x0002 || rule->value == NULL) { continue; }
+        if (dicom_dataset_find(&w->ds->root, rule->tag) == NULL) { emit_added_element(w, rule); }
+    }
+}
+
+static int emit_children(deid_writer* w, const dicom_node* parent, const deid_encoding enc, const deid_plan* plans) {
+    const bool is_root = parent == &w->ds->root;
+    size_t next_rule = 0;
+
+    for (uint32_t i = 0; i < parent->child_count; i++) {
+        const dicom_node* child = &parent->children[i];
+        if (is_root && child->tag >> 16 != 0x0002) { emit_added_before(w, &next_rule, child->tag); }
+        if (emit_node(w, child, child_encoding(w, parent, enc, child), &plans[i], parent, plans, i) != 0) { return -1; }
+    }
+    if (is_root) { emit_added_before(w, &next_rule, 0xFFFFFFFF); }
+    return 0;
+}
+
+int deidentify_file(const char* filename, const char* output, const char* profile_path) {
+    if (check_output(filename, output) != 0) { return -1; }
+
+    dicom_arena arena;
+    dicom_arena_init(&arena);
+
+    deid_profile profile;
+    if (load_profile(profile_path, &arena, &profile) != 0) {
+        dicom_arena_free(&arena);
+        return -1;
+    }
+
+    dicom_dataset ds;
+    if (dicom_dataset_load(filename, &arena, &ds) != 0) {
+        fprintf(stderr, "Error: Cannot read file '%s': Invalid DICOM file\n", filename);
+        dicom_arena_free(&arena);
+        return -1;
+    }
+
+    // Whatever could not be parsed could not be checked either
+    if (ds.is_truncated) {
+        fprintf(stderr, "Error: Dataset in '%s' is truncated or malformed, not de-identifying it\n", filename);
+        dicom_dataset_close(&ds);
+        dicom_arena_free(&arena);
+        return -1;
+    }
+
+    dicom_file_copier copier;
+    if (dicom_copier_open(&copier, filename, output) != 0) {
+        fprintf(stderr, "Error: Cannot create output file '%s'\n", output);
+        dicom_dataset_close(&ds);
+        dicom_arena_free(&arena);
+        return -1;
+    }
+
+    deid_writer w = {&ds, &profile, &arena, &copier, 0, 0, false, 0};
+    const deid_encoding meta = {true, true};
+    // The whole tree is planned once, then written front to back from the plans
+    deid_plan* plans;
+    int result = plan_children(&w, &ds.root, meta, &plans) != 0 || w.failed ? -1 : 0;
+    copy_range(&w, 0, ds.root.offset);  // Preamble and "DICM"
+    if (result == 0) { result = emit_children(&w, &ds.root, meta, plans); }
+    flush_copy(&w);
+
+    if (dicom_copier_close(&copier) != 0 && result == 0) {
+        fprintf(stderr, "Error: Writing '%s' failed\n", output);
+        result = -1;
+    }
+    else if (result != 0 && w.too_long != 0) {
+        fprintf(stderr, "Error: New value of (%04X,%04X) in '%s' is longer than its 16-bit length field allows\n",
+                w.too_long >> 16, w.too_long & 0xFFFF, filename);
+    }
+    else if (result != 0) { fprintf(stderr, "Error: Out of memory while de-identifying '%s'\n", filename); }
+
+    dicom_dataset_close(&ds);
+    dicom_arena_free(&arena);
+    return result;
+}
+
+typedef struct {
+    uint64_t offset;
+    uint32_t length;
+    uint8_t* value;
+} value_patch;
+
+static int prepare_patch(const dicom_dataset* ds, const dicom_value_edit* edit, dicom_arena* arena, value_patch* patch) {
+    const uint16_t group = (uint16_t)(edit->tag >> 16);
+    const uint16_t element = (uint16_t)(edit->tag & 0xFFFF);
+    const dicom_node* node = dicom_dataset_find(&ds->root, edit->tag);
+
+    if (node == NULL) {
+        fprintf(stderr, "Error: (%04X,%04X) is not in the dataset, --in-place cannot add elements\n", group, element);
+        return -1;
+    }
+    if (!is_text_vr(node->vr) || node->length == DICOM_UNDEFINED_LENGTH) {
+        fprintf(stderr, "Error: (%04X,%04X) is not a text value, only text values can be set in place\n", group, element);
+        return -1;
+    }
+
+    const size_t length = strlen(edit->value);
+    if (length > node->length) {
+        fprintf(stderr, "Error: Value for (%04X,%04X) needs %zu bytes but only %u are available in place\n",
+                group, element, length, node->length);
+        return -1;
+    }
+
+    patch->offset = node->offset;
+    patch->length = node->length;
+    patch->value = (uint8_t*)dicom_arena_alloc(arena, node->length + 1);
+    if (patch->value == NULL) { return -1; }
+    memcpy(patch->value, edit->value, length);
+    memset(patch->value + length, node->vr == DICOM_VR('U', 'I') ? '\0' : ' ', node->length - length);
+    return 0;
+}
+
+int set_values_in_place(const char* filename, const dicom_value_edit* edits, const int count) {
+    dicom_arena arena;
+    dicom_arena_init(&arena);
+
+    dicom_dataset ds;
+    if (dicom_dataset_load(filename, &arena, &ds) != 0) {
+        fprintf(stderr, "Error: Cannot read file '%s': Invalid DICOM file\n", filename);
+        dicom_arena_free(&arena);
+        return -1;
+    }
+
+    // Offsets past a malformed element cannot be trusted, so nothing is written into such a file
+    if (ds.is_truncated) {
+        fprintf(stderr, "Error: Dataset in '%s' is truncated or malformed, not editing it in place\n", filename);
+        dicom_dataset_close(&ds);
+        dicom_arena_free(&arena);
+        return -1;
+    }
+
+    value_patch* patches = (value_patch*)dicom_arena_alloc(&arena, (size_t)count * sizeof(value_patch));
+    int result = patches != NULL ? 0 : -1;
+    for (int i = 0; i < count && result == 0; i++) { result = prepare_patch(&ds, &edits[i], &arena, &patches[i]); }
+
+    // The mapping is read-only, drop it before writing to the file underneath
+    dicom_dataset_close(&ds);
+
+    for (int i = 0; i < count && result == 0; i++) {
+        if (dicom_file_write_at(filename, patches[i].offset, patches[i].value, patches[i].length) != 0) {
+            fprintf(stderr, "Error: Writing '%s' failed\n", filename);
+            result = -1;
+        }
+    }
+
+    dicom_arena_free(&arena);
+    return result;
+}
@@ -0,0 +1,760 @@
+#ifdef __linux__
+    #define _GNU_SOURCE  // open_memstream
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef _WIN32
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <unistd.h>
+    #include <arpa/inet.h>
+    #include <netinet/in.h>
+    #include <netinet/tcp.h>
+    #include <sys/socket.h>
+#endif
+
+#include "dicom_scp.h"
+#include "dicom_arena.h"
+#include "dicom_dataset.h"
+#include "dicom_json.h"
+#include "dicom_stats.h"
+#include "dicom_thread.h"
+
+#ifndef _WIN32
+
+#define SCP_POLL_MS 250
+#define SCP_ARTIM_MS 30000                     // Wait for the association request and for the rest of a started PDU
+#define SCP_IDLE_MS 60000                      // An association with no PDU for this long is dropped
+#define SCP_BACKLOG 64
+#define SCP_MAX_PDU 1048576                    // Advertised receive limit
+#define SCP_MAX_ACCEPTED_PDU (16 * 1048576)    // Larger PDUs abort the association, whatever we advertised
+#define SCP_MAX_CONTEXTS 128
+#define SCP_HEADER_ATTEMPT 65536               // Buffered bytes before the first attempt to parse the header
+#define SCP_MAX_COMMAND 65536                  // Command sets are a few hundred bytes
+#define SCP_MAX_HEADER (64 * 1048576)          // Buffered dataset bytes while looking for the end of the header
+#define SCP_DEFAULT_BIND "127.0.0.1"
+#define SCP_STOP_TAG 0x7FDFFFFF                // Everything before the pixel data group
+
+#define PDU_ASSOCIATE_RQ 0x01
+#define PDU_ASSOCIATE_AC 0x02
+#define PDU_ASSOCIATE_RJ 0x03
+#define PDU_DATA_TF 0x04
+#define PDU_RELEASE_RQ 0x05
+#define PDU_RELEASE_RP 0x06
+#define PDU_ABORT 0x07
+
+#define DIMSE_C_STORE_RQ 0x0001
+#define DIMSE_C_ECHO_RQ 0x0030
+#define DIMSE_NO_DATASET 0x0101
+#define STATUS_SUCCESS 0x0000
+#define STATUS_UNRECOGNIZED_OPERATION 0x0211
+#define STATUS_CANNOT_UNDERSTAND 0xC000
+
+#define UID_APPLICATION_CONTEXT "1.2.840.10008.3.1.1.1"
+#define UID_VERIFICATION "1.2.840.10008.1.1"
+#define UID_IMPLICIT_VR_LITTLE_ENDIAN "1.2.840.10008.1.2"
+#define UID_EXPLICIT_VR_LITTLE_ENDIAN "1.2.840.10008.1.2.1"
+#define UID_DEFLATED_EXPLICIT_VR_LITTLE_ENDIAN "1.2.840.10008.1.2.1.99"
+#define IMPLEMENTATION_CLASS_UID "2.25.130587213093584271735396549374238912411"
+#define IMPLEMENTATION_VERSION_NAME "DCMLOUPE"
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(const int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+typedef struct {
+    uint8_t id;
+    uint8_t result;                 // 0 accepted, 3 abstract syntax or 4 transfer syntaxes not supported
+    char transfer_syntax[65];
+} presentation_context;
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} byte_buffer;
+
+typedef struct {
+    const scp_options* options;
+    int listen_fd;
+    dicom_mutex mutex;
+    dicom_mutex output;
+    size_t associations;
+    size_t stores;
+    size_t echoes;
+    size_t failed;
+} scp_job;
+
+typedef struct {
+    scp_job* job;
+    int fd;
+    dicom_arena* arena;
+    char calling_ae[17];
+    char called_ae[17];
+    presentation_context contexts[SCP_MAX_CONTEXTS];
+    int context_count;
+
+    // Message being received: command set, then the dataset if the command announces one
+    uint8_t context_id;
+    byte_buffer command;
+    byte_buffer dataset;
+    uint64_t dataset_bytes;         // Received, including what was not buffered
+    size_t next_attempt;            // Buffered size at which the header is parsed again
+    bool header_complete;           // The buffer holds every element before the pixel data
+    bool command_complete;
+    double message_start;
+
+    size_t stores;
+    size_t echoes;
+    size_t failed;
+} association;
+
+typedef struct {
+    uint16_t command_field;
+    uint16_t message_id;
+    uint16_t data_set_type;
+    char sop_class[65];
+    char sop_instance[65];
+} dimse_command;
+
+static uint16_t be16(const uint8_t* p) {
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_be16(uint8_t* p, const uint16_t value) {
+    p[0] = (uint8_t)(value >> 8);
+    p[1] = (uint8_t)value;
+}
+
+static void put_be32(uint8_t* p, const uint32_t value) {
+    p[0] = (uint8_t)(value >> 24);
+    p[1] = (uint8_t)(value >> 16);
+    p[2] = (uint8_t)(value >> 8);
+    p[3] = (uint8_t)value;
+}
+
+// Fails past `limit` bytes, so a peer that never finishes a message cannot grow the buffer without bound
+static int buffer_append(byte_buffer* buffer, const uint8_t* data, const size_t length, const size_t limit) {
+    if (length > limit - buffer->size) { return -1; }
+    if (buffer->size + length > buffer->capacity) {
+        size_t capacity = buffer->capacity > 0 ? buffer->capacity : 4096;
+        while (capacity < buffer->size + length) { capacity *= 2; }
+        uint8_t* grown = (uint8_t*)realloc(buffer->data, capacity);
+        if (grown == NULL) { return -1; }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, length);
+    buffer->size += length;
+    return 0;
+}
+
+// UIDs and AE titles are padded to even length with NUL or spaces
+static void copy_trimmed(char* out, const size_t out_size, const uint8_t* data, size_t length) {
+    while (length > 0 && (data[length - 1] == ' ' || data[length - 1] == '\0')) { length--; }
+    size_t start = 0;
+    while (start < length && data[start] == ' ') { start++; }
+    snprintf(out, out_size, "%.*s", (int)(length - start), (const char*)data + start);
+}
+
+// False on a stop request, after timeout_ms without the socket getting ready for `events`, or on an error
+static bool wait_ready(const int fd, const short events, const int timeout_ms) {
+    for (int waited = 0; !stop_requested && waited < timeout_ms; waited += SCP_POLL_MS) {
+        struct pollfd pfd = {fd, events, 0};
+        const int ready = poll(&pfd, 1, SCP_POLL_MS);
+        if (ready > 0) { return true; }
+        if (ready < 0 && errno != EINTR) { return false; }
+    }
+    return false;
+}
+
+// A peer that stops halfway through a PDU must not hold the worker
+static bool read_full(const int fd, uint8_t* data, const size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        if (!wait_ready(fd, POLLIN, SCP_ARTIM_MS)) { return false; }
+        const ssize_t n = read(fd, data + done, length - done);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) { continue; }
+        if (n <= 0) { return false; }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+// Connections are non-blocking: a full socket buffer waits for the peer, but not forever
+static bool write_full(const int fd, const uint8_t* data, const size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        const ssize_t n = write(fd, data + done, length - done);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0 && errno == EAGAIN) {
+            if (!wait_ready(fd, POLLOUT, SCP_ARTIM_MS)) { return false; }
+            continue;
+        }
+        if (n <= 0) { return false; }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+static bool send_pdu(const int fd, const uint8_t type, const uint8_t* body, const size_t length) {
+    uint8_t header[6] = {type, 0};
+    put_be32(header + 2, (uint32_t)length);
+    return write_full(fd, header, sizeof(header)) && write_full(fd, body, length);
+}
+
+static void send_abort(const int fd) {
+    static const uint8_t body[4] = {0, 0, 2, 0};  // Source: service provider, reason not specified
+    send_pdu(fd, PDU_ABORT, body, sizeof(body));
+}
+
+/*
+ * Association negotiation
+ */
+static size_t put_item(uint8_t* out, const uint8_t type, const char* value) {
+    const size_t length = strlen(value);
+    out[0] = type;
+    out[1] = 0;
+    put_be16(out + 2, (uint16_t)length);
+    memcpy(out + 4, value, length);
+    return 4 + length;
+}
+
+// Verification and the storage SOP classes: C-ECHO and C-STORE are the only services answered
+static bool is_supported_abstract_syntax(const char* uid) {
+    static const char* const storage_roots[] = {
+        "1.2.840.10008.5.1.4.1.1.",  // Image, waveform, SR, RT and the other composite storage classes
+        "1.2.840.10008.5.1.4.34.",   // RT delivery instructions
+        "1.2.840.10008.5.1.4.38.",   // Hanging protocols
+        "1.2.840.10008.5.1.4.39.",   // Color palettes
+        "1.2.840.10008.5.1.4.43.",   // Implant templates
+        "1.2.840.10008.5.1.4.44.",
+        "1.2.840.10008.5.1.4.45.",
+    };
+    if (strcmp(uid, UID_VERIFICATION) == 0) { return true; }
+    for (size_t i = 0; i < sizeof(storage_roots) / sizeof(storage_roots[0]); i++) {
+        if (strncmp(uid, storage_roots[i], strlen(storage_roots[i])) == 0) { return true; }
+    }
+    return false;
+}
+
+/*
+ * Result of one presentation context: 3 for an abstract syntax we do not serve, 4 when no transfer syntax
+ * fits. Native encodings are preferred: they need no decoding. Deflate would have to be inflated before parsing.
+ */
+static uint8_t choose_transfer_syntax(const uint8_t* data, const size_t length, char* chosen, const size_t chosen_size) {
+    char uid[65];
+    int best = 0;
+    bool supported = false;
+
+    for (size_t pos = 0; pos + 4 <= length;) {
+        const uint8_t type = data[pos];
+        const uint16_t item_length = be16(data + pos + 2);
+        if (pos + 4 + item_length > length) { break; }
+
+        if (type == 0x30) {
+            copy_trimmed(uid, sizeof(uid), data + pos + 4, item_length);
+            supported = is_supported_abstract_syntax(uid);
+        }
+        else if (type == 0x40) {
+            copy_trimmed(uid, sizeof(uid), data + pos + 4, item_length);
+            const int rank = strcmp(uid, UID_EXPLICIT_VR_LITTLE_ENDIAN) == 0 ? 3
+                : strcmp(uid, UID_IMPLICIT_VR_LITTLE_ENDIAN) == 0 ? 2
+                : strcmp(uid, UID_DEFLATED_EXPLICIT_VR_LITTLE_ENDIAN) != 0 && uid[0] != '\0' ? 1 : 0;
+            if (rank > best) {
+                best = rank;
+                snprintf(chosen, chosen_size, "%s", uid);
+            }
+        }
+        pos += 4 + (size_t)item_length;
+    }
+    if (!supported) { return 3; }
+    return best > 0 ? 0 : 4;
+}
+
+static bool negotiate(association* assoc, const uint8_t* body, const size_t length) {
+    // Protocol version, called and calling AE titles, then variable items (PS3.8 9.3.2)
+    if (length < 68 || !(be16(body) & 0x0001)) {
+        static const uint8_t reject[4] = {0, 1, 2, 2};  // Permanent, service provider (ACSE), protocol version
+        send_pdu(assoc->fd, PDU_ASSOCIATE_RJ, reject, sizeof(reject));
+        return false;
+    }
+    copy_trimmed(assoc->called_ae, sizeof(assoc->called_ae), body + 4, 16);
+    copy_trimmed(assoc->calling_ae, sizeof(assoc->calling_ae), body + 20, 16);
+
+    const char* ae_title = assoc->job->options->ae_title;
+    if (ae_title != NULL && strcmp(assoc->called_ae, ae_title) != 0) {
+        static const uint8_t reject[4] = {0, 1, 1, 7};  // Permanent, service user, called AE title not recognized
+        send_pdu(assoc->fd, PDU_ASSOCIATE_RJ, reject, sizeof(reject));
+        fprintf(stderr, "Association from '%s' rejected: called AE title '%s' is not '%s'\n", assoc->calling_ae,
+                assoc->called_ae, ae_title);
+        return false;
+    }
+
+    assoc->context_count = 0;
+    for (size_t pos = 68; pos + 4 <= length;) {
+        const uint8_t type = body[pos];
+        const uint16_t item_length = be16(body + pos + 2);
+        if (pos + 4 + item_length > length) { break; }
+
+        if (type == 0x20 && item_length >= 4 && assoc->context_count < SCP_MAX_CONTEXTS) {
+            presentation_context* context = &assoc->contexts[assoc->context_count++];
+            context->id = body[pos + 4];
+            snprintf(context->transfer_syntax, sizeof(context->transfer_syntax), "%s", UID_IMPLICIT_VR_LITTLE_ENDIAN);
+            context->result = choose_transfer_syntax(body + pos + 8, item_length - 4u, context->transfer_syntax,
+                                                     sizeof(context->transfer_syntax));
+        }
+        pos += 4 + (size_t)item_length;
+    }
+
+    // Echo the fixed part of the request, then answer every presentation context
+    uint8_t* ac = (uint8_t*)malloc(68 + 64 + (size_t)assoc->context_count * 80 + 128);
+    if (ac == NULL) {
+        send_abort(assoc->fd);
+        return false;
+    }
+    memcpy(ac, body, 68);
+    size_t size = 68;
+    size += put_item(ac + size, 0x10, UID_APPLICATION_CONTEXT);
+
+    int accepted = 0;
+    for (int i = 0; i < assoc->context_count; i++) {
+        const presentation_context* context = &assoc->contexts[i];
+        const size_t ts_length = strlen(context->transfer_syntax);
+        ac[size] = 0x21;
+        ac[size + 1] = 0;
+        put_be16(ac + size + 2, (uint16_t)(4 + 4 + ts_length));
+        ac[size + 4] = context->id;
+        ac[size + 5] = 0;
+        ac[size + 6] = context->result;
+        ac[size + 7] = 0;
+        size += 8;
+        size += put_item(ac + size, 0x40, context->transfer_syntax);
+        if (context->result == 0) { accepted++; }
+    }
+
+    uint8_t* user_info = ac + size;
+    size_t user_size = 4;
+    user_info[user_size] = 0x51;
+    user_info[user_size + 1] = 0;
+    put_be16(user_info + user_size + 2, 4);
+    put_be32(user_info + user_size + 4, SCP_MAX_PDU);
+    user_size += 8;
+    user_size += put_item(user_info + user_size, 0x52, IMPLEMENTATION_CLASS_UID);
+    user_size += put_item(user_info + user_size, 0x55, IMPLEMENTATION_VERSION_NAME);
+    user_info[0] = 0x50;
+    user_info[1] = 0;
+    put_be16(user_info + 2, (uint16_t)(user_size - 4));
+    size += user_size;
+
+    const bool sent = send_pdu(assoc->fd, PDU_ASSOCIATE_AC, ac, size);
+    free(ac);
+    fprintf(stderr, "Association from '%s' to '%s': %d of %d presentation contexts accepted\n", assoc->calling_ae,
+            assoc->called_ae, accepted, assoc->context_count);
+    return sent;
+}
+
+static const presentation_context* find_context(const association* assoc, const uint8_t id) {
+    for (int i = 0; i < assoc->context_count; i++) {
+        if (assoc->contexts[i].id == id && assoc->contexts[i].result == 0) { return &assoc->contexts[i]; }
+    }
+    return NULL;
+}
+
+/*
+ * DIMSE messages. Command sets are always implicit VR little endian (PS3.7 6.3.1).
+ */
+static void parse_command(const byte_buffer* buffer, dimse_command* command) {
+    memset(command, 0, sizeof(*command));
+    command->data_set_type = DIMSE_NO_DATASET;
+
+    for (size_t pos = 0; pos + 8 <= buffer->size;) {
+        const uint8_t* p = buffer->data + pos;
+        const uint32_t tag = ((uint32_t)(p[0] | (p[1] << 8)) << 16) | (uint32_t)(p[2] | (p[3] << 8));
+        const uint32_t length = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+        if (length > buffer->size - pos - 8) { break; }
+
+        const uint8_t* value = p + 8;
+        const uint16_t us = length >= 2 ? (uint16_t)(value[0] | (value[1] << 8)) : 0;
+        switch (tag) {
+        case 0x00000002: copy_trimmed(command->sop_class, sizeof(command->sop_class), value, length); break;
+        case 0x00000100: command->command_field = us; break;
+        case 0x00000110: command->message_id = us; break;
+        case 0x00000800: command->data_set_type = us; break;
+        case 0x00001000: copy_trimmed(command->sop_instance, sizeof(command->sop_instance), value, length); break;
+        default: break;
+        }
+        pos += 8 + (size_t)length;
+    }
+}
+
+static size_t put_element(uint8_t* out, const uint32_t tag, const void* value, const size_t length) {
+    const size_t padded = length + (length & 1);
+    const uint16_t group = (uint16_t)(tag >> 16);
+    const uint16_t element = (uint16_t)tag;
+    const uint8_t header[8] = {
+        (uint8_t)group, (uint8_t)(group >> 8), (uint8_t)element, (uint8_t)(element >> 8),
+        (uint8_t)padded, (uint8_t)(padded >> 8), (uint8_t)(padded >> 16), (uint8_t)(padded >> 24),
+    };
+    memcpy(out, header, sizeof(header));
+    memcpy(out + 8, value, length);
+    if (padded != length) { out[8 + length] = '\0'; }
+    return 8 + padded;
+}
+
+static size_t put_us(uint8_t* out, const uint32_t tag, const uint16_t value) {
+    const uint8_t bytes[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+    return put_element(out, tag, bytes, sizeof(bytes));
+}
+
+static bool send_response(association* assoc, const dimse_command* request, const uint16_t status) {
+    // P-DATA-TF with one PDV: item length, context ID, control header (command, last fragment)
+    uint8_t pdv[512];
+    size_t size = 6;
+    const size_t group_start = size;
+    size += 12;  // (0000,0000) group length, filled in below
+    if (request->sop_class[0] != '\0') { size += put_element(pdv + size, 0x00000002, request->sop_class, strlen(request->sop_class)); }
+    size += put_us(pdv + size, 0x00000100, (uint16_t)(request->command_field | 0x8000));
+    size += put_us(pdv + size, 0x00000120, request->message_id);
+    size += put_us(pdv + size, 0x00000800, DIMSE_NO_DATASET);
+    size += put_us(pdv + size, 0x00000900, status);
+    if (request->sop_instance[0] != '\0') {
+        size += put_element(pdv + size, 0x00001000, request->sop_instance, strlen(request->sop_instance));
+    }
+
+    const uint32_t group_length = (uint32_t)(size - group_start - 12);
+    const uint8_t length_value[4] = {
+        (uint8_t)group_length, (uint8_t)(group_length >> 8), (uint8_t)(group_length >> 16), (uint8_t)(group_length >> 24)
+    };
+    put_element(pdv + group_start, 0x00000000, length_value, sizeof(length_value));
+
+    put_be32(pdv, (uint32_t)(size - 4));
+    pdv[4] = assoc->context_id;
+    pdv[5] = 0x03;
+    return send_pdu(assoc->fd, PDU_DATA_TF, pdv, size);
+}
+
+// The header has been parsed when is_partial is set: an element after the stop tag was fully in the buffer
+static bool try_parse_header(association* assoc, const char* transfer_syntax, dicom_dataset* ds) {
+    dicom_arena_reset(assoc->arena);
+    return dicom_dataset_parse_raw(assoc->dataset.data, assoc->dataset.size, transfer_syntax, SCP_STOP_TAG,
+                                   assoc->arena, ds) == 0;
+}
+
+static uint16_t log_store(association* assoc, const dimse_command* command, const char* transfer_syntax) {
+    const scp_options* options = assoc->job->options;
+    char* line = NULL;
+    size_t line_length = 0;
+    FILE* out = open_memstream(&line, &line_length);
+    if (out == NULL) { return STATUS_CANNOT_UNDERSTAND; }
+
+    dicom_dataset ds;
+    const bool parsed = try_parse_header(assoc, transfer_syntax, &ds) && ds.root.child_count > 0;
+
+    fputs("{\"calling\":", out);
+    dicom_json_write_string(out, assoc->calling_ae);
+    fputs(",\"sop_class\":", out);
+    dicom_json_write_string(out, command->sop_class);
+    fputs(",\"sop_instance\":", out);
+    dicom_json_write_string(out, command->sop_instance);
+    fputs(",\"transfer_syntax\":", out);
+    dicom_json_write_string(out, transfer_syntax);
+    fprintf(out, ",\"bytes\":%llu,\"ms\":%.3f", (unsigned long long)assoc->dataset_bytes,
+            (dicom_stats_now() - assoc->message_start) * 1e3);
+    if (parsed) {
+        if (ds.is_truncated) { fputs(",\"truncated\":true", out); }
+        fputs(",\"dataset\":", out);
+        dicom_json_write(out, &ds, options->tags, options->tag_count, assoc->arena);
+    }
+    else { fputs(",\"error\":\"cannot parse dataset\"", out); }
+    fputs("}\n", out);
+    fclose(out);
+
+    dicom_mutex_lock(&assoc->job->output);
+    fwrite(line, 1, line_length, stdout);
+    fflush(stdout);
+    dicom_mutex_unlock(&assoc->job->output);
+    free(line);
+    return parsed ? STATUS_SUCCESS : STATUS_CANNOT_UNDERSTAND;
+}
+
+static void reset_message(association* assoc) {
+    assoc->command.size = 0;
+    assoc->dataset.size = 0;
+    assoc->dataset_bytes = 0;
+    assoc->next_attempt = SCP_HEADER_ATTEMPT;
+    assoc->header_complete = false;
+    assoc->command_complete = false;
+}
+
+static bool finish_message(association* assoc) {
+    dimse_command command;
+    parse_command(&assoc->command, &command);
+    const presentation_context* context = find_context(assoc, assoc->context_id);
+
+    uint16_t status = STATUS_UNRECOGNIZED_OPERATION;
+    if (command.command_field == DIMSE_C_ECHO_RQ) {
+        status = STATUS_SUCCESS;
+        assoc->echoes++;
+    }
+    else if (command.command_field == DIMSE_C_STORE_RQ && context != NULL) {
+        status = log_store(assoc, &command, context->transfer_syntax);
+        if (status == STATUS_SUCCESS) { assoc->stores++; }
+        else { assoc->failed++; }
+    }
+
+    reset_message(assoc);
+    return send_response(assoc, &command, status);
+}
+
+// Keeps the dataset buffer only as long as the header before the pixel data is incomplete
+static int append_dataset(association* assoc, const uint8_t* data, const size_t length) {
+    assoc->dataset_bytes += length;
+    if (assoc->header_complete) { return 0; }
+    if (buffer_append(&assoc->dataset, data, length, SCP_MAX_HEADER) != 0) {
+        fprintf(stderr, "Association from '%s' aborted: no end of header within %d bytes\n", assoc->calling_ae,
+                SCP_MAX_HEADER);
+        return -1;
+    }
+
+    if (assoc->dataset.size >= assoc->next_attempt) {
+        const presentation_context* context = find_context(assoc, assoc->context_id);
+        dicom_dataset ds;
+        if (context != NULL && try_parse_header(assoc, context->transfer_syntax, &ds) && ds.is_partial) {
+            assoc->header_complete = true;
+            assoc->dataset.size = (size_t)ds.root.end;
+        }
+        assoc->next_attempt = assoc->dataset.size * 2;
+    }
+    return 0;
+}
+
+static bool handle_data(association* assoc, const uint8_t* body, const size_t length) {
+    for (size_t pos = 0; pos + 6 <= length;) {
+        const uint32_t item_length = be32(body + pos);
+        if (item_length < 2 || item_length > length - pos - 4) { return false; }
+
+        const uint8_t context_id = body[pos + 4];
+        const uint8_t control = body[pos + 5];
+        const uint8_t* fragment = body + pos + 6;
+        const size_t fragment_length = item_length - 2;
+        pos += 4 + (size_t)item_length;
+
+        if (assoc->command.size == 0 && assoc->dataset_bytes == 0) {
+            assoc->context_id = context_id;
+            assoc->message_start = dicom_stats_now();
+        }
+
+        if (control & 0x01) {
+            if (buffer_append(&assoc->command, fragment, fragment_length, SCP_MAX_COMMAND) != 0) {
+                fprintf(stderr, "Association from '%s' aborted: command set over %d bytes\n", assoc->calling_ae,
+                        SCP_MAX_COMMAND);
+                return false;
+            }
+            if (!(control & 0x02)) { continue; }
+
+            assoc->command_complete = true;
+            dimse_command command;
+            parse_command(&assoc->command, &command);
+            if (command.data_set_type == DIMSE_NO_DATASET && !finish_message(assoc)) { return false; }
+        }
+        else {
+            if (!assoc->command_complete || append_dataset(assoc, fragment, fragment_length) != 0) { return false; }
+            if ((control & 0x02) && !finish_message(assoc)) { return false; }
+        }
+    }
+    return true;
+}
+
+static void serve_association(scp_job* job, const int fd, dicom_arena* arena) {
+    association* assoc = (association*)calloc(1, sizeof(association));
+    uint8_t* body = NULL;
+    size_t body_capacity = 0;
+    if (assoc == NULL) { return; }
+    assoc->job = job;
+    assoc->fd = fd;
+    assoc->arena = arena;
+    reset_message(assoc);
+
+    bool associated = false;
+    uint8_t header[6];
+    // ARTIM until the association request is in (PS3.8 9.1.5), then an idle limit between PDUs, so that
+    // peers which connect and send nothing cannot occupy every worker
+    while (wait_ready(fd, POLLIN, associated ? SCP_IDLE_MS : SCP_ARTIM_MS) && read_full(fd, header, sizeof(header))) {
+        const uint8_t type = header[0];
+        const uint32_t length = be32(header + 2);
+        if (length > SCP_MAX_ACCEPTED_PDU) {
+            send_abort(fd);
+            break;
+        }
+        if (length > body_capacity) {
+            uint8_t* grown = (uint8_t*)realloc(body, length);
+            if (grown == NULL) {
+                send_abort(fd);
+                break;
+            }
+            body = grown;
+            body_capacity = length;
+        }
+        if (!read_full(fd, body, length)) { break; }
+
+        if (type == PDU_ASSOCIATE_RQ && !associated) {
+            if (!negotiate(assoc, body, length)) { break; }
+            associated = true;
+        }
+        else if (type == PDU_DATA_TF && associated) {
+            if (!handle_data(assoc, body, length)) {
+                send_abort(fd);
+                break;
+            }
+        }
+        else if (type == PDU_RELEASE_RQ) {
+            static const uint8_t release[4] = {0};
+            send_pdu(fd, PDU_RELEASE_RP, release, sizeof(release));
+            break;
+        }
+        else if (type == PDU_ABORT) { break; }
+        else {
+            send_abort(fd);
+            break;
+        }
+    }
+
+    dicom_mutex_lock(&job->mutex);
+    if (associated) { job->associations++; }
+    job->stores += assoc->stores;
+    job->echoes += assoc->echoes;
+    job->failed += assoc->failed;
+    dicom_mutex_unlock(&job->mutex);
+
+    free(body);
+    free(assoc->command.data);
+    free(assoc->dataset.data);
+    free(assoc);
+}
+
+// Every worker accepts on the shared socket itself, as in the query daemon
+static void scp_worker(void* arg) {
+    scp_job* job = (scp_job*)arg;
+    dicom_arena arena;
+    dicom_arena_init(&arena);
+
+    while (!stop_requested) {
+        struct pollfd pfd = {job->listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, SCP_POLL_MS) <= 0) { continue; }
+
+        const int fd = accept(job->listen_fd, NULL, NULL);
+        if (fd < 0) { continue; }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        // BSD and macOS pass O_NONBLOCK on from the listening socket, Linux does not; set it everywhere
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        const int no_delay = 1;  // Responses are tiny; waiting to coalesce them stalls the SCU
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+        serve_association(job, fd, &arena);
+        close(fd);
+    }
+
+    dicom_arena_free(&arena);
+}
+
+static int open_listener(const int port, const char* bind_address) {
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, bind_address, &address.sin_addr) != 1) {
+        fprintf(stderr, "Error: '%s' is not an IPv4 address\n", bind_address);
+        return -1;
+    }
+
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Error: socket");
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    const int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    if (bind(fd, (const struct sockaddr*)&address, sizeof(address)) != 0 || listen(fd, SCP_BACKLOG) != 0) {
+        fprintf(stderr, "Error: Cannot listen on %s:%d: %s\n", bind_address, port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+int run_scp(const scp_options* options) {
+    const char* bind_address = options->bind_address != NULL ? options->bind_address : SCP_DEFAULT_BIND;
+    const int listen_fd = open_listener(options->port, bind_address);
+    if (listen_fd < 0) { return -1; }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    scp_job job;
+    memset(&job, 0, sizeof(job));
+    job.options = options;
+    job.listen_fd = listen_fd;
+    dicom_mutex_init(&job.mutex);
+    dicom_mutex_init(&job.output);
+
+    const int thread_count = options->threads > 0 ? options->threads : dicom_cpu_count();
+    dicom_thread* threads = (dicom_thread*)malloc((size_t)thread_count * sizeof(dicom_thread));
+    int started = 0;
+    while (threads != NULL && started < thread_count && dicom_thread_start(&threads[started], scp_worker, &job) == 0) {
+        started++;
+    }
+
+    const double start = dicom_stats_now();
+    int result = 0;
+    if (started == 0) {
+        fprintf(stderr, "Error: Cannot start worker threads\n");
+        result = -1;
+    }
+    else {
+        fprintf(stderr, "Storage SCP on %s:%d as '%s' with %d worker%s, stop with Ctrl+C\n", bind_address,
+                options->port, options->ae_title != NULL ? options->ae_title : "any AE title", started,
+                started == 1 ? "" : "s");
+    }
+
+    for (int i = 0; i < started; i++) { dicom_thread_join(threads[i]); }
+    free(threads);
+
+    fprintf(stderr, "[scp] associations=%zu stores=%zu echoes=%zu failed=%zu threads=%d seconds=%.3f\n",
+            job.associations, job.stores, job.echoes, job.failed, started, dicom_stats_now() - start);
+
+    close(listen_fd);
+    dicom_mutex_destroy(&job.output);
+    dicom_mutex_destroy(&job.mutex);
+    return result;
+}
+
+#else
+
+int run_scp(const scp_options* options) {
+    fprintf(stderr, "Error: Cannot listen on port %d: the storage SCP is not supported on this platform\n", options->port);
+    return -1;
+}
+
+#endif
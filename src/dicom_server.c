@@ -0,0 +1,316 @@
+#ifdef __linux__
+    #define _GNU_SOURCE  // open_memstream
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef _WIN32
+    #include <errno.h>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <unistd.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+#endif
+
+#include "dicom_server.h"
+#include "dicom_arena.h"
+#include "dicom_dataset.h"
+#include "dicom_header_parser.h"
+#include "dicom_json.h"
+#include "dicom_stats.h"
+#include "dicom_thread.h"
+
+#ifndef _WIN32
+
+#define SERVER_POLL_MS 250
+#define SERVER_BACKLOG 128
+#define MAX_REQUEST_SIZE 65536
+#define SERVER_IDLE_MS 5000   // A connection with no request for this long is closed, freeing its worker
+#define SERVER_READ_MS 5000   // Longest wait for the rest of a message once it has started
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(const int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+typedef struct {
+    int listen_fd;
+    dicom_mutex mutex;
+    size_t connections;
+    size_t requests;
+    size_t failed;
+} server_job;
+
+// False on a stop request, after timeout_ms without the socket getting ready for `events`, or on an error
+static bool wait_ready(const int fd, const short events, const int timeout_ms) {
+    for (int waited = 0; !stop_requested && waited < timeout_ms; waited += SERVER_POLL_MS) {
+        struct pollfd pfd = {fd, events, 0};
+        const int ready = poll(&pfd, 1, SERVER_POLL_MS);
+        if (ready > 0) { return true; }
+        if (ready < 0 && errno != EINTR) { return false; }
+    }
+    return false;
+}
+
+// A client that stops halfway through a message must not hold the worker
+static bool read_full(const int fd, void* data, const size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        if (!wait_ready(fd, POLLIN, SERVER_READ_MS)) { return false; }
+        const ssize_t n = read(fd, (char*)data + done, length - done);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) { continue; }
+        if (n <= 0) { return false; }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+// Connections are non-blocking: a full socket buffer waits for the client, but not forever
+static bool write_full(const int fd, const void* data, const size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        const ssize_t n = write(fd, (const char*)data + done, length - done);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0 && errno == EAGAIN) {
+            if (!wait_ready(fd, POLLOUT, SERVER_READ_MS)) { return false; }
+            continue;
+        }
+        if (n <= 0) { return false; }
+        done += (size_t)n;
+    }
+    return true;
+}
+
+static bool send_message(const int fd, const char* data, const size_t length) {
+    if (length > UINT32_MAX) { return false; }
+    const uint8_t prefix[4] = {
+        (uint8_t)(length >> 24), (uint8_t)(length >> 16), (uint8_t)(length >> 8), (uint8_t)length
+    };
+    return write_full(fd, prefix, sizeof(prefix)) && write_full(fd, data, length);
+}
+
+// "00100010;00080020", commas also accepted; returns -1 on a malformed tag
+static int parse_tag_list(char* list, uint32_t* tags, int* count) {
+    *count = 0;
+    char* state;
+    for (char* token = strtok_r(list, ";,", &state); token != NULL; token = strtok_r(NULL, ";,", &state)) {
+        char* endptr;
+        const unsigned long tag = strtoul(token, &endptr, 16);
+        if (endptr == token || *endptr != '\0' || tag > 0xFFFFFFFF || *count >= MAX_FILTER_TAGS) { return -1; }
+        tags[(*count)++] = (uint32_t)tag;
+    }
+    return 0;
+}
+
+// Request is NUL-terminated and owned by the caller; the response is built in memory for its length
+static bool answer_request(const int fd, char* request, dicom_arena* arena) {
+    char* response = NULL;
+    size_t response_length = 0;
+    FILE* out = open_memstream(&response, &response_length);
+    if (out == NULL) { return false; }
+
+    uint32_t tags[MAX_FILTER_TAGS];
+    int tag_count = 0;
+    char* separator = strchr(request, '\n');
+    const char* path = request;
+    bool ok = true;
+
+    fputs("{\"path\":", out);
+    if (separator != NULL) { *separator = '\0'; }
+    dicom_json_write_string(out, path);
+
+    dicom_arena_reset(arena);
+    dicom_dataset ds;
+    if (separator != NULL && parse_tag_list(separator + 1, tags, &tag_count) != 0) {
+        fputs(",\"error\":\"malformed tag list\"", out);
+        ok = false;
+    }
+    else if (dicom_dataset_load(path, arena, &ds) != 0) {
+        fputs(",\"error\":\"cannot read file or not a DICOM file\"", out);
+        ok = false;
+    }
+    else {
+        if (ds.is_truncated) { fputs(",\"truncated\":true", out); }
+        fputs(",\"dataset\":", out);
+        dicom_json_write(out, &ds, tag_count > 0 ? tags : NULL, tag_count, arena);
+        dicom_dataset_close(&ds);
+    }
+    fputc('}', out);
+    fclose(out);
+
+    const bool sent = send_message(fd, response, response_length);
+    free(response);
+    return sent && ok;
+}
+
+static void serve_connection(server_job* job, const int fd, dicom_arena* arena) {
+    char* request = (char*)malloc(MAX_REQUEST_SIZE + 1);
+    size_t requests = 0;
+    size_t failed = 0;
+
+    uint8_t prefix[4];
+    // Idle connections are dropped so that a few quiet clients cannot occupy every worker
+    while (request != NULL && wait_ready(fd, POLLIN, SERVER_IDLE_MS) && read_full(fd, prefix, sizeof(prefix))) {
+        const uint32_t length = ((uint32_t)prefix[0] << 24) | ((uint32_t)prefix[1] << 16) |
+            ((uint32_t)prefix[2] << 8) | prefix[3];
+        if (length == 0) { break; }
+        if (length > MAX_REQUEST_SIZE) {
+            static const char too_long[] = "{\"error\":\"request too long\"}";
+            send_message(fd, too_long, sizeof(too_long) - 1);
+            failed++;
+            break;
+        }
+        if (!read_full(fd, request, length)) { break; }
+        request[length] = '\0';
+
+        requests++;
+        if (!answer_request(fd, request, arena)) { failed++; }
+    }
+
+    free(request);
+    dicom_mutex_lock(&job->mutex);
+    job->connections++;
+    job->requests += requests;
+    job->failed += failed;
+    dicom_mutex_unlock(&job->mutex);
+}
+
+// Every worker accepts on the shared socket itself, so there is no hand-off queue
+static void server_worker(void* arg) {
+    server_job* job = (server_job*)arg;
+    dicom_arena arena;
+    dicom_arena_init(&arena);
+
+    while (!stop_requested) {
+        struct pollfd pfd = {job->listen_fd, POLLIN, 0};
+        if (poll(&pfd, 1, SERVER_POLL_MS) <= 0) { continue; }
+
+        const int fd = accept(job->listen_fd, NULL, NULL);
+        if (fd < 0) { continue; }  // Another worker took it (EAGAIN) or the client gave up
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        // BSD and macOS pass O_NONBLOCK on from the listening socket, Linux does not; set it everywhere
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        serve_connection(job, fd, &arena);
+        close(fd);
+    }
+
+    dicom_arena_free(&arena);
+}
+
+// Left behind by a daemon that did not exit cleanly: still a socket, but nothing answers on it
+static bool is_stale_socket(const char* socket_path, const struct sockaddr_un* address) {
+    struct stat st;
+    if (stat(socket_path, &st) != 0 || !S_ISSOCK(st.st_mode)) { return false; }
+
+    const int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (probe < 0) { return false; }
+    const bool live = connect(probe, (const struct sockaddr*)address, sizeof(*address)) == 0;
+    close(probe);
+    return !live;
+}
+
+static int open_socket(const char* socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Error: Socket path '%s' is too long\n", socket_path);
+        return -1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("Error: socket");
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    // Owner only: a client can have the daemon read any file it can read. The umask covers the gap
+    // between bind() and chmod(); no other thread is running yet.
+    const mode_t old_mask = umask(077);
+    int bound = bind(fd, (const struct sockaddr*)&address, sizeof(address));
+    if (bound != 0 && errno == EADDRINUSE && is_stale_socket(socket_path, &address)) {
+        unlink(socket_path);
+        bound = bind(fd, (const struct sockaddr*)&address, sizeof(address));
+    }
+    umask(old_mask);
+    if (bound == 0) { chmod(socket_path, 0600); }
+    if (bound != 0) {
+        fprintf(stderr, "Error: Cannot bind '%s': %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, SERVER_BACKLOG) != 0) {
+        fprintf(stderr, "Error: Cannot listen on '%s': %s\n", socket_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+int run_server(const char* socket_path, const server_options* options) {
+    const int listen_fd = open_socket(socket_path);
+    if (listen_fd < 0) { return -1; }
+
+    // No SA_RESTART so that poll() returns on a stop request; clients that hang up must not kill us
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    server_job job;
+    memset(&job, 0, sizeof(job));
+    job.listen_fd = listen_fd;
+    dicom_mutex_init(&job.mutex);
+
+    const int thread_count = options->threads > 0 ? options->threads : dicom_cpu_count();
+    dicom_thread* threads = (dicom_thread*)malloc((size_t)thread_count * sizeof(dicom_thread));
+    int started = 0;
+    while (threads != NULL && started < thread_count && dicom_thread_start(&threads[started], server_worker, &job) == 0) {
+        started++;
+    }
+
+    const double start = dicom_stats_now();
+    int result = 0;
+    if (started == 0) {
+        fprintf(stderr, "Error: Cannot start worker threads\n");
+        result = -1;
+    }
+    else { fprintf(stderr, "Serving on '%s' with %d worker%s, stop with Ctrl+C\n", socket_path, started, started == 1 ? "" : "s"); }
+
+    for (int i = 0; i < started; i++) { dicom_thread_join(threads[i]); }
+    free(threads);
+
+    fprintf(stderr, "[serve] connections=%zu requests=%zu failed=%zu threads=%d seconds=%.3f\n", job.connections,
+            job.requests, job.failed, started, dicom_stats_now() - start);
+
+    close(listen_fd);
+    unlink(socket_path);
+    dicom_mutex_destroy(&job.mutex);
+    return result;
+}
+
+#else
+
+int run_server(const char* socket_path, const server_options* options) {
+    (void)options;
+    fprintf(stderr, "Error: Cannot serve on '%s': Unix domain sockets are not supported on this platform\n", socket_path);
+    return -1;
+}
+
+#endif
@@ -0,0 +1,452 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "dicom_simd.h"
+#include "dicom_thread.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define DICOM_SIMD_X86 1
+    #include <immintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+    #define DICOM_SIMD_NEON 1
+    #include <arm_neon.h>
+#endif
+
+typedef void (*swap_kernel)(const uint8_t* src, uint8_t* dst, size_t count, int width);
+
+static bool host_is_little_endian(void) {
+    const uint16_t probe = 1;
+    uint8_t first;
+    memcpy(&first, &probe, 1);
+    return first == 1;
+}
+
+static void swap_scalar(const uint8_t* src, uint8_t* dst, const size_t count, const int width) {
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* s = src + i * width;
+        uint8_t* d = dst + i * width;
+        for (int b = 0; b < width; b++) { d[b] = s[width - 1 - b]; }
+    }
+}
+
+static bool is_printable(const uint8_t c) { return c >= 32 && c < 127; }
+
+static size_t printable_run_scalar(const uint8_t* data, const size_t length) {
+    size_t i = 0;
+    while (i < length && is_printable(data[i])) { i++; }
+    return i;
+}
+
+// Classifies data[start, length) into result; the SIMD kernels use it for their tails
+static void text_scan_tail(const uint8_t* data, const size_t start, const size_t length,
+                           dicom_text_scan_result* result) {
+    for (size_t i = start; i < length; i++) {
+        const uint8_t c = data[i];
+        if (is_printable(c) || c == '\t' || c == '\n' || c == '\r') { result->text_bytes++; }
+        else if (c >= 0x80) { result->high_bytes++; }
+        else if (c == 0 && result->nul_offset == length) { result->nul_offset = i; }
+    }
+}
+
+static void text_scan_scalar(const uint8_t* data, const size_t length, dicom_text_scan_result* result) {
+    text_scan_tail(data, 0, length, result);
+}
+
+static bool is_header_candidate(const uint8_t a, const uint8_t b) {
+    return (a >= 'A' && a <= 'Z' && b >= 'A' && b <= 'Z') || (a == 0xFE && b == 0xFF) || (a == 0xFF && b == 0xFE);
+}
+
+// Pairs start at [start, length - 1); the SIMD kernels use it for their tails
+static size_t header_candidate_tail(const uint8_t* data, const size_t start, const size_t length) {
+    for (size_t i = start; i + 1 < length; i++) {
+        if (is_header_candidate(data[i], data[i + 1])) { return i; }
+    }
+    return length;
+}
+
+static size_t find_header_candidate_scalar(const uint8_t* data, const size_t length) {
+    return header_candidate_tail(data, 0, length);
+}
+
+static bool is_ascii_scalar(const uint8_t* data, const size_t length) {
+    uint8_t bits = 0;
+    for (size_t i = 0; i < length; i++) { bits |= data[i]; }
+    return (bits & 0x80) == 0;
+}
+
+#ifdef DICOM_SIMD_X86
+__attribute__((target("avx2")))
+static size_t printable_run_avx2(const uint8_t* data, const size_t length) {
+    const __m256i low = _mm256_set1_epi8(31);
+    const __m256i high = _mm256_set1_epi8(127);
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        const __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(v, low), _mm256_cmpgt_epi8(high, v));
+        const uint32_t bad = ~(uint32_t)_mm256_movemask_epi8(ok);
+        if (bad != 0) { return i + (size_t)__builtin_ctz(bad); }
+    }
+
+    return i + printable_run_scalar(data + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static void text_scan_avx2(const uint8_t* data, const size_t length, dicom_text_scan_result* result) {
+    const __m256i low = _mm256_set1_epi8(31);
+    const __m256i high = _mm256_set1_epi8(127);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        const __m256i printable = _mm256_and_si256(_mm256_cmpgt_epi8(v, low), _mm256_cmpgt_epi8(high, v));
+        const __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')),
+                                              _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                                                              _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+        const uint32_t text = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(printable, space));
+        const uint32_t upper = (uint32_t)_mm256_movemask_epi8(v);
+        const uint32_t nul = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero));
+
+        result->text_bytes += (size_t)__builtin_popcount(text);
+        result->high_bytes += (size_t)__builtin_popcount(upper);
+        if (nul != 0 && result->nul_offset == length) { result->nul_offset = i + (size_t)__builtin_ctz(nul); }
+    }
+
+    text_scan_tail(data, i, length, result);
+}
+
+// Each block is compared with itself shifted by one byte, so bit i of the mask is the pair at i
+__attribute__((target("avx2")))
+static size_t find_header_candidate_avx2(const uint8_t* data, const size_t length) {
+    const __m256i below_a = _mm256_set1_epi8('A' - 1);
+    const __m256i above_z = _mm256_set1_epi8('Z' + 1);
+    const __m256i fe = _mm256_set1_epi8((char)0xFE);
+    const __m256i ff = _mm256_set1_epi8((char)0xFF);
+
+    size_t i = 0;
+    for (; i + 33 <= length; i += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i*)(data + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i*)(data + i + 1));
+        const __m256i letters = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi8(a, below_a), _mm256_cmpgt_epi8(above_z, a)),
+            _mm256_and_si256(_mm256_cmpgt_epi8(b, below_a), _mm256_cmpgt_epi8(above_z, b)));
+        const __m256i item = _mm256_or_si256(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, fe), _mm256_cmpeq_epi8(b, ff)),
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, ff), _mm256_cmpeq_epi8(b, fe)));
+        const uint32_t hits = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(letters, item));
+        if (hits != 0) { return i + (size_t)__builtin_ctz(hits); }
+    }
+
+    return header_candidate_tail(data, i, length);
+}
+
+__attribute__((target("sse2")))
+static size_t find_header_candidate_sse2(const uint8_t* data, const size_t length) {
+    const __m128i below_a = _mm_set1_epi8('A' - 1);
+    const __m128i above_z = _mm_set1_epi8('Z' + 1);
+    const __m128i fe = _mm_set1_epi8((char)0xFE);
+    const __m128i ff = _mm_set1_epi8((char)0xFF);
+
+    size_t i = 0;
+    for (; i + 17 <= length; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(data + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(data + i + 1));
+        const __m128i letters = _mm_and_si128(
+            _mm_and_si128(_mm_cmpgt_epi8(a, below_a), _mm_cmpgt_epi8(above_z, a)),
+            _mm_and_si128(_mm_cmpgt_epi8(b, below_a), _mm_cmpgt_epi8(above_z, b)));
+        const __m128i item = _mm_or_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(a, fe), _mm_cmpeq_epi8(b, ff)),
+            _mm_and_si128(_mm_cmpeq_epi8(a, ff), _mm_cmpeq_epi8(b, fe)));
+        const uint32_t hits = (uint32_t)_mm_movemask_epi8(_mm_or_si128(letters, item));
+        if (hits != 0) { return i + (size_t)__builtin_ctz(hits); }
+    }
+
+    return header_candidate_tail(data, i, length);
+}
+
+__attribute__((target("avx2")))
+static bool is_ascii_avx2(const uint8_t* data, const size_t length) {
+    __m256i bits = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        bits = _mm256_or_si256(bits, _mm256_loadu_si256((const __m256i*)(data + i)));
+    }
+
+    return _mm256_movemask_epi8(bits) == 0 && is_ascii_scalar(data + i, length - i);
+}
+
+__attribute__((target("sse2")))
+static bool is_ascii_sse2(const uint8_t* data, const size_t length) {
+    __m128i bits = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        bits = _mm_or_si128(bits, _mm_loadu_si128((const __m128i*)(data + i)));
+    }
+
+    return _mm_movemask_epi8(bits) == 0 && is_ascii_scalar(data + i, length - i);
+}
+
+__attribute__((target("sse2")))
+static size_t printable_run_sse2(const uint8_t* data, const size_t length) {
+    const __m128i low = _mm_set1_epi8(31);
+    const __m128i high = _mm_set1_epi8(127);
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        const __m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, low), _mm_cmpgt_epi8(high, v));
+        const uint32_t bad = ~(uint32_t)_mm_movemask_epi8(ok) & 0xFFFF;
+        if (bad != 0) { return i + (size_t)__builtin_ctz(bad); }
+    }
+
+    return i + printable_run_scalar(data + i, length - i);
+}
+
+__attribute__((target("sse2")))
+static void text_scan_sse2(const uint8_t* data, const size_t length, dicom_text_scan_result* result) {
+    const __m128i low = _mm_set1_epi8(31);
+    const __m128i high = _mm_set1_epi8(127);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        const __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, low), _mm_cmpgt_epi8(high, v));
+        const __m128i space = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\t')),
+                                           _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                                                        _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        const uint32_t text = (uint32_t)_mm_movemask_epi8(_mm_or_si128(printable, space));
+        const uint32_t upper = (uint32_t)_mm_movemask_epi8(v);
+        const uint32_t nul = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+
+        result->text_bytes += (size_t)__builtin_popcount(text);
+        result->high_bytes += (size_t)__builtin_popcount(upper);
+        if (nul != 0 && result->nul_offset == length) { result->nul_offset = i + (size_t)__builtin_ctz(nul); }
+    }
+
+    text_scan_tail(data, i, length, result);
+}
+
+__attribute__((target("avx2")))
+static void swap_avx2(const uint8_t* src, uint8_t* dst, const size_t count, const int width) {
+    __m256i mask;
+    if (width == 2) {
+        mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    }
+    else if (width == 4) {
+        mask = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    }
+    else {
+        mask = _mm256_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+                                7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    }
+
+    const size_t bytes = count * (size_t)width;
+    size_t i = 0;
+    for (; i + 64 <= bytes; i += 64) {
+        const __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i*)(src + i + 32));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(a, mask));
+        _mm256_storeu_si256((__m256i*)(dst + i + 32), _mm256_shuffle_epi8(b, mask));
+    }
+    for (; i + 32 <= bytes; i += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(a, mask));
+    }
+
+    swap_scalar(src + i, dst + i, (bytes - i) / (size_t)width, width);
+}
+
+__attribute__((target("ssse3")))
+static void swap_ssse3(const uint8_t* src, uint8_t* dst, const size_t count, const int width) {
+    __m128i mask;
+    if (width == 2) { mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14); }
+    else if (width == 4) { mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12); }
+    else { mask = _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8); }
+
+    const size_t bytes = count * (size_t)width;
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(a, mask));
+    }
+
+    swap_scalar(src + i, dst + i, (bytes - i) / (size_t)width, width);
+}
+#endif
+
+#ifdef DICOM_SIMD_NEON
+static void swap_neon(const uint8_t* src, uint8_t* dst, const size_t count, const int width) {
+    const size_t bytes = count * (size_t)width;
+    size_t i = 0;
+    for (; i + 16 <= bytes; i += 16) {
+        const uint8x16_t a = vld1q_u8(src + i);
+        if (width == 2) { vst1q_u8(dst + i, vrev16q_u8(a)); }
+        else if (width == 4) { vst1q_u8(dst + i, vrev32q_u8(a)); }
+        else { vst1q_u8(dst + i, vrev64q_u8(a)); }
+    }
+
+    swap_scalar(src + i, dst + i, (bytes - i) / (size_t)width, width);
+}
+
+static bool is_ascii_neon(const uint8_t* data, const size_t length) {
+    uint8x16_t bits = vdupq_n_u8(0);
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) { bits = vorrq_u8(bits, vld1q_u8(data + i)); }
+
+    return vmaxvq_u8(bits) < 0x80 && is_ascii_scalar(data + i, length - i);
+}
+
+static size_t find_header_candidate_neon(const uint8_t* data, const size_t length) {
+    const uint8x16_t a_char = vdupq_n_u8('A');
+    const uint8x16_t z_char = vdupq_n_u8('Z');
+    const uint8x16_t fe = vdupq_n_u8(0xFE);
+    const uint8x16_t ff = vdupq_n_u8(0xFF);
+
+    size_t i = 0;
+    for (; i + 17 <= length; i += 16) {
+        const uint8x16_t a = vld1q_u8(data + i);
+        const uint8x16_t b = vld1q_u8(data + i + 1);
+        const uint8x16_t letters = vandq_u8(vandq_u8(vcgeq_u8(a, a_char), vcleq_u8(a, z_char)),
+                                            vandq_u8(vcgeq_u8(b, a_char), vcleq_u8(b, z_char)));
+        const uint8x16_t item = vorrq_u8(vandq_u8(vceqq_u8(a, fe), vceqq_u8(b, ff)),
+                                         vandq_u8(vceqq_u8(a, ff), vceqq_u8(b, fe)));
+        if (vmaxvq_u8(vorrq_u8(letters, item)) != 0) { return header_candidate_tail(data, i, i + 17); }
+    }
+
+    return header_candidate_tail(data, i, length);
+}
+
+static size_t printable_run_neon(const uint8_t* data, const size_t length) {
+    const uint8x16_t low = vdupq_n_u8(31);
+    const uint8x16_t high = vdupq_n_u8(127);
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const uint8x16_t v = vld1q_u8(data + i);
+        const uint8x16_t ok = vandq_u8(vcgtq_u8(v, low), vcltq_u8(v, high));
+        if (vminvq_u8(ok) == 0) { return i + printable_run_scalar(data + i, 16); }
+    }
+
+    return i + printable_run_scalar(data + i, length - i);
+}
+
+static void text_scan_neon(const uint8_t* data, const size_t length, dicom_text_scan_result* result) {
+    const uint8x16_t low = vdupq_n_u8(31);
+    const uint8x16_t high = vdupq_n_u8(127);
+    const uint8x16_t one = vdupq_n_u8(1);
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        const uint8x16_t v = vld1q_u8(data + i);
+        const uint8x16_t printable = vandq_u8(vcgtq_u8(v, low), vcltq_u8(v, high));
+        const uint8x16_t space = vorrq_u8(vceqq_u8(v, vdupq_n_u8('\t')),
+                                          vorrq_u8(vceqq_u8(v, vdupq_n_u8('\n')), vceqq_u8(v, vdupq_n_u8('\r'))));
+
+        result->text_bytes += vaddvq_u8(vandq_u8(vorrq_u8(printable, space), one));
+        result->high_bytes += vaddvq_u8(vshrq_n_u8(v, 7));
+
+        if (result->nul_offset == length && vmaxvq_u8(vceqq_u8(v, vdupq_n_u8(0))) != 0) {
+            for (size_t k = i; k < i + 16; k++) {
+                if (data[k] == 0) {
+                    result->nul_offset = k;
+                    break;
+                }
+            }
+        }
+    }
+
+    text_scan_tail(data, i, length, result);
+}
+#endif
+
+typedef struct {
+    swap_kernel swap;
+    bool (*is_ascii)(const uint8_t* data, size_t length);
+    size_t (*printable_run)(const uint8_t* data, size_t length);
+    void (*text_scan)(const uint8_t* data, size_t length, dicom_text_scan_result* result);
+    size_t (*find_header_candidate)(const uint8_t* data, size_t length);
+    const char* isa;
+} kernel_table;
+
+static kernel_table resolved_kernels;
+static dicom_once kernels_once = DICOM_ONCE_INIT;
+
+// Batch, watch, serve and SCP workers get here concurrently; the once makes the table visible to all of them
+static void resolve_kernels(void) {
+    kernel_table table = {swap_scalar, is_ascii_scalar, printable_run_scalar, text_scan_scalar,
+                          find_header_candidate_scalar, "scalar"};
+#if defined(DICOM_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        table = (kernel_table){swap_avx2, is_ascii_avx2, printable_run_avx2, text_scan_avx2,
+                               find_header_candidate_avx2, "avx2"};
+    }
+    else if (__builtin_cpu_supports("ssse3")) {
+        table = (kernel_table){swap_ssse3, is_ascii_sse2, printable_run_sse2, text_scan_sse2,
+                               find_header_candidate_sse2, "ssse3"};
+    }
+    else if (__builtin_cpu_supports("sse2")) {
+        table = (kernel_table){swap_scalar, is_ascii_sse2, printable_run_sse2, text_scan_sse2,
+                               find_header_candidate_sse2, "sse2"};
+    }
+#elif defined(DICOM_SIMD_NEON)
+    table = (kernel_table){swap_neon, is_ascii_neon, printable_run_neon, text_scan_neon,
+                           find_header_candidate_neon, "neon"};
+#endif
+
+    resolved_kernels = table;
+}
+
+static const kernel_table* get_kernels(void) {
+    dicom_once_run(&kernels_once, resolve_kernels);
+    return &resolved_kernels;
+}
+
+static void decode(const uint8_t* src, const size_t count, const bool little_endian, uint8_t* dst, const int width) {
+    if (count == 0) { return; }
+    if (little_endian == host_is_little_endian()) {
+        memcpy(dst, src, count * (size_t)width);
+        return;
+    }
+    get_kernels()->swap(src, dst, count, width);
+}
+
+void dicom_decode_16(const uint8_t* src, const size_t count, const bool little_endian, uint16_t* dst) {
+    decode(src, count, little_endian, (uint8_t*)dst, 2);
+}
+
+void dicom_decode_32(const uint8_t* src, const size_t count, const bool little_endian, uint32_t* dst) {
+    decode(src, count, little_endian, (uint8_t*)dst, 4);
+}
+
+void dicom_decode_64(const uint8_t* src, const size_t count, const bool little_endian, uint64_t* dst) {
+    decode(src, count, little_endian, (uint8_t*)dst, 8);
+}
+
+bool dicom_is_ascii(const uint8_t* data, const size_t length) { return get_kernels()->is_ascii(data, length); }
+
+size_t dicom_printable_run(const uint8_t* data, const size_t length) {
+    return get_kernels()->printable_run(data, length);
+}
+
+void dicom_text_scan(const uint8_t* data, const size_t length, dicom_text_scan_result* result) {
+    result->nul_offset = length;
+    result->text_bytes = 0;
+    result->high_bytes = 0;
+    get_kernels()->text_scan(data, length, result);
+}
+
+size_t dicom_find_header_candidate(const uint8_t* data, const size_t length) {
+    return get_kernels()->find_header_candidate(data, length);
+}
+
+const char* dicom_simd_isa(void) { return get_kernels()->isa; }
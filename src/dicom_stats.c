@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+#include "dicom_stats.h"
+
+DICOM_THREAD_LOCAL dicom_stats* dicom_stats_current = NULL;
+
+double dicom_stats_now(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+void dicom_stats_begin(dicom_stats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->files = 1;
+    stats->phase = DICOM_PHASE_OPEN;
+    stats->phase_start = dicom_stats_now();
+    dicom_stats_current = stats;
+}
+
+void dicom_stats_end(void) {
+    dicom_stats* stats = dicom_stats_current;
+    if (stats == NULL) { return; }
+
+    stats->phase_seconds[stats->phase] += dicom_stats_now() - stats->phase_start;
+    dicom_stats_current = NULL;
+}
+
+dicom_phase dicom_stats_phase(const dicom_phase phase) {
+    dicom_stats* stats = dicom_stats_current;
+    if (stats == NULL) { return phase; }
+
+    const dicom_phase previous = stats->phase;
+    if (previous == phase) { return previous; }
+
+    const double now = dicom_stats_now();
+    stats->phase_seconds[previous] += now - stats->phase_start;
+    stats->phase = phase;
+    stats->phase_start = now;
+    return previous;
+}
+
+void dicom_stats_add(dicom_stats* total, const dicom_stats* stats) {
+    total->bytes_read += stats->bytes_read;
+    total->read_calls += stats->read_calls;
+    total->seek_calls += stats->seek_calls;
+    total->dict_lookups += stats->dict_lookups;
+    total->dict_misses += stats->dict_misses;
+    total->elements += stats->elements;
+    total->cache_hits += stats->cache_hits;
+    total->files += stats->files;
+    for (int i = 0; i < DICOM_PHASE_COUNT; i++) { total->phase_seconds[i] += stats->phase_seconds[i]; }
+}
+
+// One key=value line, easy to grep and to load into a spreadsheet
+void dicom_stats_print(FILE* out, const char* label, const dicom_stats* stats) {
+    double total_seconds = 0.0;
+    for (int i = 0; i < DICOM_PHASE_COUNT; i++) { total_seconds += stats->phase_seconds[i]; }
+
+    fprintf(out, "[stats] %s files=%llu bytes_read=%llu read_calls=%llu seek_calls=%llu dict_lookups=%llu "
+            "dict_misses=%llu elements=%llu cache_hits=%llu open_ms=%.3f meta_ms=%.3f dataset_ms=%.3f render_ms=%.3f total_ms=%.3f\n",
+            label,
+            (unsigned long long)stats->files,
+            (unsigned long long)stats->bytes_read,
+            (unsigned long long)stats->read_calls,
+            (unsigned long long)stats->seek_calls,
+            (unsigned long long)stats->dict_lookups,
+            (unsigned long long)stats->dict_misses,
+            (unsigned long long)stats->elements,
+            (unsigned long long)stats->cache_hits,
+            stats->phase_seconds[DICOM_PHASE_OPEN] * 1e3,
+            stats->phase_seconds[DICOM_PHASE_META] * 1e3,
+            stats->phase_seconds[DICOM_PHASE_DATASET] * 1e3,
+            stats->phase_seconds[DICOM_PHASE_RENDER] * 1e3,
+            total_seconds * 1e3);
+}
@@ -0,0 +1,109 @@
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifndef _WIN32
+    #include <unistd.h>
+#endif
+
+#include "dicom_thread.h"
+
+typedef struct {
+    dicom_thread_fn fn;
+    void* arg;
+} thread_start;
+
+#ifdef _WIN32
+static DWORD WINAPI thread_main(LPVOID param) {
+    thread_start start = *(thread_start*)param;
+    free(param);
+    start.fn(start.arg);
+    return 0;
+}
+#else
+static void* thread_main(void* param) {
+    thread_start start = *(thread_start*)param;
+    free(param);
+    start.fn(start.arg);
+    return NULL;
+}
+#endif
+
+int dicom_thread_start(dicom_thread* thread, const dicom_thread_fn fn, void* arg) {
+    // Owned by the new thread once it runs
+    thread_start* start = (thread_start*)malloc(sizeof(thread_start));
+    if (start == NULL) { return -1; }
+    start->fn = fn;
+    start->arg = arg;
+
+#ifdef _WIN32
+    *thread = CreateThread(NULL, 0, thread_main, start, 0, NULL);
+    const bool started = *thread != NULL;
+#else
+    const bool started = pthread_create(thread, NULL, thread_main, start) == 0;
+#endif
+    if (!started) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+#ifdef _WIN32
+void dicom_thread_join(const dicom_thread thread) {
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+
+void dicom_mutex_init(dicom_mutex* mutex) { InitializeSRWLock(mutex); }
+void dicom_mutex_lock(dicom_mutex* mutex) { AcquireSRWLockExclusive(mutex); }
+void dicom_mutex_unlock(dicom_mutex* mutex) { ReleaseSRWLockExclusive(mutex); }
+void dicom_mutex_destroy(dicom_mutex* mutex) { (void)mutex; }
+
+void dicom_cond_init(dicom_cond* cond) { InitializeConditionVariable(cond); }
+void dicom_cond_wait(dicom_cond* cond, dicom_mutex* mutex) { SleepConditionVariableSRW(cond, mutex, INFINITE, 0); }
+void dicom_cond_signal(dicom_cond* cond) { WakeConditionVariable(cond); }
+void dicom_cond_broadcast(dicom_cond* cond) { WakeAllConditionVariable(cond); }
+void dicom_cond_destroy(dicom_cond* cond) { (void)cond; }
+
+typedef struct {
+    void (*fn)(void);
+} once_call;
+
+static BOOL CALLBACK once_main(PINIT_ONCE once, PVOID param, PVOID* context) {
+    (void)once;
+    (void)context;
+    ((once_call*)param)->fn();
+    return TRUE;
+}
+
+void dicom_once_run(dicom_once* once, void (*fn)(void)) {
+    once_call call = {fn};
+    InitOnceExecuteOnce(once, once_main, &call, NULL);
+}
+
+int dicom_cpu_count(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+#else
+void dicom_thread_join(const dicom_thread thread) { pthread_join(thread, NULL); }
+
+void dicom_mutex_init(dicom_mutex* mutex) { pthread_mutex_init(mutex, NULL); }
+void dicom_mutex_lock(dicom_mutex* mutex) { pthread_mutex_lock(mutex); }
+void dicom_mutex_unlock(dicom_mutex* mutex) { pthread_mutex_unlock(mutex); }
+void dicom_mutex_destroy(dicom_mutex* mutex) { pthread_mutex_destroy(mutex); }
+
+void dicom_cond_init(dicom_cond* cond) { pthread_cond_init(cond, NULL); }
+void dicom_cond_wait(dicom_cond* cond, dicom_mutex* mutex) { pthread_cond_wait(cond, mutex); }
+void dicom_cond_signal(dicom_cond* cond) { pthread_cond_signal(cond); }
+void dicom_cond_broadcast(dicom_cond* cond) { pthread_cond_broadcast(cond); }
+void dicom_cond_destroy(dicom_cond* cond) { pthread_cond_destroy(cond); }
+
+void dicom_once_run(dicom_once* once, void (*fn)(void)) { pthread_once(once, fn); }
+
+int dicom_cpu_count(void) {
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+#endif
@@ -0,0 +1,269 @@
+#ifdef __linux__
+    #define _GNU_SOURCE  // open_memstream
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __linux__
+    #include <errno.h>
+    #include <poll.h>
+    #include <signal.h>
+    #include <unistd.h>
+    #include <sys/inotify.h>
+#endif
+
+#include "dicom_watch.h"
+#include "dicom_arena.h"
+#include "dicom_dataset.h"
+#include "dicom_json.h"
+#include "dicom_stats.h"
+#include "dicom_thread.h"
+
+#ifdef __linux__
+
+#define WATCH_POLL_MS 250
+#define WATCH_EVENT_BUFFER 65536
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(const int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+/*
+ * Paths waiting for a worker, in arrival order. The spool can burst far faster than files are
+ * parsed, so the ring grows instead of blocking the inotify reader (which would overflow the
+ * kernel queue and lose events).
+ */
+typedef struct {
+    const watch_options* options;
+    dicom_mutex mutex;
+    dicom_cond ready;
+    char** paths;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    bool closing;
+
+    dicom_mutex output;
+    size_t parsed;
+    size_t failed;
+} watch_job;
+
+static int queue_push(watch_job* job, char* path) {
+    dicom_mutex_lock(&job->mutex);
+    if (job->count == job->capacity) {
+        const size_t capacity = job->capacity > 0 ? job->capacity * 2 : 256;
+        char** paths = (char**)malloc(capacity * sizeof(char*));
+        if (paths == NULL) {
+            dicom_mutex_unlock(&job->mutex);
+            return -1;
+        }
+        for (size_t i = 0; i < job->count; i++) { paths[i] = job->paths[(job->head + i) % job->capacity]; }
+        free(job->paths);
+        job->paths = paths;
+        job->capacity = capacity;
+        job->head = 0;
+    }
+    job->paths[(job->head + job->count) % job->capacity] = path;
+    job->count++;
+    dicom_cond_signal(&job->ready);
+    dicom_mutex_unlock(&job->mutex);
+    return 0;
+}
+
+// NULL once the queue is closed and drained
+static char* queue_pop(watch_job* job) {
+    dicom_mutex_lock(&job->mutex);
+    while (job->count == 0 && !job->closing) { dicom_cond_wait(&job->ready, &job->mutex); }
+
+    char* path = NULL;
+    if (job->count > 0) {
+        path = job->paths[job->head];
+        job->head = (job->head + 1) % job->capacity;
+        job->count--;
+    }
+    dicom_mutex_unlock(&job->mutex);
+    return path;
+}
+
+// The line is built in memory first so that lines of concurrent workers never interleave
+static bool process_file(watch_job* job, const char* path, dicom_arena* arena) {
+    char* line = NULL;
+    size_t line_length = 0;
+    FILE* out = open_memstream(&line, &line_length);
+    if (out == NULL) { return false; }
+
+    const double start = dicom_stats_now();
+    dicom_arena_reset(arena);
+    dicom_dataset ds;
+    const bool parsed = dicom_dataset_load(path, arena, &ds) == 0;
+
+    fputs("{\"path\":", out);
+    dicom_json_write_string(out, path);
+    if (parsed) {
+        fprintf(out, ",\"ms\":%.3f", (dicom_stats_now() - start) * 1e3);
+        if (ds.is_truncated) { fputs(",\"truncated\":true", out); }
+        fputs(",\"dataset\":", out);
+        dicom_json_write(out, &ds, job->options->tags, job->options->tag_count, arena);
+        dicom_dataset_close(&ds);
+    }
+    else { fputs(",\"error\":\"not a DICOM file\"", out); }
+    fputs("}\n", out);
+    fclose(out);
+
+    dicom_mutex_lock(&job->output);
+    fwrite(line, 1, line_length, stdout);
+    fflush(stdout);
+    dicom_mutex_unlock(&job->output);
+    free(line);
+    return parsed;
+}
+
+static void watch_worker(void* arg) {
+    watch_job* job = (watch_job*)arg;
+    dicom_arena arena;
+    dicom_arena_init(&arena);
+    size_t parsed = 0;
+    size_t failed = 0;
+
+    char* path;
+    while ((path = queue_pop(job)) != NULL) {
+        if (process_file(job, path, &arena)) { parsed++; }
+        else { failed++; }
+        free(path);
+    }
+
+    dicom_mutex_lock(&job->mutex);
+    job->parsed += parsed;
+    job->failed += failed;
+    dicom_mutex_unlock(&job->mutex);
+    dicom_arena_free(&arena);
+}
+
+// Returns -1 only on fatal errors; a failed read after a stop request just ends the loop
+static int read_events(const int fd, const char* dir, watch_job* job, size_t* queued) {
+    _Alignas(struct inotify_event) char buffer[WATCH_EVENT_BUFFER];
+
+    while (!stop_requested) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        const int ready = poll(&pfd, 1, WATCH_POLL_MS);
+        if (ready < 0 && errno != EINTR) {
+            perror("Error: poll");
+            return -1;
+        }
+        if (ready <= 0) { continue; }
+
+        const ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EINTR || errno == EAGAIN) { continue; }
+            perror("Error: read");
+            return -1;
+        }
+
+        for (ssize_t pos = 0; pos < length;) {
+            const struct inotify_event* event = (const struct inotify_event*)(buffer + pos);
+            pos += (ssize_t)(sizeof(struct inotify_event) + event->len);
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                fprintf(stderr, "Warning: inotify queue overflowed, some files in '%s' were not seen\n", dir);
+            }
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                fprintf(stderr, "Error: '%s' was removed or moved, stopping\n", dir);
+                return -1;
+            }
+            // Dot files are in-progress transfers (rsync, storescp) that are renamed once complete
+            if (event->len == 0 || event->name[0] == '.' || (event->mask & IN_ISDIR)) { continue; }
+
+            const size_t size = strlen(dir) + strlen(event->name) + 2;
+            char* path = (char*)malloc(size);
+            if (path == NULL || (snprintf(path, size, "%s/%s", dir, event->name), queue_push(job, path) != 0)) {
+                fprintf(stderr, "Error: Out of memory, dropping '%s'\n", event->name);
+                free(path);
+                continue;
+            }
+            (*queued)++;
+        }
+    }
+    return 0;
+}
+
+int run_watch(const char* dir, const watch_options* options) {
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        perror("Error: inotify_init1");
+        return -1;
+    }
+    if (inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR) < 0) {
+        fprintf(stderr, "Error: Cannot watch '%s': %s\n", dir, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    // No SA_RESTART: a signal has to interrupt poll() so the loop sees the stop request
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    watch_job job;
+    memset(&job, 0, sizeof(job));
+    job.options = options;
+    dicom_mutex_init(&job.mutex);
+    dicom_mutex_init(&job.output);
+    dicom_cond_init(&job.ready);
+
+    const int thread_count = options->threads > 0 ? options->threads : dicom_cpu_count();
+    dicom_thread* threads = (dicom_thread*)malloc((size_t)thread_count * sizeof(dicom_thread));
+    int started = 0;
+    while (threads != NULL && started < thread_count && dicom_thread_start(&threads[started], watch_worker, &job) == 0) {
+        started++;
+    }
+
+    int result = 0;
+    size_t queued = 0;
+    const double start = dicom_stats_now();
+    if (started == 0) {
+        fprintf(stderr, "Error: Cannot start worker threads\n");
+        result = -1;
+    }
+    else {
+        fprintf(stderr, "Watching '%s' with %d worker%s, stop with Ctrl+C\n", dir, started, started == 1 ? "" : "s");
+        result = read_events(fd, dir, &job, &queued);
+    }
+
+    // Files already queued are still parsed before exiting
+    dicom_mutex_lock(&job.mutex);
+    job.closing = true;
+    dicom_cond_broadcast(&job.ready);
+    dicom_mutex_unlock(&job.mutex);
+    for (int i = 0; i < started; i++) { dicom_thread_join(threads[i]); }
+    free(threads);
+
+    fprintf(stderr, "[watch] files=%zu parsed=%zu failed=%zu threads=%d seconds=%.3f\n", queued, job.parsed, job.failed,
+            started, dicom_stats_now() - start);
+
+    close(fd);
+    free(job.paths);
+    dicom_cond_destroy(&job.ready);
+    dicom_mutex_destroy(&job.output);
+    dicom_mutex_destroy(&job.mutex);
+    return result;
+}
+
+#else
+
+int run_watch(const char* dir, const watch_options* options) {
+    (void)options;
+    fprintf(stderr, "Error: Cannot watch '%s': --watch needs inotify and is only available on Linux\n", dir);
+    return -1;
+}
+
+#endif
@@ -6,44 +6,322 @@
 #include <stdbool.h>
 #include <sys/types.h>
 
+#include "dicom_archive.h"
+#include "dicom_batch.h"
+#include "dicom_cache.h"
+#include "dicom_dir.h"
 #include "dicom_header_parser.h"
+#include "dicom_rewrite.h"
+#include "dicom_scp.h"
+#include "dicom_server.h"
+#include "dicom_stats.h"
+#include "dicom_thread.h"
+#include "dicom_watch.h"
+
+/*
+ * -f entries are separated by ';'. Each is a tag path (see dicom_path.h), a single tag being the
+ * shortest one, or a comma-separated list of hex tags as older scripts pass them.
+ */
+static int add_filter_entries(char* input, dicom_tag_path* paths, int* count) {
+    for (char* entry = strtok(input, ";"); entry != NULL; entry = strtok(NULL, ";")) {
+        while (*entry == ' ' || *entry == '\t') { entry++; }
+        size_t length = strlen(entry);
+        while (length > 0 && (entry[length - 1] == ' ' || entry[length - 1] == '\t')) { entry[--length] = '\0'; }
+        if (length == 0) { continue; }
+
+        if (*count < MAX_FILTER_TAGS && dicom_tag_path_parse(entry, &paths[*count]) == 0) {
+            (*count)++;
+            continue;
+        }
+
+        for (char* token = entry; token != NULL && *token != '\0';) {
+            char* next = strchr(token, ',');
+            if (next != NULL) { *next++ = '\0'; }
+
+            if (*count == MAX_FILTER_TAGS) {
+                fprintf(stderr, "Error: Too many filter entries (at most %d)\n", MAX_FILTER_TAGS);
+                return -1;
+            }
+
+            char* endptr;
+            const unsigned long tag_val = strtoul(token, &endptr, 16);
+            if (token == endptr || *endptr != '\0' || tag_val > 0xFFFFFFFF) {
+                fprintf(stderr, "Error: Invalid tag '%s'. Use format: 00100030, 0x00100030 or a tag path\n", token);
+                return -1;
+            }
+            paths[*count].steps[0].tag = (uint32_t)tag_val;
+            paths[*count].steps[0].item = 0;
+            paths[(*count)++].count = 1;
+            token = next;
+        }
+    }
+    return 0;
+}
 
 int main(const int argc, char* argv[]) {
     if (argc < 2) {
-        fprintf(stderr, "Usage: %s <dicom_file> [options]\n", argv[0]);
-        fprintf(stderr, "  <dicom_file>  Path to DICOM file\n");
+        fprintf(stderr, "Usage: %s <dicom_file>... [options]\n", argv[0]);
+        fprintf(stderr, "  <dicom_file>  Path to DICOM file, several may be given\n");
+        fprintf(stderr, "                .zip, .tar and .tar.gz bundles are read member by member without extracting\n");
         fprintf(stderr, "  Options:\n");
         fprintf(stderr, "\t-n <num>     Maximum number of elements to parse (default: 250)\n");
         fprintf(stderr, "\t--all        Parse all elements until start of pixel data\n");
         fprintf(stderr, "\t-d <depth>   Maximum sequence depth (default: 5)\n");
         fprintf(stderr, "\t-c           Collapse sequences\n");
         fprintf(stderr, "\t-v           Show full values (disable truncation)\n");
+        fprintf(stderr, "\t-m           Decode all values of multi-valued numeric elements\n");
+        fprintf(stderr, "\t--recover    Resume after a corrupt element at the next plausible one, report the gaps\n");
+        fprintf(stderr, "\t             and exit with status 2 (plain dump only)\n");
         fprintf(stderr, "\t-f <tags>    Filter: show only specific tags (format: 0x00100010;0x00080020)\n");
+        fprintf(stderr, "\t             or elements inside sequences: (0040,0275)[*].(0040,0009);PatientName\n");
+        fprintf(stderr, "\t--dom        Build an in-memory dataset tree and answer lookups from it\n");
+        fprintf(stderr, "\t--cache      Render as --dom, from a record cache when the file is unchanged\n");
+        fprintf(stderr, "\t--cache-dir <dir>  Cache location (default: $DCMLOUPE_CACHE_DIR or the user cache directory)\n");
+        fprintf(stderr, "\t--path <path>  Print one element, e.g. 5200,9230[12].0028,9110.0028,0030, reading only\n");
+        fprintf(stderr, "\t               the headers on the way (exit status 3 when it is not there)\n");
+        fprintf(stderr, "\t--json       Print the dataset as DICOM JSON, numeric strings as numbers\n");
+        fprintf(stderr, "\t--hash-pixels  Follow the header with an XXH64 digest of the pixel data\n");
+        fprintf(stderr, "\t--dicomdir   Print the patient/study/series/image records of a DICOMDIR\n");
+        fprintf(stderr, "\t--stats      Report I/O, dictionary and per-phase timing counters on stderr\n");
+        fprintf(stderr, "\t--dedup      Batch: scan files and directories, report duplicate SOP Instance UIDs\n");
+        fprintf(stderr, "\t--dedup-pixels  Batch: also report files with identical pixel data\n");
+        fprintf(stderr, "\t--hierarchy  Batch: study/series report with counts, bytes and Instance Number gaps\n");
+        fprintf(stderr, "\t--threads <n>  Batch, watch, serve and SCP workers; --dom, --json and --cache also\n");
+        fprintf(stderr, "\t               build large multi-frame headers on them (default: one per CPU)\n");
+        fprintf(stderr, "\t--watch <dir>  Parse files as they land in <dir>, one JSON object per line (Linux)\n");
+        fprintf(stderr, "\t--serve <socket>  Answer length-prefixed path queries with DICOM JSON on a Unix socket\n");
+        fprintf(stderr, "\t--scp <port>   Storage SCP: accept C-ECHO and C-STORE, log each received header as JSON\n");
+        fprintf(stderr, "\t--scp-bind <addr>  SCP listen address (default: 127.0.0.1, the log holds patient data)\n");
+        fprintf(stderr, "\t--scp-ae <title>   Only accept associations called with this AE title\n");
+        fprintf(stderr, "\t--strip-pixels -o <file>  Write a copy without pixel data (metadata only)\n");
+        fprintf(stderr, "\t--deid -o <file>          Write a de-identified copy (PS3.15 basic profile)\n");
+        fprintf(stderr, "\t--deid-profile <file>     Rules, salt and private tag handling for --deid\n");
+        fprintf(stderr, "\t                          (without a salt, UIDs get a random one per run)\n");
+        fprintf(stderr, "\t--set <tag>=<value> --in-place  Overwrite a text value in the file itself (repeatable,\n");
+        fprintf(stderr, "\t                                tag or keyword, the value must fit the existing length)\n");
 
         return 1;
     }
 
-    const char* filename = NULL;
+    const char** filenames = (const char**)malloc((size_t)argc * sizeof(const char*));
+    int file_count = 0;
     int max_elements = DEFAULT_MAX_ELEMENTS;
     int max_sq_depth = DEFAULT_MAX_SQ_DEPTH;
     bool collapse_sequences = false;
     bool show_full_values = false;
-    tag_filter filter = {.tags = NULL, .count = 0};
+    bool show_all_values = false;
+    bool recover = false;
+    bool use_dom = false;
+    bool use_json = false;
+    bool use_dicomdir = false;
+    bool show_stats = false;
+    bool hash_pixels = false;
+    batch_options batch = {
+        .threads = 0, .find_duplicates = false, .hash_pixels = false, .build_hierarchy = false, .collect_stats = false,
+    };
+    bool strip_pixels = false;
+    bool deidentify = false;
+    const char* deid_profile = NULL;
+    bool in_place = false;
+    dicom_value_edit* edits = (dicom_value_edit*)malloc((size_t)argc * sizeof(dicom_value_edit));
+    int edit_count = 0;
+    const char* output = NULL;
+    const char* watch_dir = NULL;
+    bool use_cache = false;
+    const char* cache_dir = NULL;
+    char default_cache_dir[4096];
+    const char* serve_socket = NULL;
+    int scp_port = 0;
+    const char* scp_bind = NULL;
+    const char* scp_ae = NULL;
+    const char* path_text = NULL;
+    dicom_tag_path path;
+    tag_filter filter = {.tags = NULL, .count = 0, .paths = NULL};
     uint32_t tag_array[MAX_FILTER_TAGS];
+    dicom_tag_path filter_paths[MAX_FILTER_TAGS];
+    int filter_path_count = 0;
+    dicom_filter compiled_filter;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-c") == 0) { collapse_sequences = true; }
         else if (strcmp(argv[i], "-v") == 0) { show_full_values = true; }
+        else if (strcmp(argv[i], "-m") == 0) { show_all_values = true; }
         else if (strcmp(argv[i], "--all") == 0) { max_elements = INT_MAX; }
+        else if (strcmp(argv[i], "--recover") == 0) { recover = true; }
+        else if (strcmp(argv[i], "--dom") == 0) { use_dom = true; }
+        else if (strcmp(argv[i], "--json") == 0) { use_json = true; }
+        else if (strcmp(argv[i], "--cache") == 0) { use_cache = true; }
+        else if (strcmp(argv[i], "--cache-dir") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --cache-dir requires a directory\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            cache_dir = argv[++i];
+            use_cache = true;
+        }
+        else if (strcmp(argv[i], "--path") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --path requires a tag path\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            path_text = argv[++i];
+            if (dicom_tag_path_parse(path_text, &path) != 0) {
+                fprintf(stderr, "Error: Invalid tag path '%s'. Use format: 5200,9230[0].0028,9110.0028,0030\n",
+                        path_text);
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            if (dicom_tag_path_has_wildcard(&path)) {
+                fprintf(stderr, "Error: --path picks one element, use [n] instead of [*] (or -f for all)\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--dicomdir") == 0) { use_dicomdir = true; }
+        else if (strcmp(argv[i], "--stats") == 0) { show_stats = true; }
+        else if (strcmp(argv[i], "--hash-pixels") == 0) { hash_pixels = true; }
+        else if (strcmp(argv[i], "--dedup") == 0) { batch.find_duplicates = true; }
+        else if (strcmp(argv[i], "--dedup-pixels") == 0) { batch.find_duplicates = batch.hash_pixels = true; }
+        else if (strcmp(argv[i], "--hierarchy") == 0) { batch.build_hierarchy = true; }
+        else if (strcmp(argv[i], "--threads") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --threads requires a number\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            char* endptr;
+            const long val = strtol(argv[++i], &endptr, 10);
+            if (endptr == argv[i] || *endptr != '\0' || val <= 0 || val > 1024) {
+                fprintf(stderr, "Error: threads must be between 1 and 1024\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            batch.threads = (int)val;
+        }
+        else if (strcmp(argv[i], "--watch") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --watch requires a directory\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            watch_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--serve") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --serve requires a socket path\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            serve_socket = argv[++i];
+        }
+        else if (strcmp(argv[i], "--scp") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --scp requires a port\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            char* endptr;
+            const long val = strtol(argv[++i], &endptr, 10);
+            if (endptr == argv[i] || *endptr != '\0' || val <= 0 || val > 65535) {
+                fprintf(stderr, "Error: port must be between 1 and 65535\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            scp_port = (int)val;
+        }
+        else if (strcmp(argv[i], "--scp-bind") == 0 || strcmp(argv[i], "--scp-ae") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: %s requires a value\n", argv[i]);
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            if (strcmp(argv[i], "--scp-bind") == 0) { scp_bind = argv[++i]; }
+            else if (strlen(argv[i + 1]) == 0 || strlen(argv[i + 1]) > 16) {
+                fprintf(stderr, "Error: An AE title has 1 to 16 characters\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            else { scp_ae = argv[++i]; }
+        }
+        else if (strcmp(argv[i], "--strip-pixels") == 0) { strip_pixels = true; }
+        else if (strcmp(argv[i], "--deid") == 0) { deidentify = true; }
+        else if (strcmp(argv[i], "--deid-profile") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --deid-profile requires a profile file\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            deid_profile = argv[++i];
+            deidentify = true;
+        }
+        else if (strcmp(argv[i], "--in-place") == 0) { in_place = true; }
+        else if (strcmp(argv[i], "--set") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --set requires <tag>=<value>\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            // The tag is written as for -f and --path: GGGGEEEE, GGGG,EEEE, (GGGG,EEEE) or a keyword
+            const char* assignment = argv[++i];
+            const char* equals = strchr(assignment, '=');
+            char tag_text[128];
+            dicom_tag_path tag_path;
+            const size_t tag_length = equals != NULL ? (size_t)(equals - assignment) : 0;
+            if (tag_length > 0 && tag_length < sizeof(tag_text)) {
+                memcpy(tag_text, assignment, tag_length);
+                tag_text[tag_length] = '\0';
+            }
+            if (tag_length == 0 || tag_length >= sizeof(tag_text) || dicom_tag_path_parse(tag_text, &tag_path) != 0 ||
+                tag_path.count != 1) {
+                fprintf(stderr, "Error: Invalid assignment '%s'. Use format: 00080050=ACC123 or "
+                        "AccessionNumber=ACC123\n", assignment);
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            if (edits != NULL) {
+                edits[edit_count].tag = tag_path.steps[0].tag;
+                edits[edit_count++].value = equals + 1;
+            }
+        }
+        else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: -o requires an output file\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            output = argv[++i];
+        }
         else if (strcmp(argv[i], "-n") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Error: -n requires a number\n");
+                free(filenames);
+                free(edits);
                 return 1;
             }
             char* endptr;
             const long val = strtol(argv[++i], &endptr, 10);
             if (endptr == argv[i] || *endptr != '\0' || val <= 0 || val > INT_MAX) {
                 fprintf(stderr, "Error: max_elements must be a positive integer\n");
+                free(filenames);
+                free(edits);
                 return 1;
             }
             max_elements = (int)val;
@@ -51,12 +329,16 @@ int main(const int argc, char* argv[]) {
         else if (strcmp(argv[i], "-d") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Error: -d requires a number\n");
+                free(filenames);
+                free(edits);
                 return 1;
             }
             char* endptr;
             const long val = strtol(argv[++i], &endptr, 10);
             if (endptr == argv[i] || *endptr != '\0' || val <= 0 || val > 100) {
                 fprintf(stderr, "Error: max_sequence_depth must be between 1 and 100\n");
+                free(filenames);
+                free(edits);
                 return 1;
             }
             max_sq_depth = (int)val;
@@ -64,46 +346,218 @@ int main(const int argc, char* argv[]) {
         else if (strcmp(argv[i], "-f") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Error: -f requires tag(s) in format GGGGEEEE or 0xGGGGEEEE\n");
+                free(filenames);
+                free(edits);
+                return 1;
+            }
+            if (add_filter_entries(argv[++i], filter_paths, &filter_path_count) != 0) {
+                free(filenames);
+                free(edits);
                 return 1;
             }
-            i++;
-            char* input = argv[i];
-            char* token = strtok(input, ",");
+        }
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            free(filenames);
+            free(edits);
+            return 1;
+        }
+        else if (filenames != NULL) { filenames[file_count++] = argv[i]; }
+    }
+
+    // Top-level tags for flat lookups and JSON; a path brings in the whole sequence it starts from
+    for (int i = 0; i < filter_path_count; i++) {
+        const uint32_t tag = filter_paths[i].steps[0].tag;
+        bool seen = false;
+        for (int k = 0; k < filter.count; k++) { seen = seen || tag_array[k] == tag; }
+        if (!seen) { tag_array[filter.count++] = tag; }
+    }
+    if (filter.count > 0) { filter.tags = tag_array; }
 
-            while (token != NULL && filter.count < MAX_FILTER_TAGS) {
-                while (*token == ' ' || *token == '\t') token++;
+    if ((watch_dir != NULL || serve_socket != NULL || scp_port != 0) && file_count > 0) {
+        fprintf(stderr, "Error: --watch, --serve and --scp take no input files\n");
+        free(filenames);
+        free(edits);
+        return 1;
+    }
 
-                char* endptr;
-                const unsigned long tag_val = strtoul(token, &endptr, 16);
+    if ((watch_dir != NULL || serve_socket != NULL || scp_port != 0) && recover) {
+        fprintf(stderr, "Error: --recover cannot be combined with --watch, --serve or --scp\n");
+        free(filenames);
+        free(edits);
+        return 1;
+    }
 
-                while (*endptr == ' ' || *endptr == '\t') endptr++;
+    if (scp_port != 0) {
+        const scp_options scp = {
+            .port = scp_port, .bind_address = scp_bind, .ae_title = scp_ae, .threads = batch.threads,
+            .tags = filter.count > 0 ? filter.tags : NULL,
+            .tag_count = filter.count,
+        };
+        const int scp_result = run_scp(&scp);
+        free(filenames);
+        free(edits);
+        return scp_result;
+    }
 
-                if (token == endptr || *endptr != '\0' || tag_val > 0xFFFFFFFF) {
-                    fprintf(stderr, "Error: Invalid tag '%s'. Use format: 00100030 or 0x00100030\n", token);
-                    return 1;
-                }
+    if (serve_socket != NULL) {
+        const server_options server = {.threads = batch.threads};
+        const int server_result = run_server(serve_socket, &server);
+        free(filenames);
+        free(edits);
+        return server_result;
+    }
 
-                tag_array[filter.count++] = (uint32_t)tag_val;
-                token = strtok(NULL, ";");
-            }
+    if (watch_dir != NULL) {
+        const watch_options watch = {
+            .threads = batch.threads, .tags = filter.count > 0 ? filter.tags : NULL, .tag_count = filter.count,
+        };
+        const int watch_result = run_watch(watch_dir, &watch);
+        free(filenames);
+        free(edits);
+        return watch_result;
+    }
 
-            filter.tags = tag_array;
-        }
-        else if (argv[i][0] == '-') {
-            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+    if (file_count == 0) {
+        fprintf(stderr, "Error: No DICOM file specified\n");
+        free(filenames);
+        free(edits);
+        return 1;
+    }
+
+    if (strip_pixels && (output == NULL || file_count != 1)) {
+        fprintf(stderr, "Error: --strip-pixels needs exactly one input file and -o <file>\n");
+        free(filenames);
+        free(edits);
+        return 1;
+    }
+
+    if (hash_pixels && use_json) {
+        fprintf(stderr, "Error: --hash-pixels cannot be combined with --json\n");
+        free(filenames);
+        free(edits);
+        return 1;
+    }
+
+    if ((edit_count > 0) != in_place) {
+        fprintf(stderr, "Error: --set and --in-place go together\n");
+        free(filenames);
+        free(edits);
+        return 1;
+    }
+
+    // --in-place only rewrites values; any other mode alongside it would be silently ignored
+    if (in_place && (use_json || deidentify || strip_pixels || output != NULL || path_text != NULL || use_dicomdir ||
+                     use_dom || use_cache || batch.find_duplicates || batch.build_hierarchy)) {
+        fprintf(stderr, "Error: --in-place cannot be combined with --json, --deid, --strip-pixels, -o, --path, "
+                        "--dicomdir, --dom, --cache, --dedup or --hierarchy\n");
+        free(filenames);
+        free(edits);
+        return 1;
+    }
+
+    // Only the streaming dump can resynchronize; the tree builders and writers stop at the first bad element
+    if (recover && (use_json || use_dom || use_cache || path_text != NULL || use_dicomdir || deidentify ||
+                    strip_pixels || in_place || batch.find_duplicates || batch.build_hierarchy)) {
+        fprintf(stderr, "Error: --recover only works with the plain dump, not with --json, --dom, --cache, --path, "
+                        "--dicomdir, --deid, --strip-pixels, --in-place, --dedup or --hierarchy\n");
+        free(filenames);
+        free(edits);
+        return 1;
+    }
+
+    if (deidentify && (output == NULL || file_count != 1 || strip_pixels)) {
+        fprintf(stderr, "Error: --deid needs exactly one input file and -o <file>\n");
+        free(filenames);
+        free(edits);
+        return 1;
+    }
+
+    if (batch.find_duplicates || batch.build_hierarchy) {
+        batch.collect_stats = show_stats;
+        dicom_stats total = {0};
+        const int batch_result = run_batch(filenames, file_count, &batch, &total);
+        if (show_stats) { dicom_stats_print(stderr, "total", &total); }
+        free(filenames);
+        free(edits);
+        return batch_result;
+    }
+
+    if (use_cache && cache_dir == NULL) {
+        if (dicom_cache_default_dir(default_cache_dir, sizeof(default_cache_dir)) != 0) {
+            fprintf(stderr, "Error: No cache directory, set DCMLOUPE_CACHE_DIR or use --cache-dir\n");
+            free(filenames);
+            free(edits);
             return 1;
         }
-        else if (filename == NULL) { filename = argv[i]; }
-        else {
-            fprintf(stderr, "Error: Unexpected argument: %s\n", argv[i]);
+        cache_dir = default_cache_dir;
+    }
+
+    if (filter_path_count > 0) {
+        if (dicom_filter_compile(filter_paths, filter_path_count, &compiled_filter) != 0) {
+            fprintf(stderr, "Error: Out of memory\n");
+            free(filenames);
+            free(edits);
             return 1;
         }
+        filter.paths = &compiled_filter;
     }
 
-    if (filename == NULL) {
-        fprintf(stderr, "Error: No DICOM file specified\n");
-        return 1;
+    dicom_arena arena;
+    dicom_arena_init(&arena);
+
+    const parse_options options = {
+        .max_elements = max_elements,
+        .max_sq_depth = max_sq_depth,
+        .collapse_sequences = collapse_sequences,
+        .show_full_values = show_full_values,
+        .show_all_values = show_all_values,
+        .hash_pixels = hash_pixels,
+        .filter = &filter,
+        .cache_dir = use_cache ? cache_dir : NULL,
+        .threads = batch.threads > 0 ? batch.threads : dicom_cpu_count(),
+        .recover = recover,
+    };
+
+    int result = 0;
+    dicom_stats total = {0};
+    for (int i = 0; i < file_count; i++) {
+        dicom_stats stats;
+        if (show_stats) { dicom_stats_begin(&stats); }
+
+        int file_result;
+        if (in_place) { file_result = set_values_in_place(filenames[i], edits, edit_count); }
+        else if (deidentify) { file_result = deidentify_file(filenames[i], output, deid_profile); }
+        else if (strip_pixels) { file_result = strip_pixel_data(filenames[i], output); }
+        else if (use_dicomdir) { file_result = dump_dicomdir(filenames[i], &arena); }
+        else if (path_text != NULL) { file_result = dump_dicom_path(filenames[i], path_text, &path, &options, &arena); }
+        else if (use_json) { file_result = dump_dicom_json(filenames[i], &options, &arena); }
+        else if (dicom_archive_detect(filenames[i]) != DICOM_ARCHIVE_NONE) {
+            if (recover) {
+                fprintf(stderr, "Error: --recover cannot read archive members: %s\n", filenames[i]);
+                file_result = -1;
+            }
+            else { file_result = dump_dicom_archive(filenames[i], &options, &arena); }
+        }
+        else if (use_cache) { file_result = dump_dicom_cached(filenames[i], &options, &arena); }
+        else if (use_dom) { file_result = dump_dicom_dataset(filenames[i], &options, &arena); }
+        else { file_result = parse_dicom_header(filenames[i], &options, &arena); }
+        if (file_result != 0 && result >= 0) { result = file_result; }  // An error outranks damage
+
+        if (show_stats) {
+            dicom_stats_end();
+            char label[4096];
+            snprintf(label, sizeof(label), "file=%s", filenames[i]);
+            dicom_stats_print(stderr, label, &stats);
+            dicom_stats_add(&total, &stats);
+        }
     }
 
-    return parse_dicom_header(filename, max_elements, collapse_sequences, max_sq_depth, show_full_values, &filter);
+    if (show_stats && file_count > 1) { dicom_stats_print(stderr, "total", &total); }
+
+    dicom_arena_free(&arena);
+    if (filter.paths != NULL) { dicom_filter_free(&compiled_filter); }
+    free(filenames);
+    free(edits);
+    return result;
 }
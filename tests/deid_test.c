@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "dicom_arena.h"
+#include "dicom_dataset.h"
+#include "dicom_rewrite.h"
+
+/*
+ * De-identification regression test: writes a small explicit VR little endian file, runs
+ * deidentify_file() over it with a profile file, and checks the output tree element by element.
+ * Usage: dcmloupe_deid_test <scratch directory>
+ */
+
+#define SOURCE_UID "1.2.826.0.1.3680043.2.1125.1"
+#define OTHER_UID "1.2.826.0.1.3680043.2.1125.2"
+
+typedef struct {
+    uint8_t data[4096];
+    size_t size;
+} buffer;
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+static void put_u16(buffer* b, const uint16_t value) {
+    b->data[b->size++] = (uint8_t)value;
+    b->data[b->size++] = (uint8_t)(value >> 8);
+}
+
+static void put_u32(buffer* b, const uint32_t value) {
+    put_u16(b, (uint16_t)value);
+    put_u16(b, (uint16_t)(value >> 16));
+}
+
+static void put_header(buffer* b, const uint32_t tag, const char* vr, const uint32_t length) {
+    put_u16(b, (uint16_t)(tag >> 16));
+    put_u16(b, (uint16_t)tag);
+    b->data[b->size++] = (uint8_t)vr[0];
+    b->data[b->size++] = (uint8_t)vr[1];
+    if (strcmp(vr, "SQ") == 0 || strcmp(vr, "OB") == 0) {
+        put_u16(b, 0);
+        put_u32(b, length);
+    }
+    else { put_u16(b, (uint16_t)length); }
+}
+
+// Text value padded to even length, with '\0' for UI as the standard asks
+static void put_text(buffer* b, const uint32_t tag, const char* vr, const char* value) {
+    const size_t length = strlen(value);
+    const size_t padded = length + length % 2;
+    put_header(b, tag, vr, (uint32_t)padded);
+    memcpy(b->data + b->size, value, length);
+    b->size += length;
+    if (padded != length) { b->data[b->size++] = strcmp(vr, "UI") == 0 ? '\0' : ' '; }
+}
+
+static size_t write_source(const char* path) {
+    buffer meta = {{0}, 0};
+    put_header(&meta, 0x00020001, "OB", 2);
+    put_u16(&meta, 0x0100);
+    put_text(&meta, 0x00020002, "UI", "1.2.840.10008.5.1.4.1.1.7");
+    put_text(&meta, 0x00020003, "UI", SOURCE_UID);
+    put_text(&meta, 0x00020010, "UI", "1.2.840.10008.1.2.1");
+
+    buffer item = {{0}, 0};
+    put_text(&item, 0x00081150, "UI", "1.2.840.10008.5.1.4.1.1.7");
+    put_text(&item, 0x00081155, "UI", SOURCE_UID "\\" OTHER_UID);
+
+    static buffer file;
+    memset(file.data, 0, 128);
+    file.size = 128;
+    memcpy(file.data + file.size, "DICM", 4);
+    file.size += 4;
+    put_header(&file, 0x00020000, "UL", 4);
+    put_u32(&file, (uint32_t)meta.size);
+    memcpy(file.data + file.size, meta.data, meta.size);
+    file.size += meta.size;
+
+    put_text(&file, 0x00080016, "UI", "1.2.840.10008.5.1.4.1.1.7");
+    put_text(&file, 0x00080018, "UI", SOURCE_UID);
+    put_text(&file, 0x00080020, "DA", "20240102");
+    put_text(&file, 0x00080060, "CS", "OT");
+    put_text(&file, 0x00080080, "LO", "General Hospital");
+    put_header(&file, 0x00081115, "SQ", (uint32_t)item.size + 8);
+    put_u16(&file, 0xFFFE);
+    put_u16(&file, 0xE000);
+    put_u32(&file, (uint32_t)item.size);
+    memcpy(file.data + file.size, item.data, item.size);
+    file.size += item.size;
+    put_text(&file, 0x00091010, "LO", "vendor secret");
+    put_text(&file, 0x00100010, "PN", "Smith^Jane");
+    put_text(&file, 0x00100020, "LO", "MRN123456");
+    put_text(&file, 0x00101010, "AS", "042Y");
+    put_text(&file, 0x00200013, "IS", "7");
+
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) { return 0; }
+    const size_t written = fwrite(file.data, 1, file.size, fp);
+    fclose(fp);
+    return written == file.size ? written : 0;
+}
+
+static int write_profile(const char* path, const char* salt) {
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) { return -1; }
+    fprintf(fp, "salt %s\n", salt);
+    fprintf(fp, "(0010,0010) R PATIENT^ONE\n");  // Overrides the basic profile's Z
+    fprintf(fp, "00101010 D\n");
+    fprintf(fp, "00100021 R ISSUER\n");          // Missing from the source, so it is added
+    return fclose(fp);
+}
+
+static bool has_value(const dicom_dataset* ds, const dicom_node* node, const char* expected) {
+    char value[256];
+    if (node == NULL) { return false; }
+    dicom_node_string(ds, node, value, sizeof(value));
+    return strcmp(value, expected) == 0;
+}
+
+static void node_text(const dicom_dataset* ds, const dicom_node* node, char* out, const size_t size) {
+    out[0] = '\0';
+    if (node != NULL) { dicom_node_string(ds, node, out, size); }
+}
+
+static void check_output(const char* path, char* sop_uid, const size_t uid_size) {
+    dicom_arena arena;
+    dicom_arena_init(&arena);
+    dicom_dataset ds;
+    if (dicom_dataset_load(path, &arena, &ds) != 0) {
+        fprintf(stderr, "Cannot read de-identified file '%s'\n", path);
+        failures++;
+        dicom_arena_free(&arena);
+        return;
+    }
+    const dicom_node* root = &ds.root;
+    CHECK(!ds.is_truncated);
+
+    // Kept elements are copied as they are
+    CHECK(has_value(&ds, dicom_dataset_find(root, 0x00080016), "1.2.840.10008.5.1.4.1.1.7"));
+    CHECK(has_value(&ds, dicom_dataset_find(root, 0x00080060), "OT"));
+    CHECK(has_value(&ds, dicom_dataset_find(root, 0x00200013), "7"));
+
+    // X removes, Z keeps the element with an empty value
+    CHECK(dicom_dataset_find(root, 0x00080080) == NULL);
+    CHECK(dicom_dataset_find(root, 0x00091010) == NULL);  // Private groups are removed by default
+    const dicom_node* study_date = dicom_dataset_find(root, 0x00080020);
+    CHECK(study_date != NULL && study_date->length == 0);
+    const dicom_node* patient_id = dicom_dataset_find(root, 0x00100020);
+    CHECK(patient_id != NULL && patient_id->length == 0);
+
+    // D puts a dummy of the right VR in place, R the profile's value, also where it was missing
+    CHECK(has_value(&ds, dicom_dataset_find(root, 0x00101010), "000Y"));
+    CHECK(has_value(&ds, dicom_dataset_find(root, 0x00100010), "PATIENT^ONE"));
+    CHECK(has_value(&ds, dicom_dataset_find(root, 0x00100021), "ISSUER"));
+
+    // U: the same source UID maps to the same new UID wherever it appears
+    char meta_uid[128], reference[256];
+    node_text(&ds, dicom_dataset_find(root, 0x00080018), sop_uid, uid_size);
+    node_text(&ds, dicom_dataset_find(root, 0x00020003), meta_uid, sizeof(meta_uid));
+    CHECK(strncmp(sop_uid, "2.25.", 5) == 0);
+    CHECK(strcmp(sop_uid, SOURCE_UID) != 0);
+    CHECK(strcmp(sop_uid, meta_uid) == 0);
+
+    const dicom_node* sequence = dicom_dataset_find(root, 0x00081115);
+    CHECK(sequence != NULL && sequence->child_count == 1);
+    if (sequence != NULL && sequence->child_count == 1) {
+        const dicom_node* item = &sequence->children[0];
+        CHECK(has_value(&ds, dicom_dataset_find(item, 0x00081150), "1.2.840.10008.5.1.4.1.1.7"));
+        node_text(&ds, dicom_dataset_find(item, 0x00081155), reference, sizeof(reference));
+
+        // Each value of a multi-valued UI is remapped on its own
+        const char* separator = strchr(reference, '\\');
+        CHECK(separator != NULL);
+        if (separator != NULL) {
+            CHECK((size_t)(separator - reference) == strlen(sop_uid));
+            CHECK(strncmp(reference, sop_uid, strlen(sop_uid)) == 0);
+            CHECK(strncmp(separator + 1, "2.25.", 5) == 0 && strcmp(separator + 1, sop_uid) != 0);
+        }
+    }
+
+    // The meta group length follows the longer remapped Media Storage SOP Instance UID
+    const dicom_node* group_length = dicom_dataset_find(root, 0x00020000);
+    uint32_t length = 0;
+    CHECK(group_length != NULL && dicom_node_uint(&ds, group_length, &length));
+    uint64_t meta_end = 0;
+    for (uint32_t i = 0; i < root->child_count && root->children[i].tag >> 16 == 0x0002; i++) {
+        meta_end = root->children[i].end;
+    }
+    CHECK(group_length != NULL && length == meta_end - group_length->end);
+
+    dicom_dataset_close(&ds);
+    dicom_arena_free(&arena);
+}
+
+int main(const int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <scratch directory>\n", argv[0]);
+        return 2;
+    }
+
+    char source[1024], profile[1024], other_profile[1024], first[1024], second[1024], third[1024];
+    snprintf(source, sizeof(source), "%s/deid_source.dcm", argv[1]);
+    snprintf(profile, sizeof(profile), "%s/deid_profile.txt", argv[1]);
+    snprintf(other_profile, sizeof(other_profile), "%s/deid_other_profile.txt", argv[1]);
+    snprintf(first, sizeof(first), "%s/deid_first.dcm", argv[1]);
+    snprintf(second, sizeof(second), "%s/deid_second.dcm", argv[1]);
+    snprintf(third, sizeof(third), "%s/deid_third.dcm", argv[1]);
+
+    if (write_source(source) == 0 || write_profile(profile, "first secret") != 0 ||
+        write_profile(other_profile, "second secret") != 0) {
+        fprintf(stderr, "Cannot write test files in '%s'\n", argv[1]);
+        return 2;
+    }
+
+    char first_uid[128], second_uid[128], third_uid[128];
+    CHECK(deidentify_file(source, first, profile) == 0);
+    check_output(first, first_uid, sizeof(first_uid));
+
+    // Same salt, same UIDs across runs; another salt gives other UIDs
+    CHECK(deidentify_file(source, second, profile) == 0);
+    check_output(second, second_uid, sizeof(second_uid));
+    CHECK(strcmp(first_uid, second_uid) == 0);
+
+    CHECK(deidentify_file(source, third, other_profile) == 0);
+    check_output(third, third_uid, sizeof(third_uid));
+    CHECK(strcmp(first_uid, third_uid) != 0);
+
+    remove(source);
+    remove(profile);
+    remove(other_profile);
+    remove(first);
+    remove(second);
+    remove(third);
+
+    if (failures > 0) {
+        fprintf(stderr, "%d check%s failed\n", failures, failures == 1 ? "" : "s");
+        return 1;
+    }
+    printf("deid: all checks passed\n");
+    return 0;
+}